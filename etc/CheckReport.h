@@ -0,0 +1,40 @@
+/*
+	CheckReport.h
+	Reporting shared by the checks in etc/ (run together by make check). Each check prints a PASS or FAIL line as it is done,
+	and the summary at the end gives the exit status, nonzero if any check failed. Header only, so every check stays a single
+	source file.
+*/
+#ifndef CHECKREPORT_H
+#define CHECKREPORT_H
+
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <cmath>
+
+inline int& CheckFailures() {
+	static int failures = 0;
+	return failures;
+}
+
+inline void Report(const std::string& check, bool passed) {
+	std::cout<<(passed ? "PASS  " : "FAIL  ")<<check<<std::endl;
+	if(!passed) CheckFailures()++;
+}
+
+/*Passes if the value is within the tolerance either way; NaN fails*/
+inline void Report(const std::string& check, double value, double tolerance) {
+	std::ostringstream detail;
+	detail.precision(3);
+	detail<<" ("<<value<<", allowed "<<tolerance<<")";
+	Report(check + detail.str(), std::fabs(value) <= tolerance);
+}
+
+/*Prints the number of failures; the exit status for main*/
+inline int ReportSummary() {
+	int failures = CheckFailures();
+	std::cout<<(failures == 0 ? "All checks passed" : std::to_string(failures) + " checks failed")<<std::endl;
+	return failures == 0 ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,189 @@
+/*
+	decay_check.cpp
+	Check of the decay loci (include/DecaySampler.h) against plain thrown-and-cut Monte Carlo. The sampler only draws the
+	reaction angles and decay directions which can reach the acceptance, and weights them; here every reaction and every decay
+	is thrown isotropically over the whole sphere, boosted to the lab, and kept only if the product lands in the acceptance. The
+	two have to agree on
+
+	- the efficiency (fraction of decays reaching the acceptance), within the statistics of the thrown sample
+	- the momentum distribution of what reaches it: the 5% and 95% points, and the largest gap between the two distributions
+	  (Kolmogorov distance)
+
+	for a sharp and a broad sequential decay of the residual, and a breakup of the ejectile. The sampler's loci also have to be
+	the same whether it runs on the thread pool or serially.
+
+	Usage: decay_check [thrown per case]
+
+	Loads the nuclear data from ./data, as the gui does. Fixed seeds, so every run gives the same numbers.
+*/
+
+#include <string>
+#include <vector>
+#include <random>
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+#include "Reaction.h"
+#include "DecaySampler.h"
+#include "ParallelFor.h"
+#include "CheckReport.h"
+
+static const double PI = 3.14159265358979323846;
+static const double DEG2RAD = PI/180.0;
+static const double WIDTH_CUTOFF = 5.0; //same Breit-Wigner cut off as the sampler
+static const double BEAM_KE = 24.0, THETA = 15.0, ACCEPTANCE = 3.0; //MeV, deg, deg
+static const int N_SAMPLES = 400000; //per locus, for the sampler
+
+struct ThrownLocus {
+	double efficiency;
+	std::vector<double> momenta; //sorted
+};
+
+/*Boosts the four vector (E, p) by the velocity beta (three vector)*/
+static void Boost(const double beta[3], double& E, double p[3]) {
+	double b2 = beta[0]*beta[0] + beta[1]*beta[1] + beta[2]*beta[2];
+	if(b2 == 0.0) return;
+	double gamma = 1.0/std::sqrt(1.0 - b2);
+	double bp = beta[0]*p[0] + beta[1]*p[1] + beta[2]*p[2];
+	double factor = (gamma - 1.0)*bp/b2 + gamma*E;
+	for(int k=0; k<3; k++)
+		p[k] += factor*beta[k];
+	E = gamma*(E + bp);
+}
+
+static void Isotropic(std::mt19937_64& generator, double n[3]) {
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+	double cosTheta = 2.0*uniform(generator) - 1.0;
+	double sinTheta = std::sqrt(1.0 - cosTheta*cosTheta);
+	double phi = 2.0*PI*uniform(generator);
+	n[0] = sinTheta*std::cos(phi);
+	n[1] = sinTheta*std::sin(phi);
+	n[2] = cosTheta;
+}
+
+/*Every reaction and decay thrown over the whole sphere; closed or sub-threshold throws count as misses*/
+static ThrownLocus Throw(const Reaction& rxn, const DecayChannel& decay, int nThrown) {
+	bool ejectile = decay.parent == DecayChannel::EJECTILE;
+	const nucleus& parent = ejectile ? rxn.GetEjectile() : rxn.GetResidual();
+	double mBeam = rxn.GetProjectile().mass_gs, mTarget = rxn.GetTarget().mass_gs;
+	double mOther = ejectile ? rxn.GetResidual().mass_gs : rxn.GetEjectile().mass_gs;
+	double mDetected = MASS.FindMass(decay.Z, decay.A), mRemainder = MASS.FindMass(parent.Z - decay.Z, parent.A - decay.A);
+
+	double eBeam = BEAM_KE + mBeam;
+	double pBeam = std::sqrt(eBeam*eBeam - mBeam*mBeam);
+	double s = mBeam*mBeam + mTarget*mTarget + 2.0*eBeam*mTarget;
+	double sqrtS = std::sqrt(s);
+	double betaCM[3] = {0.0, 0.0, pBeam/(eBeam + mTarget)};
+	double axis[3] = {std::sin(THETA*DEG2RAD), 0.0, std::cos(THETA*DEG2RAD)};
+	double cosAcceptance = std::cos(ACCEPTANCE*DEG2RAD);
+
+	std::mt19937_64 generator(12345);
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+	ThrownLocus result;
+	for(int n=0; n<nThrown; n++) {
+		double ex = decay.ex;
+		if(decay.width > 0.0) {
+			do {
+				ex = decay.ex + 0.5*decay.width*std::tan(PI*(uniform(generator) - 0.5));
+			} while(std::fabs(ex - decay.ex) > WIDTH_CUTOFF*decay.width);
+		}
+		double M = parent.mass_gs + ex;
+		if(sqrtS <= M + mOther || M <= mDetected + mRemainder) continue;
+
+		//Unbound state in the center of mass, then in the lab
+		double pStar = std::sqrt((s - std::pow(M + mOther, 2.0))*(s - std::pow(M - mOther, 2.0)))/(2.0*sqrtS);
+		double direction[3], p[3];
+		Isotropic(generator, direction);
+		for(int k=0; k<3; k++)
+			p[k] = pStar*direction[k];
+		double E = std::sqrt(pStar*pStar + M*M);
+		Boost(betaCM, E, p);
+
+		//Decay product in the rest frame of the unbound state, then in the lab
+		double q = std::sqrt((M*M - std::pow(mDetected + mRemainder, 2.0))*(M*M - std::pow(mDetected - mRemainder, 2.0)))/(2.0*M);
+		double p1[3], betaParent[3];
+		Isotropic(generator, direction);
+		for(int k=0; k<3; k++) {
+			p1[k] = q*direction[k];
+			betaParent[k] = p[k]/E;
+		}
+		double E1 = std::sqrt(q*q + mDetected*mDetected);
+		Boost(betaParent, E1, p1);
+
+		double momentum = std::sqrt(p1[0]*p1[0] + p1[1]*p1[1] + p1[2]*p1[2]);
+		if((p1[0]*axis[0] + p1[1]*axis[1] + p1[2]*axis[2])/momentum >= cosAcceptance)
+			result.momenta.push_back(momentum);
+	}
+	std::sort(result.momenta.begin(), result.momenta.end());
+	result.efficiency = (double)result.momenta.size()/nThrown;
+	return result;
+}
+
+/*Fraction of the locus' weight at or below p*/
+static double SampledCDF(const DecayLocus& locus, double total, double p) {
+	double below = 0.0;
+	for(size_t k=0; k<locus.momenta.size() && locus.momenta[k] <= p; k++)
+		below += locus.weights[k];
+	return below/total;
+}
+
+int main(int argc, char** argv) {
+	int nThrown = argc > 1 ? std::atoi(argv[1]) : 20000000;
+
+	//10B(3He,4He)9B*, 9Be(3He,4He)8Be* with 8Be -> 2 alpha, and 12C(7Li,6Li*)13C with 6Li -> alpha + d
+	std::vector<Reaction> reactions(3);
+	reactions[0].SetReactionData(10, 5, 3, 2, 4, 2);
+	reactions[1].SetReactionData(9, 4, 3, 2, 4, 2);
+	reactions[2].SetReactionData(12, 6, 7, 3, 6, 3);
+	reactions[0].AddDecay({DecayChannel::RESIDUAL, 2.345, 0.081, 1, 1});
+	reactions[1].AddDecay({DecayChannel::RESIDUAL, 3.03, 0.0, 4, 2});
+	reactions[2].AddDecay({DecayChannel::EJECTILE, 2.186, 0.024, 4, 2});
+	const char* names[] = {"9B* -> p + 8Be, broad", "8Be* -> 2 alpha, sharp", "6Li* -> alpha + d, breakup"};
+
+	DecaySampler sampler;
+	sampler.SetNSamples(N_SAMPLES);
+	sampler.SetAcceptance(ACCEPTANCE);
+	std::vector<DecayLocus> loci = sampler.Sample(reactions, BEAM_KE, THETA);
+	std::vector<DecayLocus> serial;
+	ParallelFor(1, [&](int) { serial = sampler.Sample(reactions, BEAM_KE, THETA); }); //nested, so done on this thread alone
+	bool same = loci.size() == serial.size();
+	for(unsigned int i=0; same && i<loci.size(); i++)
+		same = loci[i].momenta == serial[i].momenta && loci[i].weights == serial[i].weights && loci[i].efficiency == serial[i].efficiency;
+	Report("loci the same on the thread pool and serially", same);
+	if(loci.size() != reactions.size()) {
+		std::cerr<<"Expected a locus per reaction!"<<std::endl;
+		return 1;
+	}
+
+	for(unsigned int i=0; i<loci.size(); i++) {
+		const DecayLocus& locus = loci[i];
+		ThrownLocus thrown = Throw(reactions[i], locus.channel, nThrown);
+		std::cout<<names[i]<<": "<<thrown.momenta.size()<<" of "<<nThrown<<" thrown in the acceptance"<<std::endl;
+		if(thrown.momenta.size() < 1000 || locus.momenta.empty()) {
+			Report("  enough in the acceptance to compare", false);
+			continue;
+		}
+
+		//Allow 4 sigma of the thrown sample's counting statistics, and 2% for the sampler's own
+		double sigma = std::sqrt((double)thrown.momenta.size())/nThrown;
+		Report("  efficiency, sampled - thrown (in sigma of the thrown)", (locus.efficiency - thrown.efficiency)/std::sqrt(sigma*sigma + std::pow(0.02*thrown.efficiency, 2.0)), 4.0);
+
+		//Distributions: the 99.9% Kolmogorov limit of the thrown sample, plus 1% for the sampler
+		size_t n = thrown.momenta.size();
+		double tolerance = 1.95/std::sqrt((double)n) + 0.01;
+		double spread = thrown.momenta[(size_t)(0.95*n)] - thrown.momenta[(size_t)(0.05*n)];
+		Report("  5% momentum, sampled - thrown (fraction of the 5-95% spread)", (locus.pLow - thrown.momenta[(size_t)(0.05*n)])/spread, tolerance);
+		Report("  95% momentum, sampled - thrown (fraction of the 5-95% spread)", (locus.pHigh - thrown.momenta[(size_t)(0.95*n)])/spread, tolerance);
+
+		double total = 0.0;
+		for(double weight : locus.weights)
+			total += weight;
+		double distance = 0.0;
+		for(size_t k=0; k<n; k+=std::max<size_t>(1, n/2000))
+			distance = std::max(distance, std::fabs(SampledCDF(locus, total, thrown.momenta[k]) - (double)(k+1)/n));
+		Report("  largest gap between the momentum distributions", distance, tolerance);
+	}
+
+	return ReportSummary();
+}
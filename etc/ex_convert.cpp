@@ -0,0 +1,320 @@
+/*
+	ex_convert.cpp
+	Event by event conversion of a focal plane TTree branch (rho, or position with a calibration) to excitation energy for one
+	reaction at one setting, for whole runs after the fact. The output is either a friend tree (a .root output file, with a
+	tree <tree>_ex holding one branch Ex, entry for entry with the input) or a flat binary column of native doubles (anything
+	else). Events outside of the table range, or NaN, come out as NaN.
+
+	Usage: spsplot_convert [options] <input.root> <tree> <branch> <output> <At> <Zt> <Ap> <Zp> <Ae> <Ze> <BeamKE> <Theta> <Bfield>
+	Options:
+		-c offset slope   the branch is a focal plane position; rho = offset + slope*x (same as the CALIBRATION keyword)
+		-e exMin exMax    excitations (MeV) covered by the table; default -1 to 20
+		-t tolerance      largest table interpolation error (MeV); default 1e-4
+		-n events         events per chunk; default 1048576
+		-q chunks         chunks in flight; default 4
+
+	The conversion goes through an ExLookupTable, so an event costs an interpolation. Events move through three stages, each
+	on its own thread: reading (ROOT I/O), converting (spread over the thread pool), and writing. The stages pass fixed size
+	chunks through queues, and the number of chunks is fixed, so memory stays bounded however large the tree is, and a slow
+	stage holds back the others instead of piling up data. The busy time of each stage is reported at the end; the
+	conversion should be well under the reading and writing.
+*/
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cmath>
+#include <TROOT.h>
+#include <TFile.h>
+#include <TTree.h>
+#include <TBranch.h>
+#include <TLeaf.h>
+#include "Reaction.h"
+#include "ExLookupTable.h"
+#include "ParallelFor.h"
+
+static const int BLOCK_SIZE = 16384; //events per conversion work item
+
+struct Chunk {
+	int n;
+	std::vector<double> values; //branch values in, excitations out
+};
+
+/*Blocking queue between two stages; Pop returns false once the queue is closed and empty*/
+class ChunkQueue {
+public:
+	void Push(Chunk* chunk) {
+		std::lock_guard<std::mutex> guard(m_mutex);
+		m_chunks.push_back(chunk);
+		m_ready.notify_one();
+	}
+
+	bool Pop(Chunk*& chunk) {
+		std::unique_lock<std::mutex> guard(m_mutex);
+		m_ready.wait(guard, [this]() { return !m_chunks.empty() || m_closed; });
+		if(m_chunks.empty()) return false;
+		chunk = m_chunks.front();
+		m_chunks.pop_front();
+		return true;
+	}
+
+	void Close() {
+		std::lock_guard<std::mutex> guard(m_mutex);
+		m_closed = true;
+		m_ready.notify_all();
+	}
+
+private:
+	std::deque<Chunk*> m_chunks;
+	std::mutex m_mutex;
+	std::condition_variable m_ready;
+	bool m_closed = false;
+};
+
+struct Options {
+	std::string input, treeName, branchName, output;
+	int At, Zt, Ap, Zp, Ae, Ze;
+	double beamKE, theta, B;
+	double calOffset = 0.0, calSlope = 1.0;
+	double exMin = -1.0, exMax = 20.0;
+	double tolerance = 1.0e-4;
+	int chunkSize = 1048576;
+	int nChunks = 4;
+};
+
+static std::atomic<bool> g_failed(false); //any stage failing stops the others
+
+static double Seconds(std::chrono::steady_clock::duration duration) {
+	return std::chrono::duration<double>(duration).count();
+}
+
+static bool ParseArguments(int argc, char** argv, Options& options) {
+	std::vector<std::string> positional;
+	for(int i=1; i<argc; i++) {
+		std::string arg = argv[i];
+		if(arg == "-c" && i+2 < argc) {
+			options.calOffset = std::atof(argv[++i]);
+			options.calSlope = std::atof(argv[++i]);
+		} else if(arg == "-e" && i+2 < argc) {
+			options.exMin = std::atof(argv[++i]);
+			options.exMax = std::atof(argv[++i]);
+		} else if(arg == "-t" && i+1 < argc) {
+			options.tolerance = std::atof(argv[++i]);
+		} else if(arg == "-n" && i+1 < argc) {
+			options.chunkSize = std::atoi(argv[++i]);
+		} else if(arg == "-q" && i+1 < argc) {
+			options.nChunks = std::atoi(argv[++i]);
+		} else if(arg.size() > 1 && arg[0] == '-' && !std::isdigit(arg[1]) && arg[1] != '.') {
+			std::cerr<<"Unrecognized option "<<arg<<std::endl;
+			return false;
+		} else {
+			positional.push_back(arg);
+		}
+	}
+	if(positional.size() != 13 || options.chunkSize < 1 || options.nChunks < 2 || options.calSlope == 0.0) return false;
+	options.input = positional[0];
+	options.treeName = positional[1];
+	options.branchName = positional[2];
+	options.output = positional[3];
+	options.At = std::atoi(positional[4].c_str());
+	options.Zt = std::atoi(positional[5].c_str());
+	options.Ap = std::atoi(positional[6].c_str());
+	options.Zp = std::atoi(positional[7].c_str());
+	options.Ae = std::atoi(positional[8].c_str());
+	options.Ze = std::atoi(positional[9].c_str());
+	options.beamKE = std::atof(positional[10].c_str());
+	options.theta = std::atof(positional[11].c_str());
+	options.B = std::atof(positional[12].c_str());
+	return true;
+}
+
+/*
+	Reading stage. Only the one branch is read (with its own basket cache); double and float branches are copied straight
+	from the branch buffer, anything else goes through TLeaf::GetValue
+*/
+static void ReadEvents(const Options& options, Long64_t nEntries, TTree* tree, TLeaf* leaf, ChunkQueue& empty, ChunkQueue& filled,
+					   std::chrono::steady_clock::duration& busy) {
+	std::string type = leaf->GetTypeName();
+	double dValue = 0.0;
+	float fValue = 0.0f;
+	if(type == "Double_t") tree->SetBranchAddress(options.branchName.c_str(), &dValue);
+	else if(type == "Float_t") tree->SetBranchAddress(options.branchName.c_str(), &fValue);
+	TBranch* branch = leaf->GetBranch();
+
+	Chunk* chunk;
+	for(Long64_t entry=0; entry<nEntries && !g_failed;) {
+		if(!empty.Pop(chunk)) break;
+		auto start = std::chrono::steady_clock::now();
+		chunk->n = std::min<Long64_t>(options.chunkSize, nEntries - entry);
+		for(int k=0; k<chunk->n; k++, entry++) {
+			if(branch->GetEntry(entry) < 0) {
+				std::cerr<<"Unable to read entry "<<entry<<" of "<<options.branchName<<"!"<<std::endl;
+				g_failed = true;
+				break;
+			}
+			if(type == "Double_t") chunk->values[k] = dValue;
+			else if(type == "Float_t") chunk->values[k] = fValue;
+			else chunk->values[k] = leaf->GetValue(0);
+		}
+		busy += std::chrono::steady_clock::now() - start;
+		filled.Push(chunk);
+	}
+	filled.Close();
+}
+
+/*Writing stage; returns chunks to the reader once they are out*/
+static void WriteEvents(const Options& options, ChunkQueue& converted, ChunkQueue& empty, std::chrono::steady_clock::duration& busy) {
+	bool toTree = options.output.size() > 5 && options.output.compare(options.output.size()-5, 5, ".root") == 0;
+	TFile* file = nullptr;
+	TTree* tree = nullptr;
+	FILE* column = nullptr;
+	double ex;
+	if(toTree) {
+		file = TFile::Open(options.output.c_str(), "RECREATE");
+		if(file == nullptr || file->IsZombie()) {
+			std::cerr<<"Unable to create "<<options.output<<"!"<<std::endl;
+			g_failed = true;
+		} else {
+			std::string name = options.treeName + "_ex";
+			tree = new TTree(name.c_str(), ("Ex (MeV) of "+options.treeName+"."+options.branchName).c_str()); //owned by the file
+			tree->Branch("Ex", &ex, "Ex/D");
+		}
+	} else {
+		column = std::fopen(options.output.c_str(), "wb");
+		if(column == nullptr) {
+			std::cerr<<"Unable to create "<<options.output<<"!"<<std::endl;
+			g_failed = true;
+		}
+	}
+
+	Chunk* chunk;
+	while(converted.Pop(chunk)) {
+		auto start = std::chrono::steady_clock::now();
+		if(!g_failed) {
+			if(tree != nullptr) {
+				for(int k=0; k<chunk->n; k++) {
+					ex = chunk->values[k];
+					tree->Fill();
+				}
+			} else if(std::fwrite(chunk->values.data(), sizeof(double), chunk->n, column) != (size_t)chunk->n) {
+				std::cerr<<"Unable to write to "<<options.output<<"!"<<std::endl;
+				g_failed = true;
+			}
+		}
+		busy += std::chrono::steady_clock::now() - start;
+		empty.Push(chunk);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	if(file != nullptr) {
+		if(tree != nullptr) tree->Write("", TObject::kOverwrite);
+		file->Close();
+		delete file;
+	}
+	if(column != nullptr && std::fclose(column) != 0) {
+		std::cerr<<"Unable to write to "<<options.output<<"!"<<std::endl;
+		g_failed = true;
+	}
+	busy += std::chrono::steady_clock::now() - start;
+	empty.Close();
+}
+
+int main(int argc, char** argv) {
+	Options options;
+	if(!ParseArguments(argc, argv, options)) {
+		std::cerr<<"Usage: spsplot_convert [-c offset slope] [-e exMin exMax] [-t tolerance] [-n events] [-q chunks] "
+				 <<"<input.root> <tree> <branch> <output> <At> <Zt> <Ap> <Zp> <Ae> <Ze> <BeamKE> <Theta> <Bfield>"<<std::endl;
+		return 1;
+	}
+
+	Reaction rxn;
+	rxn.SetReactionData(options.At, options.Zt, options.Ap, options.Zp, options.Ae, options.Ze);
+	ExLookupTable table;
+	if(!rxn.IsInitialized() ||
+	   !table.Build(rxn, options.beamKE, options.theta, options.B, options.exMin, options.exMax, options.tolerance))
+		return 1;
+	std::cout<<rxn.GetName()<<" at "<<options.beamKE<<" MeV, "<<options.theta<<" deg, "<<options.B<<" kG: "<<table.GetNPoints()
+			 <<" point table, rho "<<table.GetRhoMin()<<" to "<<table.GetRhoMax()<<" cm, largest error "<<table.GetMaxError()*1.0e3
+			 <<" keV"<<std::endl;
+
+	ROOT::EnableThreadSafety(); //reading and writing are on different threads
+	TFile* input = TFile::Open(options.input.c_str(), "READ");
+	if(input == nullptr || input->IsZombie()) {
+		std::cerr<<"Unable to open "<<options.input<<"!"<<std::endl;
+		return 1;
+	}
+	TTree* tree = nullptr;
+	input->GetObject(options.treeName.c_str(), tree);
+	TLeaf* leaf = tree == nullptr ? nullptr : tree->GetLeaf(options.branchName.c_str());
+	if(leaf == nullptr || leaf->GetLeafCount() != nullptr || leaf->GetLenStatic() != 1) {
+		std::cerr<<"No scalar branch "<<options.branchName<<" in tree "<<options.treeName<<" of "<<options.input<<"!"<<std::endl;
+		input->Close();
+		return 1;
+	}
+	tree->SetBranchStatus("*", false);
+	tree->SetBranchStatus(options.branchName.c_str(), true);
+	tree->SetCacheSize(64*1024*1024);
+	tree->AddBranchToCache(options.branchName.c_str(), true);
+	Long64_t nEntries = tree->GetEntries();
+
+	std::vector<Chunk> chunks(options.nChunks);
+	ChunkQueue empty, filled, converted;
+	for(auto& chunk : chunks) {
+		chunk.values.resize(options.chunkSize);
+		empty.Push(&chunk);
+	}
+
+	auto wallStart = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::duration readBusy(0), convertBusy(0), writeBusy(0);
+	std::thread reader(ReadEvents, std::cref(options), nEntries, tree, leaf, std::ref(empty), std::ref(filled), std::ref(readBusy));
+	std::thread writer(WriteEvents, std::cref(options), std::ref(converted), std::ref(empty), std::ref(writeBusy));
+
+	//Conversion stage, on this thread; blocks of a chunk are independent, and each writes only its own events
+	Long64_t nConverted = 0, nOutside = 0;
+	Chunk* chunk;
+	while(filled.Pop(chunk)) {
+		auto start = std::chrono::steady_clock::now();
+		int nBlocks = (chunk->n + BLOCK_SIZE - 1)/BLOCK_SIZE;
+		std::vector<int> outside(nBlocks, 0);
+		ParallelFor(nBlocks, [&](int block) {
+			double* values = chunk->values.data();
+			int end = std::min(chunk->n, (block+1)*BLOCK_SIZE);
+			for(int k=block*BLOCK_SIZE; k<end; k++) {
+				values[k] = table.Convert(options.calOffset + options.calSlope*values[k]);
+				if(std::isnan(values[k])) outside[block]++;
+			}
+		});
+		nConverted += chunk->n;
+		for(auto count : outside)
+			nOutside += count;
+		convertBusy += std::chrono::steady_clock::now() - start;
+		converted.Push(chunk);
+	}
+	converted.Close();
+	reader.join();
+	writer.join();
+	double wall = Seconds(std::chrono::steady_clock::now() - wallStart);
+	input->Close();
+	delete input;
+
+	if(g_failed) {
+		std::cerr<<"Conversion failed after "<<nConverted<<" of "<<nEntries<<" events."<<std::endl;
+		return 1;
+	}
+	std::cout<<"Converted "<<nConverted<<" events ("<<nOutside<<" outside of the table) in "<<wall<<" s, "<<nConverted/wall/1.0e6
+			 <<" M events/s"<<std::endl;
+	std::cout<<"Busy time: read "<<Seconds(readBusy)<<" s, convert "<<Seconds(convertBusy)<<" s, write "<<Seconds(writeBusy)<<" s"
+			 <<std::endl;
+	return 0;
+}
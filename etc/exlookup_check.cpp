@@ -0,0 +1,93 @@
+/*
+	exlookup_check.cpp
+	Accuracy check of the rho -> Ex conversion table (include/ExLookupTable.h) used by spsplot_convert. The table only checks
+	itself at the middle of every interval; here it is compared with the exact inverse (Reaction::CalculateExcitation) at
+	random rhos over the whole table, for a few reactions and settings, at the default tolerance and a tighter one:
+
+	- every converted Ex is within the tolerance of the exact one
+	- the batch conversion gives the same values as converting one at a time
+	- rhos outside of the table, and NaN, convert to NaN
+	- a setting the ejectile can't reach (past the largest angle of inverse kinematics) is refused
+
+	Usage: exlookup_check [events per table]
+
+	Loads the nuclear data from ./data, as the gui does. Fixed seed, so every run gives the same numbers.
+*/
+
+#include <string>
+#include <vector>
+#include <random>
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include "Reaction.h"
+#include "ExLookupTable.h"
+#include "CheckReport.h"
+
+static const double DEG2RAD = 3.14159265358979323846/180.0;
+
+struct TableCase {
+	int At, Zt, Ap, Zp, Ae, Ze;
+	double beamKE, theta, B; //MeV, deg, kG
+	double exMin, exMax; //MeV
+};
+
+int main(int argc, char** argv) {
+	int nEvents = argc > 1 ? std::atoi(argv[1]) : 1000000;
+
+	const TableCase cases[] = {
+		{12, 6, 3, 2, 4, 2, 24.0, 20.0, 9.511, 0.0, 15.0}, //12C(3He,4He)11C
+		{208, 82, 2, 1, 1, 1, 16.0, 25.0, 8.0, 0.0, 8.0}, //208Pb(d,p)209Pb
+		{27, 13, 2, 1, 3, 2, 20.0, 5.0, 10.0, 0.0, 10.0} //27Al(d,3He)26Mg
+	};
+	const double tolerances[] = {1.0e-4, 1.0e-6};
+
+	std::mt19937_64 generator(2026);
+	for(auto& setting : cases) {
+		Reaction rxn;
+		rxn.SetReactionData(setting.At, setting.Zt, setting.Ap, setting.Zp, setting.Ae, setting.Ze);
+		if(!rxn.IsInitialized()) {
+			Report(rxn.GetName() + ": reaction made", false);
+			continue;
+		}
+		for(double tolerance : tolerances) {
+			ExLookupTable table;
+			std::string name = rxn.GetName() + " at " + std::to_string((int)setting.theta) + " deg, tolerance " + std::to_string(tolerance*1.0e3) + " keV";
+			if(!table.Build(rxn, setting.beamKE, setting.theta, setting.B, setting.exMin, setting.exMax, tolerance)) {
+				Report(name + ": table built", false);
+				continue;
+			}
+			std::cout<<name<<": "<<table.GetNPoints()<<" points"<<std::endl;
+
+			std::uniform_real_distribution<double> uniform(table.GetRhoMin(), table.GetRhoMax());
+			std::vector<double> rhos(nEvents), batch(nEvents);
+			for(auto& rho : rhos)
+				rho = uniform(generator);
+			table.Convert(rhos.data(), batch.data(), nEvents);
+
+			double worst = 0.0;
+			bool sameBatch = true;
+			for(int i=0; i<nEvents; i++) {
+				double ex = table.Convert(rhos[i]);
+				double exact = rxn.CalculateExcitation(rhos[i], setting.beamKE, setting.theta*DEG2RAD, setting.B);
+				worst = std::fmax(worst, std::fabs(ex - exact));
+				sameBatch = sameBatch && batch[i] == ex;
+			}
+			Report("  converted - exact Ex (MeV)", worst, tolerance);
+			Report("  batch and single conversions the same", sameBatch);
+
+			double span = table.GetRhoMax() - table.GetRhoMin();
+			bool outside = std::isnan(table.Convert(table.GetRhoMin() - 1.0e-3*span)) && std::isnan(table.Convert(table.GetRhoMax() + 1.0e-3*span))
+						   && std::isnan(table.Convert(std::nan(""))) && !std::isnan(table.Convert(table.GetRhoMax()));
+			Report("  outside of the table, or NaN, gives NaN", outside);
+		}
+	}
+
+	Reaction inverse;
+	inverse.SetReactionData(2, 1, 12, 6, 13, 6);
+	ExLookupTable table;
+	std::cout<<inverse.GetName()<<" at 20 deg, past its largest angle:"<<std::endl;
+	Report("  unreachable setting refused", !table.Build(inverse, 120.0, 20.0, 10.0, 0.0, 5.0, 1.0e-4));
+
+	return ReportSummary();
+}
@@ -0,0 +1,291 @@
+/*
+	line_bench.cpp
+	Scaling benchmark of the line store (include/LineStore.h): the reaction table of an input file is repeated to reach
+	larger and larger reaction lists, and for each size the time to read the levels, calculate the primary setting, follow a
+	small field drift, scan the rho window, and copy the visible lines out the way every plotted graph does is reported, along
+	with the cost per line. Each size is timed twice: with the store, and with the layout it replaced, where every reaction
+	kept its own level, label and rho vectors (the "vectors" rows), so the two can be compared on the same machine.
+
+	Usage: line_bench <input file> [max reactions] [reps]
+
+	At every size the store is also checked against reading the levels and calculating every line of every reaction directly,
+	one at a time: the same levels and labels, the same rhos inside the slices, and no line left out of its slice which lands in
+	the window (the last column). The vectors rows are checked against the store: the same lines in the window, with the same rhos.
+
+	Only the setting (beam KE, field, angle, rho range) and the reaction table of the input file are used. Loads the nuclear
+	data from ./data, as the gui does. Built on the kinematics core only (no ROOT).
+*/
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+#include "Reaction.h"
+#include "LineStore.h"
+#include "ParallelFor.h"
+#include "CheckReport.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static const double DEG2RAD = 3.14159265358979323846/180.0;
+static const double FIELD_MARGIN = 0.002;
+
+struct BenchSetup {
+	double beamKE, B, theta, rhoMin, rhoMax;
+	std::vector<Reaction> table;
+};
+
+static bool ReadSetup(const std::string& filename, BenchSetup& setup) {
+	std::ifstream input(filename);
+	if(!input.is_open()) {
+		std::cerr<<"Unable to open input file "<<filename<<"!"<<std::endl;
+		return false;
+	}
+	std::string junk;
+	input>>junk>>setup.beamKE>>junk>>setup.B>>junk>>setup.theta>>junk>>setup.rhoMin>>junk>>setup.rhoMax;
+	for(int i=0; i<6; i++) //column names
+		input>>junk;
+
+	std::string line;
+	std::getline(input, line);
+	while(std::getline(input, line)) {
+		std::istringstream row(line);
+		int At, Zt, Ap, Zp, Ae, Ze;
+		if(!(row>>At>>Zt>>Ap>>Zp>>Ae>>Ze)) break; //end of the reaction table
+		Reaction rxn;
+		rxn.SetReactionData(At, Zt, Ap, Zp, Ae, Ze);
+		if(rxn.IsInitialized()) setup.table.push_back(rxn);
+	}
+	if(setup.table.empty()) {
+		std::cerr<<"No reactions in "<<filename<<"!"<<std::endl;
+		return false;
+	}
+	return true;
+}
+
+/*
+	The layout the store replaced: every reaction kept its own (sorted) levels and labels, and the rhos of the slice of them which
+	can land in the window, starting at firstLevel
+*/
+struct ReactionLines {
+	std::vector<double> ex, exSigma, rho, rhoSigma;
+	std::vector<std::string> labels;
+	int firstLevel;
+	double sliceB;
+};
+
+/*What a graph copies out of the lines of one reaction: the visible rhos, sigmas and labels, and the reaction index as y*/
+struct GraphCopy {
+	std::vector<double> rho, sigma, y;
+	std::vector<std::string> labels;
+
+	void Add(double rhoValue, double sigmaValue, double yValue, const std::string& label) {
+		rho.push_back(rhoValue);
+		sigma.push_back(sigmaValue);
+		y.push_back(yValue);
+		labels.push_back(label);
+	}
+};
+
+static void BuildVectors(const std::vector<Reaction>& reactions, std::vector<ReactionLines>& lines) {
+	lines.assign(reactions.size(), ReactionLines());
+	ParallelFor(reactions.size(), [&](int r) {
+		LineStore::ReadLevels(reactions[r].GetResidual().sym, lines[r].ex, lines[r].exSigma, lines[r].labels);
+	});
+}
+
+/*Same slice and the same rho and sigma calculation as LineStore::CalculateReaction, into each reaction's own vectors*/
+static void CalculateVectors(const std::vector<Reaction>& reactions, const BenchSetup& setup, std::vector<ReactionLines>& lines) {
+	const double theta = setup.theta*DEG2RAD;
+	ParallelFor(reactions.size(), [&](int r) {
+		const Reaction& rxn = reactions[r];
+		ReactionLines& own = lines[r];
+		const double pad = 1.0e-9; //MeV
+		double exLow = rxn.CalculateExcitation(setup.rhoMax*(1.0+FIELD_MARGIN), setup.beamKE, theta, setup.B) - pad;
+		double exHigh = rxn.CalculateExcitation(setup.rhoMin/(1.0+FIELD_MARGIN), setup.beamKE, theta, setup.B) + pad;
+		own.firstLevel = std::lower_bound(own.ex.begin(), own.ex.end(), exLow) - own.ex.begin();
+		int last = std::max(own.firstLevel, (int)(std::upper_bound(own.ex.begin(), own.ex.end(), exHigh) - own.ex.begin()));
+		own.sliceB = setup.B;
+		own.rho.clear();
+		own.rhoSigma.clear();
+		own.rho.reserve(last - own.firstLevel);
+		own.rhoSigma.reserve(last - own.firstLevel);
+		double massSigma[4] = {rxn.GetTarget().mass_unc, rxn.GetProjectile().mass_unc, rxn.GetEjectile().mass_unc, rxn.GetResidual().mass_unc};
+		RhoDerivatives d;
+		for(int i=own.firstLevel; i<last; i++) {
+			own.rho.push_back(rxn.CalculateRhoWithDerivatives(own.ex[i], setup.beamKE, theta, setup.B, d));
+			double variance = std::pow(d.dEx*own.exSigma[i], 2.0);
+			for(int k=0; k<4; k++)
+				variance += std::pow(d.dMass[k]*massSigma[k], 2.0);
+			own.rhoSigma.push_back(std::sqrt(variance));
+		}
+	});
+}
+
+template<typename Function>
+static double TimeIt(int reps, Function work) {
+	double best = 1e300;
+	for(int i=0; i<reps; i++) {
+		auto start = Clock::now();
+		work();
+		best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+	}
+	return best;
+}
+
+/*
+	Mismatches between the store, at field B, and the direct calculation of every line; relative rho differences within 1e-9
+	count as the same (the direct path goes through the momentum, the store through the derivatives, and rescales)
+*/
+static int Check(const LineStore& lines, const std::vector<Reaction>& reactions, const BenchSetup& setup, double B, double& worst) {
+	const double theta_rad = setup.theta*DEG2RAD;
+	const double* storeEx = lines.GetEx();
+	const double* storeRho = lines.GetRho();
+	const int* storeRxn = lines.GetReaction();
+	int mismatches = 0;
+	std::vector<double> ex, sigma;
+	std::vector<std::string> labels;
+	for(int r=0; r<lines.GetNReactions(); r++) {
+		const Reaction& rxn = reactions[r];
+		LineStore::ReadLevels(rxn.GetResidual().sym, ex, sigma, labels);
+		int begin = lines.GetBegin(r);
+		if(lines.GetEnd(r) - begin != (int)ex.size()) {
+			mismatches++;
+			continue;
+		}
+		for(unsigned int j=0; j<ex.size(); j++) {
+			int i = begin + j;
+			if(storeEx[i] != ex[j] || lines.GetLabel(i) != labels[j] || storeRxn[i] != r) {
+				mismatches++;
+				continue;
+			}
+			double rho = rxn.MomentumToRho(rxn.CalculateEjectileP(ex[j], setup.beamKE, theta_rad), B);
+			if(i >= lines.GetSliceBegin(r) && i < lines.GetSliceEnd(r)) {
+				double difference = std::fabs(storeRho[i]/rho - 1.0);
+				if(std::isnan(rho) != std::isnan(storeRho[i]) || difference > 1.0e-9) mismatches++;
+				else if(!std::isnan(rho)) worst = std::max(worst, difference);
+			} else if(!std::isnan(storeRho[i]) || (rho >= setup.rhoMin && rho <= setup.rhoMax)) {
+				mismatches++; //left out of the slice, but in the window
+			}
+		}
+	}
+	return mismatches;
+}
+
+int main(int argc, char** argv) {
+	if(argc < 2) {
+		std::cerr<<"Usage: line_bench <input file> [max reactions] [reps]"<<std::endl;
+		return 1;
+	}
+	BenchSetup setup;
+	if(!ReadSetup(argv[1], setup)) return 1;
+	int maxReactions = argc > 2 ? std::atoi(argv[2]) : 10000;
+	int reps = argc > 3 ? std::max(std::atoi(argv[3]), 1) : 5;
+
+	std::cout<<"reactions      lines    visible   layout    levels(ms)  calculate(ms)  rescale(ms)  window(ms)  graphs(ms)  calculate(ns/line)  check"<<std::endl;
+	int failures = 0;
+	double worst = 0.0;
+	for(int n=setup.table.size(); ; n = std::min(2*n, maxReactions)) {
+		std::vector<Reaction> reactions;
+		for(int i=0; i<n; i++)
+			reactions.push_back(setup.table[i%setup.table.size()]);
+
+		LineStore lines;
+		lines.SetWindow(setup.rhoMin, setup.rhoMax, FIELD_MARGIN);
+		double levels = TimeIt(reps, [&]() { lines.Build(reactions); });
+		double calculate = TimeIt(reps, [&]() { lines.Calculate(reactions, setup.beamKE, setup.theta, setup.B); });
+		double B = setup.B;
+		double rescale = TimeIt(reps, [&]() { B *= 1.0001; lines.Rescale(reactions, B); });
+
+		int nVisible = 0;
+		double window = TimeIt(reps, [&]() {
+			const double* rho = lines.GetRho();
+			nVisible = 0;
+			for(int r=0; r<lines.GetNReactions(); r++) {
+				for(int i=lines.GetSliceBegin(r); i<lines.GetSliceEnd(r); i++)
+					nVisible += rho[i] >= setup.rhoMin && rho[i] <= setup.rhoMax;
+			}
+		});
+
+		std::vector<GraphCopy> storeGraphs;
+		double graphs = TimeIt(reps, [&]() {
+			const double* rho = lines.GetRho();
+			const double* sigma = lines.GetRhoSigma();
+			storeGraphs.assign(n, GraphCopy());
+			for(int r=0; r<n; r++) {
+				for(int i=lines.GetSliceBegin(r); i<lines.GetSliceEnd(r); i++)
+					if(rho[i] >= setup.rhoMin && rho[i] <= setup.rhoMax) storeGraphs[r].Add(rho[i], sigma[i], r, lines.GetLabel(i));
+			}
+		});
+
+		std::cout<<std::setw(9)<<n<<std::setw(11)<<lines.GetNLines()<<std::setw(11)<<nVisible<<"   store  "<<std::fixed<<std::setprecision(3)
+				 <<std::setw(12)<<levels<<std::setw(15)<<calculate<<std::setw(13)<<rescale<<std::setw(12)<<window<<std::setw(12)<<graphs
+				 <<std::setw(20)<<std::setprecision(1)<<1e6*calculate/std::max(lines.GetNLines(), 1);
+		int mismatches = Check(lines, reactions, setup, B, worst);
+		std::cout<<"  "<<(mismatches == 0 ? "ok" : std::to_string(mismatches) + " mismatched lines")<<std::endl;
+		failures += mismatches > 0;
+
+		//The same again with every reaction's own vectors, at the same field drift
+		std::vector<ReactionLines> vectors;
+		levels = TimeIt(reps, [&]() { BuildVectors(reactions, vectors); });
+		calculate = TimeIt(reps, [&]() { CalculateVectors(reactions, setup, vectors); });
+		double vectorsB = setup.B;
+		rescale = TimeIt(reps, [&]() {
+			vectorsB *= 1.0001;
+			for(auto& own : vectors) { //every drift in the run stays inside the margin
+				double scale = own.sliceB/vectorsB;
+				for(auto& rho : own.rho)
+					rho *= scale;
+				for(auto& sigma : own.rhoSigma)
+					sigma *= scale;
+				own.sliceB = vectorsB;
+			}
+		});
+		int storeVisible = nVisible;
+		window = TimeIt(reps, [&]() {
+			nVisible = 0;
+			for(auto& own : vectors) {
+				for(double rho : own.rho)
+					nVisible += rho >= setup.rhoMin && rho <= setup.rhoMax;
+			}
+		});
+		std::vector<GraphCopy> vectorGraphs;
+		graphs = TimeIt(reps, [&]() {
+			vectorGraphs.assign(n, GraphCopy());
+			for(int r=0; r<n; r++) {
+				const ReactionLines& own = vectors[r];
+				for(unsigned int j=0; j<own.rho.size(); j++)
+					if(own.rho[j] >= setup.rhoMin && own.rho[j] <= setup.rhoMax)
+						vectorGraphs[r].Add(own.rho[j], own.rhoSigma[j], r, own.labels[own.firstLevel + j]);
+			}
+		});
+
+		int nLines = 0;
+		mismatches = std::abs(nVisible - storeVisible);
+		for(int r=0; r<n; r++) {
+			nLines += vectors[r].ex.size();
+			const GraphCopy& a = storeGraphs[r];
+			const GraphCopy& b = vectorGraphs[r];
+			if(a.labels != b.labels || a.rho.size() != b.rho.size()) {
+				mismatches += std::max(1, (int)std::abs((int)a.rho.size() - (int)b.rho.size()));
+				continue;
+			}
+			for(unsigned int j=0; j<a.rho.size(); j++)
+				mismatches += std::fabs(a.rho[j]/b.rho[j] - 1.0) > 1.0e-12;
+		}
+		std::cout<<std::setw(31)<<"   vectors"<<std::setprecision(3)<<std::setw(12)<<levels<<std::setw(15)<<calculate<<std::setw(13)<<rescale
+				 <<std::setw(12)<<window<<std::setw(12)<<graphs<<std::setw(20)<<std::setprecision(1)<<1e6*calculate/std::max(nLines, 1)
+				 <<"  "<<(mismatches == 0 ? "ok" : std::to_string(mismatches) + " lines differ from the store")<<std::endl;
+		failures += mismatches > 0;
+		if(n >= maxReactions) break;
+	}
+	std::cout<<"Worst relative rho difference from the direct calculation "<<std::scientific<<std::setprecision(2)<<worst<<std::endl;
+	Report("every size the same as the direct calculation, and both layouts the same", failures == 0);
+	return ReportSummary();
+}
@@ -0,0 +1,96 @@
+/*
+
+line_reader.c
+Minimal reader of the lines SPSPlot publishes to shared memory (PUBLISH in the input file, layout in SPSLineShm.h). Prints the
+current table once, or with -w keeps printing it whenever it changes. Plain C and no ROOT, to show what an online tool needs:
+
+	line_reader /spsplot_lines [-w]
+*/
+#include "SPSLineShm.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+
+static const sps_shm_header* header = NULL;
+static size_t mapped = 0;
+
+/*Map the whole segment; called again whenever the writer has grown it*/
+static int map_segment(int fd) {
+	struct stat info;
+	if(fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(sps_shm_header)) return 0;
+	if(header != NULL) munmap((void*)header, mapped);
+	mapped = info.st_size;
+	header = (const sps_shm_header*) mmap(NULL, mapped, PROT_READ, MAP_SHARED, fd, 0);
+	if(header == MAP_FAILED) {
+		header = NULL;
+		return 0;
+	}
+	return 1;
+}
+
+static void print_lines(const sps_shm_header* snapshot, const sps_shm_line* lines) {
+	uint32_t i;
+	printf("Sequence %llu: %u lines at B=%g kG, T=%g MeV, theta=%g deg\n", (unsigned long long) snapshot->sequence,
+		   snapshot->nLines, snapshot->B, snapshot->beamKE, snapshot->theta);
+	for(i=0; i<snapshot->nLines; i++) {
+		printf("%-20s %-8s Ex=%8.4f MeV  rho=%8.4f +/- %.4f cm", lines[i].reaction, lines[i].label, lines[i].ex, lines[i].rho,
+			   lines[i].sigma);
+		if(snapshot->flags & SPS_SHM_HAS_POSITION) printf("  x=%g", lines[i].position);
+		printf("\n");
+	}
+}
+
+int main(int argc, char** argv) {
+	static sps_shm_line lines[65536]; /* this example's own copy; a tool could just as well use the lines in place */
+	sps_shm_header snapshot;
+	uint64_t last = 0, seq;
+	int watch, fd;
+
+	if(argc < 2) {
+		fprintf(stderr, "Usage: %s <shared memory name> [-w]\n", argv[0]);
+		return 1;
+	}
+	watch = argc > 2 && strcmp(argv[2], "-w") == 0;
+	fd = shm_open(argv[1], O_RDONLY, 0);
+	if(fd < 0 || !map_segment(fd)) {
+		fprintf(stderr, "Unable to open shared memory %s; is SPSPlot publishing to it?\n", argv[1]);
+		return 1;
+	}
+	if(header->magic != SPS_SHM_MAGIC || header->version != SPS_SHM_VERSION) {
+		fprintf(stderr, "Shared memory %s is not an SPSPlot line table of version %d\n", argv[1], SPS_SHM_VERSION);
+		return 1;
+	}
+
+	do {
+		for(;;) {
+			seq = sps_shm_read_begin(header);
+			memcpy(&snapshot, header, sizeof(snapshot));
+			/* checked on the copy: the writer can grow the segment at any time, so header->capacity may already be past it */
+			if(sps_shm_size(snapshot.capacity) > mapped) { /* grown; remap and try again */
+				if(!map_segment(fd)) return 1;
+				continue;
+			}
+			if(snapshot.nLines > snapshot.capacity || snapshot.nLines > sizeof(lines)/sizeof(lines[0])) {
+				if(sps_shm_read_valid(header, seq)) return 1; /* consistent but too large for this example */
+				continue;
+			}
+			memcpy(lines, sps_shm_lines(header), snapshot.nLines*sizeof(sps_shm_line));
+			if(sps_shm_read_valid(header, seq)) break;
+		}
+		if(seq != last) {
+			snapshot.sequence = seq;
+			print_lines(&snapshot, lines);
+			fflush(stdout);
+			last = seq;
+		}
+		if(watch) poll(NULL, 0, 100);
+	} while(watch);
+
+	munmap((void*)header, mapped);
+	close(fd);
+	return 0;
+}
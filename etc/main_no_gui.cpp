@@ -1,16 +1,213 @@
+/*
+	main_no_gui.cpp
+	Batch (no gui, no X server) report generation for SPSPlot. Takes a config file and, optionally, a run plan of settings,
+	and renders the line plot of every setting offscreen. Writes a multi-page pdf (a plot page followed by line table pages
+	for each setting), a png per setting, and a text table of all of the lines.
+
+	Usage: spsplot_batch <config.inp> <output base> [run plan] [n workers]
+
+	The run plan has one setting per line, in the same order as the SETTING keyword: <name> <BeamKE> <Bfield> <Theta>.
+	Without a run plan the primary setting and any SETTING entries of the config are used.
+
+	ROOT graphics are not thread safe, so rendering is spread over forked worker processes. The pngs (rasterization is the
+	expensive part) are split between the workers, while the parent writes the pdf at the same time. The pdf itself is not
+	parallel: ROOT writes a multi-page pdf as a single stream, and the pages of separate processes can't be joined without
+	an external tool, so its time is that of one process drawing every page.
+
+	Png files are named <output base>_<setting>.png, with anything but letters, digits, '.', '-' and '_' in the setting name
+	replaced by '_' (reaction style names like 12C(3He,4He) would otherwise end up in the path).
+*/
+
 #include <string>
+#include <vector>
 #include <iostream>
-#include <TApplication.h>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <algorithm>
+#include <cctype>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <TROOT.h>
+#include <TCanvas.h>
+#include <TLatex.h>
+#include <TString.h>
+#include <TPaveText.h>
 #include "SPSPlot.h"
 
+struct RunSetting {
+	std::string name;
+	double beamKE, B, theta;
+};
+
+static const int LINES_PER_PAGE = 40;
+
+static bool ReadRunPlan(const std::string& filename, std::vector<RunSetting>& plan) {
+	std::ifstream input(filename);
+	if(!input.is_open()) {
+		std::cerr<<"Unable to open run plan "<<filename<<"!"<<std::endl;
+		return false;
+	}
+	std::string line;
+	while(std::getline(input, line)) {
+		if(line.empty() || line[0] == '#') continue;
+		std::istringstream stream(line);
+		RunSetting setting;
+		if(stream>>setting.name>>setting.beamKE>>setting.B>>setting.theta)
+			plan.push_back(setting);
+		else
+			std::cerr<<"Bad run plan line: "<<line<<" Skipping."<<std::endl;
+	}
+	return true;
+}
+
+/*Setting name made safe for a file name; names which collide once cleaned get the index of the setting appended*/
+static std::vector<std::string> MakeFileNames(const std::vector<RunSetting>& plan) {
+	std::vector<std::string> names;
+	for(unsigned int i=0; i<plan.size(); i++) {
+		std::string name = plan[i].name;
+		for(auto& c : name) {
+			if(!std::isalnum((unsigned char)c) && c != '.' && c != '-' && c != '_') c = '_';
+		}
+		if(name.empty() || name[0] == '.') name = "setting" + name;
+		if(std::find(names.begin(), names.end(), name) != names.end()) name += "_" + std::to_string(i);
+		names.push_back(name);
+	}
+	return names;
+}
+
+/*Draw the line plot of the current primary setting to the canvas; same scheme as SPSPlotMainFrame::DrawGraphs*/
+static void DrawSetting(SPSPlot& plotter, TCanvas* canvas, const RunSetting& setting) {
+	canvas->Clear();
+	canvas->cd();
+	plotter.SetParameters(setting.beamKE, setting.theta, setting.B);
+	TGraph** graphs = plotter.GetGraphs();
+	int firstValidIndex = -1;
+	for(int i=0; i<plotter.GetNGraphs(); i++) {
+		if(graphs[i]->GetN() == 0) continue; //ROOT doesn't like drawing empty graphs
+		if(firstValidIndex == -1) {
+			graphs[i]->Draw("AP*");
+			firstValidIndex = i;
+		} else {
+			graphs[i]->Draw("P*");
+		}
+	}
+
+	std::ostringstream title;
+	title<<setting.name<<": BeamKE "<<setting.beamKE<<" MeV, B "<<setting.B<<" kG, #theta "<<setting.theta<<" deg";
+	TLatex* label = new TLatex(0.12, 0.92, title.str().c_str());
+	label->SetNDC();
+	label->SetTextSize(0.04);
+	if(firstValidIndex == -1) {
+		label->Draw(); //owned by the canvas primitives; empty plot still gets a title
+	} else {
+		graphs[firstValidIndex]->GetListOfFunctions()->Add(label);
+		canvas->BuildLegend();
+	}
+	canvas->Modified();
+	canvas->Update();
+}
+
+/*Line table pages for the current primary setting; each page is printed to the open pdf*/
+static void PrintTables(SPSPlot& plotter, TCanvas* canvas, const RunSetting& setting, const std::string& pdfname, std::ofstream& table) {
+	std::vector<SPSLine> lines = plotter.GetLines();
+	for(auto& line : lines) {
+		table<<setting.name<<"\t"<<plotter.GetReaction(line.rxnIndex).GetName()<<"\t"<<line.ex<<"\t"<<line.rho<<"\t"<<line.sigma<<std::endl;
+	}
+
+	for(unsigned int first=0; first<lines.size(); first += LINES_PER_PAGE) {
+		canvas->Clear();
+		canvas->cd();
+		TPaveText* page = new TPaveText(0.05, 0.05, 0.95, 0.95, "NDC");
+		page->SetTextAlign(12);
+		page->SetTextFont(82); //fixed width so that the columns line up
+		page->SetFillColor(0);
+		page->AddText((setting.name+" lines").c_str());
+		page->AddText(Form("%-24s %10s %10s %10s", "Reaction", "Ex(MeV)", "Rho(cm)", "Sigma(cm)"));
+		for(unsigned int i=first; i<lines.size() && i<first+LINES_PER_PAGE; i++) {
+			const SPSLine& line = lines[i];
+			page->AddText(Form("%-24s %10.4f %10.3f %10.3f", plotter.GetReaction(line.rxnIndex).GetName().c_str(), line.ex, line.rho, line.sigma));
+		}
+		page->Draw();
+		canvas->Print(pdfname.c_str(), "pdf");
+		delete page;
+	}
+}
+
 int main(int argc, char** argv) {
-	if(argc != 2) {
-		std::cerr<<"Incorrect number of arguments!"<<std::endl;
+	if(argc < 3 || argc > 5) {
+		std::cerr<<"Usage: spsplot_batch <config.inp> <output base> [run plan] [n workers]"<<std::endl;
 		return 1;
 	}
 
-	string name = argv[1];
-	TApplication app("app", &argc, argv);
+	std::string name = argv[1];
+	std::string base = argv[2];
+	gROOT->SetBatch(kTRUE); //everything offscreen
 	SPSPlot plotter(name);
-	plotter.DrawPlot();
+	if(!plotter.IsValid()) return 1;
+
+	std::vector<RunSetting> plan;
+	if(argc >= 4) {
+		if(!ReadRunPlan(argv[3], plan)) return 1;
+	} else {
+		plan.push_back({"Primary", plotter.GetBeamKE(), plotter.GetB(), plotter.GetTheta()});
+		for(int i=0; i<plotter.GetNSettings(); i++) {
+			const SPSSetting& setting = plotter.GetSetting(i);
+			plan.push_back({setting.name, setting.beamKE, setting.B, setting.theta});
+		}
+	}
+	if(plan.empty()) {
+		std::cerr<<"No settings to render!"<<std::endl;
+		return 1;
+	}
+
+	int nWorkers = argc == 5 ? std::stoi(argv[4]) : std::thread::hardware_concurrency();
+	if(nWorkers < 1) nWorkers = 1;
+	int nChildren = std::min(nWorkers, (int)plan.size()); //png workers; the parent only does the pdf (if there are any)
+	if(nWorkers == 1) nChildren = 0;
+	std::vector<std::string> fileNames = MakeFileNames(plan);
+
+	std::vector<pid_t> children;
+	for(int k=0; k<nChildren; k++) {
+		pid_t pid = fork();
+		if(pid == 0) {
+			TCanvas canvas("png_canvas", "png_canvas", 1200, 600);
+			for(unsigned int i=k; i<plan.size(); i += nChildren) {
+				DrawSetting(plotter, &canvas, plan[i]);
+				canvas.SaveAs((base+"_"+fileNames[i]+".png").c_str());
+			}
+			_exit(0);
+		} else if(pid < 0) {
+			std::cerr<<"Unable to fork a png worker; the remaining pngs are done serially."<<std::endl;
+			break;
+		}
+		children.push_back(pid);
+	}
+	int nStarted = children.size();
+
+	TCanvas canvas("pdf_canvas", "pdf_canvas", 1200, 600);
+	std::string pdfname = base+".pdf";
+	std::ofstream table(base+"_lines.txt");
+	table<<"Setting\tReaction\tEx(MeV)\tRho(cm)\tSigmaRho(cm)"<<std::endl;
+	canvas.Print((pdfname+"[").c_str(), "pdf"); //open the multi-page file
+	for(unsigned int i=0; i<plan.size(); i++) {
+		DrawSetting(plotter, &canvas, plan[i]);
+		canvas.Print(pdfname.c_str(), "pdf");
+		if(nChildren == 0 || (int)(i%nChildren) >= nStarted) //no worker is going to do this png
+			canvas.SaveAs((base+"_"+fileNames[i]+".png").c_str());
+		PrintTables(plotter, &canvas, plan[i], pdfname, table);
+	}
+	canvas.Print((pdfname+"]").c_str(), "pdf");
+	table.close();
+
+	int status = 0;
+	for(auto pid : children) {
+		int childStatus;
+		waitpid(pid, &childStatus, 0);
+		if(!WIFEXITED(childStatus) || WEXITSTATUS(childStatus) != 0) {
+			std::cerr<<"A png worker failed!"<<std::endl;
+			status = 1;
+		}
+	}
+	return status;
 }
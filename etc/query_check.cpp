@@ -0,0 +1,238 @@
+/*
+	query_check.cpp
+	Protocol check of the kinematics query daemon (etc/spsplot_daemon.cpp, protocol in include/SPSQueryProtocol.h), run
+	against a live daemon:
+
+	- framing: pipelined requests of sizes around the daemon's chunk size (and an empty one), one of them sent a byte at a
+	  time, come back once each, under their own tag, with every value identical to the kinematics core's
+	- statuses: bad reactions and bad kinds are flagged per query
+	- stalled clients: a connection which sends a lot of work and never reads its responses must not hold up anyone else
+	- bad requests get a status -1 response, and the connection is closed
+
+	Usage: query_check <socket path>
+
+	Reference values come from the kinematics core, with the nuclear data of ./data, so run it next to the daemon's data.
+*/
+
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "SPSKinematics.h"
+#include "SPSQueryProtocol.h"
+#include "CheckReport.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static const int TIMEOUT_MS = 5000;
+
+static bool ReadAll(int fd, void* data, size_t length) {
+	char* buffer = (char*) data;
+	while(length > 0) {
+		pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		if(poll(&pfd, 1, TIMEOUT_MS) <= 0) return false;
+		ssize_t n = recv(fd, buffer, length, 0);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) return false;
+		buffer += n;
+		length -= n;
+	}
+	return true;
+}
+
+/*Gives up if the daemon takes nothing for timeout ms*/
+static bool WriteAll(int fd, const void* data, size_t length, size_t piece = 0, int timeout = TIMEOUT_MS) {
+	const char* buffer = (const char*) data;
+	while(length > 0) {
+		pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLOUT;
+		if(poll(&pfd, 1, timeout) <= 0) return false;
+		ssize_t n = send(fd, buffer, piece == 0 ? length : std::min(piece, length), MSG_NOSIGNAL | MSG_DONTWAIT);
+		if(n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+		if(n <= 0) return false;
+		buffer += n;
+		length -= n;
+	}
+	return true;
+}
+
+static int Connect(const std::string& path) {
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path)-1);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0 || connect(fd, (sockaddr*) &address, sizeof(address)) != 0) {
+		if(fd >= 0) close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static bool Send(int fd, uint32_t tag, const std::vector<sps_query>& queries, size_t piece = 0, int timeout = TIMEOUT_MS) {
+	sps_query_request request;
+	request.magic = SPS_QUERY_MAGIC;
+	request.version = SPS_QUERY_VERSION;
+	request.tag = tag;
+	request.nQueries = queries.size();
+	return WriteAll(fd, &request, sizeof(request), piece, timeout) && WriteAll(fd, queries.data(), queries.size()*sizeof(sps_query), piece, timeout);
+}
+
+static bool Receive(int fd, sps_query_response& response, std::vector<sps_query_result>& results) {
+	if(!ReadAll(fd, &response, sizeof(response)) || response.magic != SPS_QUERY_MAGIC) return false;
+	results.resize(response.nResults);
+	return ReadAll(fd, results.data(), results.size()*sizeof(sps_query_result));
+}
+
+/*Alternating Ex->rho and rho->Ex queries over a range of settings, for 12C(3He,4He)11C*/
+static std::vector<sps_query> MakeQueries(int n, int seed) {
+	std::vector<sps_query> queries(n);
+	for(int i=0; i<n; i++) {
+		sps_query& query = queries[i];
+		query.At = 12; query.Zt = 6; query.Ap = 3; query.Zp = 2; query.Ae = 4; query.Ze = 2;
+		query.kind = (i + seed)%2 == 0 ? SPS_QUERY_RHO : SPS_QUERY_EX;
+		query.beamKE = 20.0 + (i + seed)%7;
+		query.theta = 5.0 + (i*3 + seed)%40;
+		query.B = 7.0 + 0.1*((i + seed)%20);
+		query.value = query.kind == SPS_QUERY_RHO ? 0.05*((i + seed)%200) : 60.0 + 0.01*((i*7 + seed)%3000);
+	}
+	return queries;
+}
+
+static bool Matches(const std::vector<sps_query>& queries, const std::vector<sps_query_result>& results, const sps_reaction* rxn) {
+	if(results.size() != queries.size()) return false;
+	for(unsigned int i=0; i<queries.size(); i++) {
+		const sps_query& query = queries[i];
+		double expected;
+		if(query.kind == SPS_QUERY_RHO) sps_rho(rxn, query.beamKE, query.theta, query.B, &query.value, 1, &expected);
+		else sps_ex(rxn, query.beamKE, query.theta, query.B, &query.value, 1, &expected);
+		int32_t status = std::isfinite(expected) ? SPS_QUERY_OK : SPS_QUERY_FORBIDDEN;
+		bool same = std::isnan(expected) ? std::isnan(results[i].value) : results[i].value == expected;
+		if(!same || results[i].status != status) return false;
+	}
+	return true;
+}
+
+static void CheckFraming(const std::string& path, const sps_reaction* rxn) {
+	int fd = Connect(path);
+	if(fd < 0) {
+		Report("framing: connect", false);
+		return;
+	}
+	const int sizes[] = {0, 1, 2, 1023, 1024, 1025, 2048, 5000, 65537};
+	const int nSizes = sizeof(sizes)/sizeof(sizes[0]);
+	std::map<uint32_t, std::vector<sps_query>> sent;
+	bool sendOk = true;
+	for(int i=0; i<nSizes; i++) {
+		uint32_t tag = 1000 + i;
+		sent[tag] = MakeQueries(sizes[i], i);
+		sendOk = sendOk && Send(fd, tag, sent[tag], sizes[i] == 2 ? 1 : 0); //one request a byte at a time
+	}
+	Report("framing: pipelined requests sent", sendOk);
+
+	sps_query_response response;
+	std::vector<sps_query_result> results;
+	int nAnswered = 0;
+	bool tagsOk = true, valuesOk = true;
+	while(nAnswered < nSizes && Receive(fd, response, results)) {
+		auto iter = sent.find(response.tag);
+		if(iter == sent.end() || response.status != 0) {
+			tagsOk = false;
+			break;
+		}
+		valuesOk = valuesOk && Matches(iter->second, results, rxn);
+		sent.erase(iter);
+		nAnswered++;
+	}
+	Report("framing: every request answered once under its own tag", tagsOk && nAnswered == nSizes);
+	Report("framing: every value identical to the kinematics core", valuesOk && nAnswered == nSizes);
+	close(fd);
+}
+
+static void CheckStatuses(const std::string& path) {
+	int fd = Connect(path);
+	std::vector<sps_query> queries = MakeQueries(3, 0);
+	queries[1].Ae = 200; //no such ejectile
+	queries[2].kind = 7;
+	sps_query_response response;
+	std::vector<sps_query_result> results;
+	bool ok = fd >= 0 && Send(fd, 1, queries) && Receive(fd, response, results) && results.size() == 3;
+	Report("statuses: bad reaction and bad kind flagged per query",
+		   ok && results[1].status == SPS_QUERY_BAD_REACTION && results[2].status == SPS_QUERY_BAD_KIND && results[0].status != SPS_QUERY_BAD_KIND);
+	if(fd >= 0) close(fd);
+}
+
+/*A client that sends a lot and never reads fills its socket; the daemon must keep serving everyone else*/
+static void CheckStalledClient(const std::string& path, const sps_reaction* rxn) {
+	int stalled = Connect(path);
+	if(stalled < 0) {
+		Report("stalled client: connect", false);
+		return;
+	}
+	std::vector<sps_query> big = MakeQueries(65536, 1);
+	int nSent = 0;
+	for(int i=0; i<64; i++) {
+		if(!Send(stalled, i, big, 0, 500)) break; //the daemon stopped reading it, as it should once it has enough in flight
+		nSent++;
+	}
+	std::cout<<"      stalled client got "<<nSent<<" requests of 65536 queries in without reading"<<std::endl;
+	Report("stalled client: the daemon stops reading it", nSent < 64);
+
+	int fd = Connect(path);
+	std::vector<sps_query> queries = MakeQueries(100, 2);
+	sps_query_response response;
+	std::vector<sps_query_result> results;
+	auto start = Clock::now();
+	bool ok = fd >= 0 && Send(fd, 7, queries) && Receive(fd, response, results) && response.tag == 7 && Matches(queries, results, rxn);
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	Report("stalled client: other connections still answered (" + std::to_string(seconds) + " s)", ok);
+	if(fd >= 0) close(fd);
+	close(stalled);
+}
+
+static void CheckBadRequest(const std::string& path) {
+	int fd = Connect(path);
+	sps_query_request request;
+	request.magic = 0xdeadbeef;
+	request.version = SPS_QUERY_VERSION;
+	request.tag = 99;
+	request.nQueries = 0;
+	sps_query_response response;
+	std::vector<sps_query_result> results;
+	bool answered = fd >= 0 && WriteAll(fd, &request, sizeof(request)) && Receive(fd, response, results);
+	char byte;
+	bool closed = answered && recv(fd, &byte, 1, 0) == 0;
+	Report("bad request: status -1 and the connection closed", answered && response.tag == 99 && response.status == -1 && closed);
+	if(fd >= 0) close(fd);
+}
+
+int main(int argc, char** argv) {
+	if(argc < 2) {
+		std::cerr<<"Usage: query_check <socket path>"<<std::endl;
+		return 1;
+	}
+	std::string path = argv[1];
+	sps_reaction* rxn = sps_reaction_create(12, 6, 3, 2, 4, 2);
+	if(rxn == nullptr) {
+		std::cerr<<"Unable to make the reference reaction; is ./data there?"<<std::endl;
+		return 1;
+	}
+
+	CheckFraming(path, rxn);
+	CheckStatuses(path);
+	CheckBadRequest(path);
+	CheckStalledClient(path, rxn);
+	sps_reaction_destroy(rxn);
+	return ReportSummary();
+}
@@ -0,0 +1,202 @@
+/*
+	query_loadtest.cpp
+	Load test, and example client, of the kinematics query daemon (etc/spsplot_daemon.cpp, protocol in
+	include/SPSQueryProtocol.h). Each connection keeps a fixed number of requests in flight (pipelining) for the given time,
+	then the throughput and the latency distribution of whole requests are reported.
+
+	Usage: query_loadtest <socket path> [connections] [batch size] [pipeline depth] [seconds]
+
+	Queries alternate between Ex->rho and rho->Ex for 12C(3He,4He)11C and 10B(3He,4He)9B at a range of settings. Only needs the
+	protocol header, not the kinematics core.
+*/
+
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "SPSQueryProtocol.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static const int MAX_DEPTH = 256; //the daemon stops reading a connection past this many requests in flight
+
+struct ClientStats {
+	std::vector<double> latencies; //us, one per request
+	uint64_t nQueries = 0;
+	uint64_t nFailed = 0; //results with a status other than OK
+	bool error = false;
+};
+
+static bool ReadAll(int fd, void* data, size_t length) {
+	char* buffer = (char*) data;
+	while(length > 0) {
+		ssize_t n = recv(fd, buffer, length, 0);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) return false;
+		buffer += n;
+		length -= n;
+	}
+	return true;
+}
+
+static bool WriteAll(int fd, const void* data, size_t length) {
+	const char* buffer = (const char*) data;
+	while(length > 0) {
+		ssize_t n = send(fd, buffer, length, MSG_NOSIGNAL);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) return false;
+		buffer += n;
+		length -= n;
+	}
+	return true;
+}
+
+static int Connect(const std::string& path) {
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path)-1);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0 || connect(fd, (sockaddr*) &address, sizeof(address)) != 0) {
+		if(fd >= 0) close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*One request's worth of queries; the same buffer is sent every time, only the tag changes*/
+static std::vector<char> MakeRequest(uint32_t batchSize, unsigned int seed) {
+	std::vector<char> buffer(sizeof(sps_query_request) + batchSize*sizeof(sps_query));
+	sps_query_request* request = (sps_query_request*) buffer.data();
+	request->magic = SPS_QUERY_MAGIC;
+	request->version = SPS_QUERY_VERSION;
+	request->tag = 0;
+	request->nQueries = batchSize;
+
+	std::mt19937 generator(seed);
+	std::uniform_real_distribution<double> ex(0.0, 10.0), rho(60.0, 85.0), theta(5.0, 35.0), B(7.5, 9.5), beamKE(14.0, 24.0);
+	sps_query* queries = (sps_query*) (request + 1);
+	for(uint32_t i=0; i<batchSize; i++) {
+		sps_query& query = queries[i];
+		bool carbon = (i/64) % 2 == 0; //runs of one reaction, as a real client would send
+		query.At = carbon ? 12 : 10;
+		query.Zt = carbon ? 6 : 5;
+		query.Ap = 3;
+		query.Zp = 2;
+		query.Ae = 4;
+		query.Ze = 2;
+		query.kind = i % 2 == 0 ? SPS_QUERY_RHO : SPS_QUERY_EX;
+		query.beamKE = beamKE(generator);
+		query.theta = theta(generator);
+		query.B = B(generator);
+		query.value = query.kind == SPS_QUERY_RHO ? ex(generator) : rho(generator);
+	}
+	return buffer;
+}
+
+static void RunClient(const std::string& path, uint32_t batchSize, int depth, double seconds, unsigned int seed, ClientStats& stats) {
+	int fd = Connect(path);
+	if(fd < 0) {
+		std::cerr<<"Unable to connect to "<<path<<"!"<<std::endl;
+		stats.error = true;
+		return;
+	}
+	std::vector<char> request = MakeRequest(batchSize, seed);
+	std::vector<sps_query_result> results(batchSize);
+	std::map<uint32_t, Clock::time_point> sent;
+	uint32_t nextTag = 0;
+	auto send = [&]() {
+		((sps_query_request*) request.data())->tag = nextTag;
+		sent[nextTag++] = Clock::now();
+		return WriteAll(fd, request.data(), request.size());
+	};
+
+	Clock::time_point stop = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+	for(int i=0; i<depth; i++) {
+		if(!send()) stats.error = true;
+	}
+	while(!sent.empty() && !stats.error) {
+		sps_query_response response;
+		if(!ReadAll(fd, &response, sizeof(response)) || response.magic != SPS_QUERY_MAGIC || response.status != 0
+		   || response.nResults != batchSize || !ReadAll(fd, results.data(), batchSize*sizeof(sps_query_result))) {
+			std::cerr<<"Bad response from the daemon!"<<std::endl;
+			stats.error = true;
+			break;
+		}
+		Clock::time_point now = Clock::now();
+		auto iter = sent.find(response.tag);
+		if(iter == sent.end()) {
+			std::cerr<<"Response to an unknown request "<<response.tag<<"!"<<std::endl;
+			stats.error = true;
+			break;
+		}
+		stats.latencies.push_back(std::chrono::duration<double, std::micro>(now - iter->second).count());
+		sent.erase(iter);
+		stats.nQueries += batchSize;
+		for(auto& result : results)
+			if(result.status != SPS_QUERY_OK) stats.nFailed++;
+
+		if(now < stop && !send()) stats.error = true;
+	}
+	close(fd);
+}
+
+static double Percentile(const std::vector<double>& sorted, double fraction) {
+	if(sorted.empty()) return 0.0;
+	size_t index = std::min(sorted.size()-1, (size_t)(fraction*sorted.size()));
+	return sorted[index];
+}
+
+int main(int argc, char** argv) {
+	if(argc < 2) {
+		std::cerr<<"Usage: query_loadtest <socket path> [connections] [batch size] [pipeline depth] [seconds]"<<std::endl;
+		return 1;
+	}
+	std::string path = argv[1];
+	int nConnections = argc > 2 ? std::max(1, std::atoi(argv[2])) : 4;
+	uint32_t batchSize = argc > 3 ? std::max(1, std::atoi(argv[3])) : 256;
+	int depth = argc > 4 ? std::max(1, std::min(MAX_DEPTH, std::atoi(argv[4]))) : 8;
+	double seconds = argc > 5 ? std::atof(argv[5]) : 5.0;
+	if(batchSize > SPS_QUERY_MAX_BATCH) batchSize = SPS_QUERY_MAX_BATCH;
+
+	std::vector<ClientStats> stats(nConnections);
+	std::vector<std::thread> clients;
+	Clock::time_point start = Clock::now();
+	for(int i=0; i<nConnections; i++)
+		clients.emplace_back(RunClient, path, batchSize, depth, seconds, 1000 + i, std::ref(stats[i]));
+	for(auto& client : clients)
+		client.join();
+	double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+	std::vector<double> latencies;
+	uint64_t nQueries = 0, nFailed = 0;
+	bool error = false;
+	for(auto& client : stats) {
+		latencies.insert(latencies.end(), client.latencies.begin(), client.latencies.end());
+		nQueries += client.nQueries;
+		nFailed += client.nFailed;
+		error |= client.error;
+	}
+	std::sort(latencies.begin(), latencies.end());
+
+	std::cout<<nConnections<<" connections, "<<batchSize<<" queries per request, "<<depth<<" requests in flight per connection"<<std::endl;
+	std::cout<<std::fixed<<std::setprecision(0);
+	std::cout<<"Requests: "<<latencies.size()<<" ("<<latencies.size()/elapsed<<"/s)"<<std::endl;
+	std::cout<<"Queries: "<<nQueries<<" ("<<nQueries/elapsed<<"/s), "<<nFailed<<" not OK"<<std::endl;
+	std::cout<<std::setprecision(1);
+	std::cout<<"Request latency (us): p50 "<<Percentile(latencies, 0.5)<<"  p90 "<<Percentile(latencies, 0.9)<<"  p99 "
+			 <<Percentile(latencies, 0.99)<<"  p99.9 "<<Percentile(latencies, 0.999)<<"  max "<<(latencies.empty() ? 0.0 : latencies.back())
+			 <<std::endl;
+	return error ? 1 : 0;
+}
@@ -0,0 +1,156 @@
+/*
+	shm_stress.cpp
+	Stress test of the sequence lock on the shared memory line table (include/SPSLineShm.h, src/LinePublisher.cpp). A writer
+	publishes as fast as it can, while reader processes take snapshots the same way etc/line_reader.c does. Every table the
+	writer publishes is self-describing (the generation number is in the header and in every line, the line count grows over
+	the run so the segment is grown and remapped several times), so a reader can tell a torn copy from a whole one.
+
+	Usage: shm_stress [seconds] [readers]
+
+	Each reader reports how many snapshots it took, how many torn copies the sequence check threw away, and how many torn
+	copies got past it; the last must be zero. Linux only.
+*/
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "LinePublisher.h"
+#include "CheckReport.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static const uint32_t MAX_LINES = 16384; //segment grows from 1024 to here during the run
+
+/*Table of generation g: the count and every field are derived from g, so any mix of two tables shows up*/
+static void MakeTable(uint64_t g, sps_shm_header& parameters, std::vector<sps_shm_line>& lines) {
+	uint32_t limit = std::min<uint64_t>(MAX_LINES, 512 + g);
+	uint32_t n = 1 + (g*7919)%limit;
+	lines.resize(n);
+	for(uint32_t i=0; i<n; i++) {
+		sps_shm_line& line = lines[i];
+		memset(line.reaction, 'a' + g%26, SPS_SHM_REACTION_LENGTH-1);
+		line.reaction[SPS_SHM_REACTION_LENGTH-1] = '\0';
+		snprintf(line.label, SPS_SHM_LABEL_LENGTH, "%u", i);
+		line.rxnIndex = i;
+		line.level = (int32_t)g;
+		line.ex = g;
+		line.rho = g + 1.0e-3*i;
+		line.sigma = line.position = line.weight = g;
+	}
+	parameters.flags = 0;
+	parameters.beamKE = parameters.B = g;
+	parameters.theta = n;
+	parameters.calOffset = parameters.calSlope = 0.0;
+}
+
+static bool IsWhole(const sps_shm_header& snapshot, const sps_shm_line* lines) {
+	double g = snapshot.B;
+	if(snapshot.beamKE != g || snapshot.theta != snapshot.nLines || snapshot.nLines > snapshot.capacity) return false;
+	for(uint32_t i=0; i<snapshot.nLines; i++) {
+		const sps_shm_line& line = lines[i];
+		if(line.rxnIndex != (int32_t)i || line.level != (int32_t)(uint64_t)g || line.ex != g || line.rho != g + 1.0e-3*i || line.weight != g
+		   || line.reaction[0] != (char)('a' + (uint64_t)g%26) || line.reaction[SPS_SHM_REACTION_LENGTH-2] != line.reaction[0])
+			return false;
+	}
+	return true;
+}
+
+/*Reader process; same protocol as etc/line_reader.c, but counting rather than printing*/
+static int RunReader(const std::string& name, double seconds, int id) {
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if(fd < 0) return 2;
+	const sps_shm_header* header = nullptr;
+	size_t mapped = 0;
+	auto remap = [&]() {
+		struct stat info;
+		if(fstat(fd, &info) != 0) return false;
+		if(header != nullptr) munmap((void*)header, mapped);
+		mapped = info.st_size;
+		header = (const sps_shm_header*) mmap(nullptr, mapped, PROT_READ, MAP_SHARED, fd, 0);
+		return header != MAP_FAILED;
+	};
+	if(!remap()) return 2;
+
+	std::vector<sps_shm_line> lines(MAX_LINES);
+	sps_shm_header snapshot;
+	uint64_t snapshots = 0, rejected = 0, accepted = 0, remaps = 0, last = 0, backwards = 0;
+	auto start = Clock::now();
+	while(std::chrono::duration<double>(Clock::now() - start).count() < seconds) {
+		uint64_t seq = sps_shm_read_begin(header);
+		memcpy(&snapshot, header, sizeof(snapshot));
+		if(sps_shm_size(snapshot.capacity) > mapped) {
+			if(!remap()) return 2;
+			remaps++;
+			continue;
+		}
+		uint32_t n = std::min(snapshot.nLines, std::min(snapshot.capacity, MAX_LINES));
+		memcpy(lines.data(), sps_shm_lines(header), n*sizeof(sps_shm_line));
+		bool whole = n == snapshot.nLines && IsWhole(snapshot, lines.data());
+		if(!sps_shm_read_valid(header, seq)) {
+			if(!whole) rejected++;
+			continue;
+		}
+		if(!whole) accepted++;
+		if(seq < last) backwards++;
+		last = seq;
+		snapshots++;
+	}
+	std::cout<<"reader "<<id<<": "<<snapshots<<" snapshots, "<<remaps<<" remaps, "<<rejected<<" torn copies rejected, "
+			 <<accepted<<" torn copies accepted, "<<backwards<<" out of order"<<std::endl;
+	munmap((void*)header, mapped);
+	close(fd);
+	return accepted == 0 && backwards == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+	double seconds = argc > 1 ? std::atof(argv[1]) : 5.0;
+	int nReaders = argc > 2 ? std::max(std::atoi(argv[2]), 1) : 3;
+	std::string name = "/spsplot_stress_" + std::to_string(getpid());
+
+	LinePublisher publisher;
+	if(!publisher.Open(name, 0)) return 1;
+	sps_shm_header parameters;
+	std::vector<sps_shm_line> lines;
+	MakeTable(0, parameters, lines);
+	publisher.Publish(parameters, lines);
+
+	std::vector<pid_t> readers;
+	for(int i=0; i<nReaders; i++) {
+		pid_t pid = fork();
+		if(pid == 0) _exit(RunReader(name, seconds, i));
+		if(pid < 0) {
+			std::cerr<<"Unable to fork a reader!"<<std::endl;
+			break;
+		}
+		readers.push_back(pid);
+	}
+
+	uint64_t g = 1;
+	auto start = Clock::now();
+	while(std::chrono::duration<double>(Clock::now() - start).count() < seconds) {
+		MakeTable(g++, parameters, lines);
+		publisher.Publish(parameters, lines);
+	}
+	std::cout<<"writer: "<<g<<" tables published"<<std::endl;
+
+	int status = 0;
+	for(auto pid : readers) {
+		int readerStatus;
+		waitpid(pid, &readerStatus, 0);
+		if(!WIFEXITED(readerStatus) || WEXITSTATUS(readerStatus) != 0) status = 1;
+	}
+	publisher.Close();
+	Report("no torn copy got past the sequence check, in any reader", status == 0);
+	return ReportSummary();
+}
@@ -0,0 +1,437 @@
+/*
+	spsplot_daemon.cpp
+	Kinematics query daemon. Loads the nuclear data once (from ./data, as the gui does) and answers batches of rho and Ex
+	queries from local tools over a UNIX domain socket, so that scripts don't each need their own copy of the kinematics.
+	The protocol is in include/SPSQueryProtocol.h; etc/query_loadtest.cpp is an example client.
+
+	Usage: spsplot_daemon <socket path> [n workers]
+
+	Every connection has a thread which reads its requests and splits them into chunks for a shared pool of workers, so a
+	single large batch is spread over all of the workers, and many small ones from several clients interleave. The worker
+	that finishes the last chunk of a request queues it for the connection's writer thread; the workers never touch the
+	socket, so a client which stops reading holds up only itself. Requests may be pipelined, and so responses are sent as
+	they complete, not in request order. Each connection can only have so many requests, and so many bytes of queries and
+	results, in flight (a single request of any allowed size is always taken); past that its requests are not read until
+	some have been answered.
+
+	Built on the kinematics core only (no ROOT). Stops cleanly on SIGINT or SIGTERM.
+*/
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <array>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+#include <cmath>
+#include <csignal>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include "SPSKinematics.h"
+#include "SPSQueryProtocol.h"
+
+static const uint32_t CHUNK_SIZE = 1024; //queries per unit of work
+static const int MAX_IN_FLIGHT = 256; //requests per connection
+static const size_t MAX_IN_FLIGHT_BYTES = 64 << 20; //queries and results per connection
+static const int POLL_MS = 250; //how often idle threads check whether the daemon is stopping
+
+static std::atomic<bool> g_running(true);
+
+static void Stop(int) {
+	g_running = false;
+}
+
+struct Batch;
+
+struct Connection {
+	int fd;
+	std::mutex mutex;
+	std::condition_variable answered; //room for another request
+	std::condition_variable ready; //a response for the writer
+	std::deque<std::shared_ptr<Batch>> responses; //guarded by mutex, as are the next three
+	int inFlight = 0; //read, and not yet written
+	size_t inFlightBytes = 0;
+	bool closing = false; //no more requests will be read
+	std::atomic<bool> broken;
+
+	Connection(int socket) : fd(socket), broken(false) {}
+	~Connection() { close(fd); }
+};
+
+struct Batch {
+	std::shared_ptr<Connection> connection;
+	uint32_t tag;
+	int32_t status = 0;
+	size_t cost = 0; //bytes counted against the connection's limit
+	std::vector<sps_query> queries;
+	std::vector<sps_query_result> results;
+	std::atomic<uint32_t> remaining; //chunks
+};
+
+struct Chunk {
+	std::shared_ptr<Batch> batch;
+	uint32_t begin, end;
+};
+
+/*Chunks of every connection's requests, in arrival order*/
+class WorkQueue {
+public:
+	void Push(std::vector<Chunk>& chunks) {
+		{
+			std::lock_guard<std::mutex> guard(m_mutex);
+			for(auto& chunk : chunks)
+				m_chunks.push_back(std::move(chunk));
+		}
+		m_ready.notify_all();
+	}
+
+	/*Blocks until there is work; false once stopped and empty*/
+	bool Pop(Chunk& chunk) {
+		std::unique_lock<std::mutex> guard(m_mutex);
+		m_ready.wait(guard, [this]() { return !m_chunks.empty() || m_stopping; });
+		if(m_chunks.empty()) return false;
+		chunk = std::move(m_chunks.front());
+		m_chunks.pop_front();
+		return true;
+	}
+
+	void Stop() {
+		{
+			std::lock_guard<std::mutex> guard(m_mutex);
+			m_stopping = true;
+		}
+		m_ready.notify_all();
+	}
+
+private:
+	std::mutex m_mutex;
+	std::condition_variable m_ready;
+	std::deque<Chunk> m_chunks;
+	bool m_stopping = false;
+};
+
+static WorkQueue g_queue;
+
+/*
+	Reactions are made the first time they are asked for, and kept for the life of the daemon. Invalid ones are remembered too
+	(as nullptr), so a client repeating a bad reaction doesn't rebuild it every time. Calculations on a made reaction are const
+*/
+typedef std::array<uint16_t, 6> ReactionKey;
+static std::mutex g_reactionMutex;
+static std::map<ReactionKey, sps_reaction*> g_reactions;
+
+static const sps_reaction* GetReaction(const ReactionKey& key) {
+	std::lock_guard<std::mutex> guard(g_reactionMutex);
+	auto iter = g_reactions.find(key);
+	if(iter != g_reactions.end()) return iter->second;
+	sps_reaction* rxn = sps_reaction_create(key[0], key[1], key[2], key[3], key[4], key[5]);
+	g_reactions[key] = rxn;
+	return rxn;
+}
+
+static bool ReadAll(int fd, void* data, size_t length) {
+	char* buffer = (char*) data;
+	while(length > 0) {
+		pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		int ready = poll(&pfd, 1, POLL_MS);
+		if(ready < 0 && errno != EINTR) return false;
+		if(ready <= 0) {
+			if(!g_running) return false;
+			continue;
+		}
+		ssize_t n = recv(fd, buffer, length, 0);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) return false;
+		buffer += n;
+		length -= n;
+	}
+	return true;
+}
+
+static bool WriteAll(int fd, iovec* parts, int nParts) {
+	while(nParts > 0) {
+		msghdr message;
+		memset(&message, 0, sizeof(message));
+		message.msg_iov = parts;
+		message.msg_iovlen = nParts;
+		ssize_t n = sendmsg(fd, &message, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if(n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+			pollfd pfd;
+			pfd.fd = fd;
+			pfd.events = POLLOUT;
+			if(poll(&pfd, 1, POLL_MS) == 0 && !g_running) return false; //a client that doesn't read doesn't hold up the exit
+			continue;
+		}
+		if(n < 0) return false;
+		while(nParts > 0 && (size_t)n >= parts->iov_len) {
+			n -= parts->iov_len;
+			parts++;
+			nParts--;
+		}
+		if(nParts > 0) {
+			parts->iov_base = (char*) parts->iov_base + n;
+			parts->iov_len -= n;
+		}
+	}
+	return true;
+}
+
+static bool Respond(int fd, uint32_t tag, int32_t status, const std::vector<sps_query_result>& results) {
+	sps_query_response response;
+	response.magic = SPS_QUERY_MAGIC;
+	response.tag = tag;
+	response.nResults = results.size();
+	response.status = status;
+	iovec parts[2];
+	parts[0].iov_base = &response;
+	parts[0].iov_len = sizeof(response);
+	parts[1].iov_base = (void*) results.data();
+	parts[1].iov_len = results.size()*sizeof(sps_query_result);
+
+	return WriteAll(fd, parts, results.empty() ? 1 : 2);
+}
+
+/*Hands a complete request to its connection's writer*/
+static void Finish(const std::shared_ptr<Batch>& batch) {
+	Connection& connection = *batch->connection;
+	{
+		std::lock_guard<std::mutex> guard(connection.mutex);
+		connection.responses.push_back(batch);
+	}
+	connection.ready.notify_one();
+}
+
+/*Writes a connection's responses as they complete, until its reader is done and everything read has been answered*/
+static void WriteResponses(std::shared_ptr<Connection> connection) {
+	std::unique_lock<std::mutex> guard(connection->mutex);
+	while(true) {
+		connection->ready.wait(guard, [&]() { return !connection->responses.empty() || (connection->closing && connection->inFlight == 0); });
+		if(connection->responses.empty()) break;
+		std::shared_ptr<Batch> batch = std::move(connection->responses.front());
+		connection->responses.pop_front();
+		guard.unlock();
+
+		if(!connection->broken && !Respond(connection->fd, batch->tag, batch->status, batch->results)) {
+			connection->broken = true;
+			shutdown(connection->fd, SHUT_RDWR); //wakes the reader
+		}
+		size_t cost = batch->cost;
+		batch.reset();
+
+		guard.lock();
+		connection->inFlight--;
+		connection->inFlightBytes -= cost;
+		connection->answered.notify_one();
+	}
+}
+
+static void Evaluate(const sps_query& query, sps_query_result& result, const sps_reaction* rxn) {
+	result.reserved = 0;
+	if(rxn == nullptr) {
+		result.value = std::nan("");
+		result.status = SPS_QUERY_BAD_REACTION;
+		return;
+	}
+	if(query.kind == SPS_QUERY_RHO)
+		sps_rho(rxn, query.beamKE, query.theta, query.B, &query.value, 1, &result.value);
+	else if(query.kind == SPS_QUERY_EX)
+		sps_ex(rxn, query.beamKE, query.theta, query.B, &query.value, 1, &result.value);
+	else {
+		result.value = std::nan("");
+		result.status = SPS_QUERY_BAD_KIND;
+		return;
+	}
+	result.status = std::isfinite(result.value) ? SPS_QUERY_OK : SPS_QUERY_FORBIDDEN;
+}
+
+static void Work() {
+	Chunk chunk;
+	while(g_queue.Pop(chunk)) {
+		Batch& batch = *chunk.batch;
+		ReactionKey key, last;
+		const sps_reaction* rxn = nullptr;
+		for(uint32_t i=chunk.begin; i<chunk.end; i++) {
+			const sps_query& query = batch.queries[i];
+			key = {{query.At, query.Zt, query.Ap, query.Zp, query.Ae, query.Ze}};
+			if(i == chunk.begin || key != last) { //batches are usually runs of the same reaction
+				rxn = GetReaction(key);
+				last = key;
+			}
+			Evaluate(query, batch.results[i], rxn);
+		}
+		if(--batch.remaining == 0) Finish(chunk.batch);
+		chunk.batch.reset();
+	}
+}
+
+/*Reads requests until the client hangs up, breaks the protocol, or the daemon stops*/
+static void Serve(std::shared_ptr<Connection> connection, std::atomic<bool>* done) {
+	std::thread writer(WriteResponses, connection);
+	sps_query_request request;
+	while(!connection->broken && ReadAll(connection->fd, &request, sizeof(request))) {
+		bool bad = request.magic != SPS_QUERY_MAGIC || request.version != SPS_QUERY_VERSION || request.nQueries > SPS_QUERY_MAX_BATCH;
+		uint32_t nQueries = bad ? 0 : request.nQueries;
+		size_t cost = sizeof(sps_query_response) + nQueries*(sizeof(sps_query) + sizeof(sps_query_result));
+		{
+			std::unique_lock<std::mutex> guard(connection->mutex);
+			while((connection->inFlight >= MAX_IN_FLIGHT || (connection->inFlight > 0 && connection->inFlightBytes + cost > MAX_IN_FLIGHT_BYTES))
+				  && g_running && !connection->broken)
+				connection->answered.wait_for(guard, std::chrono::milliseconds(POLL_MS));
+			if(!g_running || connection->broken) break;
+			connection->inFlight++;
+			connection->inFlightBytes += cost;
+		}
+
+		auto batch = std::make_shared<Batch>();
+		batch->connection = connection;
+		batch->tag = request.tag;
+		batch->cost = cost;
+		if(bad) {
+			std::cerr<<"Bad request, closing connection"<<std::endl;
+			batch->status = -1;
+			Finish(batch);
+			break;
+		}
+		batch->queries.resize(nQueries);
+		batch->results.resize(nQueries);
+		if(!ReadAll(connection->fd, batch->queries.data(), nQueries*sizeof(sps_query))) {
+			std::lock_guard<std::mutex> guard(connection->mutex);
+			connection->inFlight--;
+			connection->inFlightBytes -= cost;
+			break;
+		}
+		if(nQueries == 0) {
+			Finish(batch);
+			continue;
+		}
+
+		std::vector<Chunk> chunks;
+		for(uint32_t begin=0; begin<nQueries; begin+=CHUNK_SIZE)
+			chunks.push_back({batch, begin, std::min(begin + CHUNK_SIZE, nQueries)});
+		batch->remaining = chunks.size();
+		g_queue.Push(chunks);
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(connection->mutex);
+		connection->closing = true;
+	}
+	connection->ready.notify_one();
+	writer.join();
+	*done = true;
+}
+
+/*Bind the socket, replacing a stale one left by a daemon which didn't exit cleanly, but never one which is being served*/
+static int Listen(const std::string& path) {
+	sockaddr_un address;
+	if(path.size() >= sizeof(address.sun_path)) {
+		std::cerr<<"Socket path "<<path<<" is too long!"<<std::endl;
+		return -1;
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path)-1);
+
+	struct stat info;
+	if(stat(path.c_str(), &info) == 0) {
+		if(!S_ISSOCK(info.st_mode)) {
+			std::cerr<<path<<" exists and is not a socket!"<<std::endl;
+			return -1;
+		}
+		int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		bool live = probe >= 0 && connect(probe, (sockaddr*) &address, sizeof(address)) == 0;
+		if(probe >= 0) close(probe);
+		if(live) {
+			std::cerr<<"Another daemon is already serving "<<path<<"!"<<std::endl;
+			return -1;
+		}
+		unlink(path.c_str());
+	}
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(fd < 0 || bind(fd, (sockaddr*) &address, sizeof(address)) != 0 || listen(fd, 64) != 0) {
+		std::cerr<<"Unable to listen on "<<path<<"!"<<std::endl;
+		if(fd >= 0) close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int main(int argc, char** argv) {
+	if(argc < 2) {
+		std::cerr<<"Usage: spsplot_daemon <socket path> [n workers]"<<std::endl;
+		return 1;
+	}
+	std::string path = argv[1];
+	int nWorkers = argc > 2 ? std::atoi(argv[2]) : std::thread::hardware_concurrency();
+	if(nWorkers < 1) nWorkers = 1;
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = Stop;
+	sigaction(SIGINT, &action, nullptr);
+	sigaction(SIGTERM, &action, nullptr);
+	signal(SIGPIPE, SIG_IGN);
+
+	int listener = Listen(path);
+	if(listener < 0) return 1;
+
+	std::vector<std::thread> workers;
+	for(int i=0; i<nWorkers; i++)
+		workers.emplace_back(Work);
+	std::cout<<"Serving kinematics queries on "<<path<<" with "<<nWorkers<<" workers"<<std::endl;
+
+	struct Client {
+		std::thread thread;
+		std::unique_ptr<std::atomic<bool>> done;
+	};
+	std::vector<Client> clients;
+	while(g_running) {
+		pollfd pfd;
+		pfd.fd = listener;
+		pfd.events = POLLIN;
+		if(poll(&pfd, 1, POLL_MS) <= 0) continue;
+		int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+		if(fd < 0) continue;
+
+		for(auto iter = clients.begin(); iter != clients.end();) { //reap finished connections
+			if(*(iter->done)) {
+				iter->thread.join();
+				iter = clients.erase(iter);
+			} else {
+				++iter;
+			}
+		}
+		Client client;
+		client.done.reset(new std::atomic<bool>(false));
+		client.thread = std::thread(Serve, std::make_shared<Connection>(fd), client.done.get());
+		clients.push_back(std::move(client));
+	}
+
+	std::cout<<"Stopping"<<std::endl;
+	close(listener);
+	unlink(path.c_str());
+	for(auto& client : clients)
+		client.thread.join();
+	g_queue.Stop(); //requests already read are still answered
+	for(auto& worker : workers)
+		worker.join();
+	return 0;
+}
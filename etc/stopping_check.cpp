@@ -0,0 +1,123 @@
+/*
+	stopping_check.cpp
+	Accuracy check of the stopping tables and the detector model (include/StoppingTable.h, include/DetectorModel.h) against a
+	stopping power with a closed form range. A table of S(E) = S0*E^-p is written out and loaded the way a converted SRIM or
+	LISE++ table would be, and then
+
+	- ranges match the integral of 1/S, and energies from ranges invert them
+	- deposits in a stack of layers match slowing down with the exact range, for an ion which stops in the stack and one which
+	  goes through it, and for an isotope scaled from the tabulated one
+	- an ion which stops leaves all of its energy in the stack
+	- ions without a table, or above the top of theirs, give NaN
+
+	Usage: stopping_check
+
+	Each check gives the worst error found. Needs nothing but the detector model (no ROOT, no nuclear data).
+*/
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <cstdio>
+#include <cmath>
+#include <unistd.h>
+#include "DetectorModel.h"
+#include "CheckReport.h"
+
+static const double S0 = 0.5; //MeV/(mg/cm^2) at 1 MeV
+static const double POWER = 0.8;
+static const double E_LOW = 0.1, E_HIGH = 100.0; //MeV, ends of the table
+static const int N_POINTS = 60;
+
+/*Range from the bottom of the table; the table's own range below it doesn't follow the power law, so only differences count*/
+static double ExactRange(double ke) {
+	return (std::pow(ke, 1.0 + POWER) - std::pow(E_LOW, 1.0 + POWER))/(S0*(1.0 + POWER));
+}
+
+static double ExactEnergy(double range) {
+	return std::pow(range*S0*(1.0 + POWER) + std::pow(E_LOW, 1.0 + POWER), 1.0/(1.0 + POWER));
+}
+
+/*Exact deposits of the tabulated ion (or, for A != tableA, an isotope at the same velocity) in each layer*/
+static std::vector<double> ExactDeposits(const DetectorModel& detector, double ke, int A, int tableA) {
+	double scale = (double)tableA/A;
+	std::vector<double> deposits;
+	for(int k=0; k<detector.GetNLayers(); k++) {
+		double left = ExactRange(ke*scale)/scale - detector.GetLayer(k).thickness;
+		double out = left > 0.0 ? ExactEnergy(left*scale)/scale : 0.0;
+		deposits.push_back(ke - out);
+		ke = out;
+	}
+	return deposits;
+}
+
+int main() {
+	char filename[] = "/tmp/stopping_check_XXXXXX";
+	int fd = mkstemp(filename);
+	if(fd < 0) {
+		std::cerr<<"Unable to make a temporary table!"<<std::endl;
+		return 1;
+	}
+	close(fd);
+	std::ofstream output(filename);
+	output<<"# E(MeV) S(MeV/(mg/cm^2))"<<std::endl<<std::setprecision(17);
+	for(int i=0; i<N_POINTS; i++) {
+		double e = E_LOW*std::pow(E_HIGH/E_LOW, (double)i/(N_POINTS - 1));
+		output<<e<<" "<<S0*std::pow(e, -POWER)<<std::endl;
+	}
+	output.close();
+
+	StoppingTable table;
+	bool loaded = table.Load(filename);
+	DetectorModel detector;
+	detector.AddLayer({"window", "mylar", 1.0, false});
+	detector.AddLayer({"dE", "isobutane", 5.0, true});
+	detector.AddLayer({"E", "bc404", 300.0, true});
+	for(const char* material : {"mylar", "isobutane", "bc404"})
+		loaded = detector.AddTable({4, 2, material, filename}) && loaded;
+	std::remove(filename);
+	if(!loaded) return 1;
+
+	double worst = 0.0;
+	for(double e=0.2; e<E_HIGH; e*=1.1) {
+		double range = table.GetRange(e) - table.GetRange(E_LOW);
+		worst = std::fmax(worst, std::fabs(range/ExactRange(e) - 1.0));
+	}
+	Report("range vs. the integral of 1/S (relative)", worst, 1.0e-4);
+
+	worst = 0.0;
+	for(double e=0.01; e<E_HIGH; e*=1.1)
+		worst = std::fmax(worst, std::fabs(table.GetEnergy(table.GetRange(e))/e - 1.0));
+	Report("energy from range vs. energy (relative)", worst, 1.0e-9);
+
+	//15 MeV stops in the E layer, 60 MeV goes through it; 3He is slowed with the 4He table at the same velocity
+	const double ke[] = {15.0, 60.0};
+	const int nLayers = detector.GetNLayers();
+	for(int A : {4, 3}) {
+		std::vector<double> deposits(2*nLayers);
+		detector.Deposit(A, 2, ke, 2, deposits.data());
+		worst = 0.0;
+		for(int i=0; i<2; i++) {
+			std::vector<double> exact = ExactDeposits(detector, ke[i], A, 4);
+			for(int k=0; k<nLayers; k++)
+				worst = std::fmax(worst, std::fabs(deposits[i*nLayers + k] - exact[k])/ke[i]);
+		}
+		Report(std::to_string(A) + "He deposits vs. exact slowing down (relative to KE)", worst, 1.0e-4);
+		double sum = 0.0;
+		for(int k=0; k<nLayers; k++)
+			sum += deposits[k];
+		Report(std::to_string(A) + "He stopped in the stack leaves all of its energy (MeV)", std::fabs(sum - ke[0]), 1.0e-9);
+	}
+
+	std::vector<double> deposits(nLayers);
+	double beyond = 200.0;
+	detector.Deposit(4, 2, &beyond, 1, deposits.data());
+	bool allNaN = std::isnan(deposits[0]);
+	detector.Deposit(1, 1, ke, 1, deposits.data());
+	allNaN = allNaN && std::isnan(deposits[0]) && std::isnan(deposits[nLayers-1]) && !detector.CanStop(1) && detector.CanStop(2);
+	Report("no table, or above the table, gives NaN", allNaN);
+
+	return ReportSummary();
+}
@@ -0,0 +1,36 @@
+/*
+
+	CurveOptionsFrame.h
+	Wrapper class on a TGTransientFrame (temporary frame assoc. with a main frame)
+	User specifies the angular range and SPS acceptance for the kinematic curve mode; the options are sent
+	as a signal back to the main frame.
+*/
+
+#ifndef CURVEOPTIONSFRAME_H
+#define CURVEOPTIONSFRAME_H
+
+#include "SPSPlotMainFrame.h"
+#include <TGNumberEntry.h>
+#include <TQObject.h>
+#include <RQ_OBJECT.h>
+
+class CurveOptionsFrame {
+
+	RQ_OBJECT("CurveOptionsFrame"); //ROOT wrapping into gui environment
+public:
+	CurveOptionsFrame(const TGWindow *p, const TGWindow *main, UInt_t w, UInt_t h, SPSPlotMainFrame *parent, const CurveOptions& current);
+	virtual ~CurveOptionsFrame();
+	void CloseWindow();
+	void DoOk();
+	void DoCancel();
+	void SendOptions(CurveOptions* options); // *SIGNAL*
+	ClassDef(CurveOptionsFrame, 0); //ROOT requirements
+
+private:
+	CurveOptions options;
+	TGTransientFrame *fMain;
+	TGTextButton *fOkButton, *fCancelButton;
+	TGNumberEntryField *fTMinField, *fTMaxField, *fAcceptField;
+};
+
+#endif
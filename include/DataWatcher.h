@@ -0,0 +1,70 @@
+/*
+
+DataWatcher.h
+Watches the nuclear data directory (excitations.dat and mass.txt) for changes with inotify, so that levels added mid-experiment
+show up without a restart. Files are re-read on a background thread and compared against what was last seen: excitations are
+compared per nuclide block, masses per line, and only what differs is parsed. The result is handed over as a single update,
+which the owner takes and applies on its own thread (see SPSPlot::ApplyDataUpdate). Each edit of the global MASS and EX tables
+is made under that table's write lock, and every lookup, including those from ParallelFor's workers, holds its read lock (see
+ReadWriteLock.h), so no lookup sees a half-written nuclide. The update as a whole is not atomic to other threads; thread pool
+calculations are started and waited for on the owner's thread, so none runs while it is applied.
+
+Linux only; elsewhere Start() reports that watching is unavailable.
+*/
+#ifndef DATAWATCHER_H
+#define DATAWATCHER_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <unordered_set>
+#include "ExTable.h"
+#include "MassLookup.h"
+
+struct LevelChange {
+	std::string nuclide;
+	bool removed;
+	ExData data; //empty if removed
+};
+
+/*Everything that changed since the last update was taken, in the order it happened*/
+struct DataUpdate {
+	std::vector<LevelChange> levels;
+	std::vector<MassEntry> masses;
+	bool inline IsEmpty() const { return levels.empty() && masses.empty(); };
+};
+
+class DataWatcher {
+public:
+	DataWatcher();
+	~DataWatcher();
+
+	bool Start(const std::string& directory);
+	void Stop();
+	bool TakeUpdate(DataUpdate& update);
+
+private:
+	void Run();
+	void ScanLevels(DataUpdate& update);
+	void ScanMasses(DataUpdate& update);
+
+	std::string m_directory;
+	int m_fd;
+	std::thread m_thread;
+	std::atomic<bool> m_running;
+
+	std::mutex m_mutex;
+	DataUpdate m_pending; //guarded by m_mutex
+
+	//Last seen file contents; only touched by the watcher thread (or before it starts)
+	std::unordered_map<std::string, std::string> m_levelBlocks; //nuclide -> its whitespace normalized block
+	std::unordered_set<std::string> m_massLines;
+
+	static constexpr int QUIET_MS = 100; //editors write in several steps; wait for the directory to settle
+	static constexpr int POLL_MS = 250; //how often the thread checks whether it should stop
+};
+
+#endif
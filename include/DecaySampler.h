@@ -0,0 +1,65 @@
+/*
+
+DecaySampler.h
+Expected focal plane momentum distributions (loci) of the decay products of particle-unbound states, for the decays attached
+to each reaction (see DecayChannel). The reaction is taken as isotropic in the center of mass, and the unbound residual or
+ejectile decays isotropically in its rest frame; everything is relativistic. Only decay products which come out inside the
+spectrograph acceptance (a cone around the spectrograph angle) count.
+
+Sampling is importance weighted rather than thrown and cut, since only a tiny fraction of all decays would make it into the
+acceptance: reaction angles are only drawn from the range where the unbound state can send its product into the acceptance,
+and the product's direction is drawn inside the acceptance, with its momentum solved for and weighted by the decay's lab to
+rest frame solid angle ratio. Loci are sampled in batches, spread over the thread pool, and every batch has its own fixed seed,
+so the result doesn't depend on the number of threads.
+
+Momenta rather than rhos are kept, so that a change of field is just a rescale.
+
+The decays and the sampling are given in the input file by their own keywords (DECAY and LOCUSSAMPLING), read and written here.
+*/
+#ifndef DECAYSAMPLER_H
+#define DECAYSAMPLER_H
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include "Reaction.h"
+
+struct DecayLocus {
+	int rxnIndex;
+	DecayChannel channel;
+	double efficiency; //fraction of decays with the detected product inside the acceptance
+	std::vector<double> momenta; //MeV/c, sorted
+	std::vector<double> weights; //parallel to momenta
+	double pLow, pPeak, pHigh; //5%, most likely, and 95% momenta; 0 if nothing reached the acceptance
+};
+
+class DecaySampler {
+public:
+	DecaySampler();
+	~DecaySampler();
+
+	void SetAcceptance(double halfAngle) { m_acceptance = halfAngle; }; //deg
+	void SetNSamples(int nSamples) { m_nSamples = nSamples; }; //per locus
+	std::vector<DecayLocus> Sample(const std::vector<Reaction>& reactions, double beamKE, double theta) const;
+
+	bool ReadConfigLine(const std::string& keyword, std::istream& row, bool& parsed);
+	void AttachDecays(std::vector<Reaction>& reactions);
+	void WriteConfig(std::ostream& output, const std::vector<Reaction>& reactions) const;
+	void ClearConfig();
+
+	static double MomentumToRho(double p, int Z, double B);
+
+private:
+	double m_acceptance;
+	int m_nSamples;
+	std::vector<std::pair<std::string, DecayChannel>> m_pending; //read, but not yet attached: reaction name, decay
+
+	static constexpr double DEFAULT_ACCEPTANCE = 2.0;
+	static constexpr int DEFAULT_SAMPLES = 20000;
+
+	static constexpr int BATCH_SIZE = 4096;
+	static constexpr int ANGLE_BINS = 512; //in cos of the reaction angle, for picking the range worth sampling
+	static constexpr int PEAK_BINS = 200;
+};
+
+#endif
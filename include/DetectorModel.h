@@ -0,0 +1,71 @@
+/*
+
+DetectorModel.h
+Layers of the focal plane detector, in the order the ejectile goes through them (windows, gas sections, the stopping
+scintillator), and the stopping tables needed to slow ejectiles down through them. Gives the energy each ejectile leaves in
+every layer; the read out (active) layers are what the particle ID (dE vs. E) plots are made from.
+
+Tables are kept per element and material. An isotope other than the one tabulated is scaled at the same velocity
+(S(E) of A' is S(E*A/A') of A), so a single table per element covers all of its isotopes.
+
+The detector is given in the input file by its own keywords (DETECTOR, STOPPING and PID), read and written here.
+*/
+#ifndef DETECTORMODEL_H
+#define DETECTORMODEL_H
+
+#include <vector>
+#include <string>
+#include <map>
+#include <iostream>
+#include "StoppingTable.h"
+
+struct DetectorLayer {
+	std::string name;
+	std::string material;
+	double thickness; //mg/cm^2
+	bool active; //read out; inactive layers (windows, dead gas) only slow the ejectile down
+};
+
+/*Where a stopping table came from, as given in the input file*/
+struct StoppingSource {
+	int A, Z; //ion the table is for
+	std::string material;
+	std::string filename;
+};
+
+class DetectorModel {
+public:
+	DetectorModel();
+	~DetectorModel();
+
+	void AddLayer(const DetectorLayer& layer);
+	bool AddTable(const StoppingSource& source);
+	void SetPIDLayers(const std::string& dELayer, const std::string& ELayer);
+	void Clear();
+
+	bool ReadConfigLine(const std::string& keyword, std::istream& row, bool& parsed);
+	void WriteConfig(std::ostream& output) const;
+
+	bool inline IsEmpty() const { return m_layers.empty(); };
+	int inline GetNLayers() const { return m_layers.size(); };
+	const DetectorLayer& GetLayer(int index) const { return m_layers[index]; };
+	int FindLayer(const std::string& name) const;
+
+	bool CanStop(int Z) const;
+	void Deposit(int A, int Z, const double* ke, int n, double* deposits) const;
+
+	bool FindPIDLayers(int& dELayer, int& ELayer) const;
+	int GetPIDPoints(int A, int Z, const std::vector<double>& ke, int dELayer, int ELayer, std::vector<double>& E, std::vector<double>& dE) const;
+
+private:
+	const StoppingTable* FindTable(int Z, const std::string& material, int& tableA) const;
+
+	std::vector<DetectorLayer> m_layers;
+	std::vector<StoppingSource> m_sources;
+	std::map<std::pair<int, std::string>, std::pair<int, StoppingTable>> m_tables; //(Z, material) -> (A, table)
+	std::string m_pidDE, m_pidE; //layers of the particle ID plot; empty for the first and last active layers
+
+	static constexpr int BLOCK_SIZE = 1024; //ejectiles per work item
+};
+
+#endif
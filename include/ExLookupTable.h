@@ -0,0 +1,51 @@
+/*
+
+ExLookupTable.h
+Precomputed rho -> Ex table for one reaction at one setting, for converting large numbers of focal plane events. The table is
+uniform in rho, so a conversion is an index and a linear interpolation, with no square roots. Points are taken from the exact
+inverse (Reaction::CalculateExcitation), and the table is made fine enough that interpolating never misses the exact value by
+more than the requested tolerance (checked at the middle of every interval, where the error of a smooth curve peaks).
+
+Ex has to fall monotonically with rho over the table, which holds for forward angles; Build fails otherwise. Events outside of
+the table (or NaN) convert to NaN.
+*/
+#ifndef EXLOOKUPTABLE_H
+#define EXLOOKUPTABLE_H
+
+#include <vector>
+#include <limits>
+#include "Reaction.h"
+
+class ExLookupTable {
+public:
+	ExLookupTable();
+	~ExLookupTable();
+
+	bool Build(const Reaction& rxn, double beamKE, double theta, double B, double exMin, double exMax, double tolerance);
+
+	inline double Convert(double rho) const {
+		double u = (rho - m_rhoMin)*m_invStep;
+		if(!(u >= 0.0 && u <= m_nIntervals)) return std::numeric_limits<double>::quiet_NaN(); //also catches NaN
+		int i = (int)u;
+		if(i == m_nIntervals) i--;
+		return m_ex[i] + (u - i)*(m_ex[i+1] - m_ex[i]);
+	}
+	void Convert(const double* rho, double* ex, int n) const;
+
+	bool inline IsValid() const { return m_nIntervals > 0; };
+	double inline GetRhoMin() const { return m_rhoMin; };
+	double inline GetRhoMax() const { return m_rhoMin + m_nIntervals/m_invStep; };
+	int inline GetNPoints() const { return m_ex.size(); };
+	double inline GetMaxError() const { return m_maxError; }; //MeV, largest midpoint error of the table
+
+private:
+	std::vector<double> m_ex; //at m_rhoMin + i/m_invStep
+	double m_rhoMin, m_invStep;
+	int m_nIntervals;
+	double m_maxError;
+
+	static constexpr int MIN_POINTS = 257;
+	static constexpr int MAX_POINTS = (1<<22) + 1;
+};
+
+#endif
@@ -1,10 +1,20 @@
-
 /*
 
 ExTable.h
-Generates a map for nuclear excitation energies; fed from a file titled excitations.dat in the dir /data/. Creates a static global instance
+Generates a map for nuclear excitation energies; fed from a file titled excitations.dat in the dir /data/. Creates a global instance
 of this map (EX) for use throughout code it is included into (i.e. its a singleton, but gave the option for it to not be)
 
+Levels can additionally be imported from ENSDF formated level schemes. Levels are held in a single flat store (one compact record per
+level, with labels and J-pi strings pooled), and each nuclide maps to a contiguous range of that store, so lookups stay constant time
+and memory stays small even with every known nuclide loaded.
+
+Individual levels can be overriden (or added) in named layers on top of the table, e.g. to try out a new measurement; a layer
+level replaces the table level with the same label. Layers are applied at lookup, in the order they were made, and can be
+switched on and off without touching the table.
+
+Lookups may be made from any number of threads at once; loading and editing the table waits for them, and lookups wait for it
+(see ReadWriteLock.h).
+
 Written by G.W. McCann Sep. 2020
 
 */
@@ -14,24 +24,80 @@ Written by G.W. McCann Sep. 2020
 #include <unordered_map>
 #include <string>
 #include <vector>
+#include <cstdint>
+#include "ReadWriteLock.h"
 
 struct ExData {
 	std::vector<double> ex_list;
 	std::vector<std::string> str_list;
+	std::vector<double> unc_list; //MeV; 0 if unknown
+	std::vector<std::string> jpi_list;
+};
+
+/*Compact per-level record; strings are held in the shared pools of the table*/
+struct LevelRecord {
+	double energy; //MeV
+	float uncertainty; //MeV
+	uint32_t label; //offset into the label pool
+	uint16_t jpi; //index into the J-pi pool
+	uint8_t labelLength;
+};
+
+struct LevelRange {
+	uint32_t first;
+	uint32_t count;
+};
+
+/*A single level of an override layer*/
+struct LevelOverride {
+	std::string nuclide;
+	std::string label; //replaces the table level with this label, else is added
+	double energy, uncertainty; //MeV
+};
+
+struct LevelLayer {
+	std::string name;
+	bool enabled;
+	std::vector<LevelOverride> levels;
 };
 
 class ExTable {
 public:
 	ExTable();
 	~ExTable();
-	std::vector<double> GetListOfExcitations(std::string& name);
-	std::vector<std::string> GetListOfExcitations_Strings(std::string& element);
+	std::vector<double> GetListOfExcitations(std::string& name) const;
+	std::vector<std::string> GetListOfExcitations_Strings(std::string& element) const;
+	bool GetLevels(const std::string& name, ExData& data) const;
+	bool ReadFile(const std::string& filename);
+	bool ImportENSDF(const std::string& filename);
+	void SetLevels(const std::string& name, const ExData& data);
+	void RemoveNuclide(const std::string& name);
+	void SetLevelOverride(const std::string& layer, const LevelOverride& level);
+	bool SetLayerEnabled(const std::string& layer, bool enabled);
+	bool IsLayerEnabled(const std::string& layer) const;
+	void ClearLayers();
+	std::vector<std::string> GetLayers() const;
+	std::vector<std::string> GetLayerNuclides(const std::string& layer) const;
+	int inline GetNNuclides() const { ReadGuard guard(lock); return table.size(); };
+	size_t inline GetNLevels() const { ReadGuard guard(lock); return levels.size() - garbage; };
 
 private:
-	std::unordered_map<std::string, ExData> table;
+	void SetNuclide(const std::string& name, const std::vector<LevelRecord>& nuclide_levels);
+	LevelRecord MakeRecord(double energy, double uncertainty, const std::string& label, const std::string& jpi);
+	std::string GetLabel(const LevelRecord& level) const;
+	void Compact();
+
+	std::unordered_map<std::string, LevelRange> table;
+	std::vector<LevelRecord> levels;
+	std::string labelPool;
+	std::vector<std::string> jpiPool;
+	std::unordered_map<std::string, uint16_t> jpiIndex;
+	size_t garbage; //number of levels in the store which were replaced
+	std::vector<LevelLayer> layers;
+	mutable ReadWriteLock lock; //lookups are shared, anything which changes the table is exclusive
 
 };
 
-//static global instance
-static ExTable EX;
-#endif
\ No newline at end of file
+//global instance
+extern ExTable EX;
+#endif
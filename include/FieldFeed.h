@@ -0,0 +1,56 @@
+/*
+
+FieldFeed.h
+Live readout of the spectrograph field, from either a file which the NMR logger appends to or a UNIX socket it writes to.
+Every line is one reading, and the field (kG) is the last number on the line, so both bare values and timestamped lines work.
+Readings are taken on a background thread; the owner only ever asks for the latest one, so any number of readings between two
+redraws collapse into a single update.
+
+Linux only; elsewhere Start() reports that the feed is unavailable.
+*/
+#ifndef FIELDFEED_H
+#define FIELDFEED_H
+
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+class FieldFeed {
+public:
+	FieldFeed();
+	~FieldFeed();
+
+	bool Start(const std::string& source);
+	void Stop();
+	bool inline IsRunning() const { return m_running; };
+	bool TakeField(double& B);
+	uint64_t inline GetNReadings() const { return m_nReadings; };
+
+private:
+	bool Open();
+	void Run();
+	void TailFile();
+	void ReadSocket();
+	void Consume(const char* data, size_t length);
+	static bool ParseReading(const std::string& line, double& B);
+
+	std::string m_source;
+	bool m_socket; //false=file
+	int m_fd;
+	std::thread m_thread;
+	std::atomic<bool> m_running;
+	std::atomic<uint64_t> m_nReadings;
+	std::string m_partial; //incomplete last line; only touched by the feed thread
+
+	std::mutex m_mutex;
+	double m_latest; //guarded by m_mutex
+	bool m_fresh; //guarded by m_mutex
+
+	static constexpr int TAIL_MS = 5; //how long to wait when the file has no new readings
+	static constexpr int POLL_MS = 250; //how often a quiet socket checks whether it should stop
+	static constexpr int RECONNECT_MS = 1000;
+};
+
+#endif
@@ -0,0 +1,62 @@
+/*
+
+FieldOptimizer.h
+Searches for SPS field and angle settings which place a set of wanted states on the focal plane detector
+(within [rhoMin, rhoMax]) while keeping lines from contaminant reactions at least a minimum distance away.
+Since rho goes exactly as 1/B, only the angle requires evaluating the kinematics; for each angle the allowed
+field values are found analytically as intervals, and the intervals are swept to find the best settings.
+*/
+#ifndef FIELDOPTIMIZER_H
+#define FIELDOPTIMIZER_H
+
+#include <vector>
+#include "Reaction.h"
+#include "LineStore.h"
+
+/*State which must land on the detector; rxnIndex refers to the reaction list being optimized*/
+struct WantedState {
+	int rxnIndex;
+	double excitation;
+};
+
+struct FieldSolution {
+	double theta; //deg
+	double B; //kG
+	double score; //cm; smallest distance from a wanted line to a detector edge or an on-detector contaminant line
+};
+
+/*Request as passed from the gui*/
+struct OptimizerRequest {
+	std::vector<WantedState> wanted;
+	std::vector<int> unwanted; //indices of contaminant reactions
+	double minSeparation; //cm
+	double thetaMin, thetaMax, thetaStep; //deg
+};
+
+class FieldOptimizer {
+public:
+	FieldOptimizer();
+	~FieldOptimizer();
+
+	void SetDetectorRange(double rhoMin, double rhoMax);
+	void SetFieldRange(double Bmin, double Bmax);
+	void SetAngleRange(double thetaMin, double thetaMax, double thetaStep);
+	void SetMinimumSeparation(double sep);
+
+	std::vector<FieldSolution> Optimize(const std::vector<Reaction>& reactions, const LineStore& lines, double beamKE,
+										const std::vector<WantedState>& wanted, const std::vector<int>& unwanted, int nResults);
+
+private:
+	void EvaluateAngle(const std::vector<Reaction>& reactions, const LineStore& lines, double beamKE, double theta,
+					   const std::vector<WantedState>& wanted, const std::vector<int>& unwanted, std::vector<FieldSolution>& solutions);
+	double Score(double B, const std::vector<double>& wantedK, const std::vector<double>& contamK);
+
+	double m_rhoMin, m_rhoMax;
+	double m_Bmin, m_Bmax;
+	double m_thetaMin, m_thetaMax, m_thetaStep;
+	double m_minSep;
+
+	static constexpr double DEG2RAD = 3.14159265358979323846/180.0;
+};
+
+#endif
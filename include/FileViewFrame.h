@@ -40,6 +40,7 @@ private:
 	TGTextEntry *fNameField;
 	TGFileContainer *fContents;
 	TGListView *fViewer;
+	TString fExtension; //extension of selectable files
 
 };
 
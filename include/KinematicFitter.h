@@ -0,0 +1,69 @@
+/*
+
+KinematicFitter.h
+Least-squares fit of the SPS parameters (beam KE, angle, field) and the linear mapping from measured focal plane position to
+rho (rho = offset + slope*x), to a set of peaks with identified states. Residuals are taken in position, where the model is
+x = (rho(Ex; beamKE, theta, B) - offset)/slope; in rho the fit could shrink every residual by rescaling the mapping and the
+field together. That rescaling is still a true degeneracy of the data, so the kinematic parameters enter with gaussian priors
+(their nominal values and uncertainties, i.e. the UNCERTAINTY keyword); a parameter with no uncertainty is held fixed.
+
+Minimization is Levenberg-Marquardt with the analytic Jacobian from Reaction::CalculateRhoWithDerivatives. With at most five
+parameters each iteration is a handful of kinematics evaluations and a 5x5 solve, so a fit takes well under a millisecond.
+*/
+#ifndef KINEMATICFITTER_H
+#define KINEMATICFITTER_H
+
+#include <vector>
+#include "Reaction.h"
+
+/*A measured peak identified as a state of one of the reactions*/
+struct FitPoint {
+	int rxnIndex;
+	double ex, exSigma; //MeV
+	double position, positionSigma; //focal plane axis
+};
+
+struct FitParameters {
+	double beamKE; //MeV
+	double theta; //deg
+	double B; //kG
+	double offset; //cm
+	double slope; //cm per position unit
+};
+
+struct FitResult {
+	FitParameters values;
+	FitParameters errors; //0 for fixed parameters
+	double covariance[5][5]; //in FitParameters order; fixed parameters have zero rows and columns
+	double chi2;
+	int ndf;
+	int iterations;
+	bool converged;
+};
+
+class KinematicFitter {
+public:
+	KinematicFitter();
+	~KinematicFitter();
+
+	void inline SetInitial(const FitParameters& initial) { m_initial = initial; };
+	void SetPriors(double beamKESigma, double thetaSigma, double BSigma);
+	void inline SetCalibrationFixed(bool fixed) { m_fixCalibration = fixed; };
+
+	bool Fit(const std::vector<Reaction>& reactions, const std::vector<FitPoint>& points, FitResult& result) const;
+
+	static const int NPARS = 5;
+
+private:
+	double Evaluate(const std::vector<Reaction>& reactions, const std::vector<FitPoint>& points, const double* pars,
+					const std::vector<int>& free, std::vector<double>& residuals, std::vector<double>& jacobian) const;
+
+	FitParameters m_initial;
+	double m_priorSigma[3]; //beamKE, theta, B; 0 is fixed
+	bool m_fixCalibration;
+	int m_maxIterations;
+
+	static constexpr double DEG2RAD = 3.14159265358979323846/180.0;
+};
+
+#endif
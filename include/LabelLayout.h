@@ -0,0 +1,47 @@
+/*
+
+LabelLayout.h
+Screen space placement of the excitation labels. The plot frame is divided into a grid of square buckets (one label
+height on a side), and each placed label is recorded in every bucket it covers. A new label is checked only against
+the labels in its own buckets; if it collides it is staggered upwards by whole label heights, and if no free row is
+found before the next reaction it is dropped. Labels outside of the visible range are culled before any work is done,
+so the number of labels made is bounded by the frame area no matter how dense the level scheme is.
+*/
+#ifndef LABELLAYOUT_H
+#define LABELLAYOUT_H
+
+#include <vector>
+
+class LabelLayout {
+public:
+	LabelLayout();
+	~LabelLayout();
+
+	void SetFrame(double xmin, double xmax, double ymin, double ymax, double widthPx, double heightPx, double textHeightPx);
+	void Clear();
+	bool Place(double x, double y, double yLimit, int nChars, double& labelY);
+	int inline GetNPlaced() { return m_boxes.size(); };
+
+	static const int MAX_ROWS = 3; //staggered rows tried before a label is dropped
+
+private:
+	struct Box {
+		double x1, y1, x2, y2; //px
+	};
+
+	bool Collides(const Box& box) const;
+	void Insert(const Box& box);
+	int inline CellX(double px) const { return px < 0 ? 0 : (px >= m_widthPx ? m_nx-1 : (int)(px/m_cellSize)); };
+	int inline CellY(double py) const { return py < 0 ? 0 : (py >= m_heightPx ? m_ny-1 : (int)(py/m_cellSize)); };
+
+	double m_xmin, m_xmax, m_ymin, m_ymax;
+	double m_widthPx, m_heightPx;
+	double m_textHeight, m_charWidth; //px
+	double m_cellSize; //px
+	int m_nx, m_ny;
+
+	std::vector<Box> m_boxes;
+	std::vector<std::vector<int>> m_cells; //indices into m_boxes, row major
+};
+
+#endif
@@ -0,0 +1,29 @@
+/*
+
+LineAssigner.h
+Optimal, order-preserving assignment of found peaks to predicted lines. Both lists are sorted by position, and an assignment
+is a set of (peak, line) pairs which never cross (if peak a is left of peak b, so is its line). Among those, the one with the
+lowest total cost is found by dynamic programming over (peaks x lines), like a sequence alignment: a pair costs its squared
+residual in units of the tolerance, a peak left without a line costs a fixed penalty (the square of the gate), and an
+unobserved line is free, since most predicted states are weak or off the detector.
+*/
+#ifndef LINEASSIGNER_H
+#define LINEASSIGNER_H
+
+#include <vector>
+
+class LineAssigner {
+public:
+	LineAssigner();
+	~LineAssigner();
+
+	void inline SetTolerance(double tolerance) { m_tolerance = tolerance; }; //residual scale, same units as positions
+	void inline SetGate(double nTolerance) { m_gate = nTolerance; }; //largest allowed residual, in tolerances
+
+	std::vector<int> Assign(const std::vector<double>& peaks, const std::vector<double>& lines, const std::vector<double>* lineSigmas = nullptr) const;
+
+private:
+	double m_tolerance, m_gate;
+};
+
+#endif
@@ -0,0 +1,40 @@
+/*
+
+LinePublisher.h
+Writer side of the shared memory line table (layout in SPSLineShm.h). Owns a POSIX shared memory segment, and replaces its
+contents under the sequence lock on every Publish(), growing the segment if the lines no longer fit. Readers in other
+processes never block the writer, and vice versa.
+
+Linux only; elsewhere Open() reports that publishing is unavailable.
+*/
+#ifndef LINEPUBLISHER_H
+#define LINEPUBLISHER_H
+
+#include <string>
+#include <vector>
+#include "SPSLineShm.h"
+
+class LinePublisher {
+public:
+	LinePublisher();
+	~LinePublisher();
+
+	bool Open(const std::string& name, uint32_t capacity);
+	void Close();
+	bool inline IsOpen() const { return m_header != nullptr; };
+	const std::string& GetName() const { return m_name; };
+
+	bool Publish(const sps_shm_header& parameters, const std::vector<sps_shm_line>& lines);
+
+private:
+	bool Map(uint32_t capacity);
+
+	std::string m_name;
+	int m_fd;
+	sps_shm_header* m_header; //start of the mapping
+	uint32_t m_capacity; //of the current mapping
+
+	static constexpr uint32_t DEFAULT_CAPACITY = 1024;
+};
+
+#endif
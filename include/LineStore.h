@@ -0,0 +1,90 @@
+/*
+
+LineStore.h
+Every line (level of the residual) of every reaction, in flat columns: Ex, its uncertainty, the label, and the reaction, then
+rho and its uncertainty at the primary setting. The lines of reaction r are [GetBegin(r), GetEnd(r)), in increasing Ex. Labels
+are stored once, as ids into a shared table, since most of them ("0.0", "1.234", ...) repeat between reactions.
+
+Only the lines which can land in the rho window are evaluated: rho falls with Ex, so the window edges map to an Ex interval,
+whose lines are a contiguous slice [GetSliceBegin(r), GetSliceEnd(r)) of the reaction's lines. The slice can be widened by a
+relative field margin, so the field can drift that far and be followed by rescaling alone. Lines outside of their slice have
+a NaN rho.
+
+Calculations are spread over the thread pool, one reaction per item, and write only their own reaction's part of the columns,
+so nothing is allocated per reaction once the levels are in.
+*/
+#ifndef LINESTORE_H
+#define LINESTORE_H
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include "Reaction.h"
+
+class LineStore {
+public:
+	LineStore();
+	~LineStore();
+
+	static bool ReadLevels(const std::string& nuclide, std::vector<double>& ex, std::vector<double>& sigma, std::vector<std::string>& labels);
+
+	void Build(const std::vector<Reaction>& reactions, const std::vector<char>* which=nullptr);
+	void Refresh(const std::vector<Reaction>& reactions, const std::vector<char>& changed);
+	bool Relayout(std::vector<double>& column) const;
+	void Clear();
+
+	bool SetWindow(double rhoMin, double rhoMax, double fieldMargin);
+	void SetUncertainties(double beamKESigma, double thetaSigma, double BSigma);
+	void Calculate(const std::vector<Reaction>& reactions, double beamKE, double theta, double B);
+	void Calculate(const std::vector<Reaction>& reactions, const std::vector<int>& which);
+	int Rescale(const std::vector<Reaction>& reactions, double B);
+	void CalculateMomenta(const Reaction& rxn, int rxnIndex, double beamKE, double theta, double* momenta) const;
+
+	int FindLabel(int rxnIndex, const std::string& label) const;
+
+	int inline GetNReactions() const { return (int)m_offsets.size() - 1; };
+	int inline GetNLines() const { return m_ex.size(); };
+	int inline GetBegin(int rxnIndex) const { return m_offsets[rxnIndex]; };
+	int inline GetEnd(int rxnIndex) const { return m_offsets[rxnIndex+1]; };
+	int inline GetSliceBegin(int rxnIndex) const { return m_sliceBegin[rxnIndex]; };
+	int inline GetSliceEnd(int rxnIndex) const { return m_sliceEnd[rxnIndex]; };
+
+	const double* GetEx() const { return m_ex.data(); };
+	const double* GetExSigma() const { return m_exSigma.data(); };
+	const double* GetRho() const { return m_rho.data(); };
+	const double* GetRhoSigma() const { return m_rhoSigma.data(); };
+	const int* GetReaction() const { return m_rxn.data(); };
+	const int* GetLabelId() const { return m_label.data(); };
+	const std::string& GetLabel(int line) const { return m_labels[m_label[line]]; };
+
+private:
+	int Intern(const std::string& label);
+	void Assemble(int nReactions, const std::vector<char>& fresh, std::vector<std::vector<double>>& exs,
+				  std::vector<std::vector<double>>& sigmas, std::vector<std::vector<std::string>>& labels);
+	void CalculateReaction(const Reaction& rxn, int rxnIndex);
+
+	//Columns, one entry per line
+	std::vector<double> m_ex, m_exSigma; //MeV
+	std::vector<int> m_label; //into m_labels
+	std::vector<int> m_rxn;
+	std::vector<double> m_rho, m_rhoSigma; //cm; NaN outside of the slice
+
+	//Per reaction
+	std::vector<int> m_offsets; //nReactions+1
+	std::vector<int> m_previousOffsets; //before the last Refresh, for Relayout
+	std::vector<char> m_refreshed; //by the last Refresh
+	std::vector<int> m_sliceBegin, m_sliceEnd;
+
+	std::vector<std::string> m_labels;
+	std::unordered_map<std::string, int> m_labelIds;
+
+	//Primary setting
+	double m_beamKE, m_theta, m_B; //MeV, rad, kG
+	double m_beamKESigma, m_thetaSigma, m_BSigma; //MeV, rad, kG
+	double m_rhoMin, m_rhoMax;
+	double m_fieldMargin;
+	double m_sliceB; //field the slices were found at
+	bool m_kinematicsSet;
+};
+
+#endif
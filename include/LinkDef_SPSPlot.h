@@ -3,5 +3,7 @@
 #pragma link C++ class SPSPlotMainFrame+;
 #pragma link C++ class FileViewFrame+;
 #pragma link C++ class ReactionCreationFrame+;
+#pragma link C++ class OptimizerFrame+;
+#pragma link C++ class CurveOptionsFrame+;
 
 #endif
\ No newline at end of file
@@ -2,9 +2,21 @@
 
 MassLookup.h
 Generates a map for isotopic masses using AMDC data; subtracts away
-electron mass from the atomic mass by default. Creates a static global instance
+electron mass from the atomic mass by default. Creates a global instance
 of this map (MASS) for use throughout code it is included into.
 
+Either the preformated mass.txt or an official AME mass table (AME2016 or
+AME2020 fixed width format) can be read; the format is detected from the file.
+
+Several evaluations can be loaded side by side under their own names (data/mass.txt
+is "default"), with one of them active. On top of the active evaluation sit named
+override layers, each holding a handful of masses (i.e. a new measurement); lookups
+go through the enabled layers, newest first, before falling back to the evaluation,
+so nothing is ever copied.
+
+Lookups may be made from any number of threads at once; loading and editing the
+tables waits for them, and lookups wait for it (see ReadWriteLock.h).
+
 Written by G.W. McCann Aug. 2020
 
 */
@@ -15,21 +27,67 @@ Written by G.W. McCann Aug. 2020
 #include <fstream>
 #include <string>
 #include <unordered_map>
+#include <vector>
 #include <stdexcept>
+#include "ReadWriteLock.h"
 
 using namespace std;
 
+/*A single parsed line of a mass file*/
+struct MassEntry {
+  int Z, A;
+  string element;
+  double mass, uncertainty; //MeV, nuclear
+  bool estimated;
+};
+
+struct MassRecord {
+  double mass, uncertainty; //MeV, nuclear
+  bool estimated;
+};
+
+struct MassLayer {
+  string name;
+  bool enabled;
+  unordered_map<string, MassRecord> masses;
+};
+
 class MassLookup {
 
   public:
     MassLookup();
     ~MassLookup();
-    double FindMass(int Z, int A);
-    string FindElement(int Z);
+    bool ReadFile(const string& filename);
+    bool ReadFile(const string& filename, const string& evaluation);
+    bool SelectEvaluation(const string& evaluation);
+    const string& GetEvaluation() const { return activeName; };
+    bool HasEvaluation(const string& evaluation) const { ReadGuard guard(lock); return evaluations.count(evaluation) > 0; };
+    void SetOverride(const string& layer, int Z, int A, double excess, double uncertainty);
+    bool SetLayerEnabled(const string& layer, bool enabled);
+    bool IsLayerEnabled(const string& layer) const;
+    void ClearLayers();
+    vector<string> GetLayers() const;
+    double FindMass(int Z, int A) const;
+    double FindMassUncertainty(int Z, int A) const;
+    bool IsExtrapolated(int Z, int A) const;
+    string FindElement(int Z) const;
+    void SetMass(const string& evaluation, const MassEntry& entry);
+    static bool ParseLine(const string& line, bool ameFormat, MassEntry& entry);
 
   private:
-    unordered_map<string, double> massTable;
+    bool Load(const string& filename);
+    void Insert(unordered_map<string, MassRecord>& table, const MassEntry& entry);
+    bool ReadPreformatedFile(ifstream& massfile);
+    bool ReadAMEFile(ifstream& massfile);
+    const MassRecord* Find(const string& key) const;
+    static MassRecord MakeRecord(const MassEntry& entry);
+
+    unordered_map<string, unordered_map<string, MassRecord>> evaluations; //uncertainties only available from AME files
+    unordered_map<string, MassRecord>* active; //one of evaluations
+    string activeName;
+    vector<MassLayer> layers; //lookup order is back to front
     unordered_map<int, string> elementTable;
+    mutable ReadWriteLock lock; //lookups are shared, anything which changes the tables is exclusive
 
     //constants
     static constexpr double u_to_mev = 931.4940954;
@@ -37,6 +95,6 @@ class MassLookup {
     
 };
 
-//static instance for use throught program
-static MassLookup MASS;
+//global instance for use throught program
+extern MassLookup MASS;
 #endif
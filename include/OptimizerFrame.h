@@ -0,0 +1,42 @@
+/*
+
+	OptimizerFrame.h
+	Wrapper class on a TGTransientFrame (temporary frame assoc. with a main frame)
+	User specifies the states which should land on the detector, the contaminant reactions, and the search range.
+	The request is sent as a signal back to the main frame, which runs the field optimizer.
+*/
+
+#ifndef OPTIMIZERFRAME_H
+#define OPTIMIZERFRAME_H
+
+#include "SPSPlotMainFrame.h"
+#include "FieldOptimizer.h"
+#include <TGNumberEntry.h>
+#include <TGTextEntry.h>
+#include <TQObject.h>
+#include <RQ_OBJECT.h>
+
+class OptimizerFrame {
+
+	RQ_OBJECT("OptimizerFrame"); //ROOT wrapping into gui environment
+public:
+	OptimizerFrame(const TGWindow *p, const TGWindow *main, UInt_t w, UInt_t h, SPSPlotMainFrame *parent);
+	virtual ~OptimizerFrame();
+	void CloseWindow();
+	void DoOk();
+	void DoCancel();
+	void SendRequest(OptimizerRequest* request); // *SIGNAL*
+	ClassDef(OptimizerFrame, 0); //ROOT requirements
+
+private:
+	bool ParseWanted(const char* text);
+	bool ParseUnwanted(const char* text);
+
+	OptimizerRequest request;
+	TGTransientFrame *fMain;
+	TGTextButton *fOkButton, *fCancelButton;
+	TGTextEntry *fWantedField, *fUnwantedField;
+	TGNumberEntryField *fSepField, *fTMinField, *fTMaxField, *fTStepField;
+};
+
+#endif
@@ -0,0 +1,23 @@
+/*
+
+ParallelFor.h
+Small helper for spreading independent work items over the available hardware threads. Callers write results into
+pre-sized storage indexed by the item, so each item is only ever touched by one thread and the output ordering is
+deterministic, whichever thread ends up doing it.
+
+The threads are made once and kept in a pool. Every call splits the items into one contiguous range per thread (the caller
+is one of them); a thread works through its own range from the front, and once it is empty steals the back half of another
+thread's range. So reactions with many levels, or settings needing new momenta, don't leave the other threads idle behind
+the slowest range. Ranges are a packed (begin, end) pair in one atomic word, so taking and stealing never lock.
+
+The pool runs one call at a time: a call made from inside a work item, or while another thread's call is running, is just
+done serially by its caller.
+*/
+#ifndef PARALLELFOR_H
+#define PARALLELFOR_H
+
+#include <functional>
+
+void ParallelFor(int nItems, const std::function<void(int)>& func);
+
+#endif
@@ -0,0 +1,38 @@
+/*
+
+PeakFinder.h
+Locates peaks in a measured focal plane spectrum. Works on plain arrays of bin centers and counts (no ROOT), in a single
+linear pass: the spectrum is smoothed with two passes of a running box sum (roughly a gaussian of the expected peak width),
+local maxima of the smoothed spectrum are tested against a local background taken from the smoothed spectrum a few widths
+to either side, and accepted peaks get a background subtracted centroid and area from the raw counts.
+*/
+#ifndef PEAKFINDER_H
+#define PEAKFINDER_H
+
+#include <vector>
+
+struct Peak {
+	double centroid; //same units as the bin centers
+	double height; //smoothed counts at the maximum (including background)
+	double background; //smoothed counts per bin under the peak
+	double area; //background subtracted counts
+};
+
+class PeakFinder {
+public:
+	PeakFinder();
+	~PeakFinder();
+
+	void inline SetSigma(double sigma) { m_sigma = sigma; }; //expected peak sigma, in bins
+	void inline SetThreshold(double nSigma) { m_threshold = nSigma; }; //required significance over background
+	void inline SetMinimumArea(double area) { m_minArea = area; };
+
+	std::vector<Peak> Search(const std::vector<double>& centers, const std::vector<double>& counts) const;
+
+private:
+	void Smooth(const std::vector<double>& counts, int halfWidth, std::vector<double>& smoothed) const;
+
+	double m_sigma, m_threshold, m_minArea;
+};
+
+#endif
@@ -14,13 +14,15 @@ Written by G.W. McCann Aug. 2020
 
 Modified Sep 2020 by G.W. McCann
 
+Levels, and their rhos at the primary setting, are kept for every reaction together in a LineStore; a Reaction is just the
+nuclei and the kinematics.
+
 */
 #ifndef REACTION_H
 #define REACTION_H
 
-#include <TROOT.h>
-#include <TMath.h>
 #include <iostream>
+#include <cmath>
 #include <string>
 #include <vector>
 #include "MassLookup.h"
@@ -32,44 +34,64 @@ struct nucleus {
   double p;
   int A, Z;
   double mass_gs;
+  double mass_unc;
   std::string sym;
 };
 
+/*Partial derivatives of rho (cm) with respect to each input of the kinematics*/
+struct RhoDerivatives {
+  double dEx; //cm/MeV
+  double dBeamKE; //cm/MeV
+  double dTheta; //cm/rad
+  double dB; //cm/kG
+  double dMass[4]; //cm/MeV; target, projectile, ejectile, residual
+};
+
+/*
+  A particle-unbound state which decays in flight, and the decay product which reaches the focal plane: either the residual
+  (sequential decay) or the ejectile (breakup) is made in the state, which then splits in two. See DecaySampler
+*/
+struct DecayChannel {
+  enum Parent { RESIDUAL, EJECTILE };
+  Parent parent;
+  double ex, width; //MeV, of the unbound state; a width of 0 is a sharp state
+  int A, Z; //detected decay product; the other is whatever is left
+};
+
 class Reaction {
   
   public:
     Reaction();
     ~Reaction();
     void SetReactionData(int At, int Zt, int Ap, int Zp, int Ae, int Ze);
-    void SetKinematicParams(double beamKE, double lab_angle, double mag_field);
-    vector<double>* GetRhos();
-    vector<double>* GetExs();
-    vector<std::string>* GetEx_Strings();
-    const nucleus& GetTarget();
-    const nucleus& GetProjectile();
-    const nucleus& GetEjectile();
-    const nucleus& GetResidual();
-    double GetAngle();
-    double GetBfield();
-    double GetBeamKE();
-    std::string& GetName();
+    bool UpdateMasses();
+    double CalculateEjectileP(double excitation, double beamKE, double theta_rad) const;
+    void CalculateMomentumGrid(double beamKE, const std::vector<double>& exs, const std::vector<double>& angles, std::vector<double>& p_grid) const;
+    double MomentumToRho(double p, double mag_field) const;
+    double CalculateRhoWithDerivatives(double excitation, double beamKE, double theta_rad, double mag_field, RhoDerivatives& derivs) const;
+    double CalculateExcitation(double rho, double beamKE, double theta_rad, double mag_field) const;
+    const nucleus& GetTarget() const;
+    const nucleus& GetProjectile() const;
+    const nucleus& GetEjectile() const;
+    const nucleus& GetResidual() const;
+    const std::string& GetName() const;
+    bool inline IsInitialized() const { return target_initialized; };
+    void AddDecay(const DecayChannel& decay);
+    void inline ClearDecays() { decays.clear(); };
+    const vector<DecayChannel>& GetDecays() const { return decays; };
+
+    static constexpr double C = 299792458;
+    static constexpr double QBRHO2P = 1.0E-9*C; //converts QBrho to momentum (cm*kG -> MeV/c)
 
   private:
-    void SetExcitations();
-    double CalculateRho(double excitation);
-    void CalculateRhos();
+    double EjectilePFromRS(double r, double s) const;
     nucleus target, projectile, ejectile, residual;
-    double theta, B, beamE;
     std::string name;
-    vector<double> excitations;
-    vector<std::string> ex_strings;
-    vector<double> rhos;
+    vector<DecayChannel> decays;
 
-    bool target_initialized, kinematics_initialized; 
+    bool target_initialized;
 
-    static constexpr double C = 299792458;
-    static constexpr double QBRHO2P = 1.0E-9*C; //converts QBrho to momentum (cm*kG -> MeV/c)
-    static constexpr double DEG2RAD = TMath::Pi()/180.0; //converts degrees to radians
+    static constexpr double DEG2RAD = 3.14159265358979323846/180.0; //converts degrees to radians
     static constexpr double UNIT_CHARGE = 1.602176643E-19;
     static constexpr double MEV2J = 1.602176643E-13; //MeV to Joules
 
@@ -0,0 +1,46 @@
+/*
+
+ReadWriteLock.h
+Reader/writer lock for the global nuclear data tables (MASS, EX). Lookups happen from many threads at once (reaction setup and
+kinematics are spread over the thread pool) and only need shared access; loading and editing the tables is exclusive, so a
+table is never seen half updated. Thin RAII wrapper over pthread_rwlock, since C++11 has no shared mutex.
+*/
+#ifndef READWRITELOCK_H
+#define READWRITELOCK_H
+
+#include <pthread.h>
+
+class ReadWriteLock {
+public:
+	ReadWriteLock() { pthread_rwlock_init(&m_lock, nullptr); };
+	~ReadWriteLock() { pthread_rwlock_destroy(&m_lock); };
+	ReadWriteLock(const ReadWriteLock&) = delete;
+	ReadWriteLock& operator=(const ReadWriteLock&) = delete;
+
+	void LockShared() { pthread_rwlock_rdlock(&m_lock); };
+	void Lock() { pthread_rwlock_wrlock(&m_lock); };
+	void Unlock() { pthread_rwlock_unlock(&m_lock); };
+
+private:
+	pthread_rwlock_t m_lock;
+};
+
+class ReadGuard {
+public:
+	ReadGuard(ReadWriteLock& lock) : m_lock(lock) { m_lock.LockShared(); };
+	~ReadGuard() { m_lock.Unlock(); };
+
+private:
+	ReadWriteLock& m_lock;
+};
+
+class WriteGuard {
+public:
+	WriteGuard(ReadWriteLock& lock) : m_lock(lock) { m_lock.Lock(); };
+	~WriteGuard() { m_lock.Unlock(); };
+
+private:
+	ReadWriteLock& m_lock;
+};
+
+#endif
@@ -0,0 +1,45 @@
+/*
+
+RunLog.h
+Spectrograph parameters of every run of an experiment, read from a comma separated run log with the columns: run number,
+timestamp, NMR field (kG), beam KE (MeV), and angle (deg). Gives the rho of a fixed set of lines at every run, so that drifts
+of the field, beam energy, and angle over a campaign can be followed.
+*/
+#ifndef RUNLOG_H
+#define RUNLOG_H
+
+#include <vector>
+#include <string>
+#include "Reaction.h"
+
+struct RunRecord {
+	int run;
+	std::string timestamp; //as written in the log
+	double B; //kG
+	double beamKE; //MeV
+	double theta; //deg
+};
+
+/*A line followed through the runs*/
+struct RunLine {
+	int rxnIndex;
+	double ex; //MeV
+};
+
+class RunLog {
+public:
+	RunLog();
+	~RunLog();
+
+	bool ReadFile(const std::string& filename);
+	void inline Clear() { m_runs.clear(); };
+	int inline GetNRuns() const { return m_runs.size(); };
+	const RunRecord& GetRun(int index) const { return m_runs[index]; };
+
+	void Predict(const std::vector<Reaction>& reactions, const std::vector<RunLine>& lines, std::vector<double>& rhos) const;
+
+private:
+	std::vector<RunRecord> m_runs;
+};
+
+#endif
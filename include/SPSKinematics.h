@@ -0,0 +1,66 @@
+/*
+
+SPSKinematics.h
+C interface to the SPSPlot kinematics core (Reaction, MassLookup, ExTable), for use from DAQ, sort codes, and scripts
+(ctypes, etc.) without ROOT. Link against libspsplotcore.a or libspsplotcore.so.
+
+All rho values are in cm, energies in MeV, angles in degrees, and fields in kG. Functions returning int give 0 on success
+and -1 on an invalid argument or failure. Array outputs are sized by the caller. No C++ exception crosses this interface;
+a failure inside (a malformed file, running out of memory) is reported as -1 or NULL.
+
+The mass and level tables are global (shared by every reaction). They are loaded from ./data at startup, the same as for
+the gui; the load functions merge into them, with entries of the new file replacing those of the same nucleus. Loading must not overlap with any other call;
+everything else only reads the tables, and may be called from several threads at once.
+*/
+#ifndef SPSKINEMATICS_H
+#define SPSKINEMATICS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct sps_reaction sps_reaction;
+
+/*
+	Tables; merged into what is loaded. Return 0 on success, -1 if the file couldn't be read or parsed (nuclei read before a
+	parse error are kept)
+*/
+int sps_load_masses(const char* filename);
+int sps_load_levels(const char* filename);
+int sps_import_ensdf(const char* filename);
+
+/*Reaction target(projectile, ejectile)residual; returns NULL if the reaction is invalid*/
+sps_reaction* sps_reaction_create(int At, int Zt, int Ap, int Zp, int Ae, int Ze);
+void sps_reaction_destroy(sps_reaction* rxn);
+const char* sps_reaction_name(const sps_reaction* rxn);
+
+/*Known levels of the residual; copies up to maxLevels energies (ex may be NULL) and returns the total number of levels*/
+int sps_reaction_levels(const sps_reaction* rxn, double* ex, int maxLevels);
+
+/*rho of nEx excitations at a single setting*/
+int sps_rho(const sps_reaction* rxn, double beamKE, double theta, double B, const double* ex, int nEx, double* rho);
+
+/*
+	Excitations (MeV) of nRho rhos at a single setting; the inverse of sps_rho. A rho beyond the kinematic limit gives +infinity
+*/
+int sps_ex(const sps_reaction* rxn, double beamKE, double theta, double B, const double* rho, int nRho, double* ex);
+
+/*
+	rho of nEx excitations at each of nSettings settings (parallel arrays beamKE, theta, B). Output is setting-major:
+	rho[s*nEx + i]. Large batches are spread over the available threads
+*/
+int sps_rho_settings(const sps_reaction* rxn, const double* beamKE, const double* theta, const double* B, int nSettings,
+					 const double* ex, int nEx, double* rho);
+
+/*
+	rho and its 1 sigma uncertainty for nEx excitations at a single setting, propagated from the setting uncertainties
+	(dBeamKE, dTheta, dB), the excitation uncertainties (exSigma, may be NULL), and the table mass uncertainties
+*/
+int sps_rho_sigma(const sps_reaction* rxn, double beamKE, double theta, double B, double dBeamKE, double dTheta, double dB,
+				  const double* ex, const double* exSigma, int nEx, double* rho, double* sigma);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
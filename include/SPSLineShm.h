@@ -0,0 +1,82 @@
+/*
+
+SPSLineShm.h
+Layout of the shared memory segment which SPSPlot publishes its current lines to (see LinePublisher), for online analysis
+tools (sort codes, gate drawing, etc.) in other processes. Plain C, no dependencies; include it and map the segment.
+
+The segment is a header followed by capacity line records, of which the first nLines are valid. It is guarded by a sequence
+lock: the writer makes sequence odd while it updates and even again when done, so a reader never waits on the writer, and
+can use the lines in place (no copy) as long as the sequence is the same, and even, before and after:
+
+	uint64_t seq;
+	do {
+		seq = sps_shm_read_begin(header);
+		... use header fields and sps_shm_lines(header)[0..nLines) ...
+	} while(!sps_shm_read_valid(header, seq));
+
+Anything read inside the loop is only trustworthy once sps_shm_read_valid() passes. The segment can grow at any time: take a copy
+of the header first, and if sps_shm_size() of the copy's capacity is larger than what the reader mapped, remap before touching
+the lines, and only read as many lines as the copy says (never header->capacity or header->nLines again, which may have moved
+on). See etc/line_reader.c
+*/
+#ifndef SPSLINESHM_H
+#define SPSLINESHM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SPS_SHM_MAGIC 0x4C535053u /* "SPSL" */
+#define SPS_SHM_VERSION 1
+#define SPS_SHM_REACTION_LENGTH 32
+#define SPS_SHM_LABEL_LENGTH 16
+
+/*flags*/
+#define SPS_SHM_HAS_POSITION 0x1 /* position is calibrated focal plane position, not just rho */
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sequence; /* odd while the writer is updating */
+	uint32_t capacity; /* line records the segment has room for */
+	uint32_t nLines;
+	uint32_t flags;
+	uint32_t reserved;
+	double beamKE; /* MeV */
+	double theta; /* deg */
+	double B; /* kG */
+	double calOffset, calSlope; /* rho = calOffset + calSlope*position */
+} sps_shm_header;
+
+typedef struct {
+	char reaction[SPS_SHM_REACTION_LENGTH]; /* null terminated, e.g. 10B(3He,4He)9B */
+	char label[SPS_SHM_LABEL_LENGTH]; /* state label, null terminated */
+	int32_t rxnIndex;
+	int32_t level;
+	double ex; /* MeV */
+	double rho, sigma; /* cm */
+	double position; /* focal plane, through the calibration */
+	double weight; /* relative target nuclei */
+} sps_shm_line;
+
+static inline size_t sps_shm_size(uint32_t capacity) {
+	return sizeof(sps_shm_header) + (size_t)capacity*sizeof(sps_shm_line);
+}
+
+static inline const sps_shm_line* sps_shm_lines(const sps_shm_header* header) {
+	return (const sps_shm_line*)(header + 1);
+}
+
+/*Waits out a writer in progress; updates take microseconds*/
+static inline uint64_t sps_shm_read_begin(const sps_shm_header* header) {
+	uint64_t seq;
+	while((seq = __atomic_load_n(&header->sequence, __ATOMIC_ACQUIRE)) & 1)
+		;
+	return seq;
+}
+
+static inline int sps_shm_read_valid(const sps_shm_header* header, uint64_t seq) {
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&header->sequence, __ATOMIC_RELAXED) == seq;
+}
+
+#endif
@@ -15,7 +15,100 @@ Written by G.W. McCann Sep. 2020
 #include <vector>
 #include <string>
 #include <TGraph.h>
+#include <TGraphErrors.h>
+#include <TMultiGraph.h>
+#include <TH1D.h>
 #include "Reaction.h"
+#include "LineStore.h"
+#include "FieldOptimizer.h"
+#include "LabelLayout.h"
+#include "PeakFinder.h"
+#include "KinematicFitter.h"
+#include "TargetModel.h"
+#include "SpectrumSynthesizer.h"
+#include "RunLog.h"
+#include "LinePublisher.h"
+#include "DecaySampler.h"
+#include "DetectorModel.h"
+
+struct DataUpdate;
+
+/*
+	Additional named spectrograph setting, used to compare against the primary setting. Shares the reaction
+	list (and therefore all of the nuclear data) with the primary; only the kinematics are stored per setting,
+	as columns parallel to the line store.
+*/
+struct SPSSetting {
+	std::string name;
+	double B, theta, beamKE;
+	std::vector<double> momenta; //ejectile momenta, one per line (independent of B)
+	std::vector<double> rhos; //one per line
+	std::vector<char> current; //per reaction; momenta are up to date
+	std::vector<TGraph*> graphs; //owned by SPSPlot
+};
+
+/*Options for the kinematic curve (rho vs. theta) mode*/
+struct CurveOptions {
+	double thetaMin, thetaMax; //deg
+	double acceptance; //half-width of the SPS angular acceptance around the current angle, deg
+};
+
+/*Contributions to the width of every line in the synthetic spectrum; all 1 sigma unless noted*/
+struct ResolutionModel {
+	double beamSpread; //MeV
+	double targetSpread; //MeV of beam energy, from where in the target the reaction happens
+	double acceptance; //deg, half-width of the (uniform) angular acceptance; 0 if kinematically corrected
+	double detector; //cm
+};
+
+/*Relative intensity of a single state in the synthetic spectrum; states without one have intensity 1*/
+struct LineIntensity {
+	std::string nuclide; //residual, e.g. 9B
+	double ex; //MeV
+	double intensity;
+};
+
+/*Alternate mass evaluation to load, as given in the input file*/
+struct MassTableSource {
+	std::string name;
+	std::string filename;
+};
+
+/*Override of a single mass in a data layer, as given in the input file*/
+struct MassOverride {
+	std::string layer;
+	int Z, A;
+	double excess, uncertainty; //atomic mass excess, keV
+};
+
+/*A line of the primary setting under the current nuclear data, and where the same state lands under other data*/
+struct LineShift {
+	int rxnIndex;
+	std::string label;
+	double ex, rho; //MeV, cm; current data
+	double otherEx, otherRho; //NaN if the state isn't there under the other data
+};
+
+/*A single line of the primary setting inside of the rho range*/
+struct SPSLine {
+	int rxnIndex;
+	int level; //index into the reaction's levels; the line is GetBegin(rxnIndex)+level in the line store
+	double ex; //MeV
+	double rho, sigma; //cm
+	double weight; //relative target nuclei of the reaction, 1 for reactions not from the target model
+};
+
+/*A peak found in the loaded spectrum, and the line it was assigned to (if any)*/
+struct PeakMatch {
+	int peak; //index into the found peaks, in spectrum order
+	double position; //spectrum axis
+	double rho; //cm, through the spectrum calibration
+	double area;
+	int rxnIndex; //-1 if unassigned
+	int level; //index into the reaction's excitations
+	double ex; //MeV
+	double residual; //peak - line, cm
+};
 
 class SPSPlot {
 public:
@@ -29,8 +122,29 @@ public:
 	void SetTheta(double theta);
 	void SetBeamKE(double beamKE);
 	void SetRhoRange(double rhoMin, double rhoMax);
+	void SetViewRange(double rhoMin, double rhoMax);
+	void SetFieldTracking(bool tracking);
+	int TrackField(double B);
 
 	void AddReaction(Reaction rxn);
+	int inline GetNReactions() { return m_Reactions.size(); };
+	Reaction& GetReaction(int index) { return m_Reactions[index]; };
+	void RefreshLevels();
+	int ApplyDataUpdate(const DataUpdate& update);
+	int SelectMassEvaluation(const std::string& name);
+	int SetDataLayer(const std::string& layer, bool enabled);
+	std::vector<std::string> GetMassEvaluations();
+	std::vector<std::string> GetDataLayers();
+	std::vector<LineShift> CompareData(const std::string& evaluation, const std::vector<std::string>& layers);
+	double inline GetWeight(int index) { return m_weights[index]; };
+	const TargetModel& GetTarget() { return m_target; };
+	void inline SetMinimumWeight(double weight) { m_minWeight = weight; };
+	double inline GetMinimumWeight() { return m_minWeight; };
+
+	void AddSetting(const std::string& name, double beamKE, double theta, double B);
+	void ClearSettings();
+	int inline GetNSettings() { return m_Settings.size(); };
+	const SPSSetting& GetSetting(int index) { return m_Settings[index]; };
 
 	double inline GetRhoMin() {return m_rhoMin;};
 	double inline GetRhoMax() {return m_rhoMax;};
@@ -38,28 +152,129 @@ public:
 	double inline GetBeamKE() {return m_beamKE;};
 	double inline GetB() {return m_B;};
 
+	std::vector<FieldSolution> OptimizeSettings(const OptimizerRequest& request, int nResults);
+
 	TGraph** GetGraphs();
+	TGraph** GetGraphs(int setting);
+	TMultiGraph* GetCurves(const CurveOptions& options);
 
 	int inline GetNGraphs() { return ngraphs; };
 	bool inline IsValid() { return validFlag; };
 
 	void SaveToFile(std::string& name);
+	void ExportLines(std::string& name);
+	std::vector<SPSLine> GetLines();
+
+	bool LoadSpectrum(const std::string& filename);
+	void ClearSpectrum();
+	bool inline HasSpectrum() { return !m_specCounts.empty(); };
+	void SetCalibration(double offset, double slope);
+	void SetPeakParameters(double sigma, double threshold, double tolerance);
+	const std::vector<Peak>& GetPeaks() { return m_peaks; };
+	TH1* GetSpectrum();
+	std::vector<PeakMatch> AssignPeaks();
+
+	void inline SetResolution(const ResolutionModel& resolution) { m_resolution = resolution; };
+	const ResolutionModel& GetResolution() { return m_resolution; };
+	TH1* GetSyntheticSpectrum();
+	bool FitToPeaks(FitResult& result);
+
+	bool LoadRunLog(const std::string& filename);
+	bool inline HasRunLog() { return m_runLog.GetNRuns() > 0; };
+	const RunLog& GetRunLog() { return m_runLog; };
+	void ExportRunTable(std::string& name);
+	TMultiGraph* GetDriftCurves();
+
+	bool StartPublishing(const std::string& name);
+	void StopPublishing();
+	bool inline IsPublishing() { return m_publisher.IsOpen(); };
+
+	void AddDecay(int rxnIndex, const DecayChannel& decay);
+	void SetLocusSampling(int nSamples, double acceptance);
+	const std::vector<DecayLocus>& GetLoci();
+
+	bool GetDeposits(const std::vector<SPSLine>& lines, std::vector<double>& deposits);
+	TMultiGraph* GetPIDPlot();
 
 private:
 	bool ReadInputFile(std::string& filename);
 	void UpdateReactions();
+	void UpdateSettings();
+	void RelayoutSettings(const std::vector<char>& stale);
+	void ExpandTarget();
+	int RefreshNuclearData(const std::vector<std::string>& levelNuclides);
+	void Publish();
+	void UpdateLoci();
+	double GetEjectileKE(const SPSLine& line) const;
+	bool SetupLabelLayout(LabelLayout& layout);
+	bool LayoutLabels(const double* rhos, std::vector<double>& labelY);
+	bool ReadSpectrumText(const std::string& filename);
+	bool ReadSpectrumROOT(const std::string& filename);
+	void FindPeaks();
+	bool PredictRuns(std::vector<SPSLine>& lines, std::vector<double>& rhos);
+	TGraph* MakeGraph(int rxnIndex, int first, int last, const double* rhos, const double* sigmas, const double* labelY);
 
 	std::vector<Reaction> m_Reactions;
+	LineStore m_lines; //levels of every reaction, and their rhos at the primary setting
+	std::vector<SPSSetting> m_Settings;
+	TargetModel m_target;
+	std::vector<double> m_weights; //parallel to m_Reactions
+	std::vector<bool> m_generated; //reaction came from the target model rather than the reaction table
+	double m_minWeight; //reactions with a smaller weight are not shown
 
 	double m_B;
 	double m_theta;
 	double m_beamKE;
 	double m_rhoMin, m_rhoMax;
+	double m_viewMin, m_viewMax; //visible (zoomed) part of the rho range; only labels here are made
+	double m_beamKESigma, m_thetaSigma, m_BSigma; //1 sigma uncertainties of the primary setting
+	double m_fieldMargin; //relative field drift followed without recalculating (see TrackField)
+
+	//Measured spectrum, kept on its own axis (focal plane position, or rho); rho = offset + slope*x
+	std::vector<double> m_specEdges; //nbins+1
+	std::vector<double> m_specCounts;
+	std::vector<Peak> m_peaks;
+	double m_calOffset, m_calSlope;
+	double m_peakSigma; //expected peak sigma, cm
+	double m_peakThreshold; //required peak significance
+	double m_assignTolerance; //cm
+
+	ResolutionModel m_resolution;
+	std::vector<LineIntensity> m_intensities;
+
+	RunLog m_runLog;
+
+	//Nuclear data alternatives from the input file; the tables themselves are global (MASS, EX)
+	std::vector<MassTableSource> m_massTables;
+	std::vector<MassOverride> m_massOverrides;
+	std::vector<std::pair<std::string, LevelOverride>> m_levelOverrides; //layer, level
+
+	LinePublisher m_publisher; //shared memory copy of the current lines, for other processes
+
+	//Decay loci of the unbound states (see DecaySampler); kept as momenta, so only resampled for a new beam KE or angle
+	DecaySampler m_sampler;
+	std::vector<DecayLocus> m_loci;
+	bool m_lociDirty;
+	double m_lociBeamKE, m_lociTheta; //sampled at
+
+	//Focal plane detector, for the energy deposits and particle ID of the ejectiles
+	DetectorModel m_detector;
 
 	int ngraphs;
 	bool validFlag;
 
+	static constexpr double LABEL_SIZE = 0.02; //fraction of the pad
+
 	TGraph** graph_array; //owned by SPSPlot
+	TMultiGraph* m_curves; //owned by SPSPlot
+	TH1D* m_spectrum; //owned by SPSPlot; rho axis
+	TH1D* m_synthetic; //owned by SPSPlot
+	TMultiGraph* m_drift; //owned by SPSPlot
+	TMultiGraph* m_pid; //owned by SPSPlot
+
+	static constexpr int SYNTHETIC_BINS = 2048;
+	static constexpr double FIELD_MARGIN = 0.002; //20 G at 10 kG
+	static constexpr int PID_LOCUS_POINTS = 128; //per ejectile, over the rho range
 };
 
 #endif
\ No newline at end of file
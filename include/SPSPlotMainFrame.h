@@ -23,6 +23,9 @@
 #include <TGMenu.h>
 #include "SPSPlot.h"
 
+class DataWatcher;
+class FieldFeed;
+class TTimer;
 
 class SPSPlotMainFrame : public TGMainFrame {
 public:
@@ -34,33 +37,94 @@ public:
 	void UpdateKineSettings(double rmin, double rmax, double bke, double theta, double b);
 	void DoPlot();
 	void PlotGraphs();
+	void PlotCurves();
+	void SetCurveOptions(CurveOptions* options);
+	void HandleCanvasEvent(Int_t event, Int_t px, Int_t py, TObject* obj);
+	void RedrawZoom();
 	void LoadConfig(const char* name);
 	void WriteConfig(const char* name);
+	void ImportLevels(const char* name);
+	void ExportLines(const char* name);
+	void LoadSpectrum(const char* name);
+	void LoadRunLog(const char* name);
+	void ExportRunTable(const char* name);
+	void PlotDrift();
+	void PlotPID();
+	void PrintAssignments();
+	void FitPeaks();
+	void CheckDataFiles();
+	void FollowField(const char* name);
+	void StopField();
+	void CheckField();
 	void AddReaction(Reaction* rxn);
+	void RunOptimizer(OptimizerRequest* request);
 	ClassDef(SPSPlotMainFrame, 0); //ROOT requirement
 
 	enum MenuID {
 		M_LOAD_CONFIG,
 		M_SAVE_CONFIG,
-		M_ADD_REACTION
+		M_IMPORT_ENSDF,
+		M_EXPORT_LINES,
+		M_LOAD_RUNLOG,
+		M_EXPORT_RUNS,
+		M_LOAD_SPECTRUM,
+		M_ASSIGN_PEAKS,
+		M_FIT_PEAKS,
+		M_CLEAR_SPECTRUM,
+		M_ADD_REACTION,
+		M_ADD_SETTING,
+		M_CLEAR_SETTINGS,
+		M_OPTIMIZE,
+		M_FOLLOW_FIELD,
+		M_STOP_FIELD,
+		M_CURVES,
+		M_LINES,
+		M_SYNTHETIC,
+		M_PID,
+		M_COMPARE_DATA,
+		M_DATA_ITEMS = 1000 //mass evaluations, then data layers, of the loaded config
 	};
 
 private:
+	void DrawLinePlot();
+	void RebuildDataMenu();
+	void SelectDataItem(int item);
+	void PrintDataComparison();
+	TGraph* DrawGraphs(TGraph** graphs, int ngraphs, const std::string& title);
+
 	SPSPlot fPlotter;
 
 	TGNumberEntryField *fBField, *fThetaField, *fBKEField, *fRMinField, *fRMaxField;
+	TGNumberEntryField *fWeightField;
 	TGTextButton *fPlotButton;
 
 	TRootEmbeddedCanvas *fECanvas;
 	TCanvas *fCanvas;
 
-	TGPopupMenu *fFileMenu, *fRxnMenu;
+	std::vector<TGraph*> fAxisGraphs; //graph which owns the axes on each pad; owned by fPlotter
+	double fLinkedMin, fLinkedMax; //current shared rho range of the stacked pads
+
+	TGPopupMenu *fFileMenu, *fRxnMenu, *fSettingMenu, *fSpectrumMenu, *fViewMenu, *fDataMenu;
+	std::vector<std::string> fEvaluations, fLayers; //entries of fDataMenu, from M_DATA_ITEMS
+
+	CurveOptions fCurveOptions;
+
+	DataWatcher* fWatcher; //reloads changed nuclear data files
+	TTimer* fWatchTimer; //picks up the watcher's updates on the gui thread
+	FieldFeed* fFieldFeed; //live NMR readout
+	TTimer* fFieldTimer; //takes the latest reading and redraws; bounds the frame rate
+	TTimer* fZoomTimer; //redraws a zoom once the canvas is done handling the event
 
 	bool paramFlag; //false=params unchanged, true=params changed
 	bool attachFlag; //false=no file attached, true=file attached
+	bool synthFlag; //true=show the synthetic spectrum under the line plot
+	bool curveFlag; //false=line plot, true=kinematic curves
+	bool pidFlag; //true=particle ID plot, over either of the others
 
 	UInt_t MAIN_H, MAIN_W;
 
+	static constexpr int FRAME_MS = 50; //at most 20 redraws per second from the field readout
+
 
 
 };
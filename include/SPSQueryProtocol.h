@@ -0,0 +1,62 @@
+/*
+
+SPSQueryProtocol.h
+Binary protocol of the kinematics query daemon (etc/spsplot_daemon.cpp), which loads the nuclear data once and answers
+batches of rho and Ex queries over a UNIX domain socket. Plain C, no dependencies; the socket is local, so everything is in
+native byte order and laid out exactly as these structs.
+
+A request is an sps_query_request followed by nQueries sps_query records. The response is an sps_query_response, with the
+tag of the request, followed by one sps_query_result per query, in query order. A client may send any number of requests
+without waiting for the responses (pipelining); responses can come back in a different order than the requests were sent,
+so give each request its own tag. A request with a bad magic, version, or size gets a response with status -1 and no results,
+and the daemon then closes the connection.
+
+All rho values are in cm, energies in MeV, angles in degrees, and fields in kG (same as SPSKinematics.h).
+*/
+#ifndef SPSQUERYPROTOCOL_H
+#define SPSQUERYPROTOCOL_H
+
+#include <stdint.h>
+
+#define SPS_QUERY_MAGIC 0x51535053u /* "SPSQ" */
+#define SPS_QUERY_VERSION 1
+#define SPS_QUERY_MAX_BATCH 1048576 /* queries per request */
+
+/*query kinds*/
+#define SPS_QUERY_RHO 0 /* value is Ex, result is rho */
+#define SPS_QUERY_EX 1 /* value is rho, result is Ex */
+
+/*result status*/
+#define SPS_QUERY_OK 0
+#define SPS_QUERY_BAD_REACTION 1 /* not a valid reaction (e.g. no residual) */
+#define SPS_QUERY_FORBIDDEN 2 /* kinematically forbidden; value is NaN or infinity */
+#define SPS_QUERY_BAD_KIND 3
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t tag; /* returned in the response */
+	uint32_t nQueries;
+} sps_query_request;
+
+typedef struct {
+	uint16_t At, Zt, Ap, Zp, Ae, Ze; /* target(projectile, ejectile)residual */
+	uint32_t kind;
+	double beamKE, theta, B;
+	double value;
+} sps_query;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t tag;
+	uint32_t nResults;
+	int32_t status; /* 0, or -1 if the request was rejected */
+} sps_query_response;
+
+typedef struct {
+	double value;
+	int32_t status;
+	uint32_t reserved;
+} sps_query_result;
+
+#endif
@@ -0,0 +1,45 @@
+/*
+
+SpectrumSynthesizer.h
+Builds an expected (noise free) spectrum from a list of lines, each with its own gaussian width and intensity. Rather than
+summing a gaussian into every bin for every line, the lines are binned into a stick spectrum and convolved with the resolution
+kernel by FFT. Widths differ from line to line, so lines are grouped into classes of nearly equal width (within a few percent)
+and each class is multiplied by its own kernel in frequency space; the kernel's transform is analytic. The stick spectra are
+real, so two classes share each forward transform, and the classes are summed before a single inverse transform.
+
+Lines narrower than half a bin (sigma) are not convolved at all, only split between their two nearest bins. For a line just under half a bin
+that puts the peak bin about 20% high on average against a bin integrated gaussian (45% for a line on a bin center), and more
+for narrower ones; it shows once SYNTHETIC_BINS is coarse compared to the resolution.
+*/
+#ifndef SPECTRUMSYNTHESIZER_H
+#define SPECTRUMSYNTHESIZER_H
+
+#include <vector>
+#include <complex>
+
+struct SynthLine {
+	double position;
+	double sigma; //same units as position
+	double intensity; //area of the line
+};
+
+class SpectrumSynthesizer {
+public:
+	SpectrumSynthesizer();
+	~SpectrumSynthesizer();
+
+	void SetBinning(double min, double max, int nbins);
+	std::vector<double> Generate(const std::vector<SynthLine>& lines) const;
+
+	static constexpr double TAIL_SIGMAS = 6.0; //lines this far outside of the range still contribute; also the padding against wrap around
+
+private:
+	static void FFT(std::vector<std::complex<double>>& data, const std::vector<std::complex<double>>& twiddles, bool inverse);
+
+	double m_min, m_max;
+	int m_nbins;
+
+	static constexpr double WIDTH_STEP = 0.03; //relative width spread allowed within one kernel class
+};
+
+#endif
@@ -0,0 +1,45 @@
+/*
+
+StoppingTable.h
+Stopping power of one ion in one material, read from a locally stored table (i.e. converted from SRIM or LISE++), and turned
+into range and energy lookups for slowing ions down through detector layers. The tabulated points are splined (cubic, in log E
+vs. log S) once on loading, and the spline is integrated into a range table on a fine uniform grid in log E; slowing an ion
+through a layer is then two table lookups, E -> range and (range - thickness) -> E, with no integration per ion.
+
+Below the table the stopping power is taken to go as the velocity (sqrt(E)); above it nothing is assumed, and the lookups
+give NaN. Energies are the total kinetic energy of the tabulated ion in MeV, thicknesses are areal densities in mg/cm^2.
+*/
+#ifndef STOPPINGTABLE_H
+#define STOPPINGTABLE_H
+
+#include <vector>
+#include <string>
+
+class StoppingTable {
+public:
+	StoppingTable();
+	~StoppingTable();
+
+	bool Load(const std::string& filename);
+
+	double GetRange(double ke) const; //mg/cm^2
+	double GetEnergy(double range) const; //MeV, inverse of GetRange
+
+	bool inline IsValid() const { return !m_range.empty(); };
+	double inline GetEMin() const { return m_energy.front(); };
+	double inline GetEMax() const { return m_energy.back(); };
+
+private:
+	double Spline(double logE) const;
+
+	//Tabulated points, and the second derivatives of the natural cubic spline through them (log-log)
+	std::vector<double> m_energy, m_logE, m_logS, m_d2;
+
+	//Range at m_logE0 + i*m_dLogE
+	std::vector<double> m_range;
+	double m_logE0, m_dLogE;
+
+	static constexpr int RANGE_POINTS = 4096;
+};
+
+#endif
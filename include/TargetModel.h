@@ -0,0 +1,39 @@
+/*
+
+TargetModel.h
+Composition of the physical target: every isotope that the beam can react with (the target of interest, its backing, and
+known contaminants), with its abundance and the areal density of the layer it sits in. Expands into the full set of
+reactions for a given beam and ejectile, and gives each isotope a weight proportional to its number of nuclei per unit
+area, relative to the most plentiful one.
+*/
+#ifndef TARGETMODEL_H
+#define TARGETMODEL_H
+
+#include <vector>
+#include "Reaction.h"
+
+struct TargetComponent {
+	int A, Z;
+	double abundance; //atom fraction of the isotope in its layer
+	double arealDensity; //ug/cm^2 of the layer
+};
+
+class TargetModel {
+public:
+	TargetModel();
+	~TargetModel();
+
+	void AddComponent(const TargetComponent& component);
+	void inline Clear() { m_components.clear(); };
+	bool inline IsEmpty() const { return m_components.empty(); };
+	int inline GetNComponents() const { return m_components.size(); };
+	const TargetComponent& GetComponent(int index) const { return m_components[index]; };
+
+	std::vector<double> GetWeights() const;
+	std::vector<Reaction> Expand(int Ap, int Zp, int Ae, int Ze) const;
+
+private:
+	std::vector<TargetComponent> m_components;
+};
+
+#endif
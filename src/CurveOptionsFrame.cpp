@@ -0,0 +1,98 @@
+/*
+
+	CurveOptionsFrame.cpp
+	Wrapper class on a TGTransientFrame (temporary frame assoc. with a main frame)
+	User specifies the angular range and SPS acceptance for the kinematic curve mode; the options are sent
+	as a signal back to the main frame.
+*/
+#include "CurveOptionsFrame.h"
+#include <TTimer.h>
+#include <TGLabel.h>
+
+CurveOptionsFrame::CurveOptionsFrame(const TGWindow *p, const TGWindow *main, UInt_t w, UInt_t h, SPSPlotMainFrame *parent, const CurveOptions& current) {
+	fMain = new TGTransientFrame(p, main, w, h);
+	fMain->SetCleanup(kDeepCleanup); //delete all child frames
+	fMain->DontCallClose(); //disable close window button
+
+	/*Layout orgainization hints*/
+	TGLayoutHints *fhints = new TGLayoutHints(kLHintsCenterX|kLHintsCenterY,5,5,5,5);
+
+	/*Option entry fields, starting from the current options*/
+	TGVerticalFrame *OptionFrame = new TGVerticalFrame(fMain, w, h*0.75);
+	TGLabel *tminLabel = new TGLabel(OptionFrame, "Theta Min (deg)");
+	fTMinField = new TGNumberEntryField(OptionFrame, 1, current.thetaMin, TGNumberEntry::kNESRealFour, TGNumberEntry::kNEANonNegative);
+	TGLabel *tmaxLabel = new TGLabel(OptionFrame, "Theta Max (deg)");
+	fTMaxField = new TGNumberEntryField(OptionFrame, 2, current.thetaMax, TGNumberEntry::kNESRealFour, TGNumberEntry::kNEANonNegative);
+	TGLabel *acceptLabel = new TGLabel(OptionFrame, "Acceptance +/- (deg)");
+	fAcceptField = new TGNumberEntryField(OptionFrame, 3, current.acceptance, TGNumberEntry::kNESRealFour, TGNumberEntry::kNEANonNegative);
+	OptionFrame->AddFrame(tminLabel, fhints);
+	OptionFrame->AddFrame(fTMinField, fhints);
+	OptionFrame->AddFrame(tmaxLabel, fhints);
+	OptionFrame->AddFrame(fTMaxField, fhints);
+	OptionFrame->AddFrame(acceptLabel, fhints);
+	OptionFrame->AddFrame(fAcceptField, fhints);
+
+	/*Ok and Cancel buttons*/
+	TGHorizontalFrame *ButtonFrame = new TGHorizontalFrame(fMain, w, h*0.25);
+	fOkButton = new TGTextButton(ButtonFrame, "Ok");
+	fOkButton->Connect("Clicked()","CurveOptionsFrame",this,"DoOk()");
+	fCancelButton = new TGTextButton(ButtonFrame, "Cancel");
+	fCancelButton->Connect("Clicked()","CurveOptionsFrame",this,"DoCancel()");
+	ButtonFrame->AddFrame(fOkButton, fhints);
+	ButtonFrame->AddFrame(fCancelButton, fhints);
+
+	fMain->AddFrame(OptionFrame, fhints);
+	fMain->AddFrame(ButtonFrame, fhints);
+
+	/*Signal connection*/
+	Connect("SendOptions(CurveOptions*)","SPSPlotMainFrame",parent,"SetCurveOptions(CurveOptions*)");
+
+	fMain->SetWindowName("Kinematic Curves");
+	fMain->MapSubwindows();
+	fMain->Resize();
+	fMain->CenterOnParent();
+	fMain->MapWindow();
+}
+
+CurveOptionsFrame::~CurveOptionsFrame() {
+	fMain->Cleanup(); //delete children
+	fMain->DeleteWindow();
+}
+
+void CurveOptionsFrame::CloseWindow() {
+	delete this;
+}
+
+void CurveOptionsFrame::DoOk() {
+	fOkButton->SetState(kButtonDisabled); //stop user from doing something dumb
+	fCancelButton->SetState(kButtonDisabled);
+
+	options.thetaMin = fTMinField->GetNumber();
+	options.thetaMax = fTMaxField->GetNumber();
+	options.acceptance = fAcceptField->GetNumber();
+	if(options.thetaMax <= options.thetaMin) {
+		std::cerr<<"Theta max must be larger than theta min!"<<std::endl;
+		fOkButton->SetState(kButtonUp);
+		fCancelButton->SetState(kButtonUp);
+		return;
+	}
+
+	SendOptions(&options);
+
+	//Wait for a breif period and then close the window; ensure no memory is 
+	//deleted too quickly
+	TTimer::SingleShot(150, "CurveOptionsFrame", this, "CloseWindow()");
+}
+
+void CurveOptionsFrame::DoCancel() {
+	fOkButton->SetState(kButtonDisabled); //stop user from doing something dumb
+	fCancelButton->SetState(kButtonDisabled);
+	//Wait for a breif period and then close the window; ensure no memory is 
+	//deleted too quickly
+	TTimer::SingleShot(150, "CurveOptionsFrame", this, "CloseWindow()");
+}
+
+/*Signal*/
+void CurveOptionsFrame::SendOptions(CurveOptions* options) {
+	Emit<CurveOptions*>("SendOptions(CurveOptions*)", options);
+}
@@ -0,0 +1,202 @@
+/*
+
+DataWatcher.cpp
+Watches the nuclear data directory (excitations.dat and mass.txt) for changes with inotify, so that levels added mid-experiment
+show up without a restart. Files are re-read on a background thread and compared against what was last seen: excitations are
+compared per nuclide block, masses per line, and only what differs is parsed. The result is handed over as a single update,
+which the owner takes and applies on its own thread (see SPSPlot::ApplyDataUpdate). Each edit of the global MASS and EX tables
+is made under that table's write lock, and every lookup, including those from ParallelFor's workers, holds its read lock (see
+ReadWriteLock.h), so no lookup sees a half-written nuclide. The update as a whole is not atomic to other threads; thread pool
+calculations are started and waited for on the owner's thread, so none runs while it is applied.
+
+The directory is watched rather than the files, since most editors save by writing a new file and renaming it over the old one.
+*/
+#include "DataWatcher.h"
+#include <fstream>
+#include <iostream>
+#include <cstdlib>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+static const std::string LEVEL_FILE = "excitations.dat";
+static const std::string MASS_FILE = "mass.txt";
+
+DataWatcher::DataWatcher() :
+	m_fd(-1), m_running(false)
+{
+}
+
+DataWatcher::~DataWatcher() {
+	Stop();
+}
+
+/*Take the current files as the baseline (the tables were loaded from them at startup) and start watching*/
+bool DataWatcher::Start(const std::string& directory) {
+#ifdef __linux__
+	if(m_running) return true;
+	m_directory = directory;
+	m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(m_fd < 0) {
+		std::cerr<<"Unable to initialize inotify at DataWatcher::Start()! Nuclear data will not be reloaded."<<std::endl;
+		return false;
+	}
+	if(inotify_add_watch(m_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		std::cerr<<"Unable to watch "<<directory<<" at DataWatcher::Start()! Nuclear data will not be reloaded."<<std::endl;
+		close(m_fd);
+		m_fd = -1;
+		return false;
+	}
+
+	DataUpdate baseline;
+	ScanLevels(baseline);
+	ScanMasses(baseline);
+
+	m_running = true;
+	m_thread = std::thread(&DataWatcher::Run, this);
+	return true;
+#else
+	std::cerr<<"Watching nuclear data files is only available on Linux at DataWatcher::Start()!"<<std::endl;
+	return false;
+#endif
+}
+
+void DataWatcher::Stop() {
+	if(!m_running) return;
+	m_running = false;
+	m_thread.join();
+#ifdef __linux__
+	close(m_fd);
+#endif
+	m_fd = -1;
+}
+
+/*Non-blocking; returns false if nothing has changed since the last call*/
+bool DataWatcher::TakeUpdate(DataUpdate& update) {
+	std::lock_guard<std::mutex> guard(m_mutex);
+	if(m_pending.IsEmpty()) return false;
+	update = std::move(m_pending);
+	m_pending = DataUpdate();
+	return true;
+}
+
+/*
+	Watcher thread. Collects which files were touched until the directory has been quiet for a moment, then rescans just those
+	files and queues whatever actually differs
+*/
+void DataWatcher::Run() {
+#ifdef __linux__
+	alignas(struct inotify_event) char buffer[4096];
+	pollfd pfd;
+	pfd.fd = m_fd;
+	pfd.events = POLLIN;
+	bool levelsTouched = false, massesTouched = false;
+	while(m_running) {
+		bool pending = levelsTouched || massesTouched;
+		int ready = poll(&pfd, 1, pending ? QUIET_MS : POLL_MS);
+		if(ready > 0) {
+			ssize_t length;
+			while((length = read(m_fd, buffer, sizeof(buffer))) > 0) {
+				for(char* ptr = buffer; ptr < buffer + length; ) {
+					const struct inotify_event* event = (const struct inotify_event*) ptr;
+					if(event->len > 0) {
+						std::string name = event->name;
+						if(name == LEVEL_FILE) levelsTouched = true;
+						else if(name == MASS_FILE) massesTouched = true;
+					}
+					ptr += sizeof(struct inotify_event) + event->len;
+				}
+			}
+			continue;
+		} else if(ready < 0 || !pending) {
+			continue;
+		}
+
+		DataUpdate update;
+		if(levelsTouched) ScanLevels(update);
+		if(massesTouched) ScanMasses(update);
+		levelsTouched = false;
+		massesTouched = false;
+		if(update.IsEmpty()) continue;
+
+		std::lock_guard<std::mutex> guard(m_mutex);
+		m_pending.levels.insert(m_pending.levels.end(), update.levels.begin(), update.levels.end());
+		m_pending.masses.insert(m_pending.masses.end(), update.masses.begin(), update.masses.end());
+	}
+#endif
+}
+
+/*
+	Split excitations.dat into nuclide blocks (same tokenizing as ExTable::ReadFile) and compare each block, whitespace
+	normalized, to what was last seen. Only new or changed blocks are parsed; nuclides no longer in the file are removed
+*/
+void DataWatcher::ScanLevels(DataUpdate& update) {
+	std::ifstream input(m_directory + "/" + LEVEL_FILE);
+	if(!input.is_open()) return; //mid-replace; the rename will trigger another scan
+
+	std::unordered_map<std::string, std::string> blocks;
+	std::string element, text;
+	while(input>>element) {
+		std::string& block = blocks[element];
+		block.clear();
+		while(input>>text && text != "end") {
+			block += text;
+			block.push_back(' ');
+		}
+	}
+
+	for(auto& entry : blocks) {
+		auto iter = m_levelBlocks.find(entry.first);
+		if(iter != m_levelBlocks.end() && iter->second == entry.second) continue;
+
+		LevelChange change;
+		change.nuclide = entry.first;
+		change.removed = false;
+		size_t start = 0, stop;
+		while((stop = entry.second.find(' ', start)) != std::string::npos) {
+			std::string token = entry.second.substr(start, stop - start);
+			start = stop + 1;
+			char* end;
+			double energy = std::strtod(token.c_str(), &end);
+			if(end == token.c_str()) { //same leniency as stod in ExTable::ReadFile
+				std::cerr<<"Invalid excitation "<<token<<" for "<<entry.first<<" at DataWatcher::ScanLevels()! Skipping."<<std::endl;
+				continue;
+			}
+			change.data.ex_list.push_back(energy);
+			change.data.str_list.push_back(token);
+		}
+		update.levels.push_back(change);
+	}
+	for(auto& entry : m_levelBlocks) {
+		if(blocks.count(entry.first)) continue;
+		LevelChange change;
+		change.nuclide = entry.first;
+		change.removed = true;
+		update.levels.push_back(change);
+	}
+	m_levelBlocks.swap(blocks);
+}
+
+/*Only lines which were not in the file last time are parsed; a mass which is removed from the file keeps its old value*/
+void DataWatcher::ScanMasses(DataUpdate& update) {
+	std::ifstream input(m_directory + "/" + MASS_FILE);
+	if(!input.is_open()) return;
+
+	bool ameFormat = input.peek() == '1';
+	std::unordered_set<std::string> lines;
+	std::string line;
+	MassEntry entry;
+	int lineNumber = 0;
+	while(std::getline(input, line)) {
+		if(!ameFormat && lineNumber++ < 2) continue; //column titles
+		size_t last = line.find_last_not_of(" \t\r");
+		line.erase(last == std::string::npos ? 0 : last+1);
+		if(line.empty()) continue;
+		if(!m_massLines.count(line) && MassLookup::ParseLine(line, ameFormat, entry))
+			update.masses.push_back(entry);
+		lines.insert(line);
+	}
+	m_massLines.swap(lines);
+}
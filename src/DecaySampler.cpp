@@ -0,0 +1,358 @@
+/*
+
+DecaySampler.cpp
+Expected focal plane momentum distributions (loci) of the decay products of particle-unbound states, for the decays attached
+to each reaction (see DecayChannel). The reaction is taken as isotropic in the center of mass, and the unbound residual or
+ejectile decays isotropically in its rest frame; everything is relativistic. Only decay products which come out inside the
+spectrograph acceptance (a cone around the spectrograph angle) count.
+
+Sampling is importance weighted rather than thrown and cut, since only a tiny fraction of all decays would make it into the
+acceptance: reaction angles are only drawn from the range where the unbound state can send its product into the acceptance,
+and the product's direction is drawn inside the acceptance, with its momentum solved for and weighted by the decay's lab to
+rest frame solid angle ratio. Loci are sampled in batches, spread over the thread pool, and every batch has its own fixed seed,
+so the result doesn't depend on the number of threads.
+
+Momenta rather than rhos are kept, so that a change of field is just a rescale.
+
+The decays and the sampling are given in the input file by their own keywords (DECAY and LOCUSSAMPLING), read and written here.
+*/
+#include "DecaySampler.h"
+#include "ParallelFor.h"
+#include <iostream>
+#include <cmath>
+#include <random>
+#include <numeric>
+#include <algorithm>
+
+namespace {
+
+	const double PI = 3.14159265358979323846;
+	const double DEG2RAD = PI/180.0;
+	const double WIDTH_CUTOFF = 5.0; //widths either side of the centroid a broad state is sampled over
+	const double ANGLE_MARGIN = 1.0*DEG2RAD; //slack on the reaction angle range, for the variation within an angle bin
+
+	/*Everything about one locus which doesn't change from sample to sample; masses in MeV*/
+	struct LocusSetup {
+		double mBeam, mTarget;
+		double mParent, mOther; //ground states of the unbound product of the reaction, and of its partner
+		double mDetected, mRemainder; //decay products of the unbound state
+		double ex, width;
+		double beamKE;
+		std::vector<int> bins; //bins in cos(theta_cm) of the unbound state worth sampling
+		bool valid;
+	};
+
+	/*Center of mass of the reaction for a given excitation of the unbound state*/
+	struct Frame {
+		double beta, gamma; //of the center of mass in the lab
+		double p, E; //momentum and total energy of the unbound state in the center of mass
+		double mass;
+	};
+
+	bool MakeFrame(const LocusSetup& setup, double ex, Frame& frame) {
+		frame.mass = setup.mParent + ex;
+		double eBeam = setup.beamKE + setup.mBeam;
+		double pBeam = std::sqrt(eBeam*eBeam - setup.mBeam*setup.mBeam);
+		double s = setup.mBeam*setup.mBeam + setup.mTarget*setup.mTarget + 2.0*eBeam*setup.mTarget;
+		double sqrtS = std::sqrt(s);
+		if(sqrtS <= frame.mass + setup.mOther) return false; //closed
+		double lambda = (s - std::pow(frame.mass + setup.mOther, 2.0))*(s - std::pow(frame.mass - setup.mOther, 2.0));
+		frame.p = std::sqrt(lambda)/(2.0*sqrtS);
+		frame.E = (s + frame.mass*frame.mass - setup.mOther*setup.mOther)/(2.0*sqrtS);
+		frame.beta = pBeam/(eBeam + setup.mTarget);
+		frame.gamma = (eBeam + setup.mTarget)/sqrtS;
+		return true;
+	}
+
+	/*Momentum of either product of a two body decay in the rest frame; negative if below threshold*/
+	double DecayMomentum(double M, double m1, double m2) {
+		if(M <= m1 + m2) return -1.0;
+		return std::sqrt((M*M - std::pow(m1 + m2, 2.0))*(M*M - std::pow(m1 - m2, 2.0)))/(2.0*M);
+	}
+
+	/*Lab polar angle, and momentum, of the unbound state for a cos(theta_cm)*/
+	void LabParent(const Frame& frame, double cosCM, double& theta, double& p, double& E) {
+		double pz = frame.gamma*(frame.p*cosCM + frame.beta*frame.E);
+		double pt = frame.p*std::sqrt(std::max(0.0, 1.0 - cosCM*cosCM));
+		theta = std::atan2(pt, pz);
+		p = std::sqrt(pz*pz + pt*pt);
+		E = frame.gamma*(frame.E + frame.beta*frame.p*cosCM);
+	}
+
+	/*Largest lab angle between the decay product and the unbound state; pi if the product can go anywhere*/
+	double MaxOpening(double pStar, double mDetected, double p, double M) {
+		double ratio = (pStar/mDetected)/(p/M); //product's beta*gamma in the rest frame over the parent's in the lab
+		return ratio >= 1.0 ? PI : std::asin(ratio);
+	}
+}
+
+DecaySampler::DecaySampler() :
+	m_acceptance(DEFAULT_ACCEPTANCE), m_nSamples(DEFAULT_SAMPLES)
+{
+}
+
+DecaySampler::~DecaySampler() {}
+
+double DecaySampler::MomentumToRho(double p, int Z, double B) {
+	return p/(Reaction::QBRHO2P*Z*B);
+}
+
+/*
+	One line of the input file, after its keyword. False if the keyword isn't a decay one; otherwise parsed tells whether the line
+	could be read (a malformed line changes nothing). Decays are only held until AttachDecays, since the reactions they name may
+	not exist yet (e.g. those made from the target)
+*/
+bool DecaySampler::ReadConfigLine(const std::string& keyword, std::istream& row, bool& parsed) {
+	if(keyword == "DECAY") {
+		std::pair<std::string, DecayChannel> decay;
+		std::string parent;
+		parsed = row>>decay.first>>parent>>decay.second.ex>>decay.second.width>>decay.second.A>>decay.second.Z
+				 && (parent == "RESIDUAL" || parent == "EJECTILE");
+		decay.second.parent = parent == "EJECTILE" ? DecayChannel::EJECTILE : DecayChannel::RESIDUAL;
+		if(parsed) m_pending.push_back(decay);
+	} else if(keyword == "LOCUSSAMPLING") {
+		int samples;
+		double acceptance;
+		if((parsed = (bool)(row>>samples>>acceptance))) {
+			m_nSamples = samples;
+			m_acceptance = acceptance;
+		}
+	} else {
+		return false;
+	}
+	return true;
+}
+
+/*Give the decays read from the input file to every reaction with their reaction's name*/
+void DecaySampler::AttachDecays(std::vector<Reaction>& reactions) {
+	for(auto& decay : m_pending) {
+		bool found = false;
+		for(auto& rxn : reactions) {
+			if(rxn.GetName() == decay.first) {
+				rxn.AddDecay(decay.second);
+				found = true;
+			}
+		}
+		if(!found) std::cerr<<"No reaction "<<decay.first<<" for DECAY at DecaySampler::AttachDecays()! Skipping."<<std::endl;
+	}
+	m_pending.clear();
+}
+
+/*The decay lines of the input file, for the decays attached to the reactions; sampling only if it isn't the default*/
+void DecaySampler::WriteConfig(std::ostream& output, const std::vector<Reaction>& reactions) const {
+	for(auto& rxn : reactions) {
+		for(auto& decay : rxn.GetDecays()) {
+			output<<"DECAY "<<rxn.GetName()<<"\t"<<(decay.parent == DecayChannel::EJECTILE ? "EJECTILE" : "RESIDUAL")<<"\t"<<decay.ex
+				  <<"\t"<<decay.width<<"\t"<<decay.A<<"\t"<<decay.Z<<std::endl;
+		}
+	}
+	if(m_nSamples != DEFAULT_SAMPLES || m_acceptance != DEFAULT_ACCEPTANCE)
+		output<<"LOCUSSAMPLING "<<m_nSamples<<"\t"<<m_acceptance<<std::endl;
+}
+
+/*Back to the default sampling, with no decays waiting*/
+void DecaySampler::ClearConfig() {
+	m_acceptance = DEFAULT_ACCEPTANCE;
+	m_nSamples = DEFAULT_SAMPLES;
+	m_pending.clear();
+}
+
+/*
+	One locus per decay of every reaction, in reaction then decay order. Angles in deg. Loci which can't happen (closed, below the
+	decay threshold, or never reaching the acceptance) come back empty with an efficiency of 0
+*/
+std::vector<DecayLocus> DecaySampler::Sample(const std::vector<Reaction>& reactions, double beamKE, double theta) const {
+	std::vector<DecayLocus> loci;
+	std::vector<LocusSetup> setups;
+	double thetaS = theta*DEG2RAD;
+	double acceptance = m_acceptance*DEG2RAD;
+
+	for(unsigned int i=0; i<reactions.size(); i++) {
+		const Reaction& rxn = reactions[i];
+		for(auto& decay : rxn.GetDecays()) {
+			DecayLocus locus;
+			locus.rxnIndex = i;
+			locus.channel = decay;
+			locus.efficiency = 0.0;
+			locus.pLow = locus.pPeak = locus.pHigh = 0.0;
+			loci.push_back(locus);
+
+			bool ejectile = decay.parent == DecayChannel::EJECTILE;
+			const nucleus& parent = ejectile ? rxn.GetEjectile() : rxn.GetResidual();
+			LocusSetup setup;
+			setup.mBeam = rxn.GetProjectile().mass_gs;
+			setup.mTarget = rxn.GetTarget().mass_gs;
+			setup.mParent = parent.mass_gs;
+			setup.mOther = ejectile ? rxn.GetResidual().mass_gs : rxn.GetEjectile().mass_gs;
+			setup.mDetected = MASS.FindMass(decay.Z, decay.A);
+			setup.mRemainder = MASS.FindMass(parent.Z - decay.Z, parent.A - decay.A);
+			setup.ex = decay.ex;
+			setup.width = decay.width;
+			setup.beamKE = beamKE;
+
+			//Keep the reaction angles from which the unbound state can reach within its largest opening angle of the acceptance
+			Frame frame;
+			double pStarMax = DecayMomentum(setup.mParent + decay.ex + WIDTH_CUTOFF*decay.width, setup.mDetected, setup.mRemainder);
+			setup.valid = pStarMax > 0.0 && MakeFrame(setup, decay.ex, frame);
+			if(setup.valid) {
+				std::vector<double> edgeTheta(ANGLE_BINS+1), edgeOpening(ANGLE_BINS+1);
+				double p, E;
+				for(int k=0; k<=ANGLE_BINS; k++) {
+					LabParent(frame, -1.0 + 2.0*k/ANGLE_BINS, edgeTheta[k], p, E);
+					edgeOpening[k] = MaxOpening(pStarMax, setup.mDetected, p, frame.mass);
+				}
+				for(int k=0; k<ANGLE_BINS; k++) {
+					double reach = acceptance + std::max(edgeOpening[k], edgeOpening[k+1]) + ANGLE_MARGIN;
+					double low = std::min(edgeTheta[k], edgeTheta[k+1]), high = std::max(edgeTheta[k], edgeTheta[k+1]);
+					if(low - reach <= thetaS && high + reach >= thetaS) setup.bins.push_back(k);
+				}
+				setup.valid = !setup.bins.empty();
+			}
+			setups.push_back(setup);
+		}
+	}
+
+	int nBatches = (m_nSamples + BATCH_SIZE - 1)/BATCH_SIZE;
+	std::vector<std::vector<double>> batchMomenta(loci.size()*nBatches), batchWeights(loci.size()*nBatches);
+	std::vector<double> batchSums(loci.size()*nBatches, 0.0);
+	double cosAcceptance = std::cos(acceptance);
+	double axis[3] = {std::sin(thetaS), 0.0, std::cos(thetaS)}; //spectrograph, in the horizontal (x-z) plane
+	double across[3] = {std::cos(thetaS), 0.0, -std::sin(thetaS)};
+
+	ParallelFor(loci.size()*nBatches, [&](int item) {
+		int index = item/nBatches;
+		int batch = item%nBatches;
+		const LocusSetup& setup = setups[index];
+		if(!setup.valid) return;
+		std::vector<double>& momenta = batchMomenta[item];
+		std::vector<double>& weights = batchWeights[item];
+
+		std::mt19937_64 generator(0x9E3779B97F4A7C15ULL*(index+1) + batch);
+		std::uniform_real_distribution<double> uniform(0.0, 1.0);
+		int nThrown = m_nSamples - batch*BATCH_SIZE;
+		if(nThrown > BATCH_SIZE) nThrown = BATCH_SIZE;
+		double binFraction = (double)setup.bins.size()/ANGLE_BINS;
+		double acceptanceFraction = 0.5*(1.0 - cosAcceptance); //of the full sphere
+		Frame frame;
+		bool sharp = setup.width == 0.0;
+		if(sharp) MakeFrame(setup, setup.ex, frame);
+		double pStar = DecayMomentum(setup.mParent + setup.ex, setup.mDetected, setup.mRemainder);
+
+		for(int n=0; n<nThrown; n++) {
+			if(!sharp) { //Breit-Wigner, cut off in the tails
+				double ex;
+				do {
+					ex = setup.ex + 0.5*setup.width*std::tan(PI*(uniform(generator) - 0.5));
+				} while(std::fabs(ex - setup.ex) > WIDTH_CUTOFF*setup.width);
+				if(!MakeFrame(setup, ex, frame)) continue;
+				pStar = DecayMomentum(frame.mass, setup.mDetected, setup.mRemainder);
+			}
+			if(pStar <= 0.0) continue;
+
+			//Unbound state, from the reaction angles worth sampling; azimuth only over the part which can reach the acceptance
+			int bin = setup.bins[std::min((int)(uniform(generator)*setup.bins.size()), (int)setup.bins.size()-1)];
+			double cosCM = -1.0 + 2.0*(bin + uniform(generator))/ANGLE_BINS;
+			double thetaP, p, E;
+			LabParent(frame, cosCM, thetaP, p, E);
+			double reach = acceptance + MaxOpening(pStar, setup.mDetected, p, frame.mass);
+			double phiRange = PI;
+			if(reach < PI) {
+				double denominator = std::sin(thetaP)*std::sin(thetaS);
+				if(denominator > 0.0) {
+					double x = (std::cos(reach) - std::cos(thetaP)*std::cos(thetaS))/denominator;
+					if(x >= 1.0) continue;
+					if(x > -1.0) phiRange = std::acos(x);
+				} else if(std::fabs(thetaP - thetaS) > reach) {
+					continue;
+				}
+			}
+			double phi = phiRange*(2.0*uniform(generator) - 1.0);
+			double u[3] = {std::sin(thetaP)*std::cos(phi), std::sin(thetaP)*std::sin(phi), std::cos(thetaP)};
+
+			//Decay product direction, inside the acceptance
+			double cosChi = 1.0 - uniform(generator)*(1.0 - cosAcceptance);
+			double sinChi = std::sqrt(std::max(0.0, 1.0 - cosChi*cosChi));
+			double psi = 2.0*PI*uniform(generator);
+			double d[3];
+			for(int k=0; k<3; k++)
+				d[k] = cosChi*axis[k] + sinChi*(std::cos(psi)*across[k]);
+			d[1] += sinChi*std::sin(psi);
+			double cosOpening = d[0]*u[0] + d[1]*u[1] + d[2]*u[2];
+
+			/*
+				Lab momentum along d: the rest frame energy E1* = gamma*(E1 - beta*cos*p1) fixes it, up to two roots. Each is weighted
+				by dOmega*(rest)/dOmega(lab) = p1^2/(gamma*p*|p1 - beta*E1*cos|)
+			*/
+			double beta = p/E, gamma = E/frame.mass;
+			double eStar = std::sqrt(pStar*pStar + setup.mDetected*setup.mDetected);
+			double a = 1.0 - beta*beta*cosOpening*cosOpening;
+			double b = -2.0*(eStar/gamma)*beta*cosOpening;
+			double c = setup.mDetected*setup.mDetected - std::pow(eStar/gamma, 2.0);
+			double discriminant = b*b - 4.0*a*c;
+			if(discriminant < 0.0) continue;
+			double weight = binFraction*(phiRange/PI)*acceptanceFraction;
+			for(int sign=-1; sign<=1; sign+=2) {
+				if(discriminant == 0.0 && sign == -1) continue;
+				double p1 = (-b + sign*std::sqrt(discriminant))/(2.0*a);
+				if(p1 <= 0.0) continue;
+				double e1 = eStar/gamma + beta*cosOpening*p1;
+				double jacobian = p1*p1/(gamma*pStar*std::fabs(p1 - beta*e1*cosOpening));
+				momenta.push_back(p1);
+				weights.push_back(weight*jacobian);
+				batchSums[item] += weight*jacobian;
+			}
+		}
+	});
+
+	//Batches are merged in order, so the loci are the same whichever threads did the batches
+	for(unsigned int index=0; index<loci.size(); index++) {
+		DecayLocus& locus = loci[index];
+		std::vector<double> momenta, weights;
+		double total = 0.0;
+		for(int batch=0; batch<nBatches; batch++) {
+			int item = index*nBatches + batch;
+			momenta.insert(momenta.end(), batchMomenta[item].begin(), batchMomenta[item].end());
+			weights.insert(weights.end(), batchWeights[item].begin(), batchWeights[item].end());
+			total += batchSums[item];
+		}
+		if(momenta.empty() || !(total > 0.0)) continue;
+		locus.efficiency = total/m_nSamples;
+
+		std::vector<size_t> order(momenta.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&momenta](size_t x, size_t y) { return momenta[x] < momenta[y]; });
+		locus.momenta.reserve(order.size());
+		locus.weights.reserve(order.size());
+		for(size_t k : order) {
+			locus.momenta.push_back(momenta[k]);
+			locus.weights.push_back(weights[k]);
+		}
+
+		double running = 0.0;
+		locus.pLow = locus.momenta.front();
+		locus.pHigh = locus.momenta.back();
+		bool lowFound = false;
+		for(size_t k=0; k<locus.momenta.size(); k++) {
+			running += locus.weights[k];
+			if(!lowFound && running >= 0.05*total) {
+				locus.pLow = locus.momenta[k];
+				lowFound = true;
+			}
+			if(running >= 0.95*total) {
+				locus.pHigh = locus.momenta[k];
+				break;
+			}
+		}
+
+		std::vector<double> histogram(PEAK_BINS, 0.0);
+		double pMin = locus.momenta.front(), pMax = locus.momenta.back();
+		double binWidth = (pMax - pMin)/PEAK_BINS;
+		for(size_t k=0; k<locus.momenta.size(); k++) {
+			int bin = binWidth > 0.0 ? std::min(PEAK_BINS-1, (int)((locus.momenta[k] - pMin)/binWidth)) : 0;
+			histogram[bin] += locus.weights[k];
+		}
+		int peak = std::max_element(histogram.begin(), histogram.end()) - histogram.begin();
+		locus.pPeak = pMin + (peak + 0.5)*binWidth;
+	}
+	return loci;
+}
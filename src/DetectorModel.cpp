@@ -0,0 +1,206 @@
+/*
+
+DetectorModel.cpp
+Layers of the focal plane detector, in the order the ejectile goes through them (windows, gas sections, the stopping
+scintillator), and the stopping tables needed to slow ejectiles down through them. Gives the energy each ejectile leaves in
+every layer; the read out (active) layers are what the particle ID (dE vs. E) plots are made from.
+
+Tables are kept per element and material. An isotope other than the one tabulated is scaled at the same velocity
+(S(E) of A' is S(E*A/A') of A), so a single table per element covers all of its isotopes.
+
+The detector is given in the input file by its own keywords (DETECTOR, STOPPING and PID), read and written here.
+*/
+#include "DetectorModel.h"
+#include "ParallelFor.h"
+#include <iostream>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+DetectorModel::DetectorModel() {}
+
+DetectorModel::~DetectorModel() {}
+
+void DetectorModel::AddLayer(const DetectorLayer& layer) {
+	if(layer.name.empty() || layer.material.empty() || !(layer.thickness >= 0.0)) {
+		std::cerr<<"Invalid detector layer at DetectorModel::AddLayer()! Skipping."<<std::endl;
+		return;
+	}
+	if(FindLayer(layer.name) != -1) {
+		std::cerr<<"Detector layer "<<layer.name<<" given twice at DetectorModel::AddLayer()! Skipping."<<std::endl;
+		return;
+	}
+	m_layers.push_back(layer);
+}
+
+/*Load the stopping table of an ion in a material; replaces any earlier table for the same element and material*/
+bool DetectorModel::AddTable(const StoppingSource& source) {
+	if(source.A <= 0 || source.Z <= 0 || source.material.empty()) {
+		std::cerr<<"Invalid stopping table ion or material at DetectorModel::AddTable()!"<<std::endl;
+		return false;
+	}
+	StoppingTable table;
+	if(!table.Load(source.filename)) return false;
+	m_tables[std::make_pair(source.Z, source.material)] = std::make_pair(source.A, table);
+	for(auto& other : m_sources) {
+		if(other.Z == source.Z && other.material == source.material) {
+			other = source;
+			return true;
+		}
+	}
+	m_sources.push_back(source);
+	return true;
+}
+
+/*Layers of the particle ID plot, by name; empty names go back to the first and last active layers*/
+void DetectorModel::SetPIDLayers(const std::string& dELayer, const std::string& ELayer) {
+	m_pidDE = dELayer;
+	m_pidE = ELayer;
+}
+
+void DetectorModel::Clear() {
+	m_layers.clear();
+	m_sources.clear();
+	m_tables.clear();
+	m_pidDE.clear();
+	m_pidE.clear();
+}
+
+/*
+	One line of the input file, after its keyword. False if the keyword isn't a detector one; otherwise parsed tells whether the
+	line could be read (a malformed line changes nothing)
+*/
+bool DetectorModel::ReadConfigLine(const std::string& keyword, std::istream& row, bool& parsed) {
+	if(keyword == "DETECTOR") {
+		DetectorLayer layer;
+		std::string readout;
+		parsed = row>>layer.name>>layer.material>>layer.thickness>>readout && (readout == "ACTIVE" || readout == "DEAD");
+		layer.active = readout == "ACTIVE";
+		if(parsed) AddLayer(layer);
+	} else if(keyword == "STOPPING") {
+		StoppingSource source;
+		if((parsed = (bool)(row>>source.A>>source.Z>>source.material>>source.filename))) AddTable(source);
+	} else if(keyword == "PID") {
+		std::string dELayer, ELayer;
+		if((parsed = (bool)(row>>dELayer>>ELayer))) SetPIDLayers(dELayer, ELayer);
+	} else {
+		return false;
+	}
+	return true;
+}
+
+/*The detector's lines of the input file; nothing without a detector*/
+void DetectorModel::WriteConfig(std::ostream& output) const {
+	for(auto& layer : m_layers)
+		output<<"DETECTOR "<<layer.name<<"\t"<<layer.material<<"\t"<<layer.thickness<<"\t"<<(layer.active ? "ACTIVE" : "DEAD")<<std::endl;
+	for(auto& source : m_sources)
+		output<<"STOPPING "<<source.A<<"\t"<<source.Z<<"\t"<<source.material<<"\t"<<source.filename<<std::endl;
+	if(!m_pidDE.empty())
+		output<<"PID "<<m_pidDE<<"\t"<<m_pidE<<std::endl;
+}
+
+/*Index of the named layer; -1 if there isn't one*/
+int DetectorModel::FindLayer(const std::string& name) const {
+	for(unsigned int i=0; i<m_layers.size(); i++) {
+		if(m_layers[i].name == name) return i;
+	}
+	return -1;
+}
+
+const StoppingTable* DetectorModel::FindTable(int Z, const std::string& material, int& tableA) const {
+	auto found = m_tables.find(std::make_pair(Z, material));
+	if(found == m_tables.end()) return nullptr;
+	tableA = found->second.first;
+	return &(found->second.second);
+}
+
+/*True if there is a table for the element in every layer's material*/
+bool DetectorModel::CanStop(int Z) const {
+	int tableA;
+	for(auto& layer : m_layers) {
+		if(FindTable(Z, layer.material, tableA) == nullptr) return false;
+	}
+	return !m_layers.empty();
+}
+
+/*
+	Energy (MeV) left in each layer by n ejectiles of the given isotope with kinetic energies ke (MeV), written to
+	deposits[i*GetNLayers() + layer]. Each layer is a range lookup and an energy lookup; an ejectile which stops leaves nothing
+	in the layers after. Without the tables for the element (or past the top of a table) the deposits are NaN. Ejectiles are
+	done in blocks, concurrently
+*/
+void DetectorModel::Deposit(int A, int Z, const double* ke, int n, double* deposits) const {
+	const double nan = std::numeric_limits<double>::quiet_NaN();
+	int nLayers = m_layers.size();
+	std::vector<const StoppingTable*> tables(nLayers, nullptr);
+	std::vector<double> scales(nLayers, 1.0); //tabulated A over A; at the same velocity, table E and range are E and range*scale
+	for(int k=0; k<nLayers; k++) {
+		int tableA = A;
+		tables[k] = FindTable(Z, m_layers[k].material, tableA);
+		scales[k] = (double)tableA/A;
+	}
+
+	int nBlocks = (n + BLOCK_SIZE - 1)/BLOCK_SIZE;
+	ParallelFor(nBlocks, [&](int block) {
+		int last = std::min(n, (block+1)*BLOCK_SIZE);
+		for(int i=block*BLOCK_SIZE; i<last; i++) {
+			double* row = deposits + (size_t)i*nLayers;
+			double energy = ke[i];
+			for(int k=0; k<nLayers; k++) {
+				if(tables[k] == nullptr || std::isnan(energy)) {
+					row[k] = nan;
+					energy = nan;
+					continue;
+				}
+				double range = tables[k]->GetRange(energy*scales[k])/scales[k];
+				double left = range - m_layers[k].thickness;
+				double out = left > 0.0 ? tables[k]->GetEnergy(left*scales[k])/scales[k] : 0.0;
+				if(std::isnan(left)) out = nan; //not a stop
+				row[k] = energy - out; //NaN if the ejectile is past the top of the table
+				energy = out;
+			}
+		}
+	});
+}
+
+/*The named particle ID layers, or by default the first and last active layers*/
+bool DetectorModel::FindPIDLayers(int& dELayer, int& ELayer) const {
+	dELayer = -1;
+	ELayer = -1;
+	if(!m_pidDE.empty() || !m_pidE.empty()) {
+		dELayer = FindLayer(m_pidDE);
+		ELayer = FindLayer(m_pidE);
+	} else {
+		for(unsigned int k=0; k<m_layers.size(); k++) {
+			if(!m_layers[k].active) continue;
+			if(dELayer == -1) dELayer = k;
+			ELayer = k;
+		}
+	}
+	if(dELayer == -1 || ELayer == -1 || dELayer == ELayer) {
+		std::cerr<<"Particle ID needs two different detector layers at DetectorModel::FindPIDLayers()!"<<std::endl;
+		return false;
+	}
+	return true;
+}
+
+/*
+	Particle ID (E, dE) points of ejectiles of the given isotope with kinetic energies ke (MeV), in the given layers. Only
+	ejectiles which leave energy in both layers (i.e. get into the E layer) give a point. Returns the number of points
+*/
+int DetectorModel::GetPIDPoints(int A, int Z, const std::vector<double>& ke, int dELayer, int ELayer, std::vector<double>& E, std::vector<double>& dE) const {
+	E.clear();
+	dE.clear();
+	int nLayers = m_layers.size();
+	if(ke.empty() || dELayer < 0 || ELayer < 0 || dELayer >= nLayers || ELayer >= nLayers) return 0;
+	std::vector<double> rows(ke.size()*nLayers);
+	Deposit(A, Z, ke.data(), ke.size(), rows.data());
+	for(unsigned int i=0; i<ke.size(); i++) {
+		double rowDE = rows[i*nLayers + dELayer], rowE = rows[i*nLayers + ELayer];
+		if(rowE > 0.0 && rowDE > 0.0) {
+			E.push_back(rowE);
+			dE.push_back(rowDE);
+		}
+	}
+	return E.size();
+}
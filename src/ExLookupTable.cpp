@@ -0,0 +1,97 @@
+/*
+
+ExLookupTable.cpp
+Precomputed rho -> Ex table for one reaction at one setting, for converting large numbers of focal plane events. The table is
+uniform in rho, so a conversion is an index and a linear interpolation, with no square roots. Points are taken from the exact
+inverse (Reaction::CalculateExcitation), and the table is made fine enough that interpolating never misses the exact value by
+more than the requested tolerance (checked at the middle of every interval, where the error of a smooth curve peaks).
+
+Ex has to fall monotonically with rho over the table, which holds for forward angles; Build fails otherwise. Events outside of
+the table (or NaN) convert to NaN.
+*/
+#include "ExLookupTable.h"
+#include "ParallelFor.h"
+#include <cmath>
+#include <iostream>
+
+static const double DEG2RAD = 3.14159265358979323846/180.0;
+
+ExLookupTable::ExLookupTable() :
+	m_rhoMin(0.0), m_invStep(0.0), m_nIntervals(0), m_maxError(0.0)
+{
+}
+
+ExLookupTable::~ExLookupTable() {}
+
+/*
+	Table covering excitations exMin to exMax (MeV) at beam KE (MeV), angle (deg), and field (kG); tolerance in MeV. The
+	interval count is doubled until the midpoints are all within the tolerance, and each pass evaluates the points of the
+	next one, so nothing is calculated twice
+*/
+bool ExLookupTable::Build(const Reaction& rxn, double beamKE, double theta, double B, double exMin, double exMax, double tolerance) {
+	m_ex.clear();
+	m_nIntervals = 0;
+	if(!rxn.IsInitialized() || exMin >= exMax || tolerance <= 0.0) {
+		std::cerr<<"Invalid reaction or table range at ExLookupTable::Build()!"<<std::endl;
+		return false;
+	}
+
+	double theta_rad = theta*DEG2RAD;
+	double rhoLow = rxn.MomentumToRho(rxn.CalculateEjectileP(exMax, beamKE, theta_rad), B);
+	double rhoHigh = rxn.MomentumToRho(rxn.CalculateEjectileP(exMin, beamKE, theta_rad), B);
+	if(std::isnan(rhoLow) || std::isnan(rhoHigh) || rhoLow >= rhoHigh) {
+		std::cerr<<"Excitations "<<exMin<<" to "<<exMax<<" MeV not kinematically allowed for "<<rxn.GetName()
+				 <<" at ExLookupTable::Build()!"<<std::endl;
+		return false;
+	}
+
+	std::vector<double> fine;
+	for(int n=MIN_POINTS-1; 2*n+1<=MAX_POINTS; n*=2) {
+		//Odd points of the fine grid are the midpoints of the table being tried
+		if(fine.empty()) {
+			fine.resize(2*n+1);
+			ParallelFor(fine.size(), [&](int i) {
+				fine[i] = rxn.CalculateExcitation(rhoLow + i*(rhoHigh - rhoLow)/(2*n), beamKE, theta_rad, B);
+			});
+		}
+
+		bool monotonic = true;
+		double maxError = 0.0;
+		for(int i=0; i<n; i++) {
+			const double* point = &fine[2*i];
+			monotonic = monotonic && point[0] > point[1] && point[1] > point[2];
+			maxError = std::max(maxError, std::fabs(point[1] - 0.5*(point[0] + point[2])));
+		}
+		if(!monotonic) {
+			std::cerr<<"Ex is not monotonic in rho for "<<rxn.GetName()<<" at "<<theta<<" deg at ExLookupTable::Build()!"<<std::endl;
+			return false;
+		}
+		if(maxError <= tolerance) {
+			m_ex.resize(n+1);
+			for(int i=0; i<=n; i++)
+				m_ex[i] = fine[2*i];
+			m_rhoMin = rhoLow;
+			m_invStep = n/(rhoHigh - rhoLow);
+			m_nIntervals = n;
+			m_maxError = maxError;
+			return true;
+		}
+
+		//The fine grid is the next table; only its midpoints are new
+		std::vector<double> finer(4*n+1);
+		for(int i=0; i<=2*n; i++)
+			finer[2*i] = fine[i];
+		ParallelFor(2*n, [&](int i) {
+			finer[2*i+1] = rxn.CalculateExcitation(rhoLow + (2*i+1)*(rhoHigh - rhoLow)/(4*n), beamKE, theta_rad, B);
+		});
+		fine.swap(finer);
+	}
+
+	std::cerr<<"Unable to reach a tolerance of "<<tolerance<<" MeV at ExLookupTable::Build()!"<<std::endl;
+	return false;
+}
+
+void ExLookupTable::Convert(const double* rho, double* ex, int n) const {
+	for(int i=0; i<n; i++)
+		ex[i] = Convert(rho[i]);
+}
@@ -1,10 +1,20 @@
-
 /*
 
 ExTable.cpp
-Generates a map for nuclear excitation energies; fed from a file titled excitations.dat in the dir /data/. Creates a static global instance
+Generates a map for nuclear excitation energies; fed from a file titled excitations.dat in the dir /data/. Creates a global instance
 of this map (EX) for use throughout code it is included into (i.e. its a singleton, but gave the option for it to not be)
 
+Levels can additionally be imported from ENSDF formated level schemes. Levels are held in a single flat store (one compact record per
+level, with labels and J-pi strings pooled), and each nuclide maps to a contiguous range of that store, so lookups stay constant time
+and memory stays small even with every known nuclide loaded.
+
+Individual levels can be overriden (or added) in named layers on top of the table, e.g. to try out a new measurement; a layer
+level replaces the table level with the same label. Layers are applied at lookup, in the order they were made, and can be
+switched on and off without touching the table.
+
+Lookups may be made from any number of threads at once; loading and editing the table waits for them, and lookups wait for it
+(see ReadWriteLock.h).
+
 Written by G.W. McCann Sep. 2020
 
 */
@@ -12,47 +22,390 @@ Written by G.W. McCann Sep. 2020
 #include "ExTable.h"
 #include <fstream>
 #include <iostream>
+#include <cctype>
+#include <limits>
+#include <algorithm>
 
-ExTable::ExTable() {
-	std::ifstream input("data/excitations.dat");
-	if(!input.is_open()) {
+ExTable EX;
+
+ExTable::ExTable() :
+	garbage(0)
+{
+	jpiPool.push_back(""); //index 0 is always unknown J-pi
+	jpiIndex[""] = 0;
+
+	if(!ReadFile("data/excitations.dat"))
 		std::cerr<<"Unable to open excitations.dat! Check that it is in ./data/"<<std::endl;
-		return;
-	}
+}
+
+ExTable::~ExTable() {}
+
+/*Read a hand-maintained excitation list (excitations.dat format); nuclides in the file replace any already in the table*/
+bool ExTable::ReadFile(const std::string& filename) {
+	std::ifstream input(filename);
+	if(!input.is_open()) return false;
 
+	WriteGuard guard(lock);
 	std::string element, text;
-	ExData temp;
+	std::vector<LevelRecord> temp;
 	while(input>>element) {
-		temp.ex_list.clear();
-		temp.str_list.clear();
+		temp.clear();
 		while(true){
-			input>>text;
-			if(text == "end") break;
-			temp.ex_list.emplace_back(stod(text));
-			temp.str_list.emplace_back(text);
+			if(!(input>>text) || text == "end") break; //a missing end shouldn't hang the read
+			temp.push_back(MakeRecord(stod(text), 0.0, text, ""));
 		}
-		table[element] = temp;
+		SetNuclide(element, temp);
 	}
+	return true;
 }
 
-ExTable::~ExTable() {}
-
-std::vector<double> ExTable::GetListOfExcitations(std::string& element) {
+std::vector<double> ExTable::GetListOfExcitations(std::string& element) const {
+	ReadGuard guard(lock);
 	auto iter = table.find(element);
 	if(iter == table.end()) {
 		std::cerr<<"Invalid element name at GetListOfExictations!"<<std::endl;
 		return std::vector<double>({0});
 	} else {
-		return iter->second.ex_list;
+		std::vector<double> ex_list;
+		ex_list.reserve(iter->second.count);
+		for(uint32_t i=iter->second.first; i<iter->second.first+iter->second.count; i++)
+			ex_list.push_back(levels[i].energy);
+		return ex_list;
 	}
 }
 
-std::vector<std::string> ExTable::GetListOfExcitations_Strings(std::string& element) {
+std::vector<std::string> ExTable::GetListOfExcitations_Strings(std::string& element) const {
+	ReadGuard guard(lock);
 	auto iter = table.find(element);
 	if(iter == table.end()) {
 		std::cerr<<"Invalid element name at GetListOfExictations_Strings!"<<std::endl;
 		return std::vector<std::string>({""});
 	} else {
-		return iter->second.str_list;
+		std::vector<std::string> str_list;
+		str_list.reserve(iter->second.count);
+		for(uint32_t i=iter->second.first; i<iter->second.first+iter->second.count; i++)
+			str_list.push_back(GetLabel(levels[i]));
+		return str_list;
+	}
+}
+
+/*
+	Everything known about the levels of a nuclide, with the enabled override layers applied; returns false if neither the
+	table nor any enabled layer has the nuclide
+*/
+bool ExTable::GetLevels(const std::string& name, ExData& data) const {
+	data.ex_list.clear();
+	data.str_list.clear();
+	data.unc_list.clear();
+	data.jpi_list.clear();
+
+	ReadGuard guard(lock);
+	auto iter = table.find(name);
+	bool found = iter != table.end();
+	if(found) {
+		for(uint32_t i=iter->second.first; i<iter->second.first+iter->second.count; i++) {
+			const LevelRecord& level = levels[i];
+			data.ex_list.push_back(level.energy);
+			data.str_list.push_back(GetLabel(level));
+			data.unc_list.push_back(level.uncertainty);
+			data.jpi_list.push_back(jpiPool[level.jpi]);
+		}
+	}
+
+	for(auto& layer : layers) {
+		if(!layer.enabled) continue;
+		for(auto& level : layer.levels) {
+			if(level.nuclide != name) continue;
+			found = true;
+			auto match = std::find(data.str_list.begin(), data.str_list.end(), level.label);
+			if(match != data.str_list.end()) {
+				size_t i = match - data.str_list.begin();
+				data.ex_list[i] = level.energy;
+				data.unc_list[i] = level.uncertainty;
+			} else {
+				data.ex_list.push_back(level.energy);
+				data.str_list.push_back(level.label);
+				data.unc_list.push_back(level.uncertainty);
+				data.jpi_list.push_back("");
+			}
+		}
+	}
+	return found;
+}
+
+/*Adds (or replaces) a level in an override layer; a new layer goes on top, enabled*/
+void ExTable::SetLevelOverride(const std::string& layer, const LevelOverride& level) {
+	WriteGuard guard(lock);
+	for(auto& existing : layers) {
+		if(existing.name != layer) continue;
+		for(auto& other : existing.levels) {
+			if(other.nuclide == level.nuclide && other.label == level.label) {
+				other = level;
+				return;
+			}
+		}
+		existing.levels.push_back(level);
+		return;
+	}
+	LevelLayer added;
+	added.name = layer;
+	added.enabled = true;
+	added.levels.push_back(level);
+	layers.push_back(added);
+}
+
+/*Returns false if there is no such layer*/
+bool ExTable::SetLayerEnabled(const std::string& layer, bool enabled) {
+	WriteGuard guard(lock);
+	for(auto& existing : layers) {
+		if(existing.name == layer) {
+			existing.enabled = enabled;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ExTable::IsLayerEnabled(const std::string& layer) const {
+	ReadGuard guard(lock);
+	for(auto& existing : layers) {
+		if(existing.name == layer) return existing.enabled;
+	}
+	return false;
+}
+
+void ExTable::ClearLayers() {
+	WriteGuard guard(lock);
+	layers.clear();
+}
+
+std::vector<std::string> ExTable::GetLayers() const {
+	ReadGuard guard(lock);
+	std::vector<std::string> names;
+	for(auto& existing : layers)
+		names.push_back(existing.name);
+	return names;
+}
+
+/*Nuclides with a level in the layer, i.e. those whose levels change when it is switched*/
+std::vector<std::string> ExTable::GetLayerNuclides(const std::string& layer) const {
+	ReadGuard guard(lock);
+	std::vector<std::string> nuclides;
+	for(auto& existing : layers) {
+		if(existing.name != layer) continue;
+		for(auto& level : existing.levels) {
+			if(std::find(nuclides.begin(), nuclides.end(), level.nuclide) == nuclides.end())
+				nuclides.push_back(level.nuclide);
+		}
+	}
+	return nuclides;
+}
+
+/*Adds (or replaces) a nuclide from already parsed levels; J-pi and uncertainties are optional (may be empty)*/
+void ExTable::SetLevels(const std::string& name, const ExData& data) {
+	WriteGuard guard(lock);
+	std::vector<LevelRecord> temp;
+	temp.reserve(data.ex_list.size());
+	for(size_t i=0; i<data.ex_list.size(); i++) {
+		double unc = i < data.unc_list.size() ? data.unc_list[i] : 0.0;
+		const std::string& label = i < data.str_list.size() ? data.str_list[i] : std::to_string(data.ex_list[i]);
+		temp.push_back(MakeRecord(data.ex_list[i], unc, label, i < data.jpi_list.size() ? data.jpi_list[i] : ""));
+	}
+	SetNuclide(name, temp);
+}
+
+/*Drops a nuclide; its levels are left in the store to be compacted away like replaced ones*/
+void ExTable::RemoveNuclide(const std::string& name) {
+	WriteGuard guard(lock);
+	auto iter = table.find(name);
+	if(iter == table.end()) return;
+	garbage += iter->second.count;
+	table.erase(iter);
+	if(garbage > levels.size()/2) Compact();
+}
+
+/*Adds (or replaces) the level list of a nuclide. Replaced levels are left in the store until enough accumulate to compact*/
+void ExTable::SetNuclide(const std::string& name, const std::vector<LevelRecord>& nuclide_levels) {
+	auto iter = table.find(name);
+	if(iter != table.end()) garbage += iter->second.count;
+
+	LevelRange range;
+	range.first = levels.size();
+	range.count = nuclide_levels.size();
+	levels.insert(levels.end(), nuclide_levels.begin(), nuclide_levels.end());
+	table[name] = range;
+
+	if(garbage > levels.size()/2) Compact();
+}
+
+LevelRecord ExTable::MakeRecord(double energy, double uncertainty, const std::string& label, const std::string& jpi) {
+	LevelRecord level;
+	level.energy = energy;
+	level.uncertainty = uncertainty;
+	level.label = labelPool.size();
+	level.labelLength = std::min(label.size(), (size_t) std::numeric_limits<uint8_t>::max());
+	labelPool.append(label, 0, level.labelLength);
+
+	auto iter = jpiIndex.find(jpi);
+	if(iter != jpiIndex.end()) {
+		level.jpi = iter->second;
+	} else if(jpiPool.size() < std::numeric_limits<uint16_t>::max()) {
+		level.jpi = jpiPool.size();
+		jpiIndex[jpi] = level.jpi;
+		jpiPool.push_back(jpi);
+	} else {
+		level.jpi = 0;
 	}
-}
\ No newline at end of file
+	return level;
+}
+
+std::string ExTable::GetLabel(const LevelRecord& level) const {
+	return labelPool.substr(level.label, level.labelLength);
+}
+
+/*Rebuild the store without any replaced levels or labels*/
+void ExTable::Compact() {
+	std::vector<LevelRecord> new_levels;
+	std::string new_pool;
+	new_levels.reserve(levels.size() - garbage);
+	for(auto& entry : table) {
+		LevelRange& range = entry.second;
+		uint32_t first = new_levels.size();
+		for(uint32_t i=range.first; i<range.first+range.count; i++) {
+			LevelRecord level = levels[i];
+			uint32_t offset = new_pool.size();
+			new_pool.append(labelPool, level.label, level.labelLength);
+			level.label = offset;
+			new_levels.push_back(level);
+		}
+		range.first = first;
+	}
+	levels.swap(new_levels);
+	labelPool.swap(new_pool);
+	garbage = 0;
+}
+
+/*
+	ENSDF helpers. Fields are fixed column, so they are parsed in place from the line buffer. Returns false for anything which isn't a plain
+	decimal (e.g. energies relative to an unknown level, like 1234.5+X)
+*/
+static bool ParseENSDFNumber(const std::string& line, size_t start, size_t length, double& value, int& decimals, std::string& text) {
+	text.clear();
+	for(size_t i=start; i<start+length && i<line.size(); i++) {
+		if(line[i] != ' ') text.push_back(line[i]);
+	}
+	if(text.empty()) return false;
+
+	value = 0.0;
+	decimals = 0;
+	bool point = false;
+	double scale = 1.0;
+	for(char c : text) {
+		if(c >= '0' && c <= '9') {
+			if(point) {
+				scale *= 0.1;
+				value += (c - '0')*scale;
+				decimals++;
+			} else {
+				value = value*10.0 + (c - '0');
+			}
+		} else if(c == '.' && !point) {
+			point = true;
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*ENSDF energies are in keV; the existing labels are MeV, so shift the decimal point in the text rather than reformatting the number*/
+static std::string KeVToMeVLabel(const std::string& text) {
+	size_t point = text.find('.');
+	std::string whole = text.substr(0, point);
+	std::string fraction = (point == std::string::npos) ? "" : text.substr(point+1);
+	while(whole.size() < 4) whole.insert(0, "0");
+	std::string label = whole.substr(0, whole.size()-3);
+	fraction = whole.substr(whole.size()-3) + fraction;
+	size_t nonzero = label.find_first_not_of('0');
+	label = (nonzero == std::string::npos) ? "0" : label.substr(nonzero);
+	if(fraction.find_first_not_of('0') == std::string::npos) return label;
+	return label + "." + fraction;
+}
+
+/*NUCID is the mass number in cols 1-3 and the (upper case) element symbol in cols 4-5; converted to the table convention, e.g. 208Pb*/
+static std::string ENSDFNuclide(const std::string& line) {
+	std::string name;
+	for(size_t i=0; i<3 && i<line.size(); i++) {
+		if(line[i] != ' ') name.push_back(line[i]);
+	}
+	if(line.size() > 3 && line[3] != ' ') name.push_back(std::toupper(line[3]));
+	if(line.size() > 4 && line[4] != ' ') name.push_back(std::tolower(line[4]));
+	return name;
+}
+
+/*
+	Streams an ENSDF file (80 column records) into the table, one line at a time. Only the level (L) records of ADOPTED LEVELS datasets are
+	used, since every other dataset repeats a subset of the adopted levels. Energies, uncertainties (given in units of the last digit of the
+	energy), and J-pi are kept; nuclides already in the table are replaced.
+*/
+bool ExTable::ImportENSDF(const std::string& filename) {
+	std::ifstream input(filename);
+	if(!input.is_open()) {
+		std::cerr<<"Unable to open ENSDF file "<<filename<<" at ExTable::ImportENSDF()!"<<std::endl;
+		return false;
+	}
+
+	WriteGuard guard(lock);
+	std::string line, nuclide, energy_text, unc_text, jpi;
+	std::vector<LevelRecord> pending;
+	bool adopted = false;
+	int nNuclides = 0, nSkipped = 0;
+	double energy, unc;
+	int decimals, unc_decimals;
+
+	auto flush = [&]() {
+		if(adopted && !pending.empty()) {
+			SetNuclide(nuclide, pending);
+			nNuclides++;
+		}
+		pending.clear();
+		adopted = false;
+	};
+
+	while(std::getline(input, line)) {
+		if(line.find_first_not_of(" \r") == std::string::npos) { //END record
+			flush();
+			continue;
+		}
+		if(line.size() < 9) continue;
+
+		if(line.compare(5, 4, "    ") == 0) { //identification record; starts a dataset
+			flush();
+			nuclide = ENSDFNuclide(line);
+			adopted = line.compare(9, 14, "ADOPTED LEVELS") == 0;
+			continue;
+		}
+		if(!adopted || line[7] != 'L' || line[6] != ' ' || (line[5] != ' ' && line[5] != '1')) continue;
+
+		if(!ParseENSDFNumber(line, 9, 10, energy, decimals, energy_text)) {
+			nSkipped++;
+			continue;
+		}
+		unc = 0.0;
+		if(ParseENSDFNumber(line, 19, 2, unc, unc_decimals, unc_text)) {
+			for(int i=0; i<decimals; i++)
+				unc *= 0.1;
+		} else {
+			unc = 0.0; //limits, approximations, etc.
+		}
+		jpi.clear();
+		for(size_t i=21; i<39 && i<line.size(); i++) {
+			if(line[i] != ' ') jpi.push_back(line[i]);
+		}
+		pending.push_back(MakeRecord(energy*1.0e-3, unc*1.0e-3, KeVToMeVLabel(energy_text), jpi));
+	}
+	flush();
+
+	std::cout<<"Imported "<<nNuclides<<" nuclides from "<<filename<<" ("<<nSkipped<<" levels with unknown offsets skipped)"<<std::endl;
+	return nNuclides > 0;
+}
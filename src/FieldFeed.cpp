@@ -0,0 +1,234 @@
+/*
+
+FieldFeed.cpp
+Live readout of the spectrograph field, from either a file which the NMR logger appends to or a UNIX socket it writes to.
+Every line is one reading, and the field (kG) is the last number on the line, so both bare values and timestamped lines work.
+Readings are taken on a background thread; the owner only ever asks for the latest one, so any number of readings between two
+redraws collapse into a single update.
+*/
+#include "FieldFeed.h"
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#ifdef __linux__
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+FieldFeed::FieldFeed() :
+	m_socket(false), m_fd(-1), m_running(false), m_nReadings(0), m_latest(0.0), m_fresh(false)
+{
+}
+
+FieldFeed::~FieldFeed() {
+	Stop();
+}
+
+/*A path to a socket is connected to; anything else is followed as a file, starting from its last complete reading*/
+bool FieldFeed::Start(const std::string& source) {
+#ifdef __linux__
+	Stop();
+	struct stat info;
+	if(stat(source.c_str(), &info) != 0) {
+		std::cerr<<"Field source "<<source<<" does not exist at FieldFeed::Start()!"<<std::endl;
+		return false;
+	}
+	m_source = source;
+	m_socket = S_ISSOCK(info.st_mode);
+	m_partial.clear();
+	m_nReadings = 0;
+	{
+		std::lock_guard<std::mutex> guard(m_mutex);
+		m_fresh = false;
+	}
+	if(!Open()) return false;
+
+	if(!m_socket) { //pick up the current value rather than waiting for the next reading
+		off_t size = lseek(m_fd, 0, SEEK_END);
+		off_t start = size > 4096 ? size - 4096 : 0;
+		lseek(m_fd, start, SEEK_SET);
+		char buffer[4096];
+		ssize_t length = read(m_fd, buffer, sizeof(buffer));
+		if(length > 0) {
+			const char* begin = buffer;
+			if(start > 0) { //first line may be cut
+				const char* newline = (const char*) memchr(buffer, '\n', length);
+				begin = newline != nullptr ? newline + 1 : buffer + length;
+			}
+			Consume(begin, buffer + length - begin);
+		}
+	}
+
+	m_running = true;
+	m_thread = std::thread(&FieldFeed::Run, this);
+	return true;
+#else
+	std::cerr<<"Following a live field readout is only available on Linux at FieldFeed::Start()!"<<std::endl;
+	return false;
+#endif
+}
+
+void FieldFeed::Stop() {
+	if(!m_running) return;
+	m_running = false;
+	m_thread.join();
+#ifdef __linux__
+	if(m_fd >= 0) close(m_fd);
+#endif
+	m_fd = -1;
+}
+
+/*Non-blocking; gives the most recent reading, and returns false if there hasn't been one since the last call*/
+bool FieldFeed::TakeField(double& B) {
+	std::lock_guard<std::mutex> guard(m_mutex);
+	if(!m_fresh) return false;
+	B = m_latest;
+	m_fresh = false;
+	return true;
+}
+
+bool FieldFeed::Open() {
+#ifdef __linux__
+	if(!m_socket) {
+		m_fd = open(m_source.c_str(), O_RDONLY | O_CLOEXEC);
+		if(m_fd < 0) {
+			std::cerr<<"Unable to open field file "<<m_source<<" at FieldFeed::Open()!"<<std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	sockaddr_un address;
+	if(m_source.size() >= sizeof(address.sun_path)) {
+		std::cerr<<"Field socket path "<<m_source<<" is too long at FieldFeed::Open()!"<<std::endl;
+		return false;
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, m_source.c_str(), sizeof(address.sun_path)-1);
+	m_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(m_fd < 0 || connect(m_fd, (sockaddr*) &address, sizeof(address)) != 0) {
+		std::cerr<<"Unable to connect to field socket "<<m_source<<" at FieldFeed::Open()!"<<std::endl;
+		if(m_fd >= 0) close(m_fd);
+		m_fd = -1;
+		return false;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+void FieldFeed::Run() {
+	if(m_socket) ReadSocket();
+	else TailFile();
+}
+
+/*
+	Read whatever has been appended since the last pass. A file which shrinks was truncated and is read again from the start;
+	one which was replaced (log rotation) is reopened
+*/
+void FieldFeed::TailFile() {
+#ifdef __linux__
+	char buffer[4096];
+	while(m_running) {
+		ssize_t length = read(m_fd, buffer, sizeof(buffer));
+		if(length > 0) {
+			Consume(buffer, length);
+			continue;
+		}
+
+		struct stat current, opened;
+		if(stat(m_source.c_str(), &current) == 0 && fstat(m_fd, &opened) == 0) {
+			if(current.st_ino != opened.st_ino || current.st_dev != opened.st_dev) {
+				int fd = open(m_source.c_str(), O_RDONLY | O_CLOEXEC);
+				if(fd >= 0) {
+					close(m_fd);
+					m_fd = fd;
+					m_partial.clear();
+					continue;
+				}
+			} else if(current.st_size < lseek(m_fd, 0, SEEK_CUR)) {
+				lseek(m_fd, 0, SEEK_SET);
+				m_partial.clear();
+				continue;
+			}
+		}
+		poll(nullptr, 0, TAIL_MS);
+	}
+#endif
+}
+
+/*Readings arrive as they are sent; if the readout goes away, keep trying to reconnect until stopped*/
+void FieldFeed::ReadSocket() {
+#ifdef __linux__
+	char buffer[4096];
+	while(m_running) {
+		if(m_fd < 0) {
+			poll(nullptr, 0, RECONNECT_MS);
+			if(m_running && Open()) std::cout<<"Reconnected to field socket "<<m_source<<std::endl;
+			continue;
+		}
+
+		pollfd pfd;
+		pfd.fd = m_fd;
+		pfd.events = POLLIN;
+		int ready = poll(&pfd, 1, POLL_MS);
+		if(ready <= 0) continue;
+		ssize_t length = read(m_fd, buffer, sizeof(buffer));
+		if(length > 0) {
+			Consume(buffer, length);
+		} else {
+			std::cerr<<"Field socket "<<m_source<<" closed at FieldFeed::ReadSocket()! Reconnecting."<<std::endl;
+			close(m_fd);
+			m_fd = -1;
+			m_partial.clear();
+		}
+	}
+#endif
+}
+
+/*Split new data into complete lines; only the last valid reading in the chunk needs to be published*/
+void FieldFeed::Consume(const char* data, size_t length) {
+	m_partial.append(data, length);
+	size_t end = m_partial.rfind('\n');
+	if(end == std::string::npos) return;
+
+	double B = 0.0;
+	bool found = false;
+	uint64_t nReadings = 0;
+	size_t start = 0, stop;
+	while(start < end && (stop = m_partial.find('\n', start)) != std::string::npos) {
+		double value;
+		if(ParseReading(m_partial.substr(start, stop - start), value)) {
+			B = value;
+			found = true;
+			nReadings++;
+		}
+		start = stop + 1;
+	}
+	m_partial.erase(0, end + 1);
+	if(!found) return;
+
+	m_nReadings += nReadings;
+	std::lock_guard<std::mutex> guard(m_mutex);
+	m_latest = B;
+	m_fresh = true;
+}
+
+/*The last comma or whitespace separated token of the line, which must be a positive number*/
+bool FieldFeed::ParseReading(const std::string& line, double& B) {
+	size_t last = line.find_last_not_of(" \t\r,");
+	if(last == std::string::npos) return false;
+	size_t first = line.find_last_of(" \t,", last);
+	first = first == std::string::npos ? 0 : first + 1;
+	std::string token = line.substr(first, last - first + 1);
+	char* end;
+	B = std::strtod(token.c_str(), &end);
+	return end != token.c_str() && *end == '\0' && B > 0.0;
+}
@@ -0,0 +1,167 @@
+/*
+
+FieldOptimizer.cpp
+Searches for SPS field and angle settings which place a set of wanted states on the focal plane detector
+(within [rhoMin, rhoMax]) while keeping lines from contaminant reactions at least a minimum distance away.
+Since rho goes exactly as 1/B, only the angle requires evaluating the kinematics; for each angle the allowed
+field values are found analytically as intervals, and the intervals are swept to find the best settings.
+*/
+#include "FieldOptimizer.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+FieldOptimizer::FieldOptimizer() :
+	m_rhoMin(0), m_rhoMax(0), m_Bmin(0), m_Bmax(std::numeric_limits<double>::max()), m_thetaMin(0), m_thetaMax(0),
+	m_thetaStep(1.0), m_minSep(0)
+{
+}
+
+FieldOptimizer::~FieldOptimizer() {}
+
+void FieldOptimizer::SetDetectorRange(double rhoMin, double rhoMax) {
+	m_rhoMin = rhoMin;
+	m_rhoMax = rhoMax;
+}
+
+void FieldOptimizer::SetFieldRange(double Bmin, double Bmax) {
+	m_Bmin = Bmin;
+	m_Bmax = Bmax;
+}
+
+void FieldOptimizer::SetAngleRange(double thetaMin, double thetaMax, double thetaStep) {
+	m_thetaMin = thetaMin;
+	m_thetaMax = thetaMax;
+	m_thetaStep = thetaStep;
+}
+
+void FieldOptimizer::SetMinimumSeparation(double sep) {
+	m_minSep = sep;
+}
+
+/*
+	Main entry; every angle in the range is evaluated independently (and concurrently), then all of the candidate
+	settings are ranked by score. Contaminant lines are the levels of the unwanted reactions in the line store. Returns at
+	most nResults solutions, best first
+*/
+std::vector<FieldSolution> FieldOptimizer::Optimize(const std::vector<Reaction>& reactions, const LineStore& lines, double beamKE,
+													const std::vector<WantedState>& wanted, const std::vector<int>& unwanted, int nResults) {
+	std::vector<FieldSolution> ranked;
+	if(wanted.empty() || m_rhoMax <= m_rhoMin || m_thetaStep <= 0.0 || m_thetaMax < m_thetaMin) {
+		std::cerr<<"Invalid optimizer parameters at FieldOptimizer::Optimize()!"<<std::endl;
+		return ranked;
+	}
+	for(auto& state : wanted) {
+		if(state.rxnIndex < 0 || state.rxnIndex >= (int)reactions.size()) {
+			std::cerr<<"Wanted state refers to invalid reaction index "<<state.rxnIndex<<" at FieldOptimizer::Optimize()!"<<std::endl;
+			return ranked;
+		}
+	}
+
+	int nAngles = (int)std::floor((m_thetaMax - m_thetaMin)/m_thetaStep + 1e-9) + 1;
+	std::vector<std::vector<FieldSolution>> perAngle(nAngles);
+	ParallelFor(nAngles, [&](int i) {
+		EvaluateAngle(reactions, lines, beamKE, m_thetaMin + i*m_thetaStep, wanted, unwanted, perAngle[i]);
+	});
+
+	for(auto& solutions : perAngle)
+		ranked.insert(ranked.end(), solutions.begin(), solutions.end());
+	std::stable_sort(ranked.begin(), ranked.end(), [](const FieldSolution& a, const FieldSolution& b) { return a.score > b.score; });
+	if((int)ranked.size() > nResults) ranked.resize(nResults);
+	return ranked;
+}
+
+/*
+	For a single angle, work with K = rho*B (cm*kG), which is independent of the field. A line is on the detector when
+	K/rhoMax <= B <= K/rhoMin, and a contaminant is too close to a wanted line when |dK|/B < minSep, i.e. for B > |dK|/minSep.
+	Each contaminant/wanted pair then forbids a single interval of B; the forbidden intervals are merged and removed from the
+	range which keeps every wanted line on the detector. The surviving intervals are scored at their best candidate fields.
+*/
+void FieldOptimizer::EvaluateAngle(const std::vector<Reaction>& reactions, const LineStore& lines, double beamKE, double theta,
+								   const std::vector<WantedState>& wanted, const std::vector<int>& unwanted, std::vector<FieldSolution>& solutions) {
+	double theta_rad = theta*DEG2RAD;
+
+	std::vector<double> wantedK;
+	wantedK.reserve(wanted.size());
+	for(auto& state : wanted) {
+		const Reaction& rxn = reactions[state.rxnIndex];
+		wantedK.push_back(rxn.MomentumToRho(rxn.CalculateEjectileP(state.excitation, beamKE, theta_rad), 1.0));
+	}
+
+	std::vector<double> contamK;
+	const double* ex = lines.GetEx();
+	for(auto index : unwanted) {
+		if(index < 0 || index >= (int)reactions.size() || index >= lines.GetNReactions()) continue;
+		const Reaction& rxn = reactions[index];
+		for(int i=lines.GetBegin(index); i<lines.GetEnd(index); i++) {
+			double p = rxn.CalculateEjectileP(ex[i], beamKE, theta_rad);
+			if(!std::isnan(p)) contamK.push_back(rxn.MomentumToRho(p, 1.0));
+		}
+	}
+	//Any wanted state kinematically forbidden at this angle rules it out; min/max would skip a NaN unless it came first
+	if(std::any_of(wantedK.begin(), wantedK.end(), [](double K) { return std::isnan(K); })) return;
+	std::sort(contamK.begin(), contamK.end());
+
+	double Kmin = *std::min_element(wantedK.begin(), wantedK.end());
+	double Kmax = *std::max_element(wantedK.begin(), wantedK.end());
+
+	double lo = std::max(m_Bmin, Kmax/m_rhoMax);
+	double hi = std::min(m_Bmax, Kmin/m_rhoMin);
+	if(lo > hi) return;
+
+	std::vector<std::pair<double,double>> forbidden;
+	if(m_minSep > 0.0) {
+		for(auto Kc : contamK) {
+			for(auto Kw : wantedK) {
+				double start = std::max(std::fabs(Kc - Kw)/m_minSep, Kc/m_rhoMax);
+				double stop = Kc/m_rhoMin;
+				if(start < stop && stop > lo && start < hi) forbidden.emplace_back(start, stop);
+			}
+		}
+	}
+	std::sort(forbidden.begin(), forbidden.end());
+
+	//Sweep the forbidden intervals to find what remains of [lo, hi]
+	std::vector<std::pair<double,double>> allowed;
+	double current = lo;
+	for(auto& interval : forbidden) {
+		if(interval.first > current) allowed.emplace_back(current, std::min(interval.first, hi));
+		current = std::max(current, interval.second);
+		if(current >= hi) break;
+	}
+	if(current < hi) allowed.emplace_back(current, hi);
+
+	//Candidates: the field which centers the wanted lines on the detector (if allowed) and the middle of each interval
+	double Bcenter = (Kmin + Kmax)/(m_rhoMin + m_rhoMax);
+	for(auto& interval : allowed) {
+		double candidates[2] = { std::min(std::max(Bcenter, interval.first), interval.second), 0.5*(interval.first + interval.second) };
+		FieldSolution best;
+		best.score = -1.0;
+		for(auto B : candidates) {
+			double score = Score(B, wantedK, contamK);
+			if(score > best.score) {
+				best.score = score;
+				best.B = B;
+				best.theta = theta;
+			}
+		}
+		solutions.push_back(best);
+	}
+}
+
+/*Smallest distance (cm) from any wanted line to a detector edge or to an on-detector contaminant line*/
+double FieldOptimizer::Score(double B, const std::vector<double>& wantedK, const std::vector<double>& contamK) {
+	double score = std::numeric_limits<double>::max();
+	double Klo = m_rhoMin*B, Khi = m_rhoMax*B; //on-detector contaminants in K
+	auto first = std::lower_bound(contamK.begin(), contamK.end(), Klo);
+	auto last = std::upper_bound(contamK.begin(), contamK.end(), Khi);
+	for(auto Kw : wantedK) {
+		double rho = Kw/B;
+		score = std::min(score, std::min(rho - m_rhoMin, m_rhoMax - rho));
+		auto nearest = std::lower_bound(first, last, Kw);
+		if(nearest != last) score = std::min(score, (*nearest - Kw)/B);
+		if(nearest != first) score = std::min(score, (Kw - *(nearest-1))/B);
+	}
+	return score;
+}
@@ -55,6 +55,21 @@ FileViewFrame::FileViewFrame(const TGWindow* p, const TGFrame* main, UInt_t w, U
 	/*Send signal to appropriate location*/
 	if(type == SPSPlotMainFrame::M_SAVE_CONFIG) Connect("SendText(const char*)","SPSPlotMainFrame",parent,"WriteConfig(const char*)");
 	else if(type == SPSPlotMainFrame::M_LOAD_CONFIG) Connect("SendText(const char*)","SPSPlotMainFrame",parent,"LoadConfig(const char*)");
+	else if(type == SPSPlotMainFrame::M_IMPORT_ENSDF) Connect("SendText(const char*)","SPSPlotMainFrame",parent,"ImportLevels(const char*)");
+	else if(type == SPSPlotMainFrame::M_EXPORT_LINES) Connect("SendText(const char*)","SPSPlotMainFrame",parent,"ExportLines(const char*)");
+	else if(type == SPSPlotMainFrame::M_LOAD_RUNLOG) Connect("SendText(const char*)","SPSPlotMainFrame",parent,"LoadRunLog(const char*)");
+	else if(type == SPSPlotMainFrame::M_EXPORT_RUNS) Connect("SendText(const char*)","SPSPlotMainFrame",parent,"ExportRunTable(const char*)");
+	else if(type == SPSPlotMainFrame::M_FOLLOW_FIELD) Connect("SendText(const char*)","SPSPlotMainFrame",parent,"FollowField(const char*)");
+	else if(type == SPSPlotMainFrame::M_LOAD_SPECTRUM) Connect("SendText(const char*)","SPSPlotMainFrame",parent,"LoadSpectrum(const char*)");
+
+	/*Relevant extension for the type*/
+	if(type == SPSPlotMainFrame::M_IMPORT_ENSDF) fExtension = ".ens";
+	else if(type == SPSPlotMainFrame::M_EXPORT_LINES) fExtension = ".txt";
+	else if(type == SPSPlotMainFrame::M_LOAD_RUNLOG) fExtension = ".csv";
+	else if(type == SPSPlotMainFrame::M_EXPORT_RUNS) fExtension = ".txt";
+	else if(type == SPSPlotMainFrame::M_FOLLOW_FIELD) fExtension = ""; //readout may be a socket or a log of any name
+	else if(type == SPSPlotMainFrame::M_LOAD_SPECTRUM) fExtension = ".root"; //text spectra can be typed in by name
+	else fExtension = ".inp";
 
 	fMain->SetWindowName("Select File");
 	fMain->MapSubwindows();
@@ -63,7 +78,7 @@ FileViewFrame::FileViewFrame(const TGWindow* p, const TGFrame* main, UInt_t w, U
 	fMain->MapWindow();
 
 	fContents->SetDefaultHeaders();
-	fContents->SetFilter("*.inp"); //relevant extension
+	fContents->SetFilter(("*"+fExtension).Data()); //relevant extension
 	fContents->DisplayDirectory();
 	fContents->AddFile(".."); //go back a dir
 	fContents->Resize();
@@ -123,7 +138,7 @@ void FileViewFrame::DoDoubleClick(TGLVEntry *entry, int id) {
 	TString dirname(fContents->GetDirectory());
 	TString entryname(entry->GetTitle());
 
-	if(entryname.EndsWith(".inp")) { //check if its a file
+	if(entryname.EndsWith(fExtension.Data())) { //check if its a file
 		TString name = dirname+"/"+entryname;
 		fNameField->SetText(name.Data());
 	} else {
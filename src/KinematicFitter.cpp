@@ -0,0 +1,266 @@
+/*
+
+KinematicFitter.cpp
+Least-squares fit of the SPS parameters (beam KE, angle, field) and the linear mapping from measured focal plane position to
+rho (rho = offset + slope*x), to a set of peaks with identified states. Residuals are taken in position, where the model is
+x = (rho(Ex; beamKE, theta, B) - offset)/slope; in rho the fit could shrink every residual by rescaling the mapping and the
+field together. That rescaling is still a true degeneracy of the data, so the kinematic parameters enter with gaussian priors
+(their nominal values and uncertainties, i.e. the UNCERTAINTY keyword); a parameter with no uncertainty is held fixed.
+
+Minimization is Levenberg-Marquardt with the analytic Jacobian from Reaction::CalculateRhoWithDerivatives. With at most five
+parameters each iteration is a handful of kinematics evaluations and a 5x5 solve, so a fit takes well under a millisecond.
+*/
+#include "KinematicFitter.h"
+#include <cmath>
+#include <limits>
+
+/*Gaussian elimination with partial pivoting on a small dense n x n system; A is destroyed, b becomes the solution*/
+static bool SolveLinear(std::vector<double> A, std::vector<double>& b, int n) {
+	for(int col=0; col<n; col++) {
+		int pivot = col;
+		for(int row=col+1; row<n; row++) {
+			if(std::fabs(A[row*n+col]) > std::fabs(A[pivot*n+col])) pivot = row;
+		}
+		if(A[pivot*n+col] == 0.0) return false;
+		if(pivot != col) {
+			for(int k=0; k<n; k++)
+				std::swap(A[col*n+k], A[pivot*n+k]);
+			std::swap(b[col], b[pivot]);
+		}
+		for(int row=col+1; row<n; row++) {
+			double factor = A[row*n+col]/A[col*n+col];
+			for(int k=col; k<n; k++)
+				A[row*n+k] -= factor*A[col*n+k];
+			b[row] -= factor*b[col];
+		}
+	}
+	for(int row=n-1; row>=0; row--) {
+		for(int k=row+1; k<n; k++)
+			b[row] -= A[row*n+k]*b[k];
+		b[row] /= A[row*n+row];
+	}
+	return true;
+}
+
+KinematicFitter::KinematicFitter() :
+	m_fixCalibration(false), m_maxIterations(100)
+{
+	m_initial = {0.0, 0.0, 0.0, 0.0, 1.0};
+	m_priorSigma[0] = 0.0; m_priorSigma[1] = 0.0; m_priorSigma[2] = 0.0;
+}
+
+KinematicFitter::~KinematicFitter() {}
+
+/*Uncertainties on the nominal beam KE (MeV), angle (deg), and field (kG); a parameter with zero uncertainty is fixed*/
+void KinematicFitter::SetPriors(double beamKESigma, double thetaSigma, double BSigma) {
+	m_priorSigma[0] = beamKESigma;
+	m_priorSigma[1] = thetaSigma;
+	m_priorSigma[2] = BSigma;
+}
+
+/*
+	Weighted residuals (one per point, then one per prior) and their Jacobian with respect to the free parameters, row major.
+	Each point is weighted by its position uncertainty and the uncertainty of its line (level energy and masses) taken to
+	position. Returns chi2, which is infinite if any state is kinematically forbidden at these parameters
+*/
+double KinematicFitter::Evaluate(const std::vector<Reaction>& reactions, const std::vector<FitPoint>& points, const double* pars,
+								 const std::vector<int>& free, std::vector<double>& residuals, std::vector<double>& jacobian) const {
+	int nFree = free.size();
+	residuals.clear();
+	jacobian.clear();
+	double offset = pars[3], slope = pars[4];
+	double chi2 = 0.0;
+	RhoDerivatives d;
+	double derivs[NPARS];
+	for(auto& point : points) {
+		const Reaction& rxn = reactions[point.rxnIndex];
+		double rho = rxn.CalculateRhoWithDerivatives(point.ex, pars[0], pars[1]*DEG2RAD, pars[2], d);
+		if(std::isnan(rho)) return std::numeric_limits<double>::infinity();
+
+		double mass_unc[4] = {rxn.GetTarget().mass_unc, rxn.GetProjectile().mass_unc, rxn.GetEjectile().mass_unc, rxn.GetResidual().mass_unc};
+		double lineVariance = std::pow(d.dEx*point.exSigma, 2.0);
+		for(int k=0; k<4; k++)
+			lineVariance += std::pow(d.dMass[k]*mass_unc[k], 2.0);
+		double sigma = std::sqrt(point.positionSigma*point.positionSigma + lineVariance/(slope*slope));
+		if(!(sigma > 0.0)) sigma = 1.0; //no uncertainties given at all; unweighted
+
+		double predicted = (rho - offset)/slope;
+		double r = (point.position - predicted)/sigma;
+		residuals.push_back(r);
+		chi2 += r*r;
+
+		//d(residual)/d(par) = -d(predicted)/d(par)/sigma
+		derivs[0] = d.dBeamKE/slope;
+		derivs[1] = d.dTheta*DEG2RAD/slope;
+		derivs[2] = d.dB/slope;
+		derivs[3] = -1.0/slope;
+		derivs[4] = -(rho - offset)/(slope*slope);
+		for(int k=0; k<nFree; k++)
+			jacobian.push_back(-derivs[free[k]]/sigma);
+	}
+
+	const double nominal[3] = {m_initial.beamKE, m_initial.theta, m_initial.B};
+	for(int p=0; p<3; p++) {
+		if(m_priorSigma[p] <= 0.0) continue;
+		double r = (pars[p] - nominal[p])/m_priorSigma[p];
+		residuals.push_back(r);
+		chi2 += r*r;
+		for(int k=0; k<nFree; k++)
+			jacobian.push_back(free[k] == p ? 1.0/m_priorSigma[p] : 0.0);
+	}
+	return chi2;
+}
+
+/*
+	Fit the points, starting from (and with priors centered on) the initial parameters. Returns false if there is nothing to fit,
+	too few points for the free parameters, or the normal equations are singular. On success, errors and covariance come from the
+	inverse of J^T J at the minimum (not scaled by chi2/ndf)
+*/
+bool KinematicFitter::Fit(const std::vector<Reaction>& reactions, const std::vector<FitPoint>& points, FitResult& result) const {
+	for(auto& point : points) {
+		if(point.rxnIndex < 0 || point.rxnIndex >= (int)reactions.size()) {
+			std::cerr<<"Invalid reaction index at KinematicFitter::Fit()!"<<std::endl;
+			return false;
+		}
+	}
+	if(m_initial.slope == 0.0) {
+		std::cerr<<"Position to rho slope cannot be zero at KinematicFitter::Fit()!"<<std::endl;
+		return false;
+	}
+
+	std::vector<int> free;
+	int nPriors = 0;
+	for(int p=0; p<3; p++) {
+		if(m_priorSigma[p] > 0.0) {
+			free.push_back(p);
+			nPriors++;
+		}
+	}
+	if(!m_fixCalibration) {
+		free.push_back(3);
+		free.push_back(4);
+	}
+	int nFree = free.size();
+	int nRows = points.size() + nPriors;
+	if(nFree == 0) {
+		std::cerr<<"No free parameters at KinematicFitter::Fit()! Give parameter uncertainties or free the calibration."<<std::endl;
+		return false;
+	} else if(nRows < nFree || points.empty()) {
+		std::cerr<<"Not enough identified peaks for the free parameters at KinematicFitter::Fit()!"<<std::endl;
+		return false;
+	}
+
+	double pars[NPARS] = {m_initial.beamKE, m_initial.theta, m_initial.B, m_initial.offset, m_initial.slope};
+	std::vector<double> residuals, jacobian, trialResiduals, trialJacobian;
+	double chi2 = Evaluate(reactions, points, pars, free, residuals, jacobian);
+	if(std::isinf(chi2)) {
+		std::cerr<<"A fit state is kinematically forbidden at the initial parameters at KinematicFitter::Fit()!"<<std::endl;
+		return false;
+	}
+
+	std::vector<double> JTJ(nFree*nFree), JTr(nFree);
+	double lambda = 1.0e-3;
+	result.converged = false;
+	int iteration;
+	for(iteration=0; iteration<m_maxIterations; iteration++) {
+		for(int a=0; a<nFree; a++) {
+			JTr[a] = 0.0;
+			for(int b=0; b<nFree; b++)
+				JTJ[a*nFree+b] = 0.0;
+		}
+		for(int i=0; i<nRows; i++) {
+			const double* row = &jacobian[i*nFree];
+			for(int a=0; a<nFree; a++) {
+				JTr[a] += row[a]*residuals[i];
+				for(int b=0; b<nFree; b++)
+					JTJ[a*nFree+b] += row[a]*row[b];
+			}
+		}
+
+		//Damped step; raise the damping until chi2 goes down
+		bool improved = false;
+		double trialChi2 = chi2;
+		double step[NPARS];
+		while(lambda < 1.0e10) {
+			std::vector<double> A = JTJ, delta(nFree);
+			for(int a=0; a<nFree; a++) {
+				A[a*nFree+a] *= 1.0 + lambda;
+				delta[a] = -JTr[a];
+			}
+			if(!SolveLinear(A, delta, nFree)) {
+				lambda *= 10.0;
+				continue;
+			}
+			double trial[NPARS];
+			for(int p=0; p<NPARS; p++)
+				trial[p] = pars[p];
+			for(int a=0; a<nFree; a++)
+				trial[free[a]] += delta[a];
+			trialChi2 = Evaluate(reactions, points, trial, free, trialResiduals, trialJacobian);
+			if(trialChi2 <= chi2) {
+				for(int p=0; p<NPARS; p++) {
+					step[p] = trial[p] - pars[p];
+					pars[p] = trial[p];
+				}
+				improved = true;
+				break;
+			}
+			lambda *= 10.0;
+		}
+		if(!improved) { //can't go further downhill; at the minimum to numerical precision
+			result.converged = true;
+			break;
+		}
+
+		double change = chi2 - trialChi2;
+		chi2 = trialChi2;
+		residuals.swap(trialResiduals);
+		jacobian.swap(trialJacobian);
+		lambda = std::max(lambda/10.0, 1.0e-12);
+
+		bool smallStep = true;
+		for(int p=0; p<NPARS; p++) {
+			if(std::fabs(step[p]) > 1.0e-10*(std::fabs(pars[p]) + 1.0e-10)) smallStep = false;
+		}
+		if(change <= 1.0e-12*(chi2 + 1.0e-12) || smallStep) {
+			result.converged = true;
+			iteration++;
+			break;
+		}
+	}
+
+	//Covariance from the undamped normal equations at the minimum
+	for(int a=0; a<nFree; a++) {
+		for(int b=0; b<nFree; b++)
+			JTJ[a*nFree+b] = 0.0;
+	}
+	for(int i=0; i<nRows; i++) {
+		const double* row = &jacobian[i*nFree];
+		for(int a=0; a<nFree; a++) {
+			for(int b=0; b<nFree; b++)
+				JTJ[a*nFree+b] += row[a]*row[b];
+		}
+	}
+	for(int p=0; p<NPARS; p++) {
+		for(int q=0; q<NPARS; q++)
+			result.covariance[p][q] = 0.0;
+	}
+	for(int b=0; b<nFree; b++) {
+		std::vector<double> column(nFree, 0.0);
+		column[b] = 1.0;
+		if(!SolveLinear(JTJ, column, nFree)) {
+			std::cerr<<"Singular normal equations at KinematicFitter::Fit()! The free parameters are not constrained by the peaks."<<std::endl;
+			return false;
+		}
+		for(int a=0; a<nFree; a++)
+			result.covariance[free[a]][free[b]] = column[a];
+	}
+
+	result.values = {pars[0], pars[1], pars[2], pars[3], pars[4]};
+	result.errors = {std::sqrt(result.covariance[0][0]), std::sqrt(result.covariance[1][1]), std::sqrt(result.covariance[2][2]),
+					 std::sqrt(result.covariance[3][3]), std::sqrt(result.covariance[4][4])};
+	result.chi2 = chi2;
+	result.ndf = nRows - nFree;
+	result.iterations = iteration;
+	return true;
+}
@@ -0,0 +1,92 @@
+/*
+
+LabelLayout.cpp
+Screen space placement of the excitation labels. The plot frame is divided into a grid of square buckets (one label
+height on a side), and each placed label is recorded in every bucket it covers. A new label is checked only against
+the labels in its own buckets; if it collides it is staggered upwards by whole label heights, and if no free row is
+found before the next reaction it is dropped. Labels outside of the visible range are culled before any work is done,
+so the number of labels made is bounded by the frame area no matter how dense the level scheme is.
+*/
+#include "LabelLayout.h"
+#include <cmath>
+
+LabelLayout::LabelLayout() :
+	m_xmin(0), m_xmax(0), m_ymin(0), m_ymax(0), m_widthPx(0), m_heightPx(0), m_textHeight(0), m_charWidth(0), m_cellSize(1),
+	m_nx(0), m_ny(0)
+{
+}
+
+LabelLayout::~LabelLayout() {}
+
+/*
+	Visible user range and pixel size of the plot frame. Text height is that of a label in px; average character width is
+	taken to be 0.6 of the height, which is slightly generous for the default ROOT font
+*/
+void LabelLayout::SetFrame(double xmin, double xmax, double ymin, double ymax, double widthPx, double heightPx, double textHeightPx) {
+	m_xmin = xmin; m_xmax = xmax;
+	m_ymin = ymin; m_ymax = ymax;
+	m_widthPx = widthPx; m_heightPx = heightPx;
+	m_textHeight = textHeightPx;
+	m_charWidth = 0.6*textHeightPx;
+	m_cellSize = textHeightPx > 1.0 ? textHeightPx : 1.0;
+	m_nx = std::ceil(m_widthPx/m_cellSize);
+	m_ny = std::ceil(m_heightPx/m_cellSize);
+	if(m_nx < 1) m_nx = 1;
+	if(m_ny < 1) m_ny = 1;
+	Clear();
+}
+
+void LabelLayout::Clear() {
+	m_boxes.clear();
+	m_cells.assign(m_nx*m_ny, std::vector<int>());
+}
+
+bool LabelLayout::Collides(const Box& box) const {
+	for(int j=CellY(box.y1); j<=CellY(box.y2); j++) {
+		for(int i=CellX(box.x1); i<=CellX(box.x2); i++) {
+			for(auto index : m_cells[j*m_nx+i]) {
+				const Box& other = m_boxes[index];
+				if(box.x1 < other.x2 && other.x1 < box.x2 && box.y1 < other.y2 && other.y1 < box.y2)
+					return true;
+			}
+		}
+	}
+	return false;
+}
+
+void LabelLayout::Insert(const Box& box) {
+	int index = m_boxes.size();
+	m_boxes.push_back(box);
+	for(int j=CellY(box.y1); j<=CellY(box.y2); j++) {
+		for(int i=CellX(box.x1); i<=CellX(box.x2); i++)
+			m_cells[j*m_nx+i].push_back(index);
+	}
+}
+
+/*
+	Try to place a label of nChars characters with its lower left corner at (x, y) in user coordinates. On collision the label
+	is moved up one label height at a time, as long as it stays below yLimit. Returns false if the label is outside of the frame
+	or no free row was found; otherwise labelY is the y coordinate to draw it at
+*/
+bool LabelLayout::Place(double x, double y, double yLimit, int nChars, double& labelY) {
+	if(x < m_xmin || x > m_xmax || m_xmax <= m_xmin || m_ymax <= m_ymin) return false;
+
+	double xscale = m_widthPx/(m_xmax - m_xmin);
+	double yscale = m_heightPx/(m_ymax - m_ymin);
+	Box box;
+	box.x1 = (x - m_xmin)*xscale;
+	box.x2 = box.x1 + nChars*m_charWidth;
+	double py = (y - m_ymin)*yscale;
+	double pyLimit = (yLimit - m_ymin)*yscale;
+	for(int row=0; row<MAX_ROWS; row++) {
+		box.y1 = py + row*m_textHeight;
+		box.y2 = box.y1 + m_textHeight;
+		if(row > 0 && box.y2 > pyLimit) break;
+		if(!Collides(box)) {
+			Insert(box);
+			labelY = box.y1/yscale + m_ymin;
+			return true;
+		}
+	}
+	return false;
+}
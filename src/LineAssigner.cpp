@@ -0,0 +1,78 @@
+/*
+
+LineAssigner.cpp
+Optimal, order-preserving assignment of found peaks to predicted lines. Both lists are sorted by position, and an assignment
+is a set of (peak, line) pairs which never cross (if peak a is left of peak b, so is its line). Among those, the one with the
+lowest total cost is found by dynamic programming over (peaks x lines), like a sequence alignment: a pair costs its squared
+residual in units of the tolerance, a peak left without a line costs a fixed penalty (the square of the gate), and an
+unobserved line is free, since most predicted states are weak or off the detector.
+*/
+#include "LineAssigner.h"
+#include <cmath>
+#include <cstdint>
+
+LineAssigner::LineAssigner() :
+	m_tolerance(0.1), m_gate(3.0)
+{
+}
+
+LineAssigner::~LineAssigner() {}
+
+/*
+	peaks and lines must be sorted in increasing position. If lineSigmas is given, each line's tolerance is the quadrature sum
+	of the overall tolerance and its own uncertainty. Returns the index of the assigned line for each peak (-1 if unassigned).
+	Cost is O(peaks x lines) in time and in (byte) memory, which is fine for hundreds of peaks against thousands of lines
+*/
+std::vector<int> LineAssigner::Assign(const std::vector<double>& peaks, const std::vector<double>& lines, const std::vector<double>* lineSigmas) const {
+	int nPeaks = peaks.size();
+	int nLines = lines.size();
+	std::vector<int> result(nPeaks, -1);
+	if(nPeaks == 0 || nLines == 0) return result;
+
+	enum Move : uint8_t { MATCH, SKIP_LINE, SKIP_PEAK };
+	double skipPeak = m_gate*m_gate;
+	std::vector<double> previous(nLines+1), current(nLines+1);
+	std::vector<uint8_t> moves((nPeaks+1)*(nLines+1));
+
+	for(int j=0; j<=nLines; j++) {
+		previous[j] = 0.0;
+		moves[j] = SKIP_LINE;
+	}
+	for(int i=1; i<=nPeaks; i++) {
+		current[0] = i*skipPeak;
+		moves[i*(nLines+1)] = SKIP_PEAK;
+		for(int j=1; j<=nLines; j++) {
+			double best = current[j-1];
+			uint8_t move = SKIP_LINE;
+			if(previous[j] + skipPeak < best) {
+				best = previous[j] + skipPeak;
+				move = SKIP_PEAK;
+			}
+			double tolerance = m_tolerance;
+			if(lineSigmas != nullptr) tolerance = std::sqrt(m_tolerance*m_tolerance + (*lineSigmas)[j-1]*(*lineSigmas)[j-1]);
+			double pull = (peaks[i-1] - lines[j-1])/tolerance;
+			if(std::fabs(pull) <= m_gate && previous[j-1] + pull*pull <= best) {
+				best = previous[j-1] + pull*pull;
+				move = MATCH;
+			}
+			current[j] = best;
+			moves[i*(nLines+1)+j] = move;
+		}
+		previous.swap(current);
+	}
+
+	//Walk back from the full problem
+	int i = nPeaks, j = nLines;
+	while(i > 0 && j >= 0) {
+		uint8_t move = moves[i*(nLines+1)+j];
+		if(move == MATCH) {
+			result[i-1] = j-1;
+			i--; j--;
+		} else if(move == SKIP_PEAK) {
+			i--;
+		} else {
+			j--;
+		}
+	}
+	return result;
+}
@@ -0,0 +1,133 @@
+/*
+
+LinePublisher.cpp
+Writer side of the shared memory line table (layout in SPSLineShm.h). Owns a POSIX shared memory segment, and replaces its
+contents under the sequence lock on every Publish(), growing the segment if the lines no longer fit. Readers in other
+processes never block the writer, and vice versa.
+*/
+#include "LinePublisher.h"
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+LinePublisher::LinePublisher() :
+	m_fd(-1), m_header(nullptr), m_capacity(0)
+{
+}
+
+LinePublisher::~LinePublisher() {
+	Close();
+}
+
+/*
+	Create (or take over) the segment; name is a POSIX shared memory name, e.g. /spsplot_lines. A segment left by a previous
+	run is reused, so readers which still have it mapped carry on
+*/
+bool LinePublisher::Open(const std::string& name, uint32_t capacity) {
+#ifdef __linux__
+	Close();
+	m_fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+	if(m_fd < 0) {
+		std::cerr<<"Unable to open shared memory "<<name<<" at LinePublisher::Open()! Lines will not be published."<<std::endl;
+		return false;
+	}
+	m_name = name;
+	if(!Map(capacity > DEFAULT_CAPACITY ? capacity : DEFAULT_CAPACITY)) {
+		Close();
+		return false;
+	}
+
+	if(m_header->magic != SPS_SHM_MAGIC || m_header->version != SPS_SHM_VERSION) {
+		memset(m_header, 0, sizeof(sps_shm_header));
+		m_header->magic = SPS_SHM_MAGIC;
+		m_header->version = SPS_SHM_VERSION;
+	} else if(m_header->sequence & 1) { //previous writer died mid-update
+		m_header->nLines = 0;
+		__atomic_store_n(&m_header->sequence, m_header->sequence + 1, __ATOMIC_RELEASE);
+	}
+	m_header->capacity = m_capacity;
+	return true;
+#else
+	std::cerr<<"Publishing lines to shared memory is only available on Linux at LinePublisher::Open()!"<<std::endl;
+	return false;
+#endif
+}
+
+/*The segment is removed; readers keep whatever they have mapped, but new readers will not find it*/
+void LinePublisher::Close() {
+#ifdef __linux__
+	if(m_header != nullptr) munmap(m_header, sps_shm_size(m_capacity));
+	if(m_fd >= 0) {
+		close(m_fd);
+		shm_unlink(m_name.c_str());
+	}
+#endif
+	m_header = nullptr;
+	m_fd = -1;
+	m_capacity = 0;
+	m_name.clear();
+}
+
+/*
+	(Re)map the segment with room for at least capacity lines; it is never shrunk, since readers may still have the larger
+	mapping. The old mapping is only dropped once the new one is in place
+*/
+bool LinePublisher::Map(uint32_t capacity) {
+#ifdef __linux__
+	struct stat info;
+	if(fstat(m_fd, &info) != 0) return false;
+	size_t size = sps_shm_size(capacity);
+	if((size_t)info.st_size > size && (size_t)info.st_size >= sizeof(sps_shm_header)) {
+		capacity = (info.st_size - sizeof(sps_shm_header))/sizeof(sps_shm_line);
+		size = sps_shm_size(capacity);
+	} else if((size_t)info.st_size < size && ftruncate(m_fd, size) != 0) {
+		std::cerr<<"Unable to size shared memory "<<m_name<<" at LinePublisher::Map()!"<<std::endl;
+		return false;
+	}
+
+	void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+	if(mapping == MAP_FAILED) {
+		std::cerr<<"Unable to map shared memory "<<m_name<<" at LinePublisher::Map()!"<<std::endl;
+		return false;
+	}
+	if(m_header != nullptr) munmap(m_header, sps_shm_size(m_capacity));
+	m_header = (sps_shm_header*) mapping;
+	m_capacity = capacity;
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*
+	Replace the published table. Only the parameter fields of the given header are used (sequence, capacity, and the count are
+	set here). The sequence is odd for the duration of the copy, which is all the readers synchronize on
+*/
+bool LinePublisher::Publish(const sps_shm_header& parameters, const std::vector<sps_shm_line>& lines) {
+	if(!IsOpen()) return false;
+	if(lines.size() > m_capacity && !Map(std::max<uint32_t>(2*m_capacity, lines.size()))) return false;
+
+	uint64_t sequence = m_header->sequence; //only ever written from here
+	__atomic_store_n(&m_header->sequence, sequence + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	m_header->capacity = m_capacity;
+	m_header->nLines = lines.size();
+	m_header->flags = parameters.flags;
+	m_header->beamKE = parameters.beamKE;
+	m_header->theta = parameters.theta;
+	m_header->B = parameters.B;
+	m_header->calOffset = parameters.calOffset;
+	m_header->calSlope = parameters.calSlope;
+	if(!lines.empty())
+		memcpy(m_header + 1, lines.data(), lines.size()*sizeof(sps_shm_line));
+
+	__atomic_store_n(&m_header->sequence, sequence + 2, __ATOMIC_RELEASE);
+	return true;
+}
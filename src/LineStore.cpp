@@ -0,0 +1,315 @@
+/*
+
+LineStore.cpp
+Every line (level of the residual) of every reaction, in flat columns: Ex, its uncertainty, the label, and the reaction, then
+rho and its uncertainty at the primary setting. The lines of reaction r are [GetBegin(r), GetEnd(r)), in increasing Ex. Labels
+are stored once, as ids into a shared table, since most of them ("0.0", "1.234", ...) repeat between reactions.
+
+Only the lines which can land in the rho window are evaluated: rho falls with Ex, so the window edges map to an Ex interval,
+whose lines are a contiguous slice [GetSliceBegin(r), GetSliceEnd(r)) of the reaction's lines. The slice can be widened by a
+relative field margin, so the field can drift that far and be followed by rescaling alone. Lines outside of their slice have
+a NaN rho.
+
+Calculations are spread over the thread pool, one reaction per item, and write only their own reaction's part of the columns,
+so nothing is allocated per reaction once the levels are in.
+*/
+#include "LineStore.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <numeric>
+#include <limits>
+
+static const double DEG2RAD = 3.14159265358979323846/180.0;
+static const double NaN = std::numeric_limits<double>::quiet_NaN();
+
+LineStore::LineStore() :
+	m_offsets(1, 0), m_beamKE(0.0), m_theta(0.0), m_B(0.0), m_beamKESigma(0.0), m_thetaSigma(0.0), m_BSigma(0.0), m_rhoMin(0.0),
+	m_rhoMax(std::numeric_limits<double>::infinity()), m_fieldMargin(0.0), m_sliceB(0.0), m_kinematicsSet(false)
+{
+}
+
+LineStore::~LineStore() {}
+
+/*Levels of a nuclide from the global table (EX), sorted by energy; false (and no levels) if the nuclide isn't there*/
+bool LineStore::ReadLevels(const std::string& nuclide, std::vector<double>& ex, std::vector<double>& sigma, std::vector<std::string>& labels) {
+	ExData data;
+	bool found = EX.GetLevels(nuclide, data);
+	if(found) {
+		ex.swap(data.ex_list);
+		labels.swap(data.str_list);
+		sigma.swap(data.unc_list);
+	} else {
+		std::string name = nuclide;
+		ex = EX.GetListOfExcitations(name); //reports the missing nuclide
+		labels = EX.GetListOfExcitations_Strings(name);
+		sigma.assign(ex.size(), 0.0);
+	}
+
+	if(std::is_sorted(ex.begin(), ex.end())) return found;
+	std::vector<size_t> order(ex.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&ex](size_t a, size_t b) { return ex[a] < ex[b]; });
+	std::vector<double> sortedEx, sortedSigma;
+	std::vector<std::string> sortedLabels;
+	for(auto i : order) {
+		sortedEx.push_back(ex[i]);
+		sortedSigma.push_back(sigma[i]);
+		sortedLabels.push_back(labels[i]);
+	}
+	ex.swap(sortedEx);
+	sigma.swap(sortedSigma);
+	labels.swap(sortedLabels);
+	return found;
+}
+
+/*
+	Read the levels of every reaction (or only those flagged in which; the others get no lines), replacing everything. No rhos
+	until the next Calculate
+*/
+void LineStore::Build(const std::vector<Reaction>& reactions, const std::vector<char>* which) {
+	Clear();
+	int nReactions = reactions.size();
+	std::vector<char> fresh(nReactions, 1);
+	if(which != nullptr) {
+		for(int r=0; r<nReactions; r++)
+			fresh[r] = r < (int)which->size() && (*which)[r];
+	}
+
+	std::vector<std::vector<double>> exs(nReactions), sigmas(nReactions);
+	std::vector<std::vector<std::string>> labels(nReactions);
+	ParallelFor(nReactions, [&](int r) {
+		if(fresh[r] && reactions[r].IsInitialized()) ReadLevels(reactions[r].GetResidual().sym, exs[r], sigmas[r], labels[r]);
+	});
+	Assemble(nReactions, std::vector<char>(nReactions, 1), exs, sigmas, labels);
+}
+
+/*
+	Re-read the levels of the flagged reactions (i.e. after new level data or masses), and add any reactions past the end of the
+	store; only these are recalculated, the others keep their lines and rhos. Line positions shift, so anything parallel to the
+	columns needs a Relayout
+*/
+void LineStore::Refresh(const std::vector<Reaction>& reactions, const std::vector<char>& changed) {
+	int nReactions = reactions.size();
+	int nOld = GetNReactions();
+	std::vector<char> fresh(nReactions, 0);
+	std::vector<int> which;
+	for(int r=0; r<nReactions; r++) {
+		fresh[r] = r >= nOld || (r < (int)changed.size() && changed[r]);
+		if(fresh[r]) which.push_back(r);
+	}
+
+	std::vector<std::vector<double>> exs(nReactions), sigmas(nReactions);
+	std::vector<std::vector<std::string>> labels(nReactions);
+	ParallelFor(which.size(), [&](int item) {
+		int r = which[item];
+		if(reactions[r].IsInitialized()) ReadLevels(reactions[r].GetResidual().sym, exs[r], sigmas[r], labels[r]);
+	});
+	Assemble(nReactions, fresh, exs, sigmas, labels);
+	if(m_kinematicsSet) Calculate(reactions, which);
+}
+
+/*
+	Lay out the new columns; fresh reactions come from the given levels, the rest are moved over from the current columns with
+	their rhos and slices
+*/
+void LineStore::Assemble(int nReactions, const std::vector<char>& fresh, std::vector<std::vector<double>>& exs,
+						 std::vector<std::vector<double>>& sigmas, std::vector<std::vector<std::string>>& labels) {
+	std::vector<int> offsets(nReactions+1, 0);
+	for(int r=0; r<nReactions; r++)
+		offsets[r+1] = offsets[r] + (fresh[r] ? exs[r].size() : GetEnd(r) - GetBegin(r));
+	int nLines = offsets[nReactions];
+
+	std::vector<double> ex(nLines), exSigma(nLines), rho(nLines, NaN), rhoSigma(nLines, NaN);
+	std::vector<int> label(nLines), rxn(nLines);
+	std::vector<int> sliceBegin(nReactions), sliceEnd(nReactions);
+	for(int r=0; r<nReactions; r++) {
+		int begin = offsets[r];
+		std::fill(rxn.begin()+begin, rxn.begin()+offsets[r+1], r);
+		if(fresh[r]) {
+			std::copy(exs[r].begin(), exs[r].end(), ex.begin()+begin);
+			std::copy(sigmas[r].begin(), sigmas[r].end(), exSigma.begin()+begin);
+			for(unsigned int j=0; j<labels[r].size(); j++)
+				label[begin+j] = Intern(labels[r][j]);
+			sliceBegin[r] = sliceEnd[r] = begin;
+			continue;
+		}
+		int oldBegin = GetBegin(r), oldEnd = GetEnd(r);
+		std::copy(m_ex.begin()+oldBegin, m_ex.begin()+oldEnd, ex.begin()+begin);
+		std::copy(m_exSigma.begin()+oldBegin, m_exSigma.begin()+oldEnd, exSigma.begin()+begin);
+		std::copy(m_label.begin()+oldBegin, m_label.begin()+oldEnd, label.begin()+begin);
+		std::copy(m_rho.begin()+oldBegin, m_rho.begin()+oldEnd, rho.begin()+begin);
+		std::copy(m_rhoSigma.begin()+oldBegin, m_rhoSigma.begin()+oldEnd, rhoSigma.begin()+begin);
+		sliceBegin[r] = m_sliceBegin[r] - oldBegin + begin;
+		sliceEnd[r] = m_sliceEnd[r] - oldBegin + begin;
+	}
+
+	m_previousOffsets.swap(m_offsets);
+	m_offsets.swap(offsets);
+	m_refreshed = fresh;
+	m_ex.swap(ex);
+	m_exSigma.swap(exSigma);
+	m_label.swap(label);
+	m_rxn.swap(rxn);
+	m_rho.swap(rho);
+	m_rhoSigma.swap(rhoSigma);
+	m_sliceBegin.swap(sliceBegin);
+	m_sliceEnd.swap(sliceEnd);
+}
+
+/*
+	Move a column which was parallel to the lines before the last Refresh over to the current layout. Reactions which were
+	refreshed (or added) get NaN. A column which doesn't fit the previous layout is all NaN; returns false in that case
+*/
+bool LineStore::Relayout(std::vector<double>& column) const {
+	int nReactions = GetNReactions();
+	if(column.size() != (size_t)m_previousOffsets.back() || m_refreshed.size() != (size_t)nReactions) {
+		column.assign(GetNLines(), NaN);
+		return false;
+	}
+	std::vector<double> moved(GetNLines(), NaN);
+	for(int r=0; r<nReactions; r++) {
+		if(m_refreshed[r]) continue;
+		std::copy(column.begin()+m_previousOffsets[r], column.begin()+m_previousOffsets[r+1], moved.begin()+GetBegin(r));
+	}
+	column.swap(moved);
+	return true;
+}
+
+void LineStore::Clear() {
+	m_ex.clear();
+	m_exSigma.clear();
+	m_label.clear();
+	m_rxn.clear();
+	m_rho.clear();
+	m_rhoSigma.clear();
+	m_offsets.assign(1, 0);
+	m_previousOffsets.assign(1, 0);
+	m_refreshed.clear();
+	m_sliceBegin.clear();
+	m_sliceEnd.clear();
+	m_labels.clear();
+	m_labelIds.clear();
+}
+
+int LineStore::Intern(const std::string& label) {
+	auto found = m_labelIds.find(label);
+	if(found != m_labelIds.end()) return found->second;
+	m_labels.push_back(label);
+	m_labelIds[label] = m_labels.size()-1;
+	return m_labels.size()-1;
+}
+
+/*Rho window and field margin of the slices; true if they changed, in which case the rhos need a Calculate*/
+bool LineStore::SetWindow(double rhoMin, double rhoMax, double fieldMargin) {
+	fieldMargin = std::max(fieldMargin, 0.0);
+	if(rhoMin == m_rhoMin && rhoMax == m_rhoMax && fieldMargin == m_fieldMargin) return false;
+	m_rhoMin = rhoMin;
+	m_rhoMax = rhoMax;
+	m_fieldMargin = fieldMargin;
+	return true;
+}
+
+/*Uncertainties (1 sigma) of the primary setting; beam KE in MeV, angle in deg, field in kG. Used from the next Calculate*/
+void LineStore::SetUncertainties(double beamKESigma, double thetaSigma, double BSigma) {
+	m_beamKESigma = beamKESigma;
+	m_thetaSigma = thetaSigma*DEG2RAD;
+	m_BSigma = BSigma;
+}
+
+/*Every reaction at a new primary setting (angle in deg); the slices are found at this field*/
+void LineStore::Calculate(const std::vector<Reaction>& reactions, double beamKE, double theta, double B) {
+	m_beamKE = beamKE;
+	m_theta = theta*DEG2RAD;
+	m_B = B;
+	m_sliceB = B;
+	m_kinematicsSet = true;
+	ParallelFor(GetNReactions(), [this, &reactions](int r) {
+		CalculateReaction(reactions[r], r);
+	});
+}
+
+/*Only the given reactions, at the current primary setting (i.e. after their masses or levels changed)*/
+void LineStore::Calculate(const std::vector<Reaction>& reactions, const std::vector<int>& which) {
+	if(!m_kinematicsSet) return;
+	ParallelFor(which.size(), [this, &reactions, &which](int item) {
+		CalculateReaction(reactions[which[item]], which[item]);
+	});
+}
+
+/*
+	Rho for the slice of the reaction's lines which can land in the window (padded slightly, so a line right at an edge may be
+	included and fall just outside; users still check the window), propagating the level, mass, and setting uncertainties to a
+	sigma on rho in the same pass using the analytic derivatives
+*/
+void LineStore::CalculateReaction(const Reaction& rxn, int rxnIndex) {
+	int begin = GetBegin(rxnIndex), end = GetEnd(rxnIndex);
+	std::fill(m_rho.begin()+m_sliceBegin[rxnIndex], m_rho.begin()+m_sliceEnd[rxnIndex], NaN);
+	std::fill(m_rhoSigma.begin()+m_sliceBegin[rxnIndex], m_rhoSigma.begin()+m_sliceEnd[rxnIndex], NaN);
+
+	const double pad = 1.0e-9; //MeV
+	double exLow = -std::numeric_limits<double>::infinity(), exHigh = std::numeric_limits<double>::infinity();
+	if(cos(m_theta) > 0.0) { //past 90 degrees the chosen root is no longer monotonic, so nothing is pruned
+		exLow = rxn.CalculateExcitation(m_rhoMax*(1.0+m_fieldMargin), m_beamKE, m_theta, m_sliceB) - pad;
+		exHigh = rxn.CalculateExcitation(m_rhoMin/(1.0+m_fieldMargin), m_beamKE, m_theta, m_sliceB) + pad;
+	}
+	const double* ex = m_ex.data();
+	int first = std::lower_bound(ex+begin, ex+end, exLow) - ex;
+	int last = std::max(first, (int)(std::upper_bound(ex+begin, ex+end, exHigh) - ex));
+	m_sliceBegin[rxnIndex] = first;
+	m_sliceEnd[rxnIndex] = last;
+
+	double massSigma[4] = {rxn.GetTarget().mass_unc, rxn.GetProjectile().mass_unc, rxn.GetEjectile().mass_unc, rxn.GetResidual().mass_unc};
+	RhoDerivatives d;
+	for(int i=first; i<last; i++) {
+		m_rho[i] = rxn.CalculateRhoWithDerivatives(ex[i], m_beamKE, m_theta, m_B, d);
+		double variance = pow(d.dEx*m_exSigma[i], 2.0) + pow(d.dBeamKE*m_beamKESigma, 2.0) + pow(d.dTheta*m_thetaSigma, 2.0)
+						  + pow(d.dB*m_BSigma, 2.0);
+		for(int k=0; k<4; k++)
+			variance += pow(d.dMass[k]*massSigma[k], 2.0);
+		m_rhoSigma[i] = sqrt(variance);
+	}
+}
+
+/*
+	Follow a change of the field alone. rho goes exactly as 1/B at fixed momentum, so the slices are just rescaled (as are the
+	sigmas, which leaves the field uncertainty term off by the relative drift; negligible). Once the field has drifted past the
+	margin from where the slices were found, they no longer hold every line that can be in the window, and everything is
+	recalculated. Returns the number of reactions recalculated
+*/
+int LineStore::Rescale(const std::vector<Reaction>& reactions, double B) {
+	if(!m_kinematicsSet || !(B > 0.0)) return 0;
+	double drift = B/m_sliceB;
+	if(!(drift <= 1.0+m_fieldMargin && drift >= 1.0/(1.0+m_fieldMargin))) {
+		Calculate(reactions, m_beamKE, m_theta/DEG2RAD, B);
+		return GetNReactions();
+	}
+	double scale = m_B/B;
+	for(int r=0; r<GetNReactions(); r++) {
+		for(int i=m_sliceBegin[r]; i<m_sliceEnd[r]; i++) {
+			m_rho[i] *= scale;
+			m_rhoSigma[i] *= scale;
+		}
+	}
+	m_B = B;
+	return 0;
+}
+
+/*
+	Ejectile momenta (MeV/c) of all of a reaction's lines at an arbitrary beam KE (MeV) and angle (deg), independent of the field;
+	written to momenta[line], i.e. momenta is a column parallel to the lines. Used for the comparison settings
+*/
+void LineStore::CalculateMomenta(const Reaction& rxn, int rxnIndex, double beamKE, double theta, double* momenta) const {
+	double theta_rad = theta*DEG2RAD;
+	for(int i=GetBegin(rxnIndex); i<GetEnd(rxnIndex); i++)
+		momenta[i] = rxn.CalculateEjectileP(m_ex[i], beamKE, theta_rad);
+}
+
+/*Line of the reaction with the given label; -1 if there isn't one*/
+int LineStore::FindLabel(int rxnIndex, const std::string& label) const {
+	auto found = m_labelIds.find(label);
+	if(found == m_labelIds.end()) return -1;
+	for(int i=GetBegin(rxnIndex); i<GetEnd(rxnIndex); i++) {
+		if(m_label[i] == found->second) return i;
+	}
+	return -1;
+}
@@ -2,55 +2,348 @@
 
 MassLookup.h
 Generates a map for isotopic masses using AMDC data; subtracts away
-electron mass from the atomic mass by default. Creates a static global instance
+electron mass from the atomic mass by default. Creates a global instance
 of this map (MASS) for use throughout code it is included into.
 
+Either the preformated mass.txt or an official AME mass table (AME2016 or
+AME2020 fixed width format) can be read; the format is detected from the file.
+
+Several evaluations can be loaded side by side under their own names (data/mass.txt
+is "default"), with one of them active. On top of the active evaluation sit named
+override layers, each holding a handful of masses (i.e. a new measurement); lookups
+go through the enabled layers, newest first, before falling back to the evaluation,
+so nothing is ever copied.
+
+Lookups may be made from any number of threads at once; loading and editing the
+tables waits for them, and lookups wait for it (see ReadWriteLock.h).
+
 Written by G.W. McCann Aug. 2020
 
 */
 #include "MassLookup.h"
+#include <sstream>
 
 using namespace std;
 
+MassLookup MASS;
+
 /*
-  Read in AMDC mass file, preformated to remove excess info. Here assumes that by default
-  the file is in a local directory etc/
+  Read in AMDC mass file. Here assumes that by default the file is in a local directory data/
 */
 MassLookup::MassLookup() {
-  ifstream massfile("data/mass.txt");
-  if(massfile.is_open()) {
-    string junk, A, element;
-    int Z;
-    double atomicMassBig, atomicMassSmall;
-    getline(massfile,junk);
-    getline(massfile,junk);
-    while(massfile>>junk) {
-      massfile>>Z>>A>>element>>atomicMassBig>>atomicMassSmall;
-      string key = "("+to_string(Z)+","+A+")";
-      massTable[key] = (atomicMassBig +atomicMassSmall*1e-6 - Z*electron_mass)*u_to_mev;
-      elementTable[Z] = element;
-    }
-  } else {
+  activeName = "default";
+  active = &evaluations[activeName];
+  if(!ReadFile("data/mass.txt")) {
     cerr<<"Unable to open mass.txt. Make sure it is present."<<endl;
   }
 }
 
 MassLookup::~MassLookup() {}
 
+bool MassLookup::ReadFile(const string& filename) {
+  WriteGuard guard(lock);
+  return Load(filename);
+}
+
+/*
+  Official AME files are fortran formated, and start with a '1' (new page) carriage control character in the first column;
+  the preformated file starts with its column titles. Caller holds the write lock
+*/
+bool MassLookup::Load(const string& filename) {
+  ifstream massfile(filename);
+  if(!massfile.is_open()) return false;
+
+  int first = massfile.peek();
+  if(first == '1') return ReadAMEFile(massfile);
+  else return ReadPreformatedFile(massfile);
+}
+
+/*
+  Load a file as its own evaluation, replacing anything previously loaded under that name; the active evaluation is
+  unchanged, unless it is the one being replaced
+*/
+bool MassLookup::ReadFile(const string& filename, const string& evaluation) {
+  WriteGuard guard(lock);
+  unordered_map<string, MassRecord> previous;
+  unordered_map<string, MassRecord>& table = evaluations[evaluation];
+  previous.swap(table);
+  unordered_map<string, MassRecord>* current = active;
+  active = &table;
+  bool success = Load(filename);
+  active = current;
+  if(!success) {
+    table.swap(previous);
+    if(table.empty() && evaluation != activeName) evaluations.erase(evaluation);
+    cerr<<"Unable to read mass evaluation "<<evaluation<<" from "<<filename<<" at MassLookup::ReadFile()!"<<endl;
+  }
+  return success;
+}
+
+bool MassLookup::SelectEvaluation(const string& evaluation) {
+  WriteGuard guard(lock);
+  auto iter = evaluations.find(evaluation);
+  if(iter == evaluations.end()) {
+    cerr<<"Mass evaluation "<<evaluation<<" is not loaded at MassLookup::SelectEvaluation()!"<<endl;
+    return false;
+  }
+  activeName = evaluation;
+  active = &(iter->second);
+  return true;
+}
+
+/*
+  Adds (or replaces) a single nuclide in an override layer, from its atomic mass excess and uncertainty (keV), as measurements
+  are usually given; a new layer goes on top, enabled
+*/
+void MassLookup::SetOverride(const string& layer, int Z, int A, double excess, double uncertainty) {
+  MassEntry entry;
+  entry.Z = Z;
+  entry.A = A;
+  entry.mass = (A - Z*electron_mass)*u_to_mev + excess*1e-3;
+  entry.uncertainty = uncertainty*1e-3;
+  entry.estimated = false;
+  string key = "("+to_string(Z)+","+to_string(A)+")";
+  WriteGuard guard(lock);
+  for(auto& existing : layers) {
+    if(existing.name == layer) {
+      existing.masses[key] = MakeRecord(entry);
+      return;
+    }
+  }
+  MassLayer added;
+  added.name = layer;
+  added.enabled = true;
+  added.masses[key] = MakeRecord(entry);
+  layers.push_back(added);
+}
+
+/*Returns false if there is no such layer*/
+bool MassLookup::SetLayerEnabled(const string& layer, bool enabled) {
+  WriteGuard guard(lock);
+  for(auto& existing : layers) {
+    if(existing.name == layer) {
+      existing.enabled = enabled;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool MassLookup::IsLayerEnabled(const string& layer) const {
+  ReadGuard guard(lock);
+  for(auto& existing : layers) {
+    if(existing.name == layer) return existing.enabled;
+  }
+  return false;
+}
+
+void MassLookup::ClearLayers() {
+  WriteGuard guard(lock);
+  layers.clear();
+}
+
+vector<string> MassLookup::GetLayers() const {
+  ReadGuard guard(lock);
+  vector<string> names;
+  for(auto& existing : layers)
+    names.push_back(existing.name);
+  return names;
+}
+
+/*Newest enabled layer holding the nuclide, else the active evaluation; nullptr if neither has it*/
+const MassRecord* MassLookup::Find(const string& key) const {
+  for(auto layer = layers.rbegin(); layer != layers.rend(); ++layer) {
+    if(!layer->enabled) continue;
+    auto iter = layer->masses.find(key);
+    if(iter != layer->masses.end()) return &(iter->second);
+  }
+  auto iter = active->find(key);
+  return iter == active->end() ? nullptr : &(iter->second);
+}
+
+MassRecord MassLookup::MakeRecord(const MassEntry& entry) {
+  MassRecord record;
+  record.mass = entry.mass;
+  record.uncertainty = entry.uncertainty;
+  record.estimated = entry.estimated;
+  return record;
+}
+
+/*Preformated file; removed excess info from the AME table and split atomic mass into integer and micro-u columns*/
+bool MassLookup::ReadPreformatedFile(ifstream& massfile) {
+  string line;
+  MassEntry entry;
+  getline(massfile,line);
+  getline(massfile,line);
+  while(getline(massfile, line)) {
+    if(ParseLine(line, false, entry)) Insert(*active, entry);
+  }
+  return true;
+}
+
+/*
+  Fixed width field parsing for the AME tables. Done by hand rather than through streams, since stream extraction is
+  locale dependent and comparatively slow. A '#' in place of the decimal point marks a value which is estimated from
+  systematics rather than measured; it is read as a decimal point and flagged.
+*/
+static bool ParseAMEInt(const string& line, size_t start, size_t length, int& value) {
+  size_t stop = min(line.size(), start+length);
+  bool found = false, negative = false;
+  value = 0;
+  for(size_t i=start; i<stop; i++) {
+    char c = line[i];
+    if(c == ' ') {
+      if(found) break;
+    } else if(c == '-' && !found) {
+      negative = true;
+    } else if(c >= '0' && c <= '9') {
+      value = value*10 + (c - '0');
+      found = true;
+    } else {
+      return false;
+    }
+  }
+  if(negative) value = -value;
+  return found;
+}
+
+static bool ParseAMEDecimal(const string& line, size_t start, size_t length, double& value, bool& estimated) {
+  size_t stop = min(line.size(), start+length);
+  bool found = false, point = false;
+  long long digits = 0;
+  double scale = 1.0;
+  estimated = false;
+  for(size_t i=start; i<stop; i++) {
+    char c = line[i];
+    if(c == ' ') {
+      if(found) break;
+    } else if(c >= '0' && c <= '9') {
+      digits = digits*10 + (c - '0');
+      if(point) scale *= 10.0;
+      found = true;
+    } else if((c == '.' || c == '#') && !point) {
+      point = true;
+      if(c == '#') estimated = true;
+    } else {
+      return false;
+    }
+  }
+  value = digits/scale;
+  return found;
+}
+
+/*
+  Column layout (0 indexed start, width) of the fields which are used. AME2020 widened the mass excess and binding energy
+  fields, which shifts the atomic mass columns; the two are told apart by the length of the data lines.
+*/
+struct AMELayout {
+  size_t z_start, z_width;
+  size_t a_start, a_width;
+  size_t el_start, el_width;
+  size_t big_start, big_width;
+  size_t small_start, small_width;
+  size_t unc_start, unc_width;
+};
+
+static const AMELayout AME2016_LAYOUT = {9, 5, 14, 5, 20, 3, 96, 3, 100, 12, 112, 11};
+static const AMELayout AME2020_LAYOUT = {9, 5, 14, 5, 20, 3, 106, 3, 110, 13, 123, 12};
+
+bool MassLookup::ReadAMEFile(ifstream& massfile) {
+  string line;
+  MassEntry entry;
+  int nRead = 0;
+  while(getline(massfile, line)) {
+    if(!ParseLine(line, true, entry)) continue; //header lines fail here
+    Insert(*active, entry);
+    nRead++;
+  }
+  return nRead > 0;
+}
+
+/*
+  Parse a single data line of either format into a nuclear mass (MeV). Returns false for anything which isn't a data line.
+  Kept independent of the table, so that files can be parsed off of the main thread (see DataWatcher)
+*/
+bool MassLookup::ParseLine(const string& line, bool ameFormat, MassEntry& entry) {
+  if(!ameFormat) {
+    istringstream stream(line);
+    string junk;
+    double atomicMassBig, atomicMassSmall;
+    if(!(stream>>junk>>entry.Z>>entry.A>>entry.element>>atomicMassBig>>atomicMassSmall)) return false;
+    entry.mass = (atomicMassBig + atomicMassSmall*1e-6 - entry.Z*electron_mass)*u_to_mev;
+    entry.uncertainty = 0.0;
+    entry.estimated = false;
+    return true;
+  }
+
+  int atomicMassBig;
+  double atomicMassSmall, uncertainty;
+  bool unc_estimated;
+  if(line.size() < 110) return false; //header, or too short to be data
+  const AMELayout& layout = line.size() >= 130 ? AME2020_LAYOUT : AME2016_LAYOUT;
+  if(!ParseAMEInt(line, layout.z_start, layout.z_width, entry.Z) || !ParseAMEInt(line, layout.a_start, layout.a_width, entry.A))
+    return false;
+  if(!ParseAMEInt(line, layout.big_start, layout.big_width, atomicMassBig) ||
+     !ParseAMEDecimal(line, layout.small_start, layout.small_width, atomicMassSmall, entry.estimated))
+    return false;
+  if(!ParseAMEDecimal(line, layout.unc_start, layout.unc_width, uncertainty, unc_estimated))
+    uncertainty = 0.0;
+
+  entry.element.clear();
+  for(size_t i=layout.el_start; i<layout.el_start+layout.el_width; i++) {
+    if(line[i] != ' ') entry.element.push_back(line[i]);
+  }
+  entry.mass = (atomicMassBig + atomicMassSmall*1e-6 - entry.Z*electron_mass)*u_to_mev;
+  entry.uncertainty = uncertainty*1e-6*u_to_mev;
+  return true;
+}
+
+/*
+  Adds (or replaces) a single nuclide of the named evaluation, whether or not it is the active one (i.e. a reloaded
+  data/mass.txt only ever goes to "default")
+*/
+void MassLookup::SetMass(const string& evaluation, const MassEntry& entry) {
+  WriteGuard guard(lock);
+  Insert(evaluations[evaluation], entry);
+}
+
+void MassLookup::Insert(unordered_map<string, MassRecord>& table, const MassEntry& entry) {
+  string key = "("+to_string(entry.Z)+","+to_string(entry.A)+")";
+  table[key] = MakeRecord(entry);
+  elementTable[entry.Z] = entry.element;
+}
+
 //Returns nuclear mass in MeV
-double MassLookup::FindMass(int Z, int A) {
+double MassLookup::FindMass(int Z, int A) const {
   string key = "("+to_string(Z)+","+to_string(A)+")";
-  try {
-    double mass = massTable.at(key);
-    return mass;
-  } catch (out_of_range& oor) {
+  ReadGuard guard(lock);
+  const MassRecord* record = Find(key);
+  if(record == nullptr) {
     cerr<<"Mass of "<<key<<" (Z,A) not found in Mass Table! Returning 1"<<endl;
     return 1;
   }
+  return record->mass;
+}
+
+//Returns the uncertainty of the nuclear mass in MeV; 0 if the loaded table doesn't have one
+double MassLookup::FindMassUncertainty(int Z, int A) const {
+  string key = "("+to_string(Z)+","+to_string(A)+")";
+  ReadGuard guard(lock);
+  const MassRecord* record = Find(key);
+  return record == nullptr ? 0.0 : record->uncertainty;
+}
+
+//True if the mass is estimated from systematics (marked with a # in the AME)
+bool MassLookup::IsExtrapolated(int Z, int A) const {
+  string key = "("+to_string(Z)+","+to_string(A)+")";
+  ReadGuard guard(lock);
+  const MassRecord* record = Find(key);
+  return record != nullptr && record->estimated;
 }
 
 //returns element symbol
-string MassLookup::FindElement(int Z) {
+string MassLookup::FindElement(int Z) const {
+  ReadGuard guard(lock);
   try {
     string element = elementTable.at(Z);
     return element;
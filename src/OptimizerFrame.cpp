@@ -0,0 +1,165 @@
+/*
+
+	OptimizerFrame.cpp
+	Wrapper class on a TGTransientFrame (temporary frame assoc. with a main frame)
+	User specifies the states which should land on the detector, the contaminant reactions, and the search range.
+	The request is sent as a signal back to the main frame, which runs the field optimizer.
+*/
+#include "OptimizerFrame.h"
+#include <TTimer.h>
+#include <TGLabel.h>
+#include <sstream>
+#include <algorithm>
+
+OptimizerFrame::OptimizerFrame(const TGWindow *p, const TGWindow *main, UInt_t w, UInt_t h, SPSPlotMainFrame *parent) {
+	fMain = new TGTransientFrame(p, main, w, h);
+	fMain->SetCleanup(kDeepCleanup); //delete all child frames
+	fMain->DontCallClose(); //disable close window button
+
+	/*Layout orgainization hints*/
+	TGLayoutHints *fhints = new TGLayoutHints(kLHintsCenterX|kLHintsCenterY,5,5,5,5);
+	TGLayoutHints *lhints = new TGLayoutHints(kLHintsLeft|kLHintsTop,5,5,5,5);
+
+	/*State entry; states given as rxnIndex:Ex pairs, contaminants as a list of reaction indices*/
+	TGVerticalFrame *StateFrame = new TGVerticalFrame(fMain, w, h*0.4);
+	TGLabel *wantedLabel = new TGLabel(StateFrame, "Wanted states (rxn:Ex, ...)");
+	fWantedField = new TGTextEntry(StateFrame, new TGTextBuffer(100));
+	fWantedField->Resize(w*0.8, fWantedField->GetDefaultHeight());
+	TGLabel *unwantedLabel = new TGLabel(StateFrame, "Contaminant reactions (rxn, ...)");
+	fUnwantedField = new TGTextEntry(StateFrame, new TGTextBuffer(100));
+	fUnwantedField->Resize(w*0.8, fUnwantedField->GetDefaultHeight());
+	StateFrame->AddFrame(wantedLabel, lhints);
+	StateFrame->AddFrame(fWantedField, fhints);
+	StateFrame->AddFrame(unwantedLabel, lhints);
+	StateFrame->AddFrame(fUnwantedField, fhints);
+
+	/*Search parameters*/
+	TGHorizontalFrame *ParamFrame = new TGHorizontalFrame(fMain, w, h*0.3);
+	TGVerticalFrame *SepFrame = new TGVerticalFrame(ParamFrame, w*0.25, h*0.3);
+	TGLabel *sepLabel = new TGLabel(SepFrame, "Min Sep. (cm)");
+	fSepField = new TGNumberEntryField(SepFrame, 1, 0.5, TGNumberEntry::kNESRealFour, TGNumberEntry::kNEANonNegative);
+	SepFrame->AddFrame(sepLabel, lhints);
+	SepFrame->AddFrame(fSepField, fhints);
+	TGVerticalFrame *TMinFrame = new TGVerticalFrame(ParamFrame, w*0.25, h*0.3);
+	TGLabel *tminLabel = new TGLabel(TMinFrame, "Theta Min (deg)");
+	fTMinField = new TGNumberEntryField(TMinFrame, 2, 0.0, TGNumberEntry::kNESRealFour, TGNumberEntry::kNEANonNegative);
+	TMinFrame->AddFrame(tminLabel, lhints);
+	TMinFrame->AddFrame(fTMinField, fhints);
+	TGVerticalFrame *TMaxFrame = new TGVerticalFrame(ParamFrame, w*0.25, h*0.3);
+	TGLabel *tmaxLabel = new TGLabel(TMaxFrame, "Theta Max (deg)");
+	fTMaxField = new TGNumberEntryField(TMaxFrame, 3, 60.0, TGNumberEntry::kNESRealFour, TGNumberEntry::kNEANonNegative);
+	TMaxFrame->AddFrame(tmaxLabel, lhints);
+	TMaxFrame->AddFrame(fTMaxField, fhints);
+	TGVerticalFrame *TStepFrame = new TGVerticalFrame(ParamFrame, w*0.25, h*0.3);
+	TGLabel *tstepLabel = new TGLabel(TStepFrame, "Theta Step (deg)");
+	fTStepField = new TGNumberEntryField(TStepFrame, 4, 0.5, TGNumberEntry::kNESRealFour, TGNumberEntry::kNEAPositive);
+	TStepFrame->AddFrame(tstepLabel, lhints);
+	TStepFrame->AddFrame(fTStepField, fhints);
+	ParamFrame->AddFrame(SepFrame, fhints);
+	ParamFrame->AddFrame(TMinFrame, fhints);
+	ParamFrame->AddFrame(TMaxFrame, fhints);
+	ParamFrame->AddFrame(TStepFrame, fhints);
+
+	/*Ok and Cancel buttons*/
+	TGHorizontalFrame *ButtonFrame = new TGHorizontalFrame(fMain, w, h*0.125);
+	fOkButton = new TGTextButton(ButtonFrame, "Ok");
+	fOkButton->Connect("Clicked()","OptimizerFrame",this,"DoOk()");
+	fCancelButton = new TGTextButton(ButtonFrame, "Cancel");
+	fCancelButton->Connect("Clicked()","OptimizerFrame",this,"DoCancel()");
+	ButtonFrame->AddFrame(fOkButton, fhints);
+	ButtonFrame->AddFrame(fCancelButton, fhints);
+
+	fMain->AddFrame(StateFrame, fhints);
+	fMain->AddFrame(ParamFrame, fhints);
+	fMain->AddFrame(ButtonFrame, fhints);
+
+	/*Signal connection*/
+	Connect("SendRequest(OptimizerRequest*)","SPSPlotMainFrame",parent,"RunOptimizer(OptimizerRequest*)");
+
+	fMain->SetWindowName("Optimize Field");
+	fMain->MapSubwindows();
+	fMain->Resize();
+	fMain->CenterOnParent();
+	fMain->MapWindow();
+}
+
+OptimizerFrame::~OptimizerFrame() {
+	fMain->Cleanup(); //delete children
+	fMain->DeleteWindow();
+}
+
+void OptimizerFrame::CloseWindow() {
+	delete this;
+}
+
+/*Wanted states are whitespace or comma separated rxnIndex:Ex pairs*/
+bool OptimizerFrame::ParseWanted(const char* text) {
+	std::string list = text;
+	std::replace(list.begin(), list.end(), ',', ' ');
+	std::istringstream input(list);
+	std::string entry;
+	request.wanted.clear();
+	while(input>>entry) {
+		size_t pos = entry.find(':');
+		if(pos == std::string::npos) {
+			std::cerr<<"Wanted state "<<entry<<" is not of the form rxn:Ex!"<<std::endl;
+			return false;
+		}
+		WantedState state;
+		try {
+			state.rxnIndex = std::stoi(entry.substr(0, pos));
+			state.excitation = std::stod(entry.substr(pos+1));
+		} catch(std::invalid_argument& ia) {
+			std::cerr<<"Wanted state "<<entry<<" is not of the form rxn:Ex!"<<std::endl;
+			return false;
+		}
+		request.wanted.push_back(state);
+	}
+	return !request.wanted.empty();
+}
+
+bool OptimizerFrame::ParseUnwanted(const char* text) {
+	std::string list = text;
+	std::replace(list.begin(), list.end(), ',', ' ');
+	std::istringstream input(list);
+	int index;
+	request.unwanted.clear();
+	while(input>>index)
+		request.unwanted.push_back(index);
+	return input.eof(); //anything other than integers is an error
+}
+
+void OptimizerFrame::DoOk() {
+	fOkButton->SetState(kButtonDisabled); //stop user from doing something dumb
+	fCancelButton->SetState(kButtonDisabled);
+
+	if(!ParseWanted(fWantedField->GetText()) || !ParseUnwanted(fUnwantedField->GetText())) {
+		std::cerr<<"Invalid optimizer state lists!"<<std::endl;
+		fOkButton->SetState(kButtonUp);
+		fCancelButton->SetState(kButtonUp);
+		return;
+	}
+	request.minSeparation = fSepField->GetNumber();
+	request.thetaMin = fTMinField->GetNumber();
+	request.thetaMax = fTMaxField->GetNumber();
+	request.thetaStep = fTStepField->GetNumber();
+
+	SendRequest(&request);
+
+	//Wait for a breif period and then close the window; ensure no memory is 
+	//deleted too quickly
+	TTimer::SingleShot(150, "OptimizerFrame", this, "CloseWindow()");
+}
+
+void OptimizerFrame::DoCancel() {
+	fOkButton->SetState(kButtonDisabled); //stop user from doing something dumb
+	fCancelButton->SetState(kButtonDisabled);
+	//Wait for a breif period and then close the window; ensure no memory is 
+	//deleted too quickly
+	TTimer::SingleShot(150, "OptimizerFrame", this, "CloseWindow()");
+}
+
+/*Signal*/
+void OptimizerFrame::SendRequest(OptimizerRequest* request) {
+	Emit<OptimizerRequest*>("SendRequest(OptimizerRequest*)", request);
+}
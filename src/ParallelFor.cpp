@@ -0,0 +1,176 @@
+/*
+
+ParallelFor.cpp
+Small helper for spreading independent work items over the available hardware threads. Callers write results into
+pre-sized storage indexed by the item, so each item is only ever touched by one thread and the output ordering is
+deterministic, whichever thread ends up doing it.
+
+The threads are made once and kept in a pool. Every call splits the items into one contiguous range per thread (the caller
+is one of them); a thread works through its own range from the front, and once it is empty steals the back half of another
+thread's range. So reactions with many levels, or settings needing new momenta, don't leave the other threads idle behind
+the slowest range. Ranges are a packed (begin, end) pair in one atomic word, so taking and stealing never lock.
+
+The pool runs one call at a time: a call made from inside a work item, or while another thread's call is running, is just
+done serially by its caller.
+*/
+#include "ParallelFor.h"
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+
+namespace {
+
+	struct Job {
+		const std::function<void(int)>* func;
+		std::unique_ptr<std::atomic<uint64_t>[]> ranges; //per slot; begin in the high word, end in the low word
+		int nSlots;
+		int grain; //items a thread takes from its own range at once
+		std::atomic<int> nextSlot; //slot 0 is the caller's
+		int nActive; //pool threads working on this job; guarded by the pool mutex
+	};
+
+	uint64_t Pack(uint32_t begin, uint32_t end) {
+		return ((uint64_t)begin<<32) | end;
+	}
+
+	uint32_t Begin(uint64_t range) {
+		return range>>32;
+	}
+
+	uint32_t End(uint64_t range) {
+		return range & 0xffffffff;
+	}
+
+	/*Take up to grain items from the front of a range; false if it is empty*/
+	bool TakeFront(std::atomic<uint64_t>& slot, uint32_t grain, uint32_t& first, uint32_t& last) {
+		uint64_t range = slot.load(std::memory_order_relaxed);
+		do {
+			if(Begin(range) >= End(range)) return false;
+			first = Begin(range);
+			last = std::min(End(range), first + grain);
+		} while(!slot.compare_exchange_weak(range, Pack(last, End(range))));
+		return true;
+	}
+
+	/*Take the back half (rounded up) of another thread's range*/
+	bool StealBack(std::atomic<uint64_t>& slot, uint32_t& first, uint32_t& last) {
+		uint64_t range = slot.load(std::memory_order_relaxed);
+		do {
+			if(Begin(range) >= End(range)) return false;
+			last = End(range);
+			first = last - (last - Begin(range) + 1)/2;
+		} while(!slot.compare_exchange_weak(range, Pack(Begin(range), first)));
+		return true;
+	}
+
+	/*Work through the slot's own range, then keep stealing until there is nothing left anywhere*/
+	void RunSlot(Job& job, int slot) {
+		std::atomic<uint64_t>& own = job.ranges[slot];
+		uint32_t first, last;
+		while(true) {
+			while(TakeFront(own, job.grain, first, last)) {
+				for(uint32_t i=first; i<last; i++)
+					(*job.func)(i);
+			}
+			bool stolen = false;
+			for(int k=1; k<job.nSlots && !stolen; k++)
+				stolen = StealBack(job.ranges[(slot + k) % job.nSlots], first, last);
+			if(!stolen) return;
+			own.store(Pack(first, last)); //own range is empty, so nobody else is touching it
+		}
+	}
+
+	thread_local bool t_inPool = false; //set on pool threads, and on a caller while its job runs
+
+	class ThreadPool {
+	public:
+		ThreadPool() :
+			m_job(nullptr), m_generation(0)
+		{
+			int nThreads = std::thread::hardware_concurrency();
+			for(int i=1; i<nThreads; i++) //the caller is the last thread
+				m_threads.emplace_back(&ThreadPool::Work, this);
+		}
+
+		int GetNThreads() const { return m_threads.size() + 1; }
+
+		/*False if the pool is already running a job*/
+		bool Run(int nItems, const std::function<void(int)>& func) {
+			std::unique_lock<std::mutex> guard(m_mutex);
+			if(m_job != nullptr) return false;
+
+			Job job;
+			job.func = &func;
+			job.nSlots = std::min(GetNThreads(), nItems);
+			job.grain = std::max(1, nItems/(job.nSlots*16));
+			job.ranges.reset(new std::atomic<uint64_t>[job.nSlots]);
+			int chunk = (nItems + job.nSlots - 1)/job.nSlots;
+			for(int s=0; s<job.nSlots; s++)
+				job.ranges[s].store(Pack(std::min(nItems, s*chunk), std::min(nItems, (s+1)*chunk)));
+			job.nextSlot = 1;
+			job.nActive = 0;
+			m_job = &job;
+			m_generation++;
+			guard.unlock();
+			m_ready.notify_all();
+
+			t_inPool = true;
+			RunSlot(job, 0);
+			t_inPool = false;
+
+			//Every item has been taken once the caller runs dry, but pool threads may still be finishing theirs
+			guard.lock();
+			m_job = nullptr;
+			m_done.wait(guard, [&job]() { return job.nActive == 0; });
+			return true;
+		}
+
+	private:
+		void Work() {
+			t_inPool = true;
+			uint64_t seen = 0;
+			std::unique_lock<std::mutex> guard(m_mutex);
+			while(true) {
+				m_ready.wait(guard, [this, seen]() { return m_job != nullptr && m_generation != seen; });
+				seen = m_generation;
+				Job& job = *m_job;
+				int slot = job.nextSlot++;
+				if(slot >= job.nSlots) continue; //more threads than items
+				job.nActive++;
+				guard.unlock();
+				RunSlot(job, slot);
+				guard.lock();
+				if(--job.nActive == 0) m_done.notify_all();
+			}
+		}
+
+		std::vector<std::thread> m_threads;
+		std::mutex m_mutex;
+		std::condition_variable m_ready, m_done;
+		Job* m_job;
+		uint64_t m_generation;
+	};
+
+	/*
+		Made on first use and never destroyed: the threads are left blocked at exit rather than joined, which also keeps forked
+		children (see the batch tool) safe, since they inherit the pool without its threads and just do every item themselves
+	*/
+	ThreadPool& GetPool() {
+		static ThreadPool* pool = new ThreadPool();
+		return *pool;
+	}
+}
+
+void ParallelFor(int nItems, const std::function<void(int)>& func) {
+	if(nItems <= 0) return;
+
+	if(nItems == 1 || t_inPool || GetPool().GetNThreads() == 1 || !GetPool().Run(nItems, func)) {
+		for(int i=0; i<nItems; i++)
+			func(i);
+	}
+}
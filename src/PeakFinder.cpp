@@ -0,0 +1,79 @@
+/*
+
+PeakFinder.cpp
+Locates peaks in a measured focal plane spectrum. Works on plain arrays of bin centers and counts (no ROOT), in a single
+linear pass: the spectrum is smoothed with two passes of a running box sum (roughly a gaussian of the expected peak width),
+local maxima of the smoothed spectrum are tested against a local background taken from the smoothed spectrum a few widths
+to either side, and accepted peaks get a background subtracted centroid and area from the raw counts.
+*/
+#include "PeakFinder.h"
+#include <cmath>
+#include <algorithm>
+
+PeakFinder::PeakFinder() :
+	m_sigma(2.0), m_threshold(3.0), m_minArea(0.0)
+{
+}
+
+PeakFinder::~PeakFinder() {}
+
+/*Running box average of width 2*halfWidth+1, from a prefix sum; edges average over the bins which exist*/
+void PeakFinder::Smooth(const std::vector<double>& counts, int halfWidth, std::vector<double>& smoothed) const {
+	int n = counts.size();
+	std::vector<double> prefix(n+1, 0.0);
+	for(int i=0; i<n; i++)
+		prefix[i+1] = prefix[i] + counts[i];
+	smoothed.resize(n);
+	for(int i=0; i<n; i++) {
+		int lo = std::max(0, i-halfWidth);
+		int hi = std::min(n-1, i+halfWidth);
+		smoothed[i] = (prefix[hi+1] - prefix[lo])/(hi - lo + 1);
+	}
+}
+
+/*
+	Find the peaks of a spectrum given as bin centers (increasing) and counts. Two box passes of half-width ~sigma give a
+	triangular kernel close to the expected peak shape. The background for a candidate is the smaller of the smoothed
+	spectrum 3 sigma to either side, so that a neighboring peak on one side doesn't hide it
+*/
+std::vector<Peak> PeakFinder::Search(const std::vector<double>& centers, const std::vector<double>& counts) const {
+	std::vector<Peak> peaks;
+	int n = std::min(centers.size(), counts.size());
+	if(n < 3) return peaks;
+
+	int halfWidth = std::max(1, (int)std::lround(m_sigma));
+	int offset = std::max(2, (int)std::lround(3.0*m_sigma));
+	std::vector<double> once, smoothed;
+	Smooth(counts, halfWidth, once);
+	Smooth(once, halfWidth, smoothed);
+
+	for(int i=1; i<n-1; i++) {
+		if(smoothed[i] <= smoothed[i-1] || smoothed[i] < smoothed[i+1]) continue; //plateaus count once, at their left edge
+
+		double left = smoothed[std::max(0, i-offset)];
+		double right = smoothed[std::min(n-1, i+offset)];
+		double background = std::min(left, right);
+		double net = smoothed[i] - background;
+		if(net < m_threshold*std::sqrt(std::max(background, 1.0))) continue;
+
+		//Centroid and area from the raw counts over +/- 2 sigma
+		int lo = std::max(0, i-2*halfWidth);
+		int hi = std::min(n-1, i+2*halfWidth);
+		double sum = 0.0, weighted = 0.0;
+		for(int j=lo; j<=hi; j++) {
+			double w = counts[j] - background;
+			if(w <= 0.0) continue;
+			sum += w;
+			weighted += w*centers[j];
+		}
+		if(sum <= 0.0 || sum < m_minArea) continue;
+
+		Peak peak;
+		peak.centroid = weighted/sum;
+		peak.height = smoothed[i];
+		peak.background = background;
+		peak.area = sum;
+		peaks.push_back(peak);
+	}
+	return peaks;
+}
@@ -14,11 +14,11 @@ Modified Sep 2020 by G.W. McCann
 
 */
 #include "Reaction.h"
+#include <limits>
 
 /*Set all flags to start values*/
 Reaction::Reaction() {
   target_initialized = false;
-  kinematics_initialized = false;
 }
 
 Reaction::~Reaction() {
@@ -29,14 +29,17 @@ void Reaction::SetReactionData(int At, int Zt, int Ap, int Zp, int Ae, int Ze) {
 
   target.A = At; target.Z = Zt;
   target.mass_gs = MASS.FindMass(target.Z, target.A);
+  target.mass_unc = MASS.FindMassUncertainty(target.Z, target.A);
   target.sym = to_string(target.A)+MASS.FindElement(target.Z);
 
   projectile.A = Ap; projectile.Z = Zp;
   projectile.mass_gs = MASS.FindMass(projectile.Z, projectile.A);
+  projectile.mass_unc = MASS.FindMassUncertainty(projectile.Z, projectile.A);
   projectile.sym = to_string(projectile.A) + MASS.FindElement(projectile.Z);
 
   ejectile.A = Ae; ejectile.Z = Ze;
   ejectile.mass_gs = MASS.FindMass(ejectile.Z, ejectile.A);
+  ejectile.mass_unc = MASS.FindMassUncertainty(ejectile.Z, ejectile.A);
   ejectile.sym = to_string(ejectile.A) + MASS.FindElement(ejectile.Z);
 
   residual.A = At+Ap - Ae;
@@ -47,47 +50,40 @@ void Reaction::SetReactionData(int At, int Zt, int Ap, int Zp, int Ae, int Ze) {
   }
   residual.sym = to_string(residual.A) + MASS.FindElement(residual.Z);
   residual.mass_gs = MASS.FindMass(residual.Z, residual.A);
-
-  SetExcitations(); //Find listed exictation energies
+  residual.mass_unc = MASS.FindMassUncertainty(residual.Z, residual.A);
 
   name = target.sym + "(" + projectile.sym+ "," + ejectile.sym + ")" + residual.sym;
   target_initialized = true;
 }
 
-/*initialize the kinematic (SPS) parameters*/
-void Reaction::SetKinematicParams(double beamKE, double lab_angle, double mag_field) {
-  if(!target_initialized) {
-    std::cerr<<"Target not set correctly! Unable to initialize kinematics."<<std::endl;
+/*
+  Optional decay of an unbound state of the residual or the ejectile. Only the decay itself is checked here; whether the state is
+  actually above the threshold depends on the masses, and is left to the sampling
+*/
+void Reaction::AddDecay(const DecayChannel& decay) {
+  const nucleus& parent = decay.parent == DecayChannel::EJECTILE ? ejectile : residual;
+  if(!target_initialized || decay.A <= 0 || decay.Z <= 0 || decay.A >= parent.A || decay.Z > parent.Z || decay.ex < 0.0 || decay.width < 0.0 ||
+     (decay.Z == parent.Z && parent.A - decay.A > 1)) { //whatever is left has to be a nucleus or a neutron
+    std::cerr<<"Invalid decay of "<<parent.sym<<" at Reaction::AddDecay()! Skipping."<<std::endl;
     return;
   }
-
-  beamE = beamKE;
-  projectile.KE = beamE;
-  theta = lab_angle*DEG2RAD;
-  B = mag_field;
-
-  projectile.E = projectile.KE + projectile.mass_gs;
-  projectile.p = sqrt(pow(projectile.E, 2.)-pow(projectile.mass_gs, 2.));
-
-  target.E = target.mass_gs;
-  target.KE = 0.;
-  target.p = 0.;
-
-  kinematics_initialized = true;
-  CalculateRhos(); //Calculate rho values for the given excitations
+  decays.push_back(decay);
 }
 
-/*Calculates the bending radius (in cm) of the ejectile, given an excitation energy of the residual (in MeV)*/
-double Reaction::CalculateRho(double excitation) {
-  if(!kinematics_initialized) {
-    std::cerr<<"Attempting calculation with uninitialized parameters at GetRho! Return 0"<<std::endl;
-    return 0.0;
-  }
-
+/*
+  Calculates the momentum (in MeV/c) of the ejectile for a given excitation (MeV), beam KE (MeV), and lab angle (rad).
+  Independent of the field, so it can be shared by any settings which only differ in B
+*/
+double Reaction::CalculateEjectileP(double excitation, double beamKE, double theta_rad) const {
   double Q = projectile.mass_gs+target.mass_gs - (ejectile.mass_gs+residual.mass_gs+excitation);
-  double r = sqrt(projectile.mass_gs*ejectile.mass_gs*projectile.KE)/(ejectile.mass_gs+residual.mass_gs)*cos(theta);
-  double s = (projectile.KE*(residual.mass_gs-projectile.mass_gs)+residual.mass_gs*Q)/(ejectile.mass_gs+residual.mass_gs);
+  double r = sqrt(projectile.mass_gs*ejectile.mass_gs*beamKE)/(ejectile.mass_gs+residual.mass_gs)*cos(theta_rad);
+  double s = (beamKE*(residual.mass_gs-projectile.mass_gs)+residual.mass_gs*Q)/(ejectile.mass_gs+residual.mass_gs);
 
+  return EjectilePFromRS(r, s);
+}
+
+/*Solves the kinematics for the ejectile momentum given the angle-dependent term r and the excitation-dependent term s*/
+double Reaction::EjectilePFromRS(double r, double s) const {
   double ejectKE1 = r + sqrt(r*r + s);
   double ejectKE2 = r - sqrt(r*r + s);
 
@@ -100,69 +96,136 @@ double Reaction::CalculateRho(double excitation) {
     ejectKE = ejectKE1*ejectKE1;
   }  
 
-  double ejectP = sqrt(ejectKE*(ejectKE+2.0*ejectile.mass_gs));
-  double qbrho = ejectP/QBRHO2P;
-
-  return qbrho/(ejectile.Z*B);
-}
-
-
-/*Getters and setters*/
-
-void Reaction::SetExcitations() {
-  excitations = EX.GetListOfExcitations(residual.sym);
-  ex_strings = EX.GetListOfExcitations_Strings(residual.sym);
+  return sqrt(ejectKE*(ejectKE+2.0*ejectile.mass_gs));
 }
 
-void Reaction::CalculateRhos() {  
-  rhos.clear();
-  rhos.reserve(excitations.size());
-  for(unsigned int i=0; i<excitations.size(); i++) {
-    rhos.emplace_back(CalculateRho(excitations[i]));
+/*
+  Batched version of CalculateEjectileP; fills p_grid with the momenta for every (excitation, angle) pair, stored
+  excitation-major (p_grid[i*nAngles + j]). The angle terms (cos) and the excitation terms (Q) are only calculated once each.
+  Angles in deg.
+*/
+void Reaction::CalculateMomentumGrid(double beamKE, const std::vector<double>& exs, const std::vector<double>& angles, std::vector<double>& p_grid) const {
+  unsigned int nAngles = angles.size();
+  p_grid.resize(exs.size()*nAngles);
+
+  double mass_sum = ejectile.mass_gs+residual.mass_gs;
+  double r0 = sqrt(projectile.mass_gs*ejectile.mass_gs*beamKE)/mass_sum;
+  std::vector<double> r_list(nAngles);
+  for(unsigned int j=0; j<nAngles; j++)
+    r_list[j] = r0*cos(angles[j]*DEG2RAD);
+
+  for(unsigned int i=0; i<exs.size(); i++) {
+    double Q = projectile.mass_gs+target.mass_gs - (mass_sum+exs[i]);
+    double s = (beamKE*(residual.mass_gs-projectile.mass_gs)+residual.mass_gs*Q)/mass_sum;
+    double* p_row = &p_grid[i*nAngles];
+    for(unsigned int j=0; j<nAngles; j++)
+      p_row[j] = EjectilePFromRS(r_list[j], s);
   }
 }
 
-vector<double>* Reaction::GetRhos() {
-  return &rhos;
+/*
+  Calculates rho (cm) along with its analytic partial derivatives with respect to the excitation, beam KE, angle, field, and
+  each of the ground state masses. With Te = x^2 and x = r + sqrt(r^2 + s), every input only enters through r and s (and the
+  ejectile mass also directly through p), so each derivative is a chain rule through dx = dr*x/u + ds/(2u), where u = sqrt(r^2 + s).
+  Note that the solution picked by EjectilePFromRS is always x = r + u (x = r - u is only kept if it is non-negative, in which case
+  r + u is as well), so only that branch is differentiated.
+*/
+double Reaction::CalculateRhoWithDerivatives(double excitation, double beamKE, double theta_rad, double mag_field, RhoDerivatives& derivs) const {
+  double mp = projectile.mass_gs, mt = target.mass_gs, me = ejectile.mass_gs, mr = residual.mass_gs;
+  double M = me+mr;
+  double Q = mp+mt - (M+excitation);
+  double r0 = sqrt(mp*me*beamKE)/M;
+  double r = r0*cos(theta_rad);
+  double s = (beamKE*(mr-mp)+mr*Q)/M;
+
+  double u = sqrt(r*r + s);
+  double x = r + u;
+  double Te = x*x;
+  double p = sqrt(Te*(Te+2.0*me));
+  double rho = MomentumToRho(p, mag_field);
+
+  double dx_dr = x/u, dx_ds = 0.5/u;
+  double drho_dTe = (Te+me)/p*rho/p; //rho is proportional to p
+  double drho_dx = drho_dTe*2.0*x;
+  auto chain = [&](double dr, double ds) { return drho_dx*(dx_dr*dr + dx_ds*ds); };
+
+  derivs.dEx = chain(0.0, -mr/M);
+  derivs.dBeamKE = beamKE > 0.0 ? chain(0.5*r/beamKE, (mr-mp)/M) : 0.0;
+  derivs.dTheta = chain(-r0*sin(theta_rad), 0.0);
+  derivs.dB = -rho/mag_field;
+  derivs.dMass[0] = chain(0.0, mr/M);
+  derivs.dMass[1] = chain(0.5*r/mp, (mr-beamKE)/M);
+  derivs.dMass[2] = chain(0.5*r/me - r/M, (-mr - s)/M) + Te/p*rho/p;
+  derivs.dMass[3] = chain(-r/M, (beamKE + Q - mr - s)/M);
+  return rho;
+}
+
+/*Converts an ejectile momentum (MeV/c) to a bending radius (cm) for a field in kG; rho goes exactly as 1/B*/
+double Reaction::MomentumToRho(double p, double mag_field) const {
+  double qbrho = p/QBRHO2P;
+  return qbrho/(ejectile.Z*mag_field);
 }
 
-vector<double>* Reaction::GetExs() {
-  return &excitations;
+/*
+  Re-read the four masses (i.e. after switching mass evaluation or override layers). Returns true if any of them actually
+  changed, in which case the reaction's lines need recalculating (see LineStore)
+*/
+bool Reaction::UpdateMasses() {
+  if(!target_initialized) return false;
+  bool changed = false;
+  nucleus* nuclei[4] = {&target, &projectile, &ejectile, &residual};
+  for(auto n : nuclei) {
+    double mass = MASS.FindMass(n->Z, n->A);
+    double unc = MASS.FindMassUncertainty(n->Z, n->A);
+    if(mass != n->mass_gs || unc != n->mass_unc) {
+      n->mass_gs = mass;
+      n->mass_unc = unc;
+      changed = true;
+    }
+  }
+  return changed;
 }
 
-vector<string>* Reaction::GetEx_Strings() {
-  return &ex_strings;
+/*
+  Exact inverse of the rho calculation: rho gives the ejectile KE, so x = sqrt(KE), and then s = x^2 - 2rx gives Q. Rhos beyond
+  the kinematic limit (x < r, where the square root goes negative) map to +infinity, i.e. every allowed state has a larger rho.
+  Only valid for forward angles
+*/
+double Reaction::CalculateExcitation(double rho, double beamKE, double theta_rad, double mag_field) const {
+  const double inf = std::numeric_limits<double>::infinity();
+  if(std::isinf(rho)) return -inf;
+
+  double mp = projectile.mass_gs, mt = target.mass_gs, me = ejectile.mass_gs, mr = residual.mass_gs;
+  double M = me+mr;
+  double p = rho*ejectile.Z*mag_field*QBRHO2P;
+  double Te = sqrt(p*p + me*me) - me;
+  double x = sqrt(Te);
+  double r = sqrt(mp*me*beamKE)/M*cos(theta_rad);
+  if(x < r) return inf;
+  double s = x*x - 2.0*r*x;
+  double Q = (s*M - beamKE*(mr-mp))/mr;
+  return mp+mt - M - Q;
 }
 
-const nucleus& Reaction::GetTarget() {
+/*Getters and setters*/
+
+const nucleus& Reaction::GetTarget() const {
   return target;
 }
 
-const nucleus& Reaction::GetProjectile() {
+const nucleus& Reaction::GetProjectile() const {
   return projectile;
 }
 
-const nucleus& Reaction::GetEjectile() {
+const nucleus& Reaction::GetEjectile() const {
   return ejectile;
 }
 
-const nucleus& Reaction::GetResidual() {
+const nucleus& Reaction::GetResidual() const {
   return residual;
 }
 
-double Reaction::GetAngle() {
-  return theta/DEG2RAD;
-}
-
-double Reaction::GetBfield() {
-  return B;
-}
-
-double Reaction::GetBeamKE() {
-  return beamE;
-}
-
-std::string& Reaction::GetName() {
+const std::string& Reaction::GetName() const {
   return name;
 }
 
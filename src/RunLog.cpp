@@ -0,0 +1,125 @@
+/*
+
+RunLog.cpp
+Spectrograph parameters of every run of an experiment, read from a comma separated run log with the columns: run number,
+timestamp, NMR field (kG), beam KE (MeV), and angle (deg). Gives the rho of a fixed set of lines at every run, so that drifts
+of the field, beam energy, and angle over a campaign can be followed.
+*/
+#include "RunLog.h"
+#include "ParallelFor.h"
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <algorithm>
+
+static const double DEG2RAD = 3.14159265358979323846/180.0;
+
+RunLog::RunLog() {}
+
+RunLog::~RunLog() {}
+
+/*Strip surrounding whitespace and quotes from a csv field*/
+static std::string TrimField(const std::string& field) {
+	size_t first = field.find_first_not_of(" \t\r\"");
+	if(first == std::string::npos) return "";
+	size_t last = field.find_last_not_of(" \t\r\"");
+	return field.substr(first, last - first + 1);
+}
+
+/*
+	One run per line; a header line and lines starting with # are skipped. A blank field, beam KE, or angle means unchanged
+	from the previous run (logs often only record a value when it was changed). Replaces any previously read log
+*/
+bool RunLog::ReadFile(const std::string& filename) {
+	std::ifstream input(filename);
+	if(!input.is_open()) {
+		std::cerr<<"Unable to open run log "<<filename<<" at RunLog::ReadFile()!"<<std::endl;
+		return false;
+	}
+
+	m_runs.clear();
+	std::string line, field;
+	int lineNumber = 0;
+	while(std::getline(input, line)) {
+		lineNumber++;
+		std::string trimmed = TrimField(line);
+		if(trimmed.empty() || trimmed[0] == '#') continue;
+
+		std::vector<std::string> fields;
+		std::stringstream stream(line);
+		while(std::getline(stream, field, ','))
+			fields.push_back(TrimField(field));
+		fields.resize(5);
+
+		char* end;
+		RunRecord record;
+		record.run = std::strtol(fields[0].c_str(), &end, 10);
+		if(end == fields[0].c_str() || *end != '\0') {
+			if(m_runs.empty()) continue; //column titles
+			std::cerr<<"Invalid run number at line "<<lineNumber<<" of "<<filename<<" at RunLog::ReadFile()! Skipping."<<std::endl;
+			continue;
+		}
+		record.timestamp = fields[1];
+
+		double* values[3] = {&record.B, &record.beamKE, &record.theta};
+		bool valid = true;
+		for(int i=0; i<3; i++) {
+			const std::string& text = fields[i+2];
+			if(text.empty() && !m_runs.empty()) {
+				*values[i] = i == 0 ? m_runs.back().B : (i == 1 ? m_runs.back().beamKE : m_runs.back().theta);
+				continue;
+			}
+			*values[i] = std::strtod(text.c_str(), &end);
+			if(end == text.c_str() || *end != '\0') valid = false;
+		}
+		if(!valid) {
+			std::cerr<<"Invalid parameters for run "<<record.run<<" at line "<<lineNumber<<" of "<<filename<<" at RunLog::ReadFile()! Skipping."<<std::endl;
+			continue;
+		}
+		m_runs.push_back(record);
+	}
+
+	if(m_runs.empty()) {
+		std::cerr<<"No runs found in "<<filename<<" at RunLog::ReadFile()!"<<std::endl;
+		return false;
+	}
+	return true;
+}
+
+/*
+	rho (cm) of each line at every run, stored run-major (rhos[run*nLines + line]). Ejectile momenta only depend on the beam
+	KE and angle, so consecutive runs sharing those are grouped and the momenta are calculated once per group; within a group
+	each run only rescales by its field, and a run which repeats the previous field copies its row. Groups are independent,
+	so they are spread over the available threads
+*/
+void RunLog::Predict(const std::vector<Reaction>& reactions, const std::vector<RunLine>& lines, std::vector<double>& rhos) const {
+	int nRuns = m_runs.size();
+	int nLines = lines.size();
+	rhos.assign((size_t)nRuns*nLines, 0.0);
+	if(nRuns == 0 || nLines == 0) return;
+
+	std::vector<int> groupStart;
+	for(int i=0; i<nRuns; i++) {
+		if(i == 0 || m_runs[i].beamKE != m_runs[i-1].beamKE || m_runs[i].theta != m_runs[i-1].theta)
+			groupStart.push_back(i);
+	}
+	groupStart.push_back(nRuns);
+
+	ParallelFor(groupStart.size()-1, [this, &reactions, &lines, &rhos, &groupStart, nLines](int group) {
+		int first = groupStart[group], last = groupStart[group+1];
+		const RunRecord& setting = m_runs[first];
+		std::vector<double> momenta(nLines);
+		for(int k=0; k<nLines; k++)
+			momenta[k] = reactions[lines[k].rxnIndex].CalculateEjectileP(lines[k].ex, setting.beamKE, setting.theta*DEG2RAD);
+
+		for(int i=first; i<last; i++) {
+			double* row = &rhos[(size_t)i*nLines];
+			if(i > first && m_runs[i].B == m_runs[i-1].B) {
+				std::copy(row - nLines, row, row);
+				continue;
+			}
+			for(int k=0; k<nLines; k++)
+				row[k] = reactions[lines[k].rxnIndex].MomentumToRho(momenta[k], m_runs[i].B);
+		}
+	});
+}
@@ -0,0 +1,146 @@
+/*
+
+SPSKinematics.cpp
+C interface to the SPSPlot kinematics core (Reaction, MassLookup, ExTable), for use from DAQ, sort codes, and scripts
+(ctypes, etc.) without ROOT. Thin wrappers around the const (thread safe) Reaction calculations. Entry points which can
+reach a throwing call (file parsing, allocation, thread creation) catch everything and return their error value, so no
+exception crosses into C.
+*/
+#include "SPSKinematics.h"
+#include "Reaction.h"
+#include "LineStore.h"
+#include "ParallelFor.h"
+
+struct sps_reaction {
+	Reaction rxn;
+	std::string name;
+	std::vector<double> levels;
+};
+
+static const int PARALLEL_THRESHOLD = 4096; //below this many rhos, threads cost more than they save
+static const double DEG2RAD = 3.14159265358979323846/180.0;
+
+int sps_load_masses(const char* filename) {
+	if(filename == nullptr) return -1;
+	try {
+		return MASS.ReadFile(filename) ? 0 : -1;
+	} catch(...) {
+		return -1;
+	}
+}
+
+int sps_load_levels(const char* filename) {
+	if(filename == nullptr) return -1;
+	try {
+		return EX.ReadFile(filename) ? 0 : -1;
+	} catch(...) { //i.e. std::stod on a malformed level
+		return -1;
+	}
+}
+
+int sps_import_ensdf(const char* filename) {
+	if(filename == nullptr) return -1;
+	try {
+		return EX.ImportENSDF(filename) ? 0 : -1;
+	} catch(...) {
+		return -1;
+	}
+}
+
+sps_reaction* sps_reaction_create(int At, int Zt, int Ap, int Zp, int Ae, int Ze) {
+	sps_reaction* handle = nullptr;
+	try {
+		handle = new sps_reaction;
+		handle->rxn.SetReactionData(At, Zt, Ap, Zp, Ae, Ze);
+		if(!handle->rxn.IsInitialized()) {
+			delete handle;
+			return nullptr;
+		}
+		handle->name = handle->rxn.GetName();
+		std::vector<double> sigmas;
+		std::vector<std::string> labels;
+		LineStore::ReadLevels(handle->rxn.GetResidual().sym, handle->levels, sigmas, labels);
+		return handle;
+	} catch(...) {
+		delete handle;
+		return nullptr;
+	}
+}
+
+void sps_reaction_destroy(sps_reaction* rxn) {
+	delete rxn;
+}
+
+const char* sps_reaction_name(const sps_reaction* rxn) {
+	if(rxn == nullptr) return nullptr;
+	return rxn->name.c_str();
+}
+
+int sps_reaction_levels(const sps_reaction* rxn, double* ex, int maxLevels) {
+	if(rxn == nullptr) return -1;
+	int nLevels = rxn->levels.size();
+	for(int i=0; ex != nullptr && i<nLevels && i<maxLevels; i++)
+		ex[i] = rxn->levels[i];
+	return nLevels;
+}
+
+int sps_rho(const sps_reaction* rxn, double beamKE, double theta, double B, const double* ex, int nEx, double* rho) {
+	return sps_rho_settings(rxn, &beamKE, &theta, &B, 1, ex, nEx, rho);
+}
+
+int sps_rho_settings(const sps_reaction* rxn, const double* beamKE, const double* theta, const double* B, int nSettings,
+					 const double* ex, int nEx, double* rho) {
+	if(rxn == nullptr || beamKE == nullptr || theta == nullptr || B == nullptr || ex == nullptr || rho == nullptr || nSettings < 0 || nEx < 0)
+		return -1;
+
+	const Reaction& reaction = rxn->rxn;
+	auto calculate = [&](int s) {
+		double theta_rad = theta[s]*DEG2RAD;
+		for(int i=0; i<nEx; i++)
+			rho[s*nEx+i] = reaction.MomentumToRho(reaction.CalculateEjectileP(ex[i], beamKE[s], theta_rad), B[s]);
+	};
+	if((long)nSettings*nEx < PARALLEL_THRESHOLD) {
+		for(int s=0; s<nSettings; s++)
+			calculate(s);
+	} else {
+		try {
+			ParallelFor(nSettings, calculate);
+		} catch(...) { //starting the pool can throw
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int sps_ex(const sps_reaction* rxn, double beamKE, double theta, double B, const double* rho, int nRho, double* ex) {
+	if(rxn == nullptr || rho == nullptr || ex == nullptr || nRho < 0)
+		return -1;
+
+	double theta_rad = theta*DEG2RAD;
+	for(int i=0; i<nRho; i++)
+		ex[i] = rxn->rxn.CalculateExcitation(rho[i], beamKE, theta_rad, B);
+	return 0;
+}
+
+int sps_rho_sigma(const sps_reaction* rxn, double beamKE, double theta, double B, double dBeamKE, double dTheta, double dB,
+				  const double* ex, const double* exSigma, int nEx, double* rho, double* sigma) {
+	if(rxn == nullptr || ex == nullptr || rho == nullptr || sigma == nullptr || nEx < 0)
+		return -1;
+
+	const Reaction& reaction = rxn->rxn;
+	double mass_unc[4] = {reaction.GetTarget().mass_unc, reaction.GetProjectile().mass_unc, reaction.GetEjectile().mass_unc,
+						  reaction.GetResidual().mass_unc};
+	double theta_rad = theta*DEG2RAD;
+	double dTheta_rad = dTheta*DEG2RAD;
+	RhoDerivatives d;
+	for(int i=0; i<nEx; i++) {
+		rho[i] = reaction.CalculateRhoWithDerivatives(ex[i], beamKE, theta_rad, B, d);
+		double dEx = exSigma == nullptr ? 0.0 : exSigma[i];
+		double variance = std::pow(d.dEx*dEx, 2.0) + std::pow(d.dBeamKE*dBeamKE, 2.0) + std::pow(d.dTheta*dTheta_rad, 2.0)
+						  + std::pow(d.dB*dB, 2.0);
+		for(int k=0; k<4; k++)
+			variance += std::pow(d.dMass[k]*mass_unc[k], 2.0);
+		sigma[i] = std::sqrt(variance);
+	}
+	return 0;
+}
@@ -1,20 +1,54 @@
 #include "SPSPlot.h"
+#include "ParallelFor.h"
 #include <TAxis.h>
 #include <TLatex.h>
 #include <TStyle.h>
+#include <TVirtualPad.h>
+#include <TBox.h>
+#include <TLegend.h>
+#include <TFile.h>
+#include <TKey.h>
+#include <TPolyMarker.h>
+#include <TString.h>
+#include "LineAssigner.h"
+#include "DataWatcher.h"
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <unordered_set>
+#include <array>
+#include <map>
+#include <tuple>
 
 //Default constructor
 SPSPlot::SPSPlot() {
 	graph_array = nullptr;
+	m_curves = nullptr;
+	m_spectrum = nullptr;
+	m_synthetic = nullptr;
+	m_drift = nullptr;
+	m_pid = nullptr;
 	ngraphs = 0;
 	validFlag = false;
+	m_B = 0.0; m_theta = 0.0; m_beamKE = 0.0;
+	m_rhoMin = 0.0; m_rhoMax = 0.0;
+	m_resolution = {0.0, 0.0, 0.0, 0.02};
+	m_beamKESigma = 0.0; m_thetaSigma = 0.0; m_BSigma = 0.0;
+	m_calOffset = 0.0; m_calSlope = 1.0;
+	m_peakSigma = 0.02; m_peakThreshold = 3.0; m_assignTolerance = 0.1;
+	m_minWeight = 0.0;
+	m_fieldMargin = 0.0;
+	m_lociDirty = true;
+	m_lociBeamKE = 0.0; m_lociTheta = 0.0;
 }
 
-//Overload for use as standalone (no gui)
-SPSPlot::SPSPlot(std::string& filename) {
+//Overload for use as standalone (no gui); everything is set up by the default constructor first, since reading may publish
+SPSPlot::SPSPlot(std::string& filename) : SPSPlot() {
 	validFlag = ReadInputFile(filename);
-	graph_array = nullptr;
-	ngraphs = 0;
+	Publish();
 }
 
 SPSPlot::~SPSPlot() {
@@ -23,11 +57,18 @@ SPSPlot::~SPSPlot() {
 			delete graph_array[i];
 		delete[] graph_array;
 	}
+	delete m_curves;
+	delete m_spectrum;
+	delete m_synthetic;
+	delete m_drift;
+	delete m_pid;
+	ClearSettings();
 }
 
 //Called to load data
 void SPSPlot::AttachFile(std::string& filename) {
 	validFlag = ReadInputFile(filename);
+	Publish();
 }
 
 //Handler for input data
@@ -40,6 +81,12 @@ bool SPSPlot::ReadInputFile(std::string& filename) {
 
 	//Clear reactions so that file can be loaded even if there is already loaded data
 	m_Reactions.clear();
+	ClearSettings();
+
+	//Data layers belong to the config; the reaction table is read against the plain default masses and levels
+	MASS.ClearLayers();
+	EX.ClearLayers();
+	MASS.SelectEvaluation("default");
 
 	std::string junk;
 	double bke, b, theta, rhomin, rhomax;
@@ -51,25 +98,477 @@ bool SPSPlot::ReadInputFile(std::string& filename) {
 	std::getline(input, junk);
 	std::getline(input, junk);
 	std::getline(input, junk);
+	std::vector<std::array<int, 6>> table; //the mass and level lookups of each reaction are independent, so are done in parallel
 	while(input>>at) {
-		Reaction rxn;
 		input>>zt>>ap>>zp>>ae>>ze;
-		rxn.SetReactionData(at, zt, ap, zp, ae, ze);
-		rxn.SetKinematicParams(bke, theta, b);
-		m_Reactions.push_back(rxn);
+		table.push_back({{at, zt, ap, zp, ae, ze}});
+	}
+	m_Reactions.resize(table.size());
+	ParallelFor(table.size(), [this, &table](int i) {
+		const std::array<int, 6>& rxn = table[i];
+		m_Reactions[i].SetReactionData(rxn[0], rxn[1], rxn[2], rxn[3], rxn[4], rxn[5]);
+	});
+
+	//Optional keyword lines following the reaction table
+	input.clear();
+	std::string keyword;
+	m_beamKESigma = 0.0; m_thetaSigma = 0.0; m_BSigma = 0.0;
+	m_calOffset = 0.0; m_calSlope = 1.0;
+	m_peakSigma = 0.02; m_peakThreshold = 3.0; m_assignTolerance = 0.1;
+	m_target.Clear();
+	m_minWeight = 0.0;
+	m_resolution = {0.0, 0.0, 0.0, 0.02};
+	m_intensities.clear();
+	m_massTables.clear();
+	m_massOverrides.clear();
+	m_levelOverrides.clear();
+	m_sampler.ClearConfig();
+	m_detector.Clear();
+	std::string evaluation, publishName;
+	std::vector<std::string> disabledLayers;
+	std::string line;
+	while(std::getline(input, line)) {
+		std::istringstream row(line);
+		if(!(row>>keyword)) continue; //blank line
+		bool parsed = true; //a malformed line is skipped, not the rest of the file
+		if(keyword == "SETTING") {
+			SPSSetting setting;
+			if((parsed = (bool)(row>>setting.name>>setting.beamKE>>setting.B>>setting.theta))) m_Settings.push_back(setting);
+		} else if(keyword == "UNCERTAINTY") {
+			double beamKESigma, thetaSigma, BSigma;
+			if((parsed = (bool)(row>>beamKESigma>>thetaSigma>>BSigma))) {
+				m_beamKESigma = beamKESigma; m_thetaSigma = thetaSigma; m_BSigma = BSigma;
+			}
+		} else if(keyword == "CALIBRATION") {
+			double offset, slope;
+			if((parsed = (bool)(row>>offset>>slope))) {
+				m_calOffset = offset; m_calSlope = slope;
+			}
+		} else if(keyword == "PEAKS") {
+			double sigma, threshold, tolerance;
+			if((parsed = (bool)(row>>sigma>>threshold>>tolerance))) {
+				m_peakSigma = sigma; m_peakThreshold = threshold; m_assignTolerance = tolerance;
+			}
+		} else if(keyword == "TARGET") {
+			TargetComponent component;
+			if((parsed = (bool)(row>>component.A>>component.Z>>component.abundance>>component.arealDensity))) m_target.AddComponent(component);
+		} else if(keyword == "WEIGHTCUT") {
+			double minWeight;
+			if((parsed = (bool)(row>>minWeight))) m_minWeight = minWeight;
+		} else if(keyword == "RESOLUTION") {
+			ResolutionModel resolution;
+			if((parsed = (bool)(row>>resolution.beamSpread>>resolution.targetSpread>>resolution.acceptance>>resolution.detector)))
+				m_resolution = resolution;
+		} else if(keyword == "INTENSITY") {
+			LineIntensity intensity;
+			if((parsed = (bool)(row>>intensity.nuclide>>intensity.ex>>intensity.intensity))) m_intensities.push_back(intensity);
+		} else if(keyword == "MASSTABLE") {
+			MassTableSource source;
+			if((parsed = (bool)(row>>source.name>>source.filename)) && MASS.ReadFile(source.filename, source.name)) m_massTables.push_back(source);
+		} else if(keyword == "EVALUATION") {
+			parsed = (bool)(row>>evaluation);
+		} else if(keyword == "MASSOVERRIDE") {
+			MassOverride mass;
+			if((parsed = (bool)(row>>mass.layer>>mass.Z>>mass.A>>mass.excess>>mass.uncertainty))) {
+				MASS.SetOverride(mass.layer, mass.Z, mass.A, mass.excess, mass.uncertainty);
+				m_massOverrides.push_back(mass);
+			}
+		} else if(keyword == "LEVELOVERRIDE") {
+			std::pair<std::string, LevelOverride> level;
+			if((parsed = (bool)(row>>level.first>>level.second.nuclide>>level.second.label>>level.second.energy>>level.second.uncertainty))) {
+				EX.SetLevelOverride(level.first, level.second);
+				m_levelOverrides.push_back(level);
+			}
+		} else if(keyword == "PUBLISH") {
+			parsed = (bool)(row>>publishName);
+		} else if(keyword == "LAYEROFF") {
+			std::string layer;
+			if((parsed = (bool)(row>>layer))) disabledLayers.push_back(layer);
+		} else if(!m_detector.ReadConfigLine(keyword, row, parsed) && !m_sampler.ReadConfigLine(keyword, row, parsed)) {
+			std::cerr<<"Unrecognized keyword "<<keyword<<" at SPSPlot::ReadInputFile()! Skipping line."<<std::endl;
+			continue;
+		}
+		if(!parsed) std::cerr<<"Invalid "<<keyword<<" line \""<<line<<"\" at SPSPlot::ReadInputFile()! Skipping line."<<std::endl;
 	}
 
+	//Move the reaction table over to the chosen data; no kinematics have been done yet, so this is cheap
+	if(!evaluation.empty()) MASS.SelectEvaluation(evaluation);
+	for(auto& layer : disabledLayers) {
+		MASS.SetLayerEnabled(layer, false);
+		EX.SetLayerEnabled(layer, false);
+	}
+	if(!evaluation.empty() || !m_massOverrides.empty() || !m_levelOverrides.empty()) {
+		ParallelFor(m_Reactions.size(), [this](int i) {
+			m_Reactions[i].UpdateMasses();
+		});
+	}
+
+	//Kinematics are only done once the uncertainties are known
 	m_rhoMin = rhomin; m_rhoMax = rhomax;
+	m_viewMin = rhomin; m_viewMax = rhomax;
 	m_beamKE = bke; m_theta = theta; m_B = b;
+	m_weights.assign(m_Reactions.size(), 1.0);
+	m_generated.assign(m_Reactions.size(), false);
+	ExpandTarget();
+	m_sampler.AttachDecays(m_Reactions); //target model reactions can decay too
+	if(!m_detector.IsEmpty()) {
+		std::vector<int> warned;
+		for(auto& rxn : m_Reactions) {
+			int Z = rxn.GetEjectile().Z;
+			if(m_detector.CanStop(Z) || std::find(warned.begin(), warned.end(), Z) != warned.end()) continue;
+			std::cerr<<"No STOPPING tables for ejectile Z="<<Z<<" in every detector layer at SPSPlot::ReadInputFile()! No deposits for it."<<std::endl;
+			warned.push_back(Z);
+		}
+	}
+	m_lociDirty = true;
+	m_lines.Build(m_Reactions);
+	m_lines.SetUncertainties(m_beamKESigma, m_thetaSigma, m_BSigma);
+	m_lines.SetWindow(m_rhoMin, m_rhoMax, m_fieldMargin);
+	m_lines.Calculate(m_Reactions, m_beamKE, m_theta, m_B);
+	for(auto& setting : m_Settings) //new layout
+		setting.current.clear();
+	UpdateSettings();
+	if(HasSpectrum()) FindPeaks(); //calibration or peak parameters may have changed
+	if(publishName.empty()) StopPublishing();
+	else if(publishName != m_publisher.GetName()) StartPublishing(publishName);
 	input.close();
 	return true;
 }
 
 
+/*Reactions are independent, so a target model with many isotopes costs about the same wall time as a single reaction*/
 void SPSPlot::UpdateReactions() {
-	for(auto& rxn: m_Reactions) {
-		rxn.SetKinematicParams(m_beamKE, m_theta, m_B);
+	m_lines.Calculate(m_Reactions, m_beamKE, m_theta, m_B);
+	Publish();
+}
+
+/*
+	Add the reactions of the target model, for the beam and ejectile of the first reaction in the table. A component which is
+	already in the table just gets its weight; reactions in the table which aren't part of the target keep a weight of 1
+*/
+void SPSPlot::ExpandTarget() {
+	if(m_target.IsEmpty()) return;
+	if(m_Reactions.empty()) {
+		std::cerr<<"Target model needs at least one reaction in the table to set the beam and ejectile at SPSPlot::ExpandTarget()!"<<std::endl;
+		return;
+	}
+
+	const nucleus& projectile = m_Reactions[0].GetProjectile();
+	const nucleus& ejectile = m_Reactions[0].GetEjectile();
+	std::vector<Reaction> expanded = m_target.Expand(projectile.A, projectile.Z, ejectile.A, ejectile.Z);
+	std::vector<double> weights = m_target.GetWeights();
+	for(unsigned int i=0; i<expanded.size(); i++) {
+		if(!expanded[i].IsInitialized()) continue;
+		int match = -1;
+		for(unsigned int j=0; j<m_Reactions.size() && match == -1; j++) {
+			if(m_Reactions[j].GetName() == expanded[i].GetName()) match = j;
+		}
+		if(match != -1) {
+			m_weights[match] = weights[i];
+			continue;
+		}
+		m_Reactions.push_back(expanded[i]);
+		m_weights.push_back(weights[i]);
+		m_generated.push_back(true);
+	}
+}
+
+/*
+	Brings the comparison settings up to date with the reaction list. Ejectile momenta only depend on the beam KE and
+	angle, so they are only calculated for (setting, reaction) pairs which do not have them yet, and only once per
+	distinct (beamKE, theta); any other setting sharing those parameters copies the result. Rho then follows from
+	the exact 1/B scaling. Independent pairs are calculated concurrently, each writing its own reaction's part of the
+	setting's columns.
+*/
+void SPSPlot::UpdateSettings() {
+	int nRxns = m_lines.GetNReactions();
+	int nLines = m_lines.GetNLines();
+	int nSettings = m_Settings.size();
+	if(nSettings == 0) return;
+
+	//Find pairs which need momenta, and pick a single pair to do the kinematics for each (beamKE, theta, reaction)
+	std::vector<std::pair<int,int>> pending; //(setting, rxn)
+	std::vector<int> leader; //index into pending which actually calculates
+	std::map<std::tuple<int, double, double>, int> leaderOf; //(rxn, beamKE, theta) -> first pending pair with them
+	for(auto& setting : m_Settings) {
+		if((int)setting.momenta.size() != nLines || (int)setting.current.size() != nRxns) {
+			setting.momenta.assign(nLines, std::numeric_limits<double>::quiet_NaN());
+			setting.current.assign(nRxns, 0);
+		}
+		setting.rhos.resize(nLines);
+	}
+	auto copyMomenta = [this](const SPSSetting& from, SPSSetting& to, int r) {
+		std::copy(from.momenta.begin()+m_lines.GetBegin(r), from.momenta.begin()+m_lines.GetEnd(r), to.momenta.begin()+m_lines.GetBegin(r));
+	};
+	for(int i=0; i<nSettings; i++) {
+		for(int r=0; r<nRxns; r++) {
+			if(m_Settings[i].current[r]) continue;
+			int match = -1;
+			auto found = leaderOf.find(std::make_tuple(r, m_Settings[i].beamKE, m_Settings[i].theta));
+			if(found != leaderOf.end()) match = found->second;
+			//Settings which were already up to date can also supply momenta
+			for(int j=0; j<nSettings && match == -1; j++) {
+				const SPSSetting& other = m_Settings[j];
+				if(j != i && other.current[r] && other.beamKE == m_Settings[i].beamKE && other.theta == m_Settings[i].theta) {
+					copyMomenta(other, m_Settings[i], r);
+					m_Settings[i].current[r] = 1;
+					break;
+				}
+			}
+			if(m_Settings[i].current[r]) continue;
+			pending.emplace_back(i, r);
+			leader.push_back(match == -1 ? (int)pending.size()-1 : match);
+			if(match == -1) leaderOf[std::make_tuple(r, m_Settings[i].beamKE, m_Settings[i].theta)] = pending.size()-1;
+		}
+	}
+
+	std::vector<int> leaders;
+	for(unsigned int j=0; j<pending.size(); j++)
+		if(leader[j] == (int)j) leaders.push_back(j);
+
+	ParallelFor(leaders.size(), [this, &pending, &leaders](int item) {
+		SPSSetting& setting = m_Settings[pending[leaders[item]].first];
+		int r = pending[leaders[item]].second;
+		m_lines.CalculateMomenta(m_Reactions[r], r, setting.beamKE, setting.theta, setting.momenta.data());
+	});
+	for(unsigned int j=0; j<pending.size(); j++) {
+		int r = pending[j].second;
+		if(leader[j] != (int)j) copyMomenta(m_Settings[pending[leader[j]].first], m_Settings[pending[j].first], r);
+		m_Settings[pending[j].first].current[r] = 1;
+	}
+
+	//Rho from momentum is cheap, so just redo all of them
+	ParallelFor(nSettings*nRxns, [this, nRxns](int item) {
+		SPSSetting& setting = m_Settings[item/nRxns];
+		int r = item%nRxns;
+		const Reaction& rxn = m_Reactions[r];
+		for(int j=m_lines.GetBegin(r); j<m_lines.GetEnd(r); j++)
+			setting.rhos[j] = rxn.MomentumToRho(setting.momenta[j], setting.B);
+	});
+}
+
+/*
+	Carry the comparison settings over to a new line layout after a LineStore::Refresh; the stale reactions (and any new ones)
+	are recalculated by the next UpdateSettings
+*/
+void SPSPlot::RelayoutSettings(const std::vector<char>& stale) {
+	int nRxns = m_lines.GetNReactions();
+	for(auto& setting : m_Settings) {
+		if(!m_lines.Relayout(setting.momenta)) {
+			setting.current.clear();
+			continue;
+		}
+		setting.current.resize(nRxns, 0);
+		for(int r=0; r<nRxns && r<(int)stale.size(); r++) {
+			if(stale[r]) setting.current[r] = 0;
+		}
+	}
+}
+
+/*Pick up changes to the level data; every reaction re-reads its levels and all kinematics are redone*/
+void SPSPlot::RefreshLevels() {
+	m_lines.Build(m_Reactions);
+	m_lines.Calculate(m_Reactions, m_beamKE, m_theta, m_B);
+	for(auto& setting : m_Settings)
+		setting.current.clear();
+	UpdateSettings();
+	Publish();
+}
+
+/*
+	Apply a batch of nuclear data changes to the global tables, then redo only the reactions which involve a changed nuclide: a
+	level change affects reactions with that residual, a mass change any reaction with that nucleus in it. Masses come from
+	data/mass.txt, so they go to the "default" evaluation, and only change reactions while it is the active one. Comparison
+	settings only recalculate the affected reactions. Returns the number of reactions recalculated
+*/
+int SPSPlot::ApplyDataUpdate(const DataUpdate& update) {
+	std::unordered_set<std::string> levelNuclides, massNuclides;
+	for(auto& change : update.levels) {
+		if(change.removed) EX.RemoveNuclide(change.nuclide);
+		else EX.SetLevels(change.nuclide, change.data);
+		levelNuclides.insert(change.nuclide);
+	}
+	bool defaultActive = MASS.GetEvaluation() == "default";
+	for(auto& entry : update.masses) {
+		MASS.SetMass("default", entry);
+		if(defaultActive) massNuclides.insert(std::to_string(entry.A) + entry.element);
+	}
+	if(!IsValid()) return 0;
+
+	std::vector<int> affected;
+	std::vector<bool> massChanged;
+	std::vector<char> stale(m_Reactions.size(), 0);
+	for(unsigned int i=0; i<m_Reactions.size(); i++) {
+		const Reaction& rxn = m_Reactions[i];
+		bool mass = massNuclides.count(rxn.GetTarget().sym) || massNuclides.count(rxn.GetProjectile().sym) ||
+					massNuclides.count(rxn.GetEjectile().sym) || massNuclides.count(rxn.GetResidual().sym);
+		if(mass || levelNuclides.count(rxn.GetResidual().sym)) {
+			affected.push_back(i);
+			massChanged.push_back(mass);
+			stale[i] = 1;
+		}
+	}
+
+	ParallelFor(affected.size(), [this, &affected, &massChanged](int item) {
+		Reaction& rxn = m_Reactions[affected[item]];
+		if(massChanged[item]) { //masses are only read when the reaction is set up
+			rxn.SetReactionData(rxn.GetTarget().A, rxn.GetTarget().Z, rxn.GetProjectile().A, rxn.GetProjectile().Z,
+								rxn.GetEjectile().A, rxn.GetEjectile().Z);
+		}
+	});
+	if(!affected.empty()) {
+		m_lines.Refresh(m_Reactions, stale);
+		RelayoutSettings(stale);
+	}
+	m_lociDirty = m_lociDirty || !massNuclides.empty();
+	UpdateSettings();
+	Publish();
+	return affected.size();
+}
+
+/*
+	Bring every reaction up to date after the masses or levels it is read from were switched (evaluation or data layers). A
+	reaction is only recalculated if one of its masses actually changed, or its residual is one of the given nuclides. Returns
+	the number of reactions recalculated
+*/
+int SPSPlot::RefreshNuclearData(const std::vector<std::string>& levelNuclides) {
+	if(!IsValid()) return 0;
+	std::vector<char> changed(m_Reactions.size(), 0);
+	ParallelFor(m_Reactions.size(), [this, &levelNuclides, &changed](int i) {
+		Reaction& rxn = m_Reactions[i];
+		bool levels = std::find(levelNuclides.begin(), levelNuclides.end(), rxn.GetResidual().sym) != levelNuclides.end();
+		bool masses = rxn.UpdateMasses();
+		changed[i] = levels || masses;
+	});
+
+	int nChanged = std::count(changed.begin(), changed.end(), 1);
+	if(nChanged > 0) {
+		m_lines.Refresh(m_Reactions, changed);
+		RelayoutSettings(changed);
+	}
+	m_lociDirty = true; //decay product masses aren't part of any reaction
+	UpdateSettings();
+	Publish();
+	return nChanged;
+}
+
+/*Switch the mass evaluation under everything; returns the number of reactions recalculated*/
+int SPSPlot::SelectMassEvaluation(const std::string& name) {
+	if(!MASS.SelectEvaluation(name)) return 0;
+	return RefreshNuclearData(std::vector<std::string>());
+}
+
+/*Switch a data layer (masses and/or levels) on or off; returns the number of reactions recalculated*/
+int SPSPlot::SetDataLayer(const std::string& layer, bool enabled) {
+	bool masses = MASS.SetLayerEnabled(layer, enabled);
+	bool levels = EX.SetLayerEnabled(layer, enabled);
+	if(!masses && !levels) {
+		std::cerr<<"No data layer named "<<layer<<" at SPSPlot::SetDataLayer()!"<<std::endl;
+		return 0;
+	}
+	return RefreshNuclearData(levels ? EX.GetLayerNuclides(layer) : std::vector<std::string>());
+}
+
+std::vector<std::string> SPSPlot::GetMassEvaluations() {
+	std::vector<std::string> names(1, "default");
+	for(auto& source : m_massTables) {
+		if(std::find(names.begin(), names.end(), source.name) == names.end()) names.push_back(source.name);
+	}
+	return names;
+}
+
+/*Every layer of either table, in the order they were made*/
+std::vector<std::string> SPSPlot::GetDataLayers() {
+	std::vector<std::string> names = MASS.GetLayers();
+	for(auto& layer : EX.GetLayers()) {
+		if(std::find(names.begin(), names.end(), layer) == names.end()) names.push_back(layer);
+	}
+	return names;
+}
+
+/*
+	Where each visible line of the primary setting would be under other nuclear data: the given evaluation with only the given
+	layers on. States are matched by label, so level overrides show up as well. The tables are switched over for the comparison
+	and then put back; the reactions themselves are left alone
+*/
+std::vector<LineShift> SPSPlot::CompareData(const std::string& evaluation, const std::vector<std::string>& layers) {
+	std::vector<LineShift> shifts;
+	if(!IsValid()) { return shifts; }
+	if(!MASS.HasEvaluation(evaluation)) {
+		std::cerr<<"Mass evaluation "<<evaluation<<" is not loaded at SPSPlot::CompareData()!"<<std::endl;
+		return shifts;
+	}
+
+	std::vector<SPSLine> lines = GetLines();
+	std::string current = MASS.GetEvaluation();
+	std::vector<std::string> allLayers = GetDataLayers();
+	std::vector<bool> massesOn, levelsOn;
+	for(auto& layer : allLayers) {
+		massesOn.push_back(MASS.IsLayerEnabled(layer));
+		levelsOn.push_back(EX.IsLayerEnabled(layer));
+		bool on = std::find(layers.begin(), layers.end(), layer) != layers.end();
+		MASS.SetLayerEnabled(layer, on);
+		EX.SetLayerEnabled(layer, on);
+	}
+	MASS.SelectEvaluation(evaluation);
+
+	std::vector<Reaction> others(m_Reactions.size());
+	std::vector<char> used(m_Reactions.size(), 0);
+	for(auto& line : lines)
+		used[line.rxnIndex] = 1;
+	ParallelFor(m_Reactions.size(), [this, &others, &used](int i) {
+		if(!used[i]) return;
+		others[i] = m_Reactions[i];
+		others[i].UpdateMasses();
+	});
+	LineStore otherLines;
+	otherLines.Build(others, &used);
+
+	MASS.SelectEvaluation(current);
+	for(unsigned int i=0; i<allLayers.size(); i++) {
+		MASS.SetLayerEnabled(allLayers[i], massesOn[i]);
+		EX.SetLayerEnabled(allLayers[i], levelsOn[i]);
+	}
+
+	const double deg2rad = M_PI/180.0;
+	const double nan = std::numeric_limits<double>::quiet_NaN();
+	for(auto& line : lines) {
+		Reaction& other = others[line.rxnIndex];
+		LineShift shift;
+		shift.rxnIndex = line.rxnIndex;
+		shift.label = m_lines.GetLabel(m_lines.GetBegin(line.rxnIndex) + line.level);
+		shift.ex = line.ex;
+		shift.rho = line.rho;
+		shift.otherEx = nan;
+		shift.otherRho = nan;
+		int match = otherLines.FindLabel(line.rxnIndex, shift.label);
+		if(match != -1) {
+			shift.otherEx = otherLines.GetEx()[match];
+			shift.otherRho = other.MomentumToRho(other.CalculateEjectileP(shift.otherEx, m_beamKE, m_theta*deg2rad), m_B);
+		}
+		shifts.push_back(shift);
+	}
+	return shifts;
+}
+
+/*Add a named comparison setting; shares all reaction data with the primary setting*/
+void SPSPlot::AddSetting(const std::string& name, double bke, double theta, double b) {
+	if(!IsValid()) { return; }
+	SPSSetting setting;
+	setting.name = name;
+	setting.beamKE = bke;
+	setting.theta = theta;
+	setting.B = b;
+	m_Settings.push_back(setting);
+	UpdateSettings();
+}
+
+void SPSPlot::ClearSettings() {
+	for(auto& setting : m_Settings) {
+		for(auto graph : setting.graphs)
+			delete graph;
 	}
+	m_Settings.clear();
 }
 
 //Main way to update data
@@ -107,6 +606,52 @@ void SPSPlot::SetRhoRange(double rhoMin, double rhoMax) {
 	if(!IsValid()) { return; }
 	m_rhoMin = rhoMin;
 	m_rhoMax = rhoMax;
+	m_viewMin = rhoMin;
+	m_viewMax = rhoMax;
+	if(m_lines.SetWindow(m_rhoMin, m_rhoMax, m_fieldMargin)) //only evaluates anything if the window changed
+		m_lines.Calculate(m_Reactions, m_beamKE, m_theta, m_B);
+	Publish();
+}
+
+/*
+	While following a live field readout, every reaction evaluates a slightly wider slice of its levels, so that small drifts
+	of the field can be followed by rescaling alone (see LineStore::Rescale)
+*/
+void SPSPlot::SetFieldTracking(bool tracking) {
+	m_fieldMargin = tracking ? FIELD_MARGIN : 0.0;
+	if(!IsValid()) { return; }
+	if(m_lines.SetWindow(m_rhoMin, m_rhoMax, m_fieldMargin))
+		m_lines.Calculate(m_Reactions, m_beamKE, m_theta, m_B);
+}
+
+/*
+	New field for the primary setting from a live readout. Only the field changed, so the lines are rescaled by the old over
+	the new field rather than recalculated; O(lines), and cheap enough to run on every reading. Comparison settings are left
+	alone. Returns the number of reactions which had drifted far enough to need recalculating
+*/
+int SPSPlot::TrackField(double b) {
+	if(!IsValid() || !(b > 0.0)) { return 0; }
+	m_B = b;
+	int nRecalculated = m_lines.Rescale(m_Reactions, b);
+	Publish();
+	return nRecalculated;
+}
+
+/*Visible part of the rho range (i.e. after zooming), which sets the level of detail of the labels*/
+void SPSPlot::SetViewRange(double rhoMin, double rhoMax) {
+	if(!IsValid()) { return; }
+	m_viewMin = std::max(rhoMin, m_rhoMin);
+	m_viewMax = std::min(rhoMax, m_rhoMax);
+}
+
+/*Search for the field/angle settings which best place the requested states on the detector at the current beam KE*/
+std::vector<FieldSolution> SPSPlot::OptimizeSettings(const OptimizerRequest& request, int nResults) {
+	if(!IsValid()) { return std::vector<FieldSolution>(); }
+	FieldOptimizer optimizer;
+	optimizer.SetDetectorRange(m_rhoMin, m_rhoMax);
+	optimizer.SetAngleRange(request.thetaMin, request.thetaMax, request.thetaStep);
+	optimizer.SetMinimumSeparation(request.minSeparation);
+	return optimizer.Optimize(m_Reactions, m_lines, m_beamKE, request.wanted, request.unwanted, nResults);
 }
 
 /*Workhorse function; generates an array of graphs (one for each reaction)
@@ -118,63 +663,316 @@ void SPSPlot::SetRhoRange(double rhoMin, double rhoMax) {
 TGraph** SPSPlot::GetGraphs() {
 	if(!IsValid()) { return nullptr; }
 
-	if(ngraphs == 0) ngraphs = m_Reactions.size(); //The first call makes the number of graphs the number of rxns
+	int nRxns = m_Reactions.size();
 
 	/*eliminate memory leaks*/
-	if(graph_array == nullptr) {
-		graph_array = new TGraph*[ngraphs];
-	} else {
+	if(graph_array != nullptr) {
 		for(int i=0; i<ngraphs; i++)
 			delete graph_array[i];
+		if(ngraphs != nRxns) { //reactions were added since the last call
+			delete[] graph_array;
+			graph_array = nullptr;
+		}
 	}
+	if(graph_array == nullptr) graph_array = new TGraph*[nRxns];
+	ngraphs = nRxns;
+
+	std::vector<double> labelY;
+	bool useLayout = LayoutLabels(m_lines.GetRho(), labelY);
+	for(int i=0; i<nRxns; i++)
+		graph_array[i] = MakeGraph(i, m_lines.GetSliceBegin(i), m_lines.GetSliceEnd(i), m_lines.GetRho(), m_lines.GetRhoSigma(),
+								   useLayout ? labelY.data() : nullptr);
+
+	//Decay loci as translucent bands just under their reaction's line, over the middle 90% of the decay products
+	UpdateLoci();
+	for(auto& locus : m_loci) {
+		if(locus.efficiency <= 0.0 || m_weights[locus.rxnIndex] < m_minWeight) continue;
+		double rhoLow = std::max(m_rhoMin, DecaySampler::MomentumToRho(locus.pLow, locus.channel.Z, m_B));
+		double rhoHigh = std::min(m_rhoMax, DecaySampler::MomentumToRho(locus.pHigh, locus.channel.Z, m_B));
+		if(rhoLow >= rhoHigh) continue;
+		TBox* band = new TBox(rhoLow, locus.rxnIndex - 0.35, rhoHigh, locus.rxnIndex - 0.05);
+		band->SetFillColorAlpha(locus.rxnIndex+1, 0.35);
+		graph_array[locus.rxnIndex]->GetListOfFunctions()->Add(band); //graph owns the band
+		std::string symbol = std::to_string(locus.channel.A) + MASS.FindElement(locus.channel.Z);
+		double rhoPeak = DecaySampler::MomentumToRho(locus.pPeak, locus.channel.Z, m_B);
+		if(rhoPeak < m_rhoMin || rhoPeak > m_rhoMax) rhoPeak = rhoLow;
+		TLatex* label = new TLatex(rhoPeak, locus.rxnIndex - 0.3, Form("%g*#rightarrow%s", locus.channel.ex, symbol.c_str()));
+		label->SetTextSize(LABEL_SIZE);
+		graph_array[locus.rxnIndex]->GetListOfFunctions()->Add(label);
+	}
+
+	return graph_array;
 
-	//local memory for tgraphs
-	std::vector<std::vector<double>> rxn_labels;
-	std::vector<std::vector<double>> valid_rhos;
-	std::vector<std::vector<std::string>> ex_labels;
-	int localSize=0; //indexing variable
-	rxn_labels.reserve(ngraphs);
-	valid_rhos.reserve(ngraphs);
-	ex_labels.reserve(ngraphs);
+}
+
+/*Same as above, but for one of the comparison settings. Graphs are owned by the setting, one per reaction*/
+TGraph** SPSPlot::GetGraphs(int index) {
+	if(!IsValid() || index < 0 || index >= (int)m_Settings.size()) { return nullptr; }
+
+	SPSSetting& setting = m_Settings[index];
+	for(auto graph : setting.graphs)
+		delete graph;
+	setting.graphs.clear();
 
+	std::vector<double> labelY;
+	bool useLayout = LayoutLabels(setting.rhos.data(), labelY);
 	int nRxns = m_Reactions.size();
-	for(int i=0; i<nRxns; i++) {
-		//set graph data
-		localSize = m_Reactions[i].GetRhos()->size();
-		rxn_labels.emplace_back(std::vector<double>());
-		valid_rhos.emplace_back(std::vector<double>());
-		ex_labels.emplace_back(std::vector<std::string>());
-		for(int j=0; j<localSize; j++) {
-			rxn_labels[i].push_back((double)i);
-			double& this_rho = m_Reactions[i].GetRhos()->at(j);
-			std::string& this_label = m_Reactions[i].GetEx_Strings()->at(j);
-			if(this_rho >= m_rhoMin && this_rho <= m_rhoMax) {
-				valid_rhos[i].push_back(this_rho);
-				ex_labels[i].push_back(this_label);
+	for(int i=0; i<nRxns; i++)
+		setting.graphs.push_back(MakeGraph(i, m_lines.GetBegin(i), m_lines.GetEnd(i), setting.rhos.data(), nullptr, useLayout ? labelY.data() : nullptr));
+
+	return setting.graphs.data();
+}
+
+/*
+	Size the label layout to the plot frame of the current pad, over the visible rho range. Without a pad (or before the pad
+	has a size) there is nothing to lay out against, and every label is made
+*/
+bool SPSPlot::SetupLabelLayout(LabelLayout& layout) {
+	if(gPad == nullptr) return false;
+	double padW = gPad->GetWw()*gPad->GetAbsWNDC();
+	double padH = gPad->GetWh()*gPad->GetAbsHNDC();
+	double frameW = padW*(1.0 - gPad->GetLeftMargin() - gPad->GetRightMargin());
+	double frameH = padH*(1.0 - gPad->GetTopMargin() - gPad->GetBottomMargin());
+	if(frameW <= 0 || frameH <= 0) return false;
+	layout.SetFrame(m_viewMin, m_viewMax, -1.0, m_Reactions.size(), frameW, frameH, LABEL_SIZE*std::min(padW, padH));
+	return true;
+}
+
+/*
+	Place the labels of every visible line of a column of rhos (parallel to the line store), over all reactions at once and
+	lowest excitation first, so that the low lying states keep their labels when the frame is crowded. labelY is the label
+	height per line, NaN where it was dropped. False without a layout (see SetupLabelLayout), in which case every label is made
+*/
+bool SPSPlot::LayoutLabels(const double* rhos, std::vector<double>& labelY) {
+	LabelLayout layout;
+	if(!SetupLabelLayout(layout)) return false;
+
+	const double* ex = m_lines.GetEx();
+	std::vector<int> visible;
+	for(int i=0; i<(int)m_Reactions.size(); i++) {
+		if(m_weights[i] < m_minWeight) continue;
+		for(int j=m_lines.GetBegin(i); j<m_lines.GetEnd(i); j++) {
+			if(rhos[j] >= m_rhoMin && rhos[j] <= m_rhoMax) visible.push_back(j);
+		}
+	}
+	std::stable_sort(visible.begin(), visible.end(), [ex](int a, int b) { return ex[a] < ex[b]; });
+
+	const int* rxn = m_lines.GetReaction();
+	labelY.assign(m_lines.GetNLines(), std::numeric_limits<double>::quiet_NaN());
+	for(auto j : visible) {
+		double y = rxn[j] + 0.1;
+		if(layout.Place(rhos[j], y, rxn[j] + 1.0, m_lines.GetLabel(j).size(), y)) labelY[j] = y;
+	}
+	return true;
+}
+
+/*Create and format the graph for a single reaction from the lines [first, last) of a column of rhos (parallel to the line store),
+  with tlatex labels on the points inside of the rho range. If sigmas are given, the graph is a TGraphErrors with
+  the rho uncertainty as a horizontal error bar. With label heights from LayoutLabels, only the labels it placed are made.
+*/
+TGraph* SPSPlot::MakeGraph(int rxnIndex, int first, int last, const double* rhos, const double* sigmas, const double* labelY) {
+	Reaction& rxn = m_Reactions[rxnIndex];
+	std::vector<double> valid_rhos, valid_sigmas, rxn_labels;
+	std::vector<int> valid_lines;
+	std::vector<std::string> ex_labels;
+	if(m_weights[rxnIndex] < m_minWeight) last = first; //filtered reactions get an empty graph
+	for(int j=first; j<last; j++) {
+		double this_rho = rhos[j];
+		if(this_rho >= m_rhoMin && this_rho <= m_rhoMax) {
+			valid_rhos.push_back(this_rho);
+			rxn_labels.push_back((double)rxnIndex);
+			valid_lines.push_back(j);
+			ex_labels.push_back(m_lines.GetLabel(j));
+			if(sigmas != nullptr) valid_sigmas.push_back(sigmas[j]);
+		}
+	}
+
+	TGraph* graph;
+	if(sigmas != nullptr) graph = new TGraphErrors(valid_rhos.size(), valid_rhos.data(), rxn_labels.data(), valid_sigmas.data(), nullptr);
+	else graph = new TGraph(valid_rhos.size(), valid_rhos.data(), rxn_labels.data());
+	graph->SetName(rxn.GetName().c_str());
+	if(m_weights[rxnIndex] != 1.0) graph->SetTitle(Form("%s (w = %.3g)", rxn.GetName().c_str(), m_weights[rxnIndex]));
+	else graph->SetTitle(rxn.GetName().c_str());
+	graph->SetMarkerColor(rxnIndex+1);
+	graph->SetMarkerSize(1);
+	for(unsigned int j=0; j<valid_rhos.size(); j++) {
+		double y = labelY != nullptr ? labelY[valid_lines[j]] : graph->GetY()[j]+0.1;
+		if(std::isnan(y)) continue; //dropped by the layout
+		TLatex *label = new TLatex(graph->GetX()[j], y, ex_labels[j].c_str());
+		label->SetTextSize(LABEL_SIZE);
+		graph->GetListOfFunctions()->Add(label); //graphs then own the labels (i.e. deleted when graph is deleted)
+	}
+	graph->GetXaxis()->SetLimits(m_rhoMin, m_rhoMax);
+	graph->SetMinimum(-1); //obnoxius root difference between setting x and y axis ranges
+	graph->SetMaximum(m_Reactions.size());
+	graph->GetXaxis()->SetTitle("#rho (cm)"); //latex style labels
+	graph->GetYaxis()->SetTitle("Reaction Index");
+	return graph;
+}
+
+/*Adaptively sampled rho(theta) curves for the visible states of a single reaction*/
+struct SampledCurves {
+	std::vector<double> angles; //deg, sorted
+	std::vector<int> states; //index into the reaction's excitations
+	std::vector<std::vector<double>> rhos; //per state, parallel to angles
+};
+
+/*
+	Samples rho(theta) for every state of a reaction whose curve crosses the rho window. Starts from a coarse angular grid
+	and repeatedly bisects only the intervals where linear interpolation misses the midpoint by more than a small fraction
+	of the window, for any of the states. All evaluations go through the batched momentum grid, so each pass is a single
+	call over (states x new angles).
+*/
+static void SampleCurves(const Reaction& rxn, const std::vector<double>& exs, double beamKE, double B, double rhoMin, double rhoMax,
+						 const CurveOptions& options, SampledCurves& curves) {
+	const int nCoarse = 17;
+	const int maxPasses = 8;
+	double tolerance = 1.0e-3*(rhoMax - rhoMin);
+
+	curves.angles.resize(nCoarse);
+	for(int j=0; j<nCoarse; j++)
+		curves.angles[j] = options.thetaMin + j*(options.thetaMax - options.thetaMin)/(nCoarse - 1);
+
+	std::vector<double> grid;
+	rxn.CalculateMomentumGrid(beamKE, exs, curves.angles, grid);
+
+	std::vector<double> stateExs;
+	for(unsigned int i=0; i<exs.size(); i++) {
+		std::vector<double> rhos(nCoarse);
+		double lo = std::numeric_limits<double>::max(), hi = -lo;
+		for(int j=0; j<nCoarse; j++) {
+			rhos[j] = rxn.MomentumToRho(grid[i*nCoarse+j], B);
+			if(std::isnan(rhos[j])) continue;
+			lo = std::min(lo, rhos[j]);
+			hi = std::max(hi, rhos[j]);
+		}
+		if(hi >= rhoMin && lo <= rhoMax) {
+			curves.states.push_back(i);
+			curves.rhos.push_back(rhos);
+			stateExs.push_back(exs[i]);
+		}
+	}
+	if(curves.states.empty()) return;
+
+	unsigned int nStates = curves.states.size();
+	std::vector<bool> refine(nCoarse-1, true);
+	for(int pass=0; pass<maxPasses; pass++) {
+		std::vector<double> mids;
+		for(unsigned int k=0; k<refine.size(); k++) {
+			if(refine[k]) mids.push_back(0.5*(curves.angles[k] + curves.angles[k+1]));
+		}
+		if(mids.empty()) break;
+		rxn.CalculateMomentumGrid(beamKE, stateExs, mids, grid);
+
+		//Interleave the midpoints, flagging the intervals which still need work
+		std::vector<double> angles;
+		std::vector<std::vector<double>> rhos(nStates);
+		std::vector<bool> nextRefine;
+		unsigned int m = 0;
+		for(unsigned int k=0; k<refine.size(); k++) {
+			angles.push_back(curves.angles[k]);
+			for(unsigned int i=0; i<nStates; i++)
+				rhos[i].push_back(curves.rhos[i][k]);
+			if(!refine[k]) {
+				nextRefine.push_back(false);
+				continue;
+			}
+
+			angles.push_back(mids[m]);
+			double error = 0.0;
+			for(unsigned int i=0; i<nStates; i++) {
+				double rho_mid = rxn.MomentumToRho(grid[i*mids.size()+m], B);
+				rhos[i].push_back(rho_mid);
+				double deviation = std::fabs(rho_mid - 0.5*(curves.rhos[i][k] + curves.rhos[i][k+1]));
+				if(deviation > error) error = deviation; //NaN (kinematically forbidden) never triggers refinement
 			}
+			bool more = error > tolerance;
+			nextRefine.push_back(more);
+			nextRefine.push_back(more);
+			m++;
 		}
+		angles.push_back(curves.angles.back());
+		for(unsigned int i=0; i<nStates; i++)
+			rhos[i].push_back(curves.rhos[i].back());
+
+		curves.angles.swap(angles);
+		curves.rhos.swap(rhos);
+		refine.swap(nextRefine);
+	}
+}
+
+/*
+	Kinematic curve mode; one curve of rho vs. theta for each state which crosses the rho window, over the requested angular
+	range. The SPS angular acceptance around the current angle is drawn as a band, so lines which broaden or cross can be picked
+	out. States are labeled where they cross the current angle. Sampling is done per reaction, concurrently; the ROOT objects
+	are made afterwards.
+*/
+TMultiGraph* SPSPlot::GetCurves(const CurveOptions& options) {
+	if(!IsValid()) { return nullptr; }
+	if(options.thetaMax <= options.thetaMin) {
+		std::cerr<<"Invalid angular range at SPSPlot::GetCurves()!"<<std::endl;
+		return nullptr;
+	}
 
-		//create and format the graphs with tlatex labels on each point
-		graph_array[i] = new TGraph(valid_rhos[i].size(), &(valid_rhos[i][0]), &(rxn_labels[i][0]));
-		graph_array[i]->SetName(m_Reactions[i].GetName().c_str());
-		graph_array[i]->SetTitle(m_Reactions[i].GetName().c_str());
-		graph_array[i]->SetMarkerColor(i+1);
-		graph_array[i]->SetMarkerSize(1);
-		for(unsigned int j=0; j<valid_rhos[i].size(); j++) {
-			TLatex *label = new TLatex(graph_array[i]->GetX()[j], graph_array[i]->GetY()[j]+0.1, ex_labels[i][j].c_str());
-			label->SetTextSize(0.02);
-			graph_array[i]->GetListOfFunctions()->Add(label); //graphs then own the labels (i.e. deleted when graph is deleted)
+	delete m_curves;
+	m_curves = new TMultiGraph();
+	m_curves->SetTitle(";#rho (cm);#theta_{lab} (deg)");
+
+	int nRxns = m_Reactions.size();
+	std::vector<SampledCurves> sampled(nRxns);
+	std::vector<std::vector<double>> crossings(nRxns); //rho of each sampled state at the current angle
+	std::vector<double> current_angle(1, m_theta);
+	ParallelFor(nRxns, [this, &sampled, &crossings, &current_angle, &options](int i) {
+		Reaction& rxn = m_Reactions[i];
+		std::vector<double> exs(m_lines.GetEx()+m_lines.GetBegin(i), m_lines.GetEx()+m_lines.GetEnd(i));
+		SampleCurves(rxn, exs, m_beamKE, m_B, m_rhoMin, m_rhoMax, options, sampled[i]);
+		std::vector<double> stateExs;
+		for(auto state : sampled[i].states)
+			stateExs.push_back(exs[state]);
+		rxn.CalculateMomentumGrid(m_beamKE, stateExs, current_angle, crossings[i]);
+		for(auto& p : crossings[i])
+			p = rxn.MomentumToRho(p, m_B);
+	});
+
+	TLegend* legend = new TLegend(0.75, 0.75, 0.95, 0.95);
+	for(int i=0; i<nRxns; i++) {
+		SampledCurves& curves = sampled[i];
+		bool inLegend = false;
+		for(unsigned int k=0; k<curves.states.size(); k++) {
+			TGraph* graph = new TGraph();
+			int n = 0;
+			for(unsigned int j=0; j<curves.angles.size(); j++) {
+				if(std::isnan(curves.rhos[k][j])) continue;
+				graph->SetPoint(n++, curves.rhos[k][j], curves.angles[j]);
+			}
+			if(n == 0) {
+				delete graph;
+				continue;
+			}
+			graph->SetName(m_Reactions[i].GetName().c_str());
+			graph->SetTitle(m_Reactions[i].GetName().c_str());
+			graph->SetLineColor(i+1);
+			double rho0 = crossings[i][k];
+			if(!std::isnan(rho0) && rho0 >= m_rhoMin && rho0 <= m_rhoMax) {
+				TLatex *label = new TLatex(rho0, m_theta, m_lines.GetLabel(m_lines.GetBegin(i) + curves.states[k]).c_str());
+				label->SetTextSize(0.02);
+				graph->GetListOfFunctions()->Add(label); //graph owns the label
+			}
+			if(!inLegend) {
+				legend->AddEntry(graph, m_Reactions[i].GetName().c_str(), "l");
+				inLegend = true;
+			}
+			m_curves->Add(graph); //multigraph owns the graphs
 		}
-		graph_array[i]->GetXaxis()->SetLimits(m_rhoMin, m_rhoMax);
-		graph_array[i]->SetMinimum(-1); //obnoxius root difference between setting x and y axis ranges
-		graph_array[i]->SetMaximum(ngraphs);
-		graph_array[i]->GetXaxis()->SetTitle("#rho (cm)"); //latex style labels
-		graph_array[i]->GetYaxis()->SetTitle("Reaction Index");
 	}
-	ngraphs = nRxns;
 
-	return graph_array;
+	TBox* band = new TBox(m_rhoMin, m_theta - options.acceptance, m_rhoMax, m_theta + options.acceptance);
+	band->SetFillStyle(3004);
+	band->SetFillColor(kGray+1);
+	m_curves->GetListOfFunctions()->Add(band); //multigraph owns the band and legend
+	m_curves->GetListOfFunctions()->Add(legend);
 
+	return m_curves;
 }
 
 /*
@@ -194,16 +992,731 @@ void SPSPlot::SaveToFile(std::string& name) {
 	output<<"RhoMin(cm): "<<m_rhoMin<<" RhoMax(cm): "<<m_rhoMax<<std::endl;
 	output<<std::endl;
 	output<<"AT\tZT\tAP\tZP\tAE\tZE"<<std::endl;
-	for(auto rxn: m_Reactions) {
+	for(unsigned int i=0; i<m_Reactions.size(); i++) {
+		if(m_generated[i]) continue; //comes back from the TARGET lines
+		const Reaction& rxn = m_Reactions[i];
 		output<<rxn.GetTarget().A<<"\t"<<rxn.GetTarget().Z;
 		output<<"\t"<<rxn.GetProjectile().A<<"\t"<<rxn.GetProjectile().Z;
 		output<<"\t"<<rxn.GetEjectile().A<<"\t"<<rxn.GetEjectile().Z;
 		output<<std::endl;
 	}
+	for(auto& setting: m_Settings) {
+		output<<"SETTING "<<setting.name<<"\t"<<setting.beamKE<<"\t"<<setting.B<<"\t"<<setting.theta<<std::endl;
+	}
+	if(m_beamKESigma != 0.0 || m_thetaSigma != 0.0 || m_BSigma != 0.0)
+		output<<"UNCERTAINTY "<<m_beamKESigma<<"\t"<<m_thetaSigma<<"\t"<<m_BSigma<<std::endl;
+	if(m_calOffset != 0.0 || m_calSlope != 1.0)
+		output<<"CALIBRATION "<<m_calOffset<<"\t"<<m_calSlope<<std::endl;
+	output<<"PEAKS "<<m_peakSigma<<"\t"<<m_peakThreshold<<"\t"<<m_assignTolerance<<std::endl;
+	for(int i=0; i<m_target.GetNComponents(); i++) {
+		const TargetComponent& component = m_target.GetComponent(i);
+		output<<"TARGET "<<component.A<<"\t"<<component.Z<<"\t"<<component.abundance<<"\t"<<component.arealDensity<<std::endl;
+	}
+	if(m_minWeight != 0.0)
+		output<<"WEIGHTCUT "<<m_minWeight<<std::endl;
+	output<<"RESOLUTION "<<m_resolution.beamSpread<<"\t"<<m_resolution.targetSpread<<"\t"<<m_resolution.acceptance<<"\t"<<m_resolution.detector<<std::endl;
+	for(auto& intensity : m_intensities)
+		output<<"INTENSITY "<<intensity.nuclide<<"\t"<<intensity.ex<<"\t"<<intensity.intensity<<std::endl;
+	for(auto& source : m_massTables)
+		output<<"MASSTABLE "<<source.name<<"\t"<<source.filename<<std::endl;
+	if(MASS.GetEvaluation() != "default")
+		output<<"EVALUATION "<<MASS.GetEvaluation()<<std::endl;
+	output.precision(12); //mass excesses are given to the eV
+	for(auto& mass : m_massOverrides)
+		output<<"MASSOVERRIDE "<<mass.layer<<"\t"<<mass.Z<<"\t"<<mass.A<<"\t"<<mass.excess<<"\t"<<mass.uncertainty<<std::endl;
+	for(auto& level : m_levelOverrides)
+		output<<"LEVELOVERRIDE "<<level.first<<"\t"<<level.second.nuclide<<"\t"<<level.second.label<<"\t"<<level.second.energy
+			  <<"\t"<<level.second.uncertainty<<std::endl;
+	for(auto& layer : GetDataLayers()) {
+		if(!MASS.IsLayerEnabled(layer) && !EX.IsLayerEnabled(layer)) output<<"LAYEROFF "<<layer<<std::endl;
+	}
+	if(IsPublishing()) output<<"PUBLISH "<<m_publisher.GetName()<<std::endl;
+	m_sampler.WriteConfig(output, m_Reactions);
+	m_detector.WriteConfig(output);
 	output.close();
 }
 
+/*Lines of the primary setting inside the rho range, in reaction order, for reactions passing the weight cut*/
+std::vector<SPSLine> SPSPlot::GetLines() {
+	std::vector<SPSLine> lines;
+	if(!IsValid()) { return lines; }
+	const double* exs = m_lines.GetEx();
+	const double* rhos = m_lines.GetRho();
+	const double* sigmas = m_lines.GetRhoSigma();
+	for(int i=0; i<m_lines.GetNReactions(); i++) {
+		if(m_weights[i] < m_minWeight) continue;
+		for(int j=m_lines.GetSliceBegin(i); j<m_lines.GetSliceEnd(i); j++) {
+			if(!(rhos[j] >= m_rhoMin && rhos[j] <= m_rhoMax)) continue; //also drops forbidden (NaN) lines
+			SPSLine line;
+			line.rxnIndex = i;
+			line.level = j - m_lines.GetBegin(i);
+			line.ex = exs[j];
+			line.rho = rhos[j];
+			line.sigma = sigmas[j];
+			line.weight = m_weights[i];
+			lines.push_back(line);
+		}
+	}
+	return lines;
+}
+
+/*Write the lines of the primary setting inside the rho range, with the propagated uncertainty on rho, as a text table*/
+void SPSPlot::ExportLines(std::string& name) {
+	if(!IsValid()) { return; }
+	std::ofstream output(name);
+	if(!output.is_open()) {
+		std::cerr<<"Unable to create line export file!"<<std::endl;
+		return;
+	}
+
+	//With a detector, the energy left in each of its layers follows
+	std::vector<SPSLine> lines = GetLines();
+	std::vector<double> deposits;
+	GetDeposits(lines, deposits);
+	int nLayers = m_detector.GetNLayers();
+	output<<"Reaction\tEx(MeV)\tRho(cm)\tSigmaRho(cm)\tWeight";
+	for(int k=0; k<nLayers; k++)
+		output<<"\t"<<m_detector.GetLayer(k).name<<"(MeV)";
+	output<<std::endl;
+	for(unsigned int i=0; i<lines.size(); i++) { //no flush per line; large reaction lists give many thousands
+		const SPSLine& line = lines[i];
+		output<<m_Reactions[line.rxnIndex].GetName()<<"\t"<<line.ex<<"\t"<<line.rho<<"\t"<<line.sigma<<"\t"<<line.weight;
+		for(int k=0; k<nLayers; k++)
+			output<<"\t"<<deposits[i*nLayers + k];
+		output<<"\n";
+	}
+	output.close();
+}
+
+/*
+	Publish the lines to a POSIX shared memory segment (e.g. /spsplot_lines), kept current on every recalculation, so that online
+	tools in other processes can read them without going through files. See SPSLineShm.h for the layout
+*/
+bool SPSPlot::StartPublishing(const std::string& name) {
+	if(!m_publisher.Open(name, GetLines().size())) return false;
+	Publish();
+	return true;
+}
+
+void SPSPlot::StopPublishing() {
+	m_publisher.Close();
+}
+
+/*Current lines to the shared memory segment, if there is one. Positions are only flagged as such when there is a calibration*/
+void SPSPlot::Publish() {
+	if(!IsPublishing() || !IsValid()) return;
+	sps_shm_header parameters;
+	memset(&parameters, 0, sizeof(parameters));
+	parameters.beamKE = m_beamKE;
+	parameters.theta = m_theta;
+	parameters.B = m_B;
+	parameters.calOffset = m_calOffset;
+	parameters.calSlope = m_calSlope;
+	if(m_calOffset != 0.0 || m_calSlope != 1.0) parameters.flags |= SPS_SHM_HAS_POSITION;
+
+	std::vector<SPSLine> lines = GetLines();
+	std::vector<sps_shm_line> records(lines.size());
+	for(unsigned int i=0; i<lines.size(); i++) {
+		sps_shm_line& record = records[i];
+		memset(&record, 0, sizeof(record));
+		strncpy(record.reaction, m_Reactions[lines[i].rxnIndex].GetName().c_str(), SPS_SHM_REACTION_LENGTH-1);
+		strncpy(record.label, m_lines.GetLabel(m_lines.GetBegin(lines[i].rxnIndex) + lines[i].level).c_str(), SPS_SHM_LABEL_LENGTH-1);
+		record.rxnIndex = lines[i].rxnIndex;
+		record.level = lines[i].level;
+		record.ex = lines[i].ex;
+		record.rho = lines[i].rho;
+		record.sigma = lines[i].sigma;
+		record.position = (lines[i].rho - m_calOffset)/m_calSlope;
+		record.weight = lines[i].weight;
+	}
+	m_publisher.Publish(parameters, records);
+}
+
+/*
+	Load a measured focal plane spectrum and find its peaks. ROOT files (.root) give their first 1D histogram; anything else is
+	read as a text file of two columns, bin center and counts. The spectrum axis is mapped to rho through the calibration
+*/
+bool SPSPlot::LoadSpectrum(const std::string& filename) {
+	ClearSpectrum();
+	bool success;
+	if(filename.size() > 5 && filename.compare(filename.size()-5, 5, ".root") == 0)
+		success = ReadSpectrumROOT(filename);
+	else
+		success = ReadSpectrumText(filename);
+	if(!success || m_specCounts.empty()) {
+		ClearSpectrum();
+		return false;
+	}
+	FindPeaks();
+	return true;
+}
+
+/*Peak search over the loaded spectrum; the expected width is given in rho, so it is taken to bins through the calibration*/
+void SPSPlot::FindPeaks() {
+	m_peaks.clear();
+	if(!HasSpectrum()) return;
+
+	int nbins = m_specCounts.size();
+	std::vector<double> centers(nbins);
+	for(int i=0; i<nbins; i++)
+		centers[i] = 0.5*(m_specEdges[i] + m_specEdges[i+1]);
+	double binWidth = std::fabs(m_calSlope)*(m_specEdges[nbins] - m_specEdges[0])/nbins; //cm
+	if(!(binWidth > 0.0)) return;
+
+	PeakFinder finder;
+	finder.SetSigma(m_peakSigma/binWidth);
+	finder.SetThreshold(m_peakThreshold);
+	m_peaks = finder.Search(centers, m_specCounts);
+}
+
+/*Peak search (expected sigma in cm, significance) and assignment tolerance (cm) parameters*/
+void SPSPlot::SetPeakParameters(double sigma, double threshold, double tolerance) {
+	m_peakSigma = sigma;
+	m_peakThreshold = threshold;
+	m_assignTolerance = tolerance;
+	FindPeaks();
+}
+
+bool SPSPlot::ReadSpectrumText(const std::string& filename) {
+	std::ifstream input(filename);
+	if(!input.is_open()) {
+		std::cerr<<"Unable to open spectrum file "<<filename<<" at SPSPlot::LoadSpectrum()!"<<std::endl;
+		return false;
+	}
+
+	std::vector<double> centers;
+	std::string line;
+	while(std::getline(input, line)) {
+		if(line.empty() || line[0] == '#') continue;
+		//strtod rather than a stringstream per line; spectra can have tens of thousands of bins
+		char* end;
+		double x = std::strtod(line.c_str(), &end);
+		char* start = end;
+		double y = std::strtod(start, &end);
+		if(end == start) {
+			std::cerr<<"Bad spectrum line "<<line<<" at SPSPlot::LoadSpectrum()! Skipping."<<std::endl;
+			continue;
+		}
+		if(!centers.empty() && x <= centers.back()) {
+			std::cerr<<"Spectrum bin centers must be increasing at SPSPlot::LoadSpectrum()!"<<std::endl;
+			return false;
+		}
+		centers.push_back(x);
+		m_specCounts.push_back(y);
+	}
+	if(centers.size() < 2) {
+		std::cerr<<"Spectrum file "<<filename<<" has too few bins!"<<std::endl;
+		return false;
+	}
+
+	//Edges halfway between centers; the outer edges mirror their neighbors
+	m_specEdges.resize(centers.size()+1);
+	for(unsigned int i=1; i<centers.size(); i++)
+		m_specEdges[i] = 0.5*(centers[i-1] + centers[i]);
+	m_specEdges.front() = centers.front() - (m_specEdges[1] - centers.front());
+	m_specEdges.back() = centers.back() + (centers.back() - m_specEdges[centers.size()-1]);
+	return true;
+}
+
+bool SPSPlot::ReadSpectrumROOT(const std::string& filename) {
+	TFile* file = TFile::Open(filename.c_str(), "READ");
+	if(file == nullptr || file->IsZombie()) {
+		std::cerr<<"Unable to open spectrum file "<<filename<<" at SPSPlot::LoadSpectrum()!"<<std::endl;
+		delete file;
+		return false;
+	}
+
+	TH1* hist = nullptr;
+	TIter next(file->GetListOfKeys());
+	while(TKey* key = (TKey*) next()) {
+		hist = dynamic_cast<TH1*>(key->ReadObj());
+		if(hist != nullptr && hist->GetDimension() == 1) break;
+		hist = nullptr;
+	}
+	if(hist == nullptr) {
+		std::cerr<<"No 1D histogram in "<<filename<<" at SPSPlot::LoadSpectrum()!"<<std::endl;
+		file->Close();
+		delete file;
+		return false;
+	}
+
+	int nbins = hist->GetNbinsX();
+	m_specEdges.resize(nbins+1);
+	m_specCounts.resize(nbins);
+	for(int i=0; i<nbins; i++) {
+		m_specEdges[i] = hist->GetBinLowEdge(i+1);
+		m_specCounts[i] = hist->GetBinContent(i+1);
+	}
+	m_specEdges[nbins] = hist->GetBinLowEdge(nbins+1);
+	file->Close(); //histogram belongs to the file
+	delete file;
+	return true;
+}
+
+void SPSPlot::ClearSpectrum() {
+	m_specEdges.clear();
+	m_specCounts.clear();
+	m_peaks.clear();
+	delete m_spectrum;
+	m_spectrum = nullptr;
+}
+
+/*Map the spectrum axis to rho (cm): rho = offset + slope*x*/
+void SPSPlot::SetCalibration(double offset, double slope) {
+	if(slope == 0.0) {
+		std::cerr<<"Spectrum calibration slope cannot be zero at SPSPlot::SetCalibration()!"<<std::endl;
+		return;
+	}
+	m_calOffset = offset;
+	m_calSlope = slope;
+	FindPeaks(); //width in bins depends on the calibration
+	Publish();
+}
+
+/*The spectrum as a histogram in rho, with the found peaks marked. Remade each call, since the calibration may have changed*/
+TH1* SPSPlot::GetSpectrum() {
+	if(!HasSpectrum()) { return nullptr; }
+
+	delete m_spectrum;
+	int nbins = m_specCounts.size();
+	std::vector<double> edges(nbins+1);
+	for(int i=0; i<=nbins; i++)
+		edges[i] = m_calOffset + m_calSlope*m_specEdges[i];
+	if(m_calSlope < 0.0) std::reverse(edges.begin(), edges.end());
+	m_spectrum = new TH1D("spectrum", ";#rho (cm);Counts", nbins, edges.data());
+	m_spectrum->SetDirectory(nullptr);
+	m_spectrum->SetStats(false);
+	for(int i=0; i<nbins; i++)
+		m_spectrum->SetBinContent(m_calSlope < 0.0 ? nbins-i : i+1, m_specCounts[i]);
+
+	if(!m_peaks.empty()) {
+		std::vector<double> x, y;
+		for(auto& peak : m_peaks) {
+			x.push_back(m_calOffset + m_calSlope*peak.centroid);
+			y.push_back(peak.height);
+		}
+		TPolyMarker* markers = new TPolyMarker(x.size(), x.data(), y.data());
+		markers->SetMarkerStyle(23);
+		markers->SetMarkerColor(kRed);
+		m_spectrum->GetListOfFunctions()->Add(markers); //histogram owns the markers
+	}
+	return m_spectrum;
+}
+
+/*
+	Expected spectrum of the primary setting over the rho range: every line which lands within the range or close enough to it for its
+	tail to reach in, with an area of its reaction's target weight times its relative intensity, and a width from the resolution
+	model (beam energy spread and target thickness through d(rho)/dE, the uniform angular acceptance through d(rho)/d(theta), and the
+	detector resolution, in quadrature). With a measured spectrum loaded, it is scaled to the measured counts over the range, and to
+	the height of the measured bins, so the two overlay
+*/
+TH1* SPSPlot::GetSyntheticSpectrum() {
+	if(!IsValid()) { return nullptr; }
+
+	const double deg2rad = M_PI/180.0;
+	const double* exs = m_lines.GetEx();
+	std::vector<SynthLine> synthLines;
+	RhoDerivatives d;
+	/*
+		Line j of reaction i; -1 if it is past the low rho side of the range by more than its tails reach, +1 past the high side.
+		Lines outside of the window slice were never calculated, so every line is done here
+	*/
+	auto addLine = [&](int i, int j) {
+		const Reaction& rxn = m_Reactions[i];
+		double rho = rxn.CalculateRhoWithDerivatives(exs[j], m_beamKE, m_theta*deg2rad, m_B, d);
+		if(std::isnan(rho)) return -1; //forbidden, as are all higher states
+		double variance = std::pow(d.dBeamKE*m_resolution.beamSpread, 2.0) + std::pow(d.dBeamKE*m_resolution.targetSpread, 2.0)
+						  + std::pow(d.dTheta*m_resolution.acceptance*deg2rad, 2.0)/3.0 + std::pow(m_resolution.detector, 2.0);
+		double sigma = std::sqrt(variance);
+		double reach = SpectrumSynthesizer::TAIL_SIGMAS*sigma;
+		if(rho < m_rhoMin - reach) return -1;
+		if(rho > m_rhoMax + reach) return 1;
+		double intensity = 1.0;
+		for(auto& entry : m_intensities) {
+			if(entry.nuclide == rxn.GetResidual().sym && std::fabs(entry.ex - exs[j]) < 1.0e-4) {
+				intensity = entry.intensity;
+				break;
+			}
+		}
+		synthLines.push_back({rho, sigma, m_weights[i]*intensity});
+		return 0;
+	};
+	//rho falls with Ex inside of the slice's pruning, so the walk out of the slice stops at the first line out of reach
+	for(int i=0; i<m_lines.GetNReactions(); i++) {
+		if(m_weights[i] < m_minWeight) continue;
+		for(int j=m_lines.GetSliceBegin(i); j<m_lines.GetSliceEnd(i); j++)
+			addLine(i, j);
+		for(int j=m_lines.GetSliceEnd(i); j<m_lines.GetEnd(i); j++) {
+			if(addLine(i, j) == -1) break;
+		}
+		for(int j=m_lines.GetSliceBegin(i)-1; j>=m_lines.GetBegin(i); j--) {
+			if(addLine(i, j) == 1) break;
+		}
+	}
+
+	SpectrumSynthesizer synthesizer;
+	synthesizer.SetBinning(m_rhoMin, m_rhoMax, SYNTHETIC_BINS);
+	std::vector<double> counts = synthesizer.Generate(synthLines);
+
+	//Match the measured counts over the range, at the height of the measured bins
+	double scale = 1.0;
+	if(HasSpectrum()) {
+		double measuredCounts = 0.0;
+		int measuredBins = 0;
+		for(unsigned int i=0; i<m_specCounts.size(); i++) {
+			double rho = m_calOffset + m_calSlope*0.5*(m_specEdges[i] + m_specEdges[i+1]);
+			if(rho < m_rhoMin || rho > m_rhoMax) continue;
+			measuredCounts += m_specCounts[i];
+			measuredBins++;
+		}
+		double total = 0.0;
+		for(auto count : counts)
+			total += count;
+		if(total > 0.0 && measuredBins > 0) scale = measuredCounts/total*(double)SYNTHETIC_BINS/measuredBins;
+	}
+
+	delete m_synthetic;
+	m_synthetic = new TH1D("synthetic", ";#rho (cm);Counts", SYNTHETIC_BINS, m_rhoMin, m_rhoMax);
+	m_synthetic->SetDirectory(nullptr);
+	m_synthetic->SetStats(false);
+	m_synthetic->SetLineColor(kRed);
+	for(int i=0; i<SYNTHETIC_BINS; i++)
+		m_synthetic->SetBinContent(i+1, counts[i]*scale);
+	return m_synthetic;
+}
+
+/*
+	Assign the found peaks to the visible lines of the primary setting. Peaks and lines are both put in rho order and matched with
+	the optimal order-preserving assignment (see LineAssigner), using the propagated line uncertainties on top of the assignment
+	tolerance. Every peak is returned, assigned or not, in spectrum order
+*/
+std::vector<PeakMatch> SPSPlot::AssignPeaks() {
+	std::vector<PeakMatch> matches;
+	if(!IsValid() || m_peaks.empty()) { return matches; }
+
+	std::vector<SPSLine> lines = GetLines();
+	std::sort(lines.begin(), lines.end(), [](const SPSLine& a, const SPSLine& b) { return a.rho < b.rho; });
+	std::vector<double> lineRhos, lineSigmas;
+	for(auto& line : lines) {
+		lineRhos.push_back(line.rho);
+		lineSigmas.push_back(line.sigma);
+	}
+
+	std::vector<int> order(m_peaks.size());
+	for(unsigned int i=0; i<order.size(); i++)
+		order[i] = i;
+	if(m_calSlope < 0.0) std::reverse(order.begin(), order.end()); //peaks are in spectrum order, which is then decreasing rho
+	std::vector<double> peakRhos;
+	for(auto index : order)
+		peakRhos.push_back(m_calOffset + m_calSlope*m_peaks[index].centroid);
+
+	LineAssigner assigner;
+	assigner.SetTolerance(m_assignTolerance);
+	std::vector<int> assigned = assigner.Assign(peakRhos, lineRhos, &lineSigmas);
+
+	matches.resize(m_peaks.size());
+	for(unsigned int k=0; k<order.size(); k++) {
+		PeakMatch& match = matches[order[k]];
+		match.peak = order[k];
+		match.position = m_peaks[order[k]].centroid;
+		match.rho = peakRhos[k];
+		match.area = m_peaks[order[k]].area;
+		match.rxnIndex = -1;
+		match.level = -1;
+		match.ex = 0.0;
+		match.residual = 0.0;
+		if(assigned[k] == -1) continue;
+		const SPSLine& line = lines[assigned[k]];
+		match.rxnIndex = line.rxnIndex;
+		match.level = line.level;
+		match.ex = line.ex;
+		match.residual = match.rho - line.rho;
+	}
+	return matches;
+}
+
+/*
+	Fit the primary setting (beam KE, angle, field) and the spectrum calibration to the assigned peaks. Kinematic parameters
+	float within their uncertainties (UNCERTAINTY keyword) and are fixed if they have none. Each peak is weighted by its
+	statistical centroid uncertainty, sigma/sqrt(area). On success the fitted values become the current setting and calibration
+*/
+bool SPSPlot::FitToPeaks(FitResult& result) {
+	if(!IsValid()) { return false; }
+	std::vector<PeakMatch> matches = AssignPeaks();
+	std::vector<FitPoint> points;
+	for(auto& match : matches) {
+		if(match.rxnIndex == -1) continue;
+		FitPoint point;
+		point.rxnIndex = match.rxnIndex;
+		point.ex = match.ex;
+		point.exSigma = m_lines.GetExSigma()[m_lines.GetBegin(match.rxnIndex) + match.level];
+		point.position = match.position;
+		point.positionSigma = m_peakSigma/std::fabs(m_calSlope)/std::sqrt(std::max(match.area, 1.0));
+		points.push_back(point);
+	}
+	if(points.empty()) {
+		std::cerr<<"No assigned peaks to fit at SPSPlot::FitToPeaks()!"<<std::endl;
+		return false;
+	}
+
+	KinematicFitter fitter;
+	fitter.SetInitial({m_beamKE, m_theta, m_B, m_calOffset, m_calSlope});
+	fitter.SetPriors(m_beamKESigma, m_thetaSigma, m_BSigma);
+	if(!fitter.Fit(m_Reactions, points, result)) return false;
+
+	SetParameters(result.values.beamKE, result.values.theta, result.values.B);
+	SetCalibration(result.values.offset, result.values.slope);
+	return true;
+}
+
+/*Read a run log (see RunLog); the lines followed through it are those of the primary setting at the time of use*/
+bool SPSPlot::LoadRunLog(const std::string& filename) {
+	if(!m_runLog.ReadFile(filename)) {
+		m_runLog.Clear();
+		return false;
+	}
+	return true;
+}
+
+/*rho of every visible line of the primary setting at every run of the log, run-major (see RunLog::Predict)*/
+bool SPSPlot::PredictRuns(std::vector<SPSLine>& lines, std::vector<double>& rhos) {
+	if(!IsValid() || !HasRunLog()) {
+		std::cerr<<"Unable to predict runs without both an input file and a run log at SPSPlot::PredictRuns()!"<<std::endl;
+		return false;
+	}
+	lines = GetLines();
+	std::vector<RunLine> tracked;
+	for(auto& line : lines)
+		tracked.push_back({line.rxnIndex, line.ex});
+	m_runLog.Predict(m_Reactions, tracked, rhos);
+	return true;
+}
+
+/*Time series of the predicted lines: one row per run with its parameters, one column per line (reaction:Ex)*/
+void SPSPlot::ExportRunTable(std::string& name) {
+	std::vector<SPSLine> lines;
+	std::vector<double> rhos;
+	if(!PredictRuns(lines, rhos)) return;
+	std::ofstream output(name);
+	if(!output.is_open()) {
+		std::cerr<<"Unable to create run table file!"<<std::endl;
+		return;
+	}
+
+	output<<"Run\tTimestamp\tBfield(kG)\tBeamKE(MeV)\tTheta(deg)";
+	for(auto& line : lines)
+		output<<"\t"<<m_Reactions[line.rxnIndex].GetName()<<":"<<line.ex;
+	output<<std::endl;
+	size_t nLines = lines.size();
+	for(int i=0; i<m_runLog.GetNRuns(); i++) {
+		const RunRecord& run = m_runLog.GetRun(i);
+		output<<run.run<<"\t"<<(run.timestamp.empty() ? "-" : run.timestamp)<<"\t"<<run.B<<"\t"<<run.beamKE<<"\t"<<run.theta;
+		for(size_t k=0; k<nLines; k++)
+			output<<"\t"<<rhos[i*nLines + k];
+		output<<std::endl;
+	}
+	output.close();
+}
+
+/*
+	Drift of each visible line over the run log, as the shift in rho from its position in the first run, against run number.
+	Colored by reaction, the same as the line plot
+*/
+TMultiGraph* SPSPlot::GetDriftCurves() {
+	std::vector<SPSLine> lines;
+	std::vector<double> rhos;
+	if(!PredictRuns(lines, rhos)) return nullptr;
+
+	delete m_drift;
+	m_drift = new TMultiGraph();
+	m_drift->SetTitle(";Run;#rho - #rho_{first run} (cm)");
+
+	TLegend* legend = new TLegend(0.75, 0.75, 0.95, 0.95);
+	std::vector<bool> inLegend(m_Reactions.size(), false);
+	size_t nLines = lines.size();
+	int nRuns = m_runLog.GetNRuns();
+	for(size_t k=0; k<nLines; k++) {
+		int rxn = lines[k].rxnIndex;
+		TGraph* graph = new TGraph();
+		int n = 0;
+		for(int i=0; i<nRuns; i++) {
+			double shift = rhos[i*nLines + k] - rhos[k];
+			if(std::isnan(shift)) continue;
+			graph->SetPoint(n++, m_runLog.GetRun(i).run, shift);
+		}
+		if(n == 0) {
+			delete graph;
+			continue;
+		}
+		graph->SetName(Form("%s_%g", m_Reactions[rxn].GetName().c_str(), lines[k].ex));
+		graph->SetTitle(Form("%s Ex = %g MeV", m_Reactions[rxn].GetName().c_str(), lines[k].ex));
+		graph->SetLineColor(rxn+1);
+		graph->SetMarkerColor(rxn+1);
+		if(!inLegend[rxn]) {
+			legend->AddEntry(graph, m_Reactions[rxn].GetName().c_str(), "l");
+			inLegend[rxn] = true;
+		}
+		m_drift->Add(graph); //multigraph owns the graphs
+	}
+	m_drift->GetListOfFunctions()->Add(legend); //multigraph owns the legend
+	return m_drift;
+}
+
 void SPSPlot::AddReaction(Reaction rxn) {
-	rxn.SetKinematicParams(m_beamKE, m_theta, m_B);
 	m_Reactions.push_back(rxn);
+	m_weights.push_back(1.0);
+	m_generated.push_back(false);
+	m_lociDirty = m_lociDirty || !rxn.GetDecays().empty();
+	m_lines.Refresh(m_Reactions, std::vector<char>()); //only the new reaction is read and calculated
+	RelayoutSettings(std::vector<char>());
+	UpdateSettings(); //only the new reaction needs kinematics
+	Publish();
+}
+
+/*Attach a decay to one of the reactions; the loci are resampled the next time they are needed*/
+void SPSPlot::AddDecay(int rxnIndex, const DecayChannel& decay) {
+	if(rxnIndex < 0 || rxnIndex >= (int)m_Reactions.size()) {
+		std::cerr<<"Invalid reaction index at SPSPlot::AddDecay()!"<<std::endl;
+		return;
+	}
+	m_Reactions[rxnIndex].AddDecay(decay);
+	m_lociDirty = true;
+}
+
+/*Samples per locus, and the half-angle (deg) of the acceptance cone the decay products have to come out in*/
+void SPSPlot::SetLocusSampling(int nSamples, double acceptance) {
+	m_sampler.SetNSamples(nSamples);
+	m_sampler.SetAcceptance(acceptance);
+	m_lociDirty = true;
+}
+
+const std::vector<DecayLocus>& SPSPlot::GetLoci() {
+	UpdateLoci();
+	return m_loci;
+}
+
+/*
+	Loci only depend on the beam KE and angle (and the nuclear data); the field just rescales them, so following the field or
+	changing it costs nothing here
+*/
+void SPSPlot::UpdateLoci() {
+	if(!m_lociDirty && m_lociBeamKE == m_beamKE && m_lociTheta == m_theta) return;
+	m_loci = m_sampler.Sample(m_Reactions, m_beamKE, m_theta);
+	m_lociBeamKE = m_beamKE;
+	m_lociTheta = m_theta;
+	m_lociDirty = false;
+}
+
+/*
+	Energy left by the ejectile of each of the given lines in every detector layer, as deposits[i*nLayers + layer] (see
+	DetectorModel::Deposit). Lines are grouped by ejectile isotope, so each isotope is a single batch over all of its lines.
+	False if there is no detector
+*/
+bool SPSPlot::GetDeposits(const std::vector<SPSLine>& lines, std::vector<double>& deposits) {
+	int nLayers = m_detector.GetNLayers();
+	deposits.assign(lines.size()*nLayers, std::numeric_limits<double>::quiet_NaN());
+	if(nLayers == 0) return false;
+
+	std::map<std::pair<int, int>, std::vector<int>> species; //(A, Z) of the ejectile -> lines
+	for(unsigned int i=0; i<lines.size(); i++) {
+		const nucleus& ejectile = m_Reactions[lines[i].rxnIndex].GetEjectile();
+		species[std::make_pair(ejectile.A, ejectile.Z)].push_back(i);
+	}
+
+	std::vector<double> ke, rows;
+	for(auto& group : species) {
+		const std::vector<int>& members = group.second;
+		int n = members.size();
+		ke.resize(n);
+		for(int j=0; j<n; j++)
+			ke[j] = GetEjectileKE(lines[members[j]]);
+		rows.resize(n*nLayers);
+		m_detector.Deposit(group.first.first, group.first.second, ke.data(), n, rows.data());
+		for(int j=0; j<n; j++)
+			std::copy(rows.begin()+j*nLayers, rows.begin()+(j+1)*nLayers, deposits.begin()+members[j]*nLayers);
+	}
+	return true;
+}
+
+/*Kinetic energy (MeV) of the ejectile of a line of the primary setting*/
+double SPSPlot::GetEjectileKE(const SPSLine& line) const {
+	const Reaction& rxn = m_Reactions[line.rxnIndex];
+	double p = rxn.CalculateEjectileP(line.ex, m_beamKE, m_theta*M_PI/180.0);
+	double m = rxn.GetEjectile().mass_gs;
+	return std::sqrt(p*p + m*m) - m;
+}
+
+/*
+	Predicted particle ID (dE vs. E) plot. Each ejectile gets its locus over the rho range, as a line, and a marker at every line
+	of the primary setting inside the range. Everything is remade from the current lines, so the plot follows every change of
+	the setting. Ejectiles without stopping tables for every layer are left out
+*/
+TMultiGraph* SPSPlot::GetPIDPlot() {
+	if(!IsValid() || m_detector.IsEmpty()) { return nullptr; }
+	int dELayer, ELayer;
+	if(!m_detector.FindPIDLayers(dELayer, ELayer)) return nullptr;
+
+	//One reaction per ejectile isotope for its mass; only reactions passing the weight cut
+	std::map<std::pair<int, int>, int> species;
+	for(unsigned int i=0; i<m_Reactions.size(); i++) {
+		const nucleus& ejectile = m_Reactions[i].GetEjectile();
+		if(m_weights[i] >= m_minWeight && m_detector.CanStop(ejectile.Z)) species.emplace(std::make_pair(ejectile.A, ejectile.Z), i);
+	}
+
+	delete m_pid;
+	m_pid = new TMultiGraph();
+	m_pid->SetTitle(Form(";%s (MeV);%s (MeV)", m_detector.GetLayer(ELayer).name.c_str(), m_detector.GetLayer(dELayer).name.c_str()));
+	std::vector<SPSLine> lines = GetLines();
+	std::vector<double> ke, E, dE;
+	TLegend* legend = new TLegend(0.75, 0.75, 0.95, 0.95);
+	int color = 1;
+	for(auto& entry : species) {
+		int A = entry.first.first, Z = entry.first.second;
+		double m = m_Reactions[entry.second].GetEjectile().mass_gs;
+		ke.resize(PID_LOCUS_POINTS);
+		for(int j=0; j<PID_LOCUS_POINTS; j++) {
+			double rho = m_rhoMin + j*(m_rhoMax - m_rhoMin)/(PID_LOCUS_POINTS - 1);
+			double p = rho*Z*m_B*Reaction::QBRHO2P;
+			ke[j] = std::sqrt(p*p + m*m) - m;
+		}
+		int n = m_detector.GetPIDPoints(A, Z, ke, dELayer, ELayer, E, dE);
+		TGraph* locus = n > 0 ? new TGraph(n, E.data(), dE.data()) : new TGraph();
+
+		ke.clear();
+		for(auto& line : lines) {
+			const nucleus& ejectile = m_Reactions[line.rxnIndex].GetEjectile();
+			if(ejectile.A == A && ejectile.Z == Z) ke.push_back(GetEjectileKE(line));
+		}
+		int nMarkers = m_detector.GetPIDPoints(A, Z, ke, dELayer, ELayer, E, dE);
+		TGraph* markers = nMarkers > 0 ? new TGraph(nMarkers, E.data(), dE.data()) : new TGraph();
+		if(n == 0 && nMarkers == 0) {
+			delete locus;
+			delete markers;
+			continue;
+		}
+
+		std::string symbol = Form("^{%d}%s", A, MASS.FindElement(Z).c_str());
+		locus->SetName(Form("%d%s_locus", A, MASS.FindElement(Z).c_str()));
+		locus->SetTitle(symbol.c_str());
+		locus->SetLineColor(color);
+		markers->SetName(Form("%d%s_lines", A, MASS.FindElement(Z).c_str()));
+		markers->SetTitle(symbol.c_str());
+		markers->SetMarkerColor(color);
+		markers->SetMarkerStyle(20);
+		if(n > 0) {
+			TLatex* label = new TLatex(locus->GetX()[n/2], locus->GetY()[n/2], symbol.c_str());
+			label->SetTextSize(LABEL_SIZE);
+			label->SetTextColor(color);
+			locus->GetListOfFunctions()->Add(label); //graph owns the label
+			m_pid->Add(locus, "L"); //multigraph owns the graphs
+		} else {
+			delete locus;
+		}
+		if(nMarkers > 0) m_pid->Add(markers, "P");
+		else delete markers;
+		legend->AddEntry(nMarkers > 0 ? markers : locus, symbol.c_str(), nMarkers > 0 ? "p" : "l");
+		if(++color == 10) color++; //10 is white
+	}
+	m_pid->GetListOfFunctions()->Add(legend); //multigraph owns the legend
+	return m_pid;
 }
@@ -12,14 +12,24 @@
 #include "SPSPlotMainFrame.h"
 #include <TGLabel.h>
 #include <TApplication.h>
+#include <TLatex.h>
+#include <TTimer.h>
 #include <iostream>
 #include <string>
+#include <cmath>
 #include "FileViewFrame.h"
 #include "ReactionCreationFrame.h"
+#include "OptimizerFrame.h"
+#include "CurveOptionsFrame.h"
+#include "DataWatcher.h"
+#include "FieldFeed.h"
 
 SPSPlotMainFrame::SPSPlotMainFrame(const TGWindow *p, UInt_t w, UInt_t h) :
-	TGMainFrame(p, w, h), paramFlag(false), attachFlag(false)
+	TGMainFrame(p, w, h), paramFlag(false), attachFlag(false), synthFlag(false), curveFlag(false), pidFlag(false)
 {
+	fCurveOptions.thetaMin = 0.0;
+	fCurveOptions.thetaMax = 60.0;
+	fCurveOptions.acceptance = 2.0;
 
 	SetCleanup(kDeepCleanup); //ensures that all child frames are deleted
 	MAIN_H = h; MAIN_W = w; //size all frames relative to the main frame
@@ -39,6 +49,7 @@ SPSPlotMainFrame::SPSPlotMainFrame(const TGWindow *p, UInt_t w, UInt_t h) :
 	fECanvas = new TRootEmbeddedCanvas("ECanvas", CanvasFrame, w, h*0.95);
 	fCanvas = fECanvas->GetCanvas();
 	fCanvas->SetCrosshair();
+	fCanvas->Connect("ProcessedEvent(Int_t,Int_t,Int_t,TObject*)","SPSPlotMainFrame",this,"HandleCanvasEvent(Int_t,Int_t,Int_t,TObject*)");
 	CanvasFrame->AddFrame(clabel, lhints);
 	CanvasFrame->AddFrame(fECanvas, chints);
 
@@ -78,6 +89,13 @@ SPSPlotMainFrame::SPSPlotMainFrame(const TGWindow *p, UInt_t w, UInt_t h) :
 	ThetaFrame->AddFrame(tlabel, lhints);
 	ThetaFrame->AddFrame(fThetaField, fhints);
 
+	TGVerticalFrame *WeightFrame = new TGVerticalFrame(EditFrame, w*0.16, h*0.25);
+	TGLabel *wlabel = new TGLabel(WeightFrame, "Min. Weight");
+	fWeightField = new TGNumberEntryField(WeightFrame, 6, 0, TGNumberEntry::kNESRealFour, TGNumberEntry::kNEANonNegative);
+	fWeightField->Connect("TextChanged(const char*)","SPSPlotMainFrame",this,"HandleParameterChange()");
+	WeightFrame->AddFrame(wlabel, lhints);
+	WeightFrame->AddFrame(fWeightField, fhints);
+
 	/*Plotting is explicity controlled by a button*/
 	fPlotButton = new TGTextButton(EditFrame, "Plot!");
 	fPlotButton->SetState(kButtonDisabled);
@@ -88,6 +106,7 @@ SPSPlotMainFrame::SPSPlotMainFrame(const TGWindow *p, UInt_t w, UInt_t h) :
 	EditFrame->AddFrame(BKEFrame, fhints);
 	EditFrame->AddFrame(ThetaFrame, fhints);
 	EditFrame->AddFrame(BFrame, fhints);
+	EditFrame->AddFrame(WeightFrame, fhints);
 	EditFrame->AddFrame(fPlotButton, fhints);
 
 	/*Menus*/
@@ -95,17 +114,71 @@ SPSPlotMainFrame::SPSPlotMainFrame(const TGWindow *p, UInt_t w, UInt_t h) :
 	fFileMenu = new TGPopupMenu(gClient->GetRoot());
 	fFileMenu->AddEntry("Load Config", M_LOAD_CONFIG);
 	fFileMenu->AddEntry("Save Config", M_SAVE_CONFIG);
+	fFileMenu->AddEntry("Import ENSDF Levels", M_IMPORT_ENSDF);
+	fFileMenu->AddEntry("Export Lines", M_EXPORT_LINES);
+	fFileMenu->AddEntry("Load Run Log", M_LOAD_RUNLOG);
+	fFileMenu->AddEntry("Export Run Table", M_EXPORT_RUNS);
 	fFileMenu->Connect("Activated(Int_t)","SPSPlotMainFrame",this,"HandleMenuSelection(Int_t)");
 	fMenuBar->AddPopup("File", fFileMenu, mhints);
 	fRxnMenu = new TGPopupMenu(gClient->GetRoot());
 	fRxnMenu->AddEntry("Add Reaction", M_ADD_REACTION);
 	fRxnMenu->Connect("Activated(Int_t)","SPSPlotMainFrame",this,"HandleMenuSelection(Int_t)");
 	fMenuBar->AddPopup("Reaction", fRxnMenu, mhints);
+	fSettingMenu = new TGPopupMenu(gClient->GetRoot());
+	fSettingMenu->AddEntry("Add Current as Comparison", M_ADD_SETTING);
+	fSettingMenu->AddEntry("Clear Comparisons", M_CLEAR_SETTINGS);
+	fSettingMenu->AddEntry("Optimize Field", M_OPTIMIZE);
+	fSettingMenu->AddSeparator();
+	fSettingMenu->AddEntry("Follow NMR Field", M_FOLLOW_FIELD);
+	fSettingMenu->AddEntry("Stop Following Field", M_STOP_FIELD);
+	fSettingMenu->Connect("Activated(Int_t)","SPSPlotMainFrame",this,"HandleMenuSelection(Int_t)");
+	fMenuBar->AddPopup("Settings", fSettingMenu, mhints);
+	fSpectrumMenu = new TGPopupMenu(gClient->GetRoot());
+	fSpectrumMenu->AddEntry("Load Spectrum", M_LOAD_SPECTRUM);
+	fSpectrumMenu->AddEntry("Assign Peaks", M_ASSIGN_PEAKS);
+	fSpectrumMenu->AddEntry("Fit Parameters", M_FIT_PEAKS);
+	fSpectrumMenu->AddEntry("Clear Spectrum", M_CLEAR_SPECTRUM);
+	fSpectrumMenu->Connect("Activated(Int_t)","SPSPlotMainFrame",this,"HandleMenuSelection(Int_t)");
+	fMenuBar->AddPopup("Spectrum", fSpectrumMenu, mhints);
+	fViewMenu = new TGPopupMenu(gClient->GetRoot());
+	fViewMenu->AddEntry("Line Plot", M_LINES);
+	fViewMenu->AddEntry("Kinematic Curves", M_CURVES);
+	fViewMenu->AddEntry("Particle ID", M_PID);
+	fViewMenu->AddSeparator();
+	fViewMenu->AddEntry("Synthetic Spectrum", M_SYNTHETIC);
+	fViewMenu->CheckEntry(M_LINES);
+	fViewMenu->Connect("Activated(Int_t)","SPSPlotMainFrame",this,"HandleMenuSelection(Int_t)");
+	fMenuBar->AddPopup("View", fViewMenu, mhints);
+
+	fDataMenu = new TGPopupMenu(gClient->GetRoot());
+	fDataMenu->AddEntry("Compare With Default Data", M_COMPARE_DATA);
+	fDataMenu->AddSeparator();
+	fDataMenu->Connect("Activated(Int_t)","SPSPlotMainFrame",this,"HandleMenuSelection(Int_t)");
+	fMenuBar->AddPopup("Data", fDataMenu, mhints);
+	RebuildDataMenu();
 
 	AddFrame(fMenuBar);
 	AddFrame(CanvasFrame, chints);
 	AddFrame(EditFrame, ehints);
 
+	/*Nuclear data files are re-read in the background as they change; updates are applied from the gui thread*/
+	fWatcher = new DataWatcher();
+	fWatchTimer = nullptr;
+	if(fWatcher->Start("data")) {
+		fWatchTimer = new TTimer(250);
+		fWatchTimer->Connect("Timeout()","SPSPlotMainFrame",this,"CheckDataFiles()");
+		fWatchTimer->TurnOn();
+	}
+
+	/*Field readings arrive on their own thread; the timer applies only the latest, so redraws never queue up behind readings*/
+	fFieldFeed = new FieldFeed();
+	fFieldTimer = new TTimer(FRAME_MS);
+	fFieldTimer->Connect("Timeout()","SPSPlotMainFrame",this,"CheckField()");
+
+	/*A zoom can't be redrawn from inside the canvas's own event; it is done on the next pass of the event loop*/
+	fZoomTimer = new TTimer(0);
+	fZoomTimer->Connect("Timeout()","SPSPlotMainFrame",this,"RedrawZoom()");
+
 	SetWindowName("SPSPlot");
 	MapSubwindows();
 	Resize();
@@ -114,6 +187,11 @@ SPSPlotMainFrame::SPSPlotMainFrame(const TGWindow *p, UInt_t w, UInt_t h) :
 }
 
 SPSPlotMainFrame::~SPSPlotMainFrame() {
+	delete fWatchTimer;
+	delete fWatcher;
+	delete fFieldTimer;
+	delete fZoomTimer;
+	delete fFieldFeed;
 	Cleanup(); //delete children
 	delete this; //get rid of window
 }
@@ -140,9 +218,88 @@ void SPSPlotMainFrame::HandleMenuSelection(int id) {
 		case M_LOAD_CONFIG:
 			new FileViewFrame(gClient->GetRoot(), this, MAIN_W*0.5, MAIN_H*0.5, this, id);
 			break;
+		case M_IMPORT_ENSDF:
+			new FileViewFrame(gClient->GetRoot(), this, MAIN_W*0.5, MAIN_H*0.5, this, id);
+			break;
+		case M_EXPORT_LINES:
+			new FileViewFrame(gClient->GetRoot(), this, MAIN_W*0.5, MAIN_H*0.5, this, id);
+			break;
+		case M_LOAD_RUNLOG:
+			new FileViewFrame(gClient->GetRoot(), this, MAIN_W*0.5, MAIN_H*0.5, this, id);
+			break;
+		case M_EXPORT_RUNS:
+			new FileViewFrame(gClient->GetRoot(), this, MAIN_W*0.5, MAIN_H*0.5, this, id);
+			break;
+		case M_LOAD_SPECTRUM:
+			new FileViewFrame(gClient->GetRoot(), this, MAIN_W*0.5, MAIN_H*0.5, this, id);
+			break;
+		case M_ASSIGN_PEAKS:
+			PrintAssignments();
+			break;
+		case M_FIT_PEAKS:
+			FitPeaks();
+			break;
+		case M_CLEAR_SPECTRUM:
+			fPlotter.ClearSpectrum();
+			if(attachFlag) PlotGraphs();
+			break;
 		case M_ADD_REACTION:
 			new ReactionCreationFrame(gClient->GetRoot(), this, MAIN_W*0.5, MAIN_H*0.75, this);
 			break;
+		case M_ADD_SETTING:
+		{
+			if(!attachFlag) {
+				std::cerr<<"Unable to add a comparison setting without an input file!"<<std::endl;
+				break;
+			}
+			std::string name = "Setting" + std::to_string(fPlotter.GetNSettings()+1);
+			fPlotter.AddSetting(name, fBKEField->GetNumber(), fThetaField->GetNumber(), fBField->GetNumber());
+			PlotGraphs();
+			break;
+		}
+		case M_CLEAR_SETTINGS:
+			fPlotter.ClearSettings();
+			if(attachFlag) PlotGraphs();
+			break;
+		case M_OPTIMIZE:
+			new OptimizerFrame(gClient->GetRoot(), this, MAIN_W*0.75, MAIN_H*0.5, this);
+			break;
+		case M_FOLLOW_FIELD:
+			new FileViewFrame(gClient->GetRoot(), this, MAIN_W*0.5, MAIN_H*0.5, this, id);
+			break;
+		case M_STOP_FIELD:
+			StopField();
+			break;
+		case M_CURVES:
+			new CurveOptionsFrame(gClient->GetRoot(), this, MAIN_W*0.5, MAIN_H*0.5, this, fCurveOptions);
+			break;
+		case M_LINES:
+			curveFlag = false;
+			pidFlag = false;
+			fViewMenu->CheckEntry(M_LINES);
+			fViewMenu->UnCheckEntry(M_CURVES);
+			fViewMenu->UnCheckEntry(M_PID);
+			if(attachFlag) PlotGraphs();
+			break;
+		case M_PID:
+			pidFlag = true;
+			fViewMenu->CheckEntry(M_PID);
+			fViewMenu->UnCheckEntry(M_LINES);
+			fViewMenu->UnCheckEntry(M_CURVES);
+			if(attachFlag) PlotGraphs();
+			break;
+		case M_SYNTHETIC:
+			synthFlag = !synthFlag;
+			if(synthFlag) fViewMenu->CheckEntry(M_SYNTHETIC);
+			else fViewMenu->UnCheckEntry(M_SYNTHETIC);
+			if(attachFlag && !curveFlag && !pidFlag) DrawLinePlot();
+			break;
+		case M_COMPARE_DATA:
+			PrintDataComparison();
+			break;
+		default:
+			if(id >= M_DATA_ITEMS) SelectDataItem(id - M_DATA_ITEMS);
+			break;
 	}
 
 }
@@ -167,14 +324,107 @@ void SPSPlotMainFrame::DoPlot() {
 	paramFlag = false; //now params are same as plot params
 }
 
-/*Actual plotting function; slightly complicated to handle axis generation*/
+/*Actual plotting function; the primary setting and each comparison setting get their own pad, stacked vertically
+  with a shared rho axis. Resets any zoom to the full rho range
+*/
 void SPSPlotMainFrame::PlotGraphs() {
+	if(pidFlag) {
+		PlotPID();
+		return;
+	} else if(curveFlag) {
+		PlotCurves();
+		return;
+	}
+
+	fLinkedMin = fPlotter.GetRhoMin();
+	fLinkedMax = fPlotter.GetRhoMax();
+	fPlotter.SetViewRange(fLinkedMin, fLinkedMax);
+	DrawLinePlot();
+}
+
+/*Draw the line plot over the current (linked) rho range. Graphs are remade each time, so that the labels are laid out
+  for what is actually visible on each pad
+*/
+void SPSPlotMainFrame::DrawLinePlot() {
+	fCanvas->Clear();
+	fAxisGraphs.clear();
+	int nSettings = fPlotter.GetNSettings();
+	bool spectrumPad = fPlotter.HasSpectrum() || synthFlag;
+	int nPads = nSettings + 1 + (spectrumPad ? 1 : 0);
+	if(nPads > 1) fCanvas->Divide(1, nPads);
+	bool zoomed = fLinkedMin != fPlotter.GetRhoMin() || fLinkedMax != fPlotter.GetRhoMax();
+
+	fCanvas->cd(nPads > 1 ? 1 : 0);
+	TGraph* axisGraph = DrawGraphs(fPlotter.GetGraphs(), fPlotter.GetNGraphs(), nSettings > 0 ? "Current" : "");
+	if(axisGraph != nullptr) {
+		if(zoomed) axisGraph->GetXaxis()->SetRangeUser(fLinkedMin, fLinkedMax);
+		gPad->BuildLegend(); //If someone is drawn build a legend
+	}
+	fAxisGraphs.push_back(axisGraph);
+	for(int i=0; i<nSettings; i++) {
+		fCanvas->cd(i+2);
+		axisGraph = DrawGraphs(fPlotter.GetGraphs(i), fPlotter.GetNGraphs(), fPlotter.GetSetting(i).name);
+		if(axisGraph != nullptr && zoomed) axisGraph->GetXaxis()->SetRangeUser(fLinkedMin, fLinkedMax);
+		fAxisGraphs.push_back(axisGraph);
+	}
+	if(spectrumPad) { //measured and/or synthetic spectrum on the bottom pad, over the same rho range
+		fCanvas->cd(nPads);
+		TH1* spectrum = fPlotter.HasSpectrum() ? fPlotter.GetSpectrum() : nullptr;
+		if(spectrum != nullptr) {
+			spectrum->GetXaxis()->SetRangeUser(fLinkedMin, fLinkedMax);
+			spectrum->Draw("HIST");
+		}
+		TH1* synthetic = synthFlag ? fPlotter.GetSyntheticSpectrum() : nullptr;
+		if(synthetic != nullptr) {
+			synthetic->GetXaxis()->SetRangeUser(fLinkedMin, fLinkedMax);
+			synthetic->Draw(spectrum != nullptr ? "HIST SAME" : "HIST");
+		}
+	}
+
 	fCanvas->cd();
-	auto graphs = fPlotter.GetGraphs();
-	int ngraphs = fPlotter.GetNGraphs();
+	fCanvas->Modified();
+	fCanvas->Update();
+}
+
+/*Kinematic curve mode; rho vs. theta for every visible state, with the acceptance band around the current angle*/
+void SPSPlotMainFrame::PlotCurves() {
+	fCanvas->Clear();
+	fAxisGraphs.clear();
+	fCanvas->cd();
+
+	TMultiGraph* curves = fPlotter.GetCurves(fCurveOptions);
+	if(curves == nullptr || curves->GetListOfGraphs() == nullptr) { //empty canvas lets the user know
+		fCanvas->Modified();
+		fCanvas->Update();
+		return;
+	}
+
+	curves->Draw("AL");
+	curves->GetXaxis()->SetLimits(fPlotter.GetRhoMin(), fPlotter.GetRhoMax());
+	curves->SetMinimum(fCurveOptions.thetaMin);
+	curves->SetMaximum(fCurveOptions.thetaMax);
+	fCanvas->Modified();
+	fCanvas->Update();
+}
+
+/*New curve options from the CurveOptionsFrame; switches to curve mode*/
+void SPSPlotMainFrame::SetCurveOptions(CurveOptions* options) {
+	fCurveOptions = *options;
+	curveFlag = true;
+	pidFlag = false;
+	fViewMenu->CheckEntry(M_CURVES);
+	fViewMenu->UnCheckEntry(M_LINES);
+	fViewMenu->UnCheckEntry(M_PID);
+	if(attachFlag) PlotGraphs();
+}
+
+/*Draw one set of graphs to the current pad; slightly complicated to handle axis generation. Returns the graph which owns the axes
+  (nullptr if nothing was drawn)
+*/
+TGraph* SPSPlotMainFrame::DrawGraphs(TGraph** graphs, int ngraphs, const std::string& title) {
 	if(graphs == nullptr){
 		std::cerr<<"Faliure to generate graphs! Make sure input file is formated correctly!"<<std::endl;
-		return;
+		return nullptr;
 	}
 
 	int firstValidIndex = 0; //keeps track of who should be making the axes
@@ -197,14 +447,42 @@ void SPSPlotMainFrame::PlotGraphs() {
 			nDrawn++;
 		}
 	}
-	if(nDrawn > 0) fCanvas->BuildLegend(); //If someone is drawn build a legend; if no one clear the canvas to let the user know
-	else fCanvas->Clear();
-	fCanvas->Modified();
-	fCanvas->Update();
+	if(nDrawn == 0) return nullptr; //empty pad lets the user know
+
+	if(!title.empty()) { //name the pad; the graph owns the label
+		TLatex* label = new TLatex(0.12, 0.92, title.c_str());
+		label->SetNDC();
+		label->SetTextSize(0.05);
+		graphs[firstValidIndex]->GetListOfFunctions()->Add(label);
+	}
+	return graphs[firstValidIndex];
 }
 
-/*Feed params to the SPSPlot instance*/
+/*Keep the rho axes of the stacked pads linked; whichever pad was zoomed sets the range of all of the others. The plot is redrawn
+  so that the labels are laid out again for the new range (more of them fit as the zoom increases)
+*/
+void SPSPlotMainFrame::HandleCanvasEvent(Int_t event, Int_t px, Int_t py, TObject* obj) {
+	if(event != kButton1Up || fAxisGraphs.empty() || gPad == nullptr) return;
+
+	double xmin = gPad->GetUxmin();
+	double xmax = gPad->GetUxmax();
+	if(xmin == fLinkedMin && xmax == fLinkedMax) return;
+
+	fLinkedMin = xmin;
+	fLinkedMax = xmax;
+	fPlotter.SetViewRange(xmin, xmax);
+	fZoomTimer->Start(0, kTRUE); //single shot; clearing the canvas here would delete the object it is handling
+}
+
+/*Line plot over the zoomed range, from the timer started by HandleCanvasEvent*/
+void SPSPlotMainFrame::RedrawZoom() {
+	if(!attachFlag || curveFlag || pidFlag || fAxisGraphs.empty()) return;
+	DrawLinePlot();
+}
+
+/*Feed params to the SPSPlot instance; the weight cut is always read straight from its field*/
 void SPSPlotMainFrame::UpdateKineSettings(double rmin, double rmax, double bke, double theta, double b) {
+	fPlotter.SetMinimumWeight(fWeightField->GetNumber());
 	fPlotter.SetRhoRange(rmin, rmax);
 	fPlotter.SetParameters(bke, theta, b);
 }
@@ -222,6 +500,241 @@ void SPSPlotMainFrame::LoadConfig(const char* name) {
 	fBKEField->SetNumber(fPlotter.GetBeamKE());
 	fThetaField->SetNumber(fPlotter.GetTheta());
 	fBField->SetNumber(fPlotter.GetB());
+	fWeightField->SetNumber(fPlotter.GetMinimumWeight());
+	RebuildDataMenu();
+}
+
+/*One radio entry per mass evaluation and one check entry per data layer of the loaded config*/
+void SPSPlotMainFrame::RebuildDataMenu() {
+	for(unsigned int i=0; i<fEvaluations.size()+fLayers.size(); i++)
+		fDataMenu->DeleteEntry(M_DATA_ITEMS+i);
+	fEvaluations = fPlotter.GetMassEvaluations();
+	fLayers = fPlotter.GetDataLayers();
+
+	int nEvaluations = fEvaluations.size();
+	for(int i=0; i<nEvaluations; i++) {
+		fDataMenu->AddEntry(("Masses: "+fEvaluations[i]).c_str(), M_DATA_ITEMS+i);
+		if(fEvaluations[i] == MASS.GetEvaluation())
+			fDataMenu->RCheckEntry(M_DATA_ITEMS+i, M_DATA_ITEMS, M_DATA_ITEMS+nEvaluations-1);
+	}
+	for(unsigned int i=0; i<fLayers.size(); i++) {
+		int id = M_DATA_ITEMS+nEvaluations+i;
+		fDataMenu->AddEntry(("Layer: "+fLayers[i]).c_str(), id);
+		if(MASS.IsLayerEnabled(fLayers[i]) || EX.IsLayerEnabled(fLayers[i])) fDataMenu->CheckEntry(id);
+	}
+}
+
+/*Switch to a mass evaluation, or toggle a data layer; only the reactions touched are recalculated*/
+void SPSPlotMainFrame::SelectDataItem(int item) {
+	int nEvaluations = fEvaluations.size();
+	int id = M_DATA_ITEMS+item;
+	int nChanged;
+	if(item < nEvaluations) {
+		nChanged = fPlotter.SelectMassEvaluation(fEvaluations[item]);
+		fDataMenu->RCheckEntry(id, M_DATA_ITEMS, M_DATA_ITEMS+nEvaluations-1);
+	} else if(item < nEvaluations+(int)fLayers.size()) {
+		bool enabled = !fDataMenu->IsEntryChecked(id);
+		nChanged = fPlotter.SetDataLayer(fLayers[item-nEvaluations], enabled);
+		if(enabled) fDataMenu->CheckEntry(id);
+		else fDataMenu->UnCheckEntry(id);
+	} else {
+		return;
+	}
+	std::cout<<nChanged<<" reactions updated"<<std::endl;
+	if(!attachFlag || nChanged == 0) return;
+	if(pidFlag) PlotPID();
+	else if(curveFlag) PlotCurves();
+	else DrawLinePlot(); //keeps the current zoom
+}
+
+/*Table of how far each visible line moves between the default masses and levels, and the current choice of data*/
+void SPSPlotMainFrame::PrintDataComparison() {
+	if(!attachFlag) {
+		std::cerr<<"Unable to compare data without an input file!"<<std::endl;
+		return;
+	}
+
+	UpdateKineSettings(fRMinField->GetNumber(), fRMaxField->GetNumber(), fBKEField->GetNumber(), fThetaField->GetNumber(), fBField->GetNumber());
+	std::vector<LineShift> shifts = fPlotter.CompareData("default", std::vector<std::string>());
+	std::cout<<"Reaction\tState\tEx(MeV)\tRho(cm)\tDefaultEx(MeV)\tDefaultRho(cm)\tShift(cm)"<<std::endl;
+	for(auto& shift : shifts) {
+		std::cout<<fPlotter.GetReaction(shift.rxnIndex).GetName()<<"\t"<<shift.label<<"\t"<<shift.ex<<"\t"<<shift.rho<<"\t";
+		if(std::isnan(shift.otherRho))
+			std::cout<<"-\t-\t-"<<std::endl;
+		else
+			std::cout<<shift.otherEx<<"\t"<<shift.otherRho<<"\t"<<shift.rho - shift.otherRho<<std::endl;
+	}
+}
+
+/*Load a full ENSDF level scheme into the level table; any loaded reactions pick up the new levels*/
+void SPSPlotMainFrame::ImportLevels(const char* name) {
+	std::string sname = name;
+	if(!EX.ImportENSDF(sname)) return;
+	fPlotter.RefreshLevels();
+	if(attachFlag) PlotGraphs();
+}
+
+/*Write the visible lines, with their rho uncertainties, as a table*/
+void SPSPlotMainFrame::ExportLines(const char* name) {
+	if(!attachFlag) {
+		std::cerr<<"Unable to export lines without an input file!"<<std::endl;
+		return;
+	}
+	std::string sname = name;
+	fPlotter.ExportLines(sname);
+}
+
+/*Load a measured spectrum (the peaks are found on loading), and assign the peaks to the current lines*/
+void SPSPlotMainFrame::LoadSpectrum(const char* name) {
+	std::string sname = name;
+	if(!fPlotter.LoadSpectrum(sname)) return;
+	std::cout<<"Found "<<fPlotter.GetPeaks().size()<<" peaks in "<<sname<<std::endl;
+	if(attachFlag) {
+		PrintAssignments();
+		PlotGraphs();
+	}
+}
+
+/*Load a run log and show how the current lines drift over it*/
+void SPSPlotMainFrame::LoadRunLog(const char* name) {
+	std::string sname = name;
+	if(!fPlotter.LoadRunLog(sname)) return;
+	std::cout<<"Read "<<fPlotter.GetRunLog().GetNRuns()<<" runs from "<<sname<<std::endl;
+	if(attachFlag) PlotDrift();
+}
+
+/*Write the predicted rho of each current line at every run of the log*/
+void SPSPlotMainFrame::ExportRunTable(const char* name) {
+	if(!attachFlag || !fPlotter.HasRunLog()) {
+		std::cerr<<"Unable to export a run table without both an input file and a run log!"<<std::endl;
+		return;
+	}
+	UpdateKineSettings(fRMinField->GetNumber(), fRMaxField->GetNumber(), fBKEField->GetNumber(), fThetaField->GetNumber(), fBField->GetNumber());
+	std::string sname = name;
+	fPlotter.ExportRunTable(sname);
+}
+
+/*Shift of each current line over the runs of the log; replaces the plot until the next redraw*/
+void SPSPlotMainFrame::PlotDrift() {
+	UpdateKineSettings(fRMinField->GetNumber(), fRMaxField->GetNumber(), fBKEField->GetNumber(), fThetaField->GetNumber(), fBField->GetNumber());
+	fCanvas->Clear();
+	fAxisGraphs.clear();
+	fCanvas->cd();
+
+	TMultiGraph* drift = fPlotter.GetDriftCurves();
+	if(drift != nullptr && drift->GetListOfGraphs() != nullptr)
+		drift->Draw("AL");
+	fCanvas->Modified();
+	fCanvas->Update();
+}
+
+/*
+	Predicted dE vs. E of the ejectiles in the focal plane detector, from the current lines. Remade on every redraw, so it
+	follows each change of the parameters
+*/
+void SPSPlotMainFrame::PlotPID() {
+	fCanvas->Clear();
+	fAxisGraphs.clear();
+	fCanvas->cd();
+
+	TMultiGraph* pid = fPlotter.GetPIDPlot();
+	if(pid != nullptr && pid->GetListOfGraphs() != nullptr)
+		pid->Draw("A");
+	fCanvas->Modified();
+	fCanvas->Update();
+}
+
+/*Table of each found peak and the line it is assigned to, for the current setting*/
+void SPSPlotMainFrame::PrintAssignments() {
+	if(!attachFlag || !fPlotter.HasSpectrum()) {
+		std::cerr<<"Unable to assign peaks without both an input file and a spectrum!"<<std::endl;
+		return;
+	}
+
+	//Make sure the lines match what is in the entry fields
+	UpdateKineSettings(fRMinField->GetNumber(), fRMaxField->GetNumber(), fBKEField->GetNumber(), fThetaField->GetNumber(), fBField->GetNumber());
+	std::vector<PeakMatch> matches = fPlotter.AssignPeaks();
+	std::cout<<"Peak\tPosition\tRho(cm)\tArea\tReaction\tEx(MeV)\tResidual(cm)"<<std::endl;
+	for(auto& match : matches) {
+		std::cout<<match.peak<<"\t"<<match.position<<"\t"<<match.rho<<"\t"<<match.area<<"\t";
+		if(match.rxnIndex == -1)
+			std::cout<<"-\t-\t-"<<std::endl;
+		else
+			std::cout<<fPlotter.GetReaction(match.rxnIndex).GetName()<<"\t"<<match.ex<<"\t"<<match.residual<<std::endl;
+	}
+}
+
+/*Fit beam KE, angle, field, and the spectrum calibration to the assigned peaks; the result replaces the current setting*/
+void SPSPlotMainFrame::FitPeaks() {
+	if(!attachFlag || !fPlotter.HasSpectrum()) {
+		std::cerr<<"Unable to fit without both an input file and a spectrum!"<<std::endl;
+		return;
+	}
+
+	UpdateKineSettings(fRMinField->GetNumber(), fRMaxField->GetNumber(), fBKEField->GetNumber(), fThetaField->GetNumber(), fBField->GetNumber());
+	FitResult result;
+	if(!fPlotter.FitToPeaks(result)) return;
+
+	std::cout<<"Fit "<<(result.converged ? "converged" : "did not converge")<<" after "<<result.iterations<<" iterations, chi2/ndf = "
+			 <<result.chi2<<"/"<<result.ndf<<std::endl;
+	std::cout<<"BeamKE(MeV): "<<result.values.beamKE<<" +/- "<<result.errors.beamKE<<std::endl;
+	std::cout<<"Theta(deg): "<<result.values.theta<<" +/- "<<result.errors.theta<<std::endl;
+	std::cout<<"Bfield(kG): "<<result.values.B<<" +/- "<<result.errors.B<<std::endl;
+	std::cout<<"Calibration offset(cm): "<<result.values.offset<<" +/- "<<result.errors.offset<<std::endl;
+	std::cout<<"Calibration slope(cm): "<<result.values.slope<<" +/- "<<result.errors.slope<<std::endl;
+
+	fBKEField->SetNumber(fPlotter.GetBeamKE());
+	fThetaField->SetNumber(fPlotter.GetTheta());
+	fBField->SetNumber(fPlotter.GetB());
+	PrintAssignments();
+	PlotGraphs();
+}
+
+/*Apply any nuclear data changes the watcher has finished reading, and redraw if a shown reaction changed*/
+void SPSPlotMainFrame::CheckDataFiles() {
+	DataUpdate update;
+	if(!fWatcher->TakeUpdate(update)) return;
+	int nChanged = fPlotter.ApplyDataUpdate(update);
+	std::cout<<"Reloaded "<<update.levels.size()<<" level schemes and "<<update.masses.size()<<" masses; "<<nChanged<<" reactions updated"<<std::endl;
+	if(!attachFlag || nChanged == 0) return;
+	if(pidFlag) PlotPID();
+	else if(curveFlag) PlotCurves();
+	else DrawLinePlot(); //keeps the current zoom
+}
+
+/*Follow the field from an NMR readout (a file being appended to, or a UNIX socket); the line plot tracks every reading*/
+void SPSPlotMainFrame::FollowField(const char* name) {
+	std::string sname = name;
+	fFieldTimer->TurnOff();
+	if(!fFieldFeed->Start(sname)) {
+		fPlotter.SetFieldTracking(false);
+		return;
+	}
+	fPlotter.SetFieldTracking(true);
+	fFieldTimer->TurnOn();
+	std::cout<<"Following the field from "<<sname<<std::endl;
+}
+
+void SPSPlotMainFrame::StopField() {
+	if(!fFieldFeed->IsRunning()) return;
+	fFieldTimer->TurnOff();
+	fFieldFeed->Stop();
+	fPlotter.SetFieldTracking(false);
+	std::cout<<"Stopped following the field after "<<fFieldFeed->GetNReadings()<<" readings"<<std::endl;
+}
+
+/*
+	Apply the latest field reading, if there is a new one. Lines are rescaled rather than recalculated (see SPSPlot::TrackField),
+	so this keeps up with the readout; readings in between frames are simply superseded. Kinematic curves are not followed
+*/
+void SPSPlotMainFrame::CheckField() {
+	double b;
+	if(!fFieldFeed->TakeField(b)) return;
+	fBField->SetNumber(b);
+	if(!attachFlag) return;
+	fPlotter.TrackField(b);
+	if(pidFlag) PlotPID();
+	else if(!curveFlag) DrawLinePlot(); //keeps the current zoom
 }
 
 /*Writting out*/
@@ -233,4 +746,29 @@ void SPSPlotMainFrame::WriteConfig(const char* name) {
 void SPSPlotMainFrame::AddReaction(Reaction* rxn) {
 	fPlotter.AddReaction(*rxn);
 	PlotGraphs();
-}
\ No newline at end of file
+}
+
+/*Run the field optimizer at the current beam KE and rho range; the ranked settings are printed and the best is applied*/
+void SPSPlotMainFrame::RunOptimizer(OptimizerRequest* request) {
+	if(!attachFlag) {
+		std::cerr<<"Unable to optimize without an input file!"<<std::endl;
+		return;
+	}
+
+	//Make sure the optimizer sees what is in the entry fields
+	UpdateKineSettings(fRMinField->GetNumber(), fRMaxField->GetNumber(), fBKEField->GetNumber(), fThetaField->GetNumber(), fBField->GetNumber());
+	std::vector<FieldSolution> solutions = fPlotter.OptimizeSettings(*request, 10);
+	if(solutions.empty()) {
+		std::cerr<<"No field settings place all wanted states on the detector without contamination!"<<std::endl;
+		return;
+	}
+
+	std::cout<<"Rank\tTheta(deg)\tBfield(kG)\tScore(cm)"<<std::endl;
+	for(unsigned int i=0; i<solutions.size(); i++)
+		std::cout<<i+1<<"\t"<<solutions[i].theta<<"\t"<<solutions[i].B<<"\t"<<solutions[i].score<<std::endl;
+
+	fThetaField->SetNumber(solutions[0].theta);
+	fBField->SetNumber(solutions[0].B);
+	paramFlag = true;
+	DoPlot();
+}
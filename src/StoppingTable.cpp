@@ -0,0 +1,130 @@
+/*
+
+StoppingTable.cpp
+Stopping power of one ion in one material, read from a locally stored table (i.e. converted from SRIM or LISE++), and turned
+into range and energy lookups for slowing ions down through detector layers. The tabulated points are splined (cubic, in log E
+vs. log S) once on loading, and the spline is integrated into a range table on a fine uniform grid in log E; slowing an ion
+through a layer is then two table lookups, E -> range and (range - thickness) -> E, with no integration per ion.
+
+Below the table the stopping power is taken to go as the velocity (sqrt(E)); above it nothing is assumed, and the lookups
+give NaN. Energies are the total kinetic energy of the tabulated ion in MeV, thicknesses are areal densities in mg/cm^2.
+*/
+#include "StoppingTable.h"
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+StoppingTable::StoppingTable() :
+	m_logE0(0.0), m_dLogE(0.0)
+{
+}
+
+StoppingTable::~StoppingTable() {}
+
+/*
+	Two columns, energy (MeV) and stopping power (MeV/(mg/cm^2)), in any order of energy; lines starting with # are comments.
+	Needs at least three points
+*/
+bool StoppingTable::Load(const std::string& filename) {
+	m_energy.clear();
+	m_logE.clear();
+	m_logS.clear();
+	m_d2.clear();
+	m_range.clear();
+
+	std::ifstream input(filename);
+	if(!input.is_open()) {
+		std::cerr<<"Unable to open stopping table "<<filename<<" at StoppingTable::Load()!"<<std::endl;
+		return false;
+	}
+	std::vector<std::pair<double, double>> points;
+	std::string line;
+	while(std::getline(input, line)) {
+		if(line.empty() || line[0] == '#') continue;
+		std::istringstream row(line);
+		double e, s;
+		if(!(row>>e>>s) || !(e > 0.0) || !(s > 0.0)) {
+			std::cerr<<"Invalid line \""<<line<<"\" in stopping table "<<filename<<" at StoppingTable::Load()! Skipping."<<std::endl;
+			continue;
+		}
+		points.emplace_back(e, s);
+	}
+	std::sort(points.begin(), points.end());
+	points.erase(std::unique(points.begin(), points.end(),
+							 [](const std::pair<double, double>& a, const std::pair<double, double>& b) { return a.first == b.first; }),
+				 points.end());
+	if(points.size() < 3) {
+		std::cerr<<"Stopping table "<<filename<<" needs at least three points at StoppingTable::Load()!"<<std::endl;
+		return false;
+	}
+
+	int n = points.size();
+	for(auto& point : points) {
+		m_energy.push_back(point.first);
+		m_logE.push_back(std::log(point.first));
+		m_logS.push_back(std::log(point.second));
+	}
+
+	//Natural cubic spline; tridiagonal system for the second derivatives
+	m_d2.assign(n, 0.0);
+	std::vector<double> u(n, 0.0);
+	for(int i=1; i<n-1; i++) {
+		double sig = (m_logE[i] - m_logE[i-1])/(m_logE[i+1] - m_logE[i-1]);
+		double p = sig*m_d2[i-1] + 2.0;
+		m_d2[i] = (sig - 1.0)/p;
+		double slope = (m_logS[i+1] - m_logS[i])/(m_logE[i+1] - m_logE[i]) - (m_logS[i] - m_logS[i-1])/(m_logE[i] - m_logE[i-1]);
+		u[i] = (6.0*slope/(m_logE[i+1] - m_logE[i-1]) - sig*u[i-1])/p;
+	}
+	m_d2[n-1] = 0.0;
+	for(int i=n-2; i>=0; i--)
+		m_d2[i] = m_d2[i]*m_d2[i+1] + u[i];
+
+	/*
+		dR/dlogE = E/S(E), integrated by Simpson's rule on the fine grid. Below the table S goes as sqrt(E), which gives
+		R = 2E/S at the first point
+	*/
+	m_logE0 = m_logE.front();
+	m_dLogE = (m_logE.back() - m_logE0)/(RANGE_POINTS - 1);
+	auto integrand = [this](double logE) { return std::exp(logE - Spline(logE)); };
+	m_range.resize(RANGE_POINTS);
+	m_range[0] = 2.0*integrand(m_logE0);
+	for(int i=1; i<RANGE_POINTS; i++) {
+		double a = m_logE0 + (i-1)*m_dLogE;
+		m_range[i] = m_range[i-1] + m_dLogE/6.0*(integrand(a) + 4.0*integrand(a + 0.5*m_dLogE) + integrand(a + m_dLogE));
+	}
+	return true;
+}
+
+/*log S at log E, inside of the table*/
+double StoppingTable::Spline(double logE) const {
+	int hi = std::upper_bound(m_logE.begin(), m_logE.end(), logE) - m_logE.begin();
+	hi = std::min(std::max(hi, 1), (int)m_logE.size()-1);
+	int lo = hi - 1;
+	double h = m_logE[hi] - m_logE[lo];
+	double a = (m_logE[hi] - logE)/h;
+	double b = 1.0 - a;
+	return a*m_logS[lo] + b*m_logS[hi] + ((a*a*a - a)*m_d2[lo] + (b*b*b - b)*m_d2[hi])*h*h/6.0;
+}
+
+double StoppingTable::GetRange(double ke) const {
+	if(!IsValid() || !(ke <= GetEMax())) return std::numeric_limits<double>::quiet_NaN(); //also catches NaN
+	if(ke <= 0.0) return 0.0;
+	if(ke < GetEMin()) return m_range.front()*std::sqrt(ke/GetEMin());
+	double u = (std::log(ke) - m_logE0)/m_dLogE;
+	int i = std::min((int)u, RANGE_POINTS-2);
+	return m_range[i] + (u - i)*(m_range[i+1] - m_range[i]);
+}
+
+double StoppingTable::GetEnergy(double range) const {
+	if(!IsValid() || !(range <= m_range.back())) return std::numeric_limits<double>::quiet_NaN();
+	if(range <= 0.0) return 0.0;
+	if(range < m_range.front()) return GetEMin()*std::pow(range/m_range.front(), 2.0);
+	int hi = std::upper_bound(m_range.begin(), m_range.end(), range) - m_range.begin();
+	hi = std::min(hi, RANGE_POINTS-1);
+	int lo = hi - 1;
+	double u = lo + (range - m_range[lo])/(m_range[hi] - m_range[lo]);
+	return std::exp(m_logE0 + u*m_dLogE);
+}
@@ -0,0 +1,54 @@
+/*
+
+TargetModel.cpp
+Composition of the physical target: every isotope that the beam can react with (the target of interest, its backing, and
+known contaminants), with its abundance and the areal density of the layer it sits in. Expands into the full set of
+reactions for a given beam and ejectile, and gives each isotope a weight proportional to its number of nuclei per unit
+area, relative to the most plentiful one.
+*/
+#include "TargetModel.h"
+#include "ParallelFor.h"
+#include <iostream>
+#include <algorithm>
+
+TargetModel::TargetModel() {}
+
+TargetModel::~TargetModel() {}
+
+void TargetModel::AddComponent(const TargetComponent& component) {
+	if(component.A <= 0 || component.Z <= 0 || component.abundance < 0.0 || component.arealDensity < 0.0) {
+		std::cerr<<"Invalid target component at TargetModel::AddComponent()! Skipping."<<std::endl;
+		return;
+	}
+	m_components.push_back(component);
+}
+
+/*
+	Relative number of nuclei per unit area of each component, abundance*density/A (mass number standing in for the atomic
+	mass), normalized so that the largest is 1
+*/
+std::vector<double> TargetModel::GetWeights() const {
+	std::vector<double> weights;
+	double largest = 0.0;
+	for(auto& component : m_components) {
+		weights.push_back(component.abundance*component.arealDensity/component.A);
+		largest = std::max(largest, weights.back());
+	}
+	if(largest > 0.0) {
+		for(auto& weight : weights)
+			weight /= largest;
+	}
+	return weights;
+}
+
+/*
+	One reaction per component for the given beam and ejectile, in component order. Setting up a reaction is the mass and level
+	lookups, which only read the shared tables, so the components are done concurrently
+*/
+std::vector<Reaction> TargetModel::Expand(int Ap, int Zp, int Ae, int Ze) const {
+	std::vector<Reaction> reactions(m_components.size());
+	ParallelFor(m_components.size(), [this, &reactions, Ap, Zp, Ae, Ze](int i) {
+		reactions[i].SetReactionData(m_components[i].A, m_components[i].Z, Ap, Zp, Ae, Ze);
+	});
+	return reactions;
+}